@@ -0,0 +1,147 @@
+#ifndef PREQUEL_CONTAINER_BLOOM_FILTER_HPP
+#define PREQUEL_CONTAINER_BLOOM_FILTER_HPP
+
+#include <prequel/anchor_handle.hpp>
+#include <prequel/binary_format.hpp>
+#include <prequel/block_index.hpp>
+#include <prequel/container/allocator.hpp>
+#include <prequel/defs.hpp>
+
+#include <memory>
+
+namespace prequel {
+
+namespace detail {
+
+class bloom_filter_impl;
+
+struct bloom_filter_anchor {
+    /// Number of hashes inserted since the filter was (re-) initialized.
+    u64 size = 0;
+
+    /// The number of hashes the filter was dimensioned for.
+    u64 capacity = 0;
+
+    /// Number of blocks that contain filter bits.
+    u64 blocks = 0;
+
+    /// Number of directory blocks (in addition to the filter blocks).
+    u64 directory_blocks = 0;
+
+    /// Height of the directory tree.
+    /// - 0: no storage allocated
+    /// - 1: the root is the only filter block
+    /// - > 1: the root is a directory block
+    u32 height = 0;
+
+    /// Number of bits set for every inserted hash.
+    u32 hashes = 0;
+
+    /// Points to the root block (if any).
+    block_index root;
+
+    static constexpr auto get_binary_format() {
+        using self = bloom_filter_anchor;
+        return binary_format(&self::size, &self::capacity, &self::blocks,
+                             &self::directory_blocks, &self::height, &self::hashes, &self::root);
+    }
+};
+
+} // namespace detail
+
+using bloom_filter_anchor = detail::bloom_filter_anchor;
+
+/**
+ * A persistent, blocked Bloom filter over 64-bit hash values.
+ *
+ * A Bloom filter answers membership queries with no false negatives and a small,
+ * configurable rate of false positives. Containers use it to reject lookups
+ * for absent keys before reading any of their own nodes.
+ *
+ * All bits set by a single hash value are located in the same 64-byte region
+ * of a single block, which means that every operation touches exactly one filter block
+ * (plus the directory blocks, of which there are very few, see below).
+ *
+ * Filter blocks are allocated one at a time, so every allocator (including the
+ * \ref node_allocator) is supported. They are addressed through a small tree of
+ * directory blocks, each of which stores `block_size / 8` block indices.
+ *
+ * The filter does not grow on its own: it is dimensioned for a certain number
+ * of hashes when it is initialized with `reset(capacity, bits_per_key)`.
+ * Inserting more hashes than that is allowed, but the false positive rate
+ * will increase. Hashes cannot be removed from a filter; owners are expected to
+ * rebuild it from scratch (e.g. when `size() > capacity()`).
+ */
+class bloom_filter {
+public:
+    using anchor = bloom_filter_anchor;
+
+public:
+    explicit bloom_filter(anchor_handle<anchor> _anchor, allocator& alloc);
+    ~bloom_filter();
+
+    bloom_filter(const bloom_filter&) = delete;
+    bloom_filter& operator=(const bloom_filter&) = delete;
+
+    bloom_filter(bloom_filter&&) noexcept;
+    bloom_filter& operator=(bloom_filter&&) noexcept;
+
+public:
+    engine& get_engine() const;
+    allocator& get_allocator() const;
+
+    /// Returns true if storage has been allocated for the filter,
+    /// i.e. if it has been initialized by `reset(capacity, bits_per_key)`.
+    bool initialized() const;
+
+    /// Returns the number of hashes inserted since the filter was initialized
+    /// (duplicates are counted every time).
+    u64 size() const;
+
+    /// Returns the number of hashes the filter was dimensioned for.
+    u64 capacity() const;
+
+    /// Returns the number of bits set for every hash.
+    u32 hashes() const;
+
+    /// Returns the number of filter blocks (not including directory blocks).
+    u64 blocks() const;
+
+    /// Returns the total size of this datastructure on disk, in bytes.
+    u64 byte_size() const;
+
+    /// Returns false if the hash was definitely never inserted into the filter, true otherwise.
+    /// Always returns true if the filter is not initialized.
+    bool may_contain(u64 hash) const;
+
+    /// Inserts the hash into the filter.
+    /// Throws if the filter is not initialized.
+    void insert(u64 hash);
+
+    /// Frees the current storage (if any) and initializes an empty filter for `capacity`
+    /// hashes, using roughly `bits_per_key` bits per hash. 10 bits per hash result in
+    /// a false positive rate of about 1%, every additional 5 bits reduce it by a factor of 10.
+    /// \post `initialized() && size() == 0`.
+    void reset(u64 capacity, u32 bits_per_key);
+
+    /// Removes all hashes from the filter but keeps its storage.
+    /// \post `size() == 0`.
+    void clear();
+
+    /// Frees all storage.
+    /// \post `!initialized() && byte_size() == 0`.
+    void reset();
+
+    /// Perform internal consistency checks.
+    void validate() const;
+
+private:
+    detail::bloom_filter_impl& impl() const;
+
+private:
+    std::unique_ptr<detail::bloom_filter_impl> m_impl;
+};
+
+} // namespace prequel
+
+#endif // PREQUEL_CONTAINER_BLOOM_FILTER_HPP
@@ -4,15 +4,21 @@
 #include <prequel/anchor_handle.hpp>
 #include <prequel/binary_format.hpp>
 #include <prequel/container/allocator.hpp>
+#include <prequel/container/bloom_filter.hpp>
 #include <prequel/container/indexing.hpp>
 #include <prequel/defs.hpp>
 #include <prequel/engine.hpp>
+#include <prequel/exception.hpp>
+#include <prequel/hash.hpp>
 #include <prequel/serialization.hpp>
 
 #include <fmt/ostream.h>
 
 #include <memory>
+#include <optional>
 #include <ostream>
+#include <type_traits>
+#include <vector>
 
 namespace prequel {
 
@@ -89,6 +95,115 @@ struct raw_btree_options {
     /// Returns true if `left_key` is less than `right_key`. Both byte buffers
     /// contain keys and have size `key_size`.
     bool (*key_less)(const byte* left_key, const byte* right_key, void* user_data) = nullptr;
+
+    /// Returns a hash value for the given key (`key_size` readable bytes).
+    /// Only used by the key filter (see `filter_bits_per_key`) and can remain null otherwise.
+    /// Keys that are equal according to `key_less` *must* have equal hash values.
+    ///
+    /// When null, the filter hashes the serialized bytes of every key. This is only correct
+    /// if equal keys always have identical serialized representations, which is *not* the case
+    /// for floating point numbers (`0.0` and `-0.0` are equal) or for case insensitive strings,
+    /// for example. The filter produces false negatives when this requirement is violated.
+    u64 (*key_hash)(const byte* key, void* user_data) = nullptr;
+
+    /// When true, every leaf node stores the addresses of its left and right neighbor.
+    /// Cursors can then move across leaf boundaries with a single block read instead
+    /// of walking through the parent nodes, and scans can prefetch the upcoming leaves.
+    /// Costs two block indices per leaf and an additional write when a leaf is split or merged.
+    ///
+    /// This setting changes the on-disk format of leaf nodes: it must not be changed
+    /// for an existing tree.
+    bool linked_leaves = false;
+
+    /// When true, internal nodes store the common prefix of their keys only once.
+    /// The prefix is derived from the key range covered by a node, so nodes deeper
+    /// in the tree (with narrower key ranges) tend to have longer prefixes.
+    /// The space saved increases the fanout of internal nodes, which in turn
+    /// can reduce the height of the tree.
+    /// Most effective for large keys with a common structure, e.g. composite keys
+    /// made of big endian integers.
+    ///
+    /// Prefix compression requires that `key_less` orders keys like byte strings
+    /// (i.e. like `memcmp`). This is the case for keys made of serialized unsigned integers
+    /// and byte arrays, but *not* for signed integers or floating point numbers.
+    ///
+    /// This setting changes the on-disk format of internal nodes: it must not be changed
+    /// for an existing tree.
+    bool prefix_compression = false;
+
+    /// When true, leaf nodes store the common prefix of their values only once.
+    /// Like with `prefix_compression`, the prefix is derived from the key range covered
+    /// by a leaf. The space saved increases the number of values per leaf, which reduces
+    /// the number of leaves (i.e. the I/O required for scans) and the size of the tree.
+    /// Most effective for densely populated key ranges, e.g. sequential big endian integers.
+    ///
+    /// Leaf prefix compression requires that `key_less` orders keys like byte strings
+    /// (see `prefix_compression`) and that every value starts with its key, i.e. that
+    /// `derive_key` returns the first `key_size` bytes of the value. Inserting a value
+    /// that does not start with its key throws an exception.
+    ///
+    /// This setting changes the on-disk format of leaf nodes: it must not be changed
+    /// for an existing tree.
+    bool leaf_prefix_compression = false;
+
+    /// When true, internal nodes store the number of values in the subtree of every child
+    /// (an order statistic tree). This enables `rank()`, `select()` and `count()`
+    /// in logarithmic time, for example to seek to the n-th value for pagination.
+    /// Costs 8 bytes per child pointer (i.e. a lower fanout) and additional writes
+    /// to all nodes on the path from the root to the modified leaf.
+    ///
+    /// This setting changes the on-disk format of internal nodes: it must not be changed
+    /// for an existing tree.
+    bool counted = false;
+
+    /// When > 0, the tree maintains a Bloom filter over its keys, using roughly this many
+    /// bits per key (see \ref bloom_filter). `find()` consults the filter first and
+    /// answers most lookups for absent keys with a single filter block read, without
+    /// reading any tree nodes. 10 bits per key result in a false positive rate of about 1%.
+    ///
+    /// The filter is stored in its own blocks and is updated by every insertion.
+    /// Erased keys remain in the filter until it is rebuilt, which happens
+    /// when the number of insertions exceeds the capacity of the filter
+    /// (it is then resized for twice the current number of values) and after bulk loading.
+    /// Rebuilding the filter visits all values in the tree.
+    ///
+    /// The filter relies on `key_hash` (or on the serialized bytes of the keys if
+    /// `key_hash` is null), see the requirements described there.
+    ///
+    /// The state of the filter lives in a separate anchor (`raw_btree::filter_anchor`)
+    /// that must be passed to the tree's constructor, the tree's own anchor is not affected.
+    /// This setting can be changed for an existing tree (as long as the filter anchor is passed):
+    /// the filter is built (or freed) when the tree is opened.
+    u32 filter_bits_per_key = 0;
+
+    /// Target fill factor of the nodes created by the bulk loader, in `(0, 1]`.
+    /// Leaves and internal nodes are only filled up to this fraction of their capacity
+    /// (but never below the minimum fill factor), which leaves room for later insertions
+    /// without splitting the new nodes right away.
+    /// The default creates full nodes, which is best for trees that are rarely modified.
+    double bulk_load_fill_factor = 1.0;
+
+    /// Minimum fill factor of leaves, in `(0, 0.5]`. A leaf (other than the leftmost and
+    /// the rightmost leaf) that falls below this fraction of its capacity after an erase
+    /// steals values from a neighbor or is merged with it.
+    /// Lower values make merges lazier, which avoids repeated merges and splits of the same
+    /// leaves when values are inserted and erased alternately. They also allow adaptive splits
+    /// (see `adaptive_splits`) to move the split point further away from the middle.
+    ///
+    /// The minimum fill factor can be lowered for an existing tree, but not raised.
+    double min_leaf_fill_factor = 0.5;
+
+    /// When true, full leaves are not always split in the middle. Consecutive insertions into
+    /// the same leaf at ascending (or at the same) positions are detected as a sequential
+    /// insertion pattern, for example increasing timestamps per tenant in a tree keyed by
+    /// (tenant, timestamp). A full leaf is then split at the insertion point, so that the
+    /// leaf that does not receive future insertions remains (almost) full.
+    /// Both halves of a split keep at least `min_leaf_fill_factor` of the leaf's capacity,
+    /// so this setting has no effect with the default minimum fill factor of 0.5.
+    ///
+    /// Insertions at the end (or the beginning) of the tree are always optimized
+    /// in this way, independent of this setting.
+    bool adaptive_splits = false;
 };
 
 using raw_btree_anchor = detail::raw_btree_anchor;
@@ -128,6 +243,9 @@ public:
     /// True iff the element this cursor pointed to was erased.
     bool erased() const;
 
+    /// True iff this is a lazy cursor (see raw_btree::create_lazy_cursor()).
+    bool lazy() const;
+
     /// Equivalent to `!at_end()`.
     explicit operator bool() const { return !at_end(); }
 
@@ -220,6 +338,17 @@ public:
     /// \warning count is the number of values, *NOT* the number of bytes.
     void insert(const byte* values, size_t count);
 
+    /// Like `insert(values, count)`, but complete leaf nodes are prepared
+    /// concurrently by `threads` worker threads (0 means one thread per hardware thread).
+    /// Workers copy the values into leaf images and derive their keys, the calling thread
+    /// writes the leaves and builds the internal nodes. The tree's `derive_key` function
+    /// must therefore be safe to call concurrently.
+    ///
+    /// Worthwhile for large inputs, small inputs are loaded sequentially.
+    ///
+    /// \warning count is the number of values, *NOT* the number of bytes.
+    void insert_parallel(const byte* values, size_t count, u32 threads = 0);
+
     /// Finalizes the loading procedure. All changes will be applied
     /// to the tree and no more values can be inserted using this loader.
     void finish();
@@ -253,6 +382,7 @@ private:
 class raw_btree {
 public:
     using anchor = raw_btree_anchor;
+    using filter_anchor = bloom_filter_anchor;
     using cursor = raw_btree_cursor;
 
     struct insert_result {
@@ -315,7 +445,17 @@ public:
     /// Constructs the tree rooted at the existing anchor.
     /// The options must be equivalent every time the tree is opened;
     /// they are not persisted to disk.
+    ///
+    /// \throws bad_argument If `options.filter_bits_per_key` is not 0
+    ///         (key filters require a filter anchor, see below).
     raw_btree(anchor_handle<anchor> _anchor, const raw_btree_options& options, allocator& alloc);
+
+    /// Constructs the tree rooted at the existing anchor. The key filter
+    /// (see `raw_btree_options::filter_bits_per_key`) is stored in `_filter_anchor`,
+    /// which must be passed every time the tree is opened. The filter is built (or freed)
+    /// when the tree is opened with a different `filter_bits_per_key` setting.
+    raw_btree(anchor_handle<anchor> _anchor, anchor_handle<filter_anchor> _filter_anchor,
+              const raw_btree_options& options, allocator& alloc);
     ~raw_btree();
 
     raw_btree(raw_btree&& other) noexcept;
@@ -331,9 +471,19 @@ public:
     /// The object should be used to insert values in ascending order (according to the
     /// tree's comparison function) into the tree.
     ///
-    /// \note Only empty trees can be bulk-loaded.
+    /// \note Only empty trees can be bulk-loaded. Use `bulk_append()` for non-empty trees.
     loader bulk_load();
 
+    /// Creates a bulk loading object that appends to this tree.
+    /// The inserted values must be in ascending order and they must all be greater
+    /// than the current maximum of the tree (for example, when a time series
+    /// or an auto-increment sequence is loaded in batches). The tree is not modified
+    /// until the loader is finished; it must not be modified by other means in the meantime.
+    ///
+    /// The new values are added to the rightmost path of the tree, so the cost is
+    /// proportional to the number of new values (and not to the size of the tree).
+    loader bulk_append();
+
     /// Returns the size (in bytes) of every value in the tree (stored in leaf nodes).
     u32 value_size() const;
 
@@ -386,10 +536,33 @@ public:
     /// otherwise the cursor will attempt to move to the implied element.
     cursor create_cursor(cursor_seek_t seek = seek_none) const;
 
+    /// Create a new lazy cursor and seek it to the specified position.
+    ///
+    /// Normal cursors are kept up to date by every modification of the tree, which makes
+    /// insertions and deletions slower when many cursors are alive. Lazy cursors are not
+    /// updated; they remember the key of their current value instead. When they are used
+    /// after the tree has been modified, they seek to that key again. If the value
+    /// has been erased in the meantime, the cursor behaves as if `erased()` was true.
+    ///
+    /// Lazy cursors are useful for long running iterations: modifications do not
+    /// pay for them, but every step of the cursor derives the key of the current value.
+    cursor create_lazy_cursor(cursor_seek_t seek = seek_none) const;
+
     /// Seek to the given key within this tree. The cursor will be invalid
     /// if the key was not found, otherwise it will point to the found value.
     cursor find(const byte* key) const;
 
+    /// Looks up `count` keys (stored contiguously, `key_size()` bytes each) at once.
+    /// If `keys[i]` was found, its value is copied to `values + i * value_size()` and
+    /// `found[i]` is set to true, otherwise `found[i]` is set to false.
+    /// Returns the number of keys that were found.
+    ///
+    /// The keys can be passed in any order; they are sorted and the tree is walked once
+    /// in ascending order. Internal nodes on the common path of consecutive keys are only read
+    /// once and leaves are read (and prefetched, if supported by the engine) in ascending order,
+    /// which is much cheaper than calling `find()` for every key.
+    u64 find_many(const byte* keys, size_t count, byte* values, bool* found) const;
+
     /// Seek to the smallest key `lb` with `lb >= key`. The cursor will be invalid
     /// if no such key exists within this tree.
     cursor lower_bound(const byte* key) const;
@@ -398,6 +571,27 @@ public:
     /// if no such key exists within this tree.
     cursor upper_bound(const byte* key) const;
 
+    /// Returns true if the tree stores subtree sizes (see `raw_btree_options::counted`).
+    bool counted() const;
+
+    /// Returns true if the tree maintains a filter over its keys
+    /// (see `raw_btree_options::filter_bits_per_key`).
+    bool filtered() const;
+
+    /// Returns the number of values with a key less than `key`, i.e. the index
+    /// that a value with that key has (or would have) in sorted order.
+    /// Requires a counted tree. Runs in logarithmic time.
+    u64 rank(const byte* key) const;
+
+    /// Seek to the value with the given index (in sorted order). The cursor will be invalid
+    /// if `index >= size()`.
+    /// Requires a counted tree. Runs in logarithmic time.
+    cursor select(u64 index) const;
+
+    /// Returns the number of values with a key in `[lower, upper)`.
+    /// Runs in logarithmic time for counted trees; other trees visit every value in the range.
+    u64 count(const byte* lower, const byte* upper) const;
+
     /// Attempts to insert the given value into the tree. The tree will not be modified
     /// if a value with the same key already exists.
     insert_result insert(const byte* value);
@@ -406,6 +600,45 @@ public:
     /// it will be overwritten.
     insert_result insert_or_update(const byte* value);
 
+    /// Inserts `count` values (stored contiguously) in ascending order.
+    /// Values whose key already exists in the tree are skipped, just like with `insert()`.
+    /// Returns the number of values that have been inserted.
+    ///
+    /// The values are merged into the tree one leaf at a time: only the first value
+    /// of every leaf requires a search from the root and at most one split, the following
+    /// values for the same leaf are merged into it directly.
+    /// Throws `bad_argument` if the values are not sorted; values that have been inserted
+    /// up to that point remain in the tree.
+    u64 insert_sorted_batch(const byte* values, size_t count);
+
+    /// Erases all values with a key in `[lower, upper)`.
+    /// Returns the number of values that have been erased.
+    ///
+    /// Subtrees that lie completely within the range are freed as a whole, without
+    /// visiting their values (with prefix compression, covered leaves are freed one
+    /// at a time instead). Only the two leaves at the boundaries of the range may need
+    /// to steal or merge values, and never from a neighbor inside the range.
+    /// Cursors that pointed to an erased value are marked as erased.
+    u64 erase_range(const byte* lower, const byte* upper);
+
+    /// Improves the physical layout of the tree for range scans. After many random
+    /// insertions and deletions, neighboring leaves are usually scattered across the file,
+    /// which turns scans into random I/O.
+    ///
+    /// Every call processes up to `max_leaves` leaves in key order, continuing where the
+    /// previous call stopped (the position is kept in memory only). Neighboring leaves
+    /// (with the same parent) are merged while their values fit into a single leaf,
+    /// up to the `bulk_load_fill_factor`. Leaves that do not already follow their predecessor
+    /// on disk are then moved into a contiguous range of blocks, in key order.
+    /// Returns true when the last leaf of the tree has been processed; the next call
+    /// will start a new pass from the beginning.
+    ///
+    /// The tree remains fully usable between calls, and cursors remain valid.
+    /// The allocator must support allocations of more than one block (i.e. not the
+    /// \ref node_allocator) unless `max_leaves` is 1.
+    /// Must not be called while a bulk loader is active.
+    bool compact(u64 max_leaves);
+
     /// Removes all data from this tree. After this operation completes,
     /// the tree will not occupy any space on disk.
     /// \post `empty() && byte_size() == 0`.
@@ -478,6 +711,9 @@ public:
         friend binary_format_access;
     };
 
+    /// Anchor of the key filter (optional, see `raw_btree_options::filter_bits_per_key`).
+    using filter_anchor = raw_btree::filter_anchor;
+
 public:
     /// Cursors are used to traverse the values in a btree.
     class cursor {
@@ -500,6 +736,9 @@ public:
         /// True iff the element this cursor pointed to was erased.
         bool erased() const { return m_inner.erased(); }
 
+        /// True iff this is a lazy cursor (see btree::create_lazy_cursor()).
+        bool lazy() const { return m_inner.lazy(); }
+
         /// Equivalent to `!at_end()`.
         explicit operator bool() const { return static_cast<bool>(m_inner); }
 
@@ -617,6 +856,30 @@ public:
             }
         }
 
+        /// Insert a number of values into the new tree, using `threads` worker
+        /// threads to build leaf nodes (0 means one thread per hardware thread).
+        /// The values must be ordered and unique and must be greater
+        /// than the previous values inserted into the tree.
+        /// See raw_btree_loader::insert_parallel().
+        template<typename InputIter>
+        void insert_parallel(const InputIter& begin, const InputIter& end, u32 threads = 0) {
+            // Serialize in chunks to bound the size of the buffer.
+            static constexpr size_t chunk_size = size_t(1) << 16;
+
+            std::vector<byte> buffer;
+            buffer.reserve(chunk_size * value_size());
+            for (auto i = begin; i != end; ++i) {
+                auto value = serialize_to_buffer(*i);
+                buffer.insert(buffer.end(), value.begin(), value.end());
+                if (buffer.size() == chunk_size * value_size()) {
+                    m_inner.insert_parallel(buffer.data(), chunk_size, threads);
+                    buffer.clear();
+                }
+            }
+            if (!buffer.empty())
+                m_inner.insert_parallel(buffer.data(), buffer.size() / value_size(), threads);
+        }
+
         /// Finalizes the loading procedure. All changes will be applied
         /// to the tree and no more values can be inserted using this loader.
         void finish() { m_inner.finish(); }
@@ -663,8 +926,40 @@ public:
     /// they are not persisted to disk.
     explicit btree(anchor_handle<anchor> anchor_, allocator& alloc_,
                    DeriveKey derive_key = DeriveKey(), KeyLess less = KeyLess())
+        : btree(std::move(anchor_), alloc_, raw_btree_options(), std::move(derive_key),
+                std::move(less)) {}
+
+    /// Constructs the tree rooted at the existing anchor, using the layout and tuning
+    /// settings in `settings` (e.g. `linked_leaves`). The value size, the key size
+    /// and the callbacks in `settings` are ignored, they are provided by this class.
+    /// The only exception is `key_hash`, which is kept if it is not null (it receives
+    /// a serialized key and an unspecified `user_data` pointer).
+    /// The settings must be equivalent every time the tree is opened.
+    ///
+    /// Without `key_hash`, the key filter (`filter_bits_per_key`) hashes the serialized keys,
+    /// so keys that are equal according to `KeyLess` must have identical serialized
+    /// representations. Floating point keys are normalized before hashing (`-0.0` is hashed
+    /// like `0.0`).
+    ///
+    /// Key filters require a filter anchor, use the constructor below to enable them.
+    explicit btree(anchor_handle<anchor> anchor_, allocator& alloc_,
+                   const raw_btree_options& settings, DeriveKey derive_key = DeriveKey(),
+                   KeyLess less = KeyLess())
+        : btree(std::move(anchor_), anchor_handle<filter_anchor>(), alloc_, settings,
+                std::move(derive_key), std::move(less)) {}
+
+    /// Constructs the tree rooted at the existing anchor, with the key filter
+    /// stored in `filter_anchor_` (see `raw_btree_options::filter_bits_per_key`).
+    /// The filter anchor must be passed every time the tree is opened.
+    ///
+    /// \throws bad_argument If the key filter is enabled for a custom `KeyLess`
+    ///         but `key_hash` is null.
+    explicit btree(anchor_handle<anchor> anchor_, anchor_handle<filter_anchor> filter_anchor_,
+                   allocator& alloc_, const raw_btree_options& settings,
+                   DeriveKey derive_key = DeriveKey(), KeyLess less = KeyLess())
         : m_state(std::make_unique<state_t>(std::move(derive_key), std::move(less)))
-        , m_inner(std::move(anchor_).template member<&anchor::tree>(), make_options(), alloc_) {}
+        , m_inner(std::move(anchor_).template member<&anchor::tree>(), std::move(filter_anchor_),
+                  make_options(settings), alloc_) {}
 
     engine& get_engine() const { return m_inner.get_engine(); }
     allocator& get_allocator() const { return m_inner.get_allocator(); }
@@ -682,9 +977,14 @@ public:
     /// The object should be used to insert values in ascending order (according to the
     /// tree's comparison function) into the tree.
     ///
-    /// \note Only empty trees can be bulk-loaded.
+    /// \note Only empty trees can be bulk-loaded. Use `bulk_append()` for non-empty trees.
     loader bulk_load() { return loader(m_inner.bulk_load()); }
 
+    /// Creates a bulk loading object that appends to this tree.
+    /// All inserted values must be greater than the current maximum of the tree.
+    /// See raw_btree::bulk_append().
+    loader bulk_append() { return loader(m_inner.bulk_append()); }
+
     /// \}
 
     /// \name Tree size
@@ -748,6 +1048,14 @@ public:
         return cursor(m_inner.create_cursor(seek));
     }
 
+    /// Create a new lazy cursor and seek it to the specified position.
+    /// Lazy cursors are not updated by modifications of the tree. They seek to
+    /// the key of their current value again when they are used after a modification.
+    /// See raw_btree::create_lazy_cursor().
+    cursor create_lazy_cursor(cursor_seek_t seek = seek_none) const {
+        return cursor(m_inner.create_lazy_cursor(seek));
+    }
+
     /// Seek to the given key within this tree. The cursor will be invalid
     /// if the key was not found, otherwise it will point to the found value.
     cursor find(const key_type& key) const {
@@ -755,6 +1063,31 @@ public:
         return cursor(m_inner.find(buffer.data()));
     }
 
+    /// Looks up all keys in `[begin, end)`. The result contains the value
+    /// for every key (in the same order), or an empty optional if the key was not found.
+    /// See raw_btree::find_many().
+    template<typename InputIter>
+    std::vector<std::optional<value_type>> find_many(const InputIter& begin,
+                                                     const InputIter& end) const {
+        std::vector<byte> keys;
+        for (auto i = begin; i != end; ++i) {
+            auto key = serialize_to_buffer(*i);
+            keys.insert(keys.end(), key.begin(), key.end());
+        }
+
+        const size_t count = keys.size() / key_size();
+        std::vector<byte> values(count * value_size());
+        std::unique_ptr<bool[]> found(new bool[count]);
+        m_inner.find_many(keys.data(), count, values.data(), found.get());
+
+        std::vector<std::optional<value_type>> result(count);
+        for (size_t i = 0; i < count; ++i) {
+            if (found[i])
+                result[i] = deserialize<value_type>(values.data() + i * value_size());
+        }
+        return result;
+    }
+
     /// Seek to the smallest key `lb` with `lb >= key`. The cursor will be invalid
     /// if no such key exists within this tree.
     cursor lower_bound(const key_type& key) const {
@@ -769,6 +1102,32 @@ public:
         return cursor(m_inner.upper_bound(buffer.data()));
     }
 
+    /// Returns true if the tree stores subtree sizes (see `raw_btree_options::counted`).
+    bool counted() const { return m_inner.counted(); }
+
+    /// Returns true if the tree maintains a filter over its keys
+    /// (see `raw_btree_options::filter_bits_per_key`).
+    bool filtered() const { return m_inner.filtered(); }
+
+    /// Returns the number of values with a key less than `key`.
+    /// Requires a counted tree.
+    u64 rank(const key_type& key) const {
+        auto buffer = serialize_to_buffer(key);
+        return m_inner.rank(buffer.data());
+    }
+
+    /// Seek to the value with the given index (in sorted order). The cursor will be invalid
+    /// if `index >= size()`.
+    /// Requires a counted tree.
+    cursor select(u64 index) const { return cursor(m_inner.select(index)); }
+
+    /// Returns the number of values with a key in `[lower, upper)`.
+    u64 count(const key_type& lower, const key_type& upper) const {
+        auto lower_buffer = serialize_to_buffer(lower);
+        auto upper_buffer = serialize_to_buffer(upper);
+        return m_inner.count(lower_buffer.data(), upper_buffer.data());
+    }
+
     /// Attempts to insert the given value into the tree. The tree will not be modified
     /// if a value with the same key already exists.
     insert_result insert(const value_type& value) {
@@ -785,6 +1144,59 @@ public:
         return insert_result(cursor(std::move(result.position)), result.inserted);
     }
 
+    /// Inserts the values in `[begin, end)`, which must be sorted.
+    /// Values whose key already exists in the tree are skipped.
+    /// Returns the number of values that have been inserted.
+    /// See raw_btree::insert_sorted_batch().
+    template<typename InputIter>
+    u64 insert_sorted_batch(const InputIter& begin, const InputIter& end) {
+        // Serialize in chunks to bound the size of the buffer.
+        static constexpr size_t chunk_size = 1024;
+
+        std::vector<byte> buffer;
+        buffer.reserve(chunk_size * value_size());
+
+        // The raw tree only checks the order within a chunk, the boundaries
+        // between chunks are checked here.
+        std::optional<key_type> last_key;
+        u64 inserted = 0;
+        auto flush = [&]() {
+            const size_t count = buffer.size() / value_size();
+            if (last_key
+                && key_less(derive_key(deserialize<value_type>(buffer.data())), *last_key))
+                PREQUEL_THROW(bad_argument("Values must be sorted."));
+
+            inserted += m_inner.insert_sorted_batch(buffer.data(), count);
+            const byte* last = buffer.data() + buffer.size() - value_size();
+            last_key = derive_key(deserialize<value_type>(last));
+            buffer.clear();
+        };
+
+        for (auto i = begin; i != end; ++i) {
+            auto value = serialize_to_buffer(*i);
+            buffer.insert(buffer.end(), value.begin(), value.end());
+            if (buffer.size() == chunk_size * value_size())
+                flush();
+        }
+        if (!buffer.empty())
+            flush();
+        return inserted;
+    }
+
+    /// Erases all values with a key in `[lower, upper)`.
+    /// Returns the number of values that have been erased.
+    /// See raw_btree::erase_range().
+    u64 erase_range(const key_type& lower, const key_type& upper) {
+        auto lower_buffer = serialize_to_buffer(lower);
+        auto upper_buffer = serialize_to_buffer(upper);
+        return m_inner.erase_range(lower_buffer.data(), upper_buffer.data());
+    }
+
+    /// Improves the physical layout of the tree for range scans.
+    /// Returns true when a complete pass over the tree has been made.
+    /// See raw_btree::compact().
+    bool compact(u64 max_leaves) { return m_inner.compact(max_leaves); }
+
     /// Removes all data from this tree. After this operation completes,
     /// the tree will not occupy any space on disk.
     /// \post `empty() && byte_size() == 0`.
@@ -850,13 +1262,22 @@ public:
     const raw_btree& raw() const { return m_inner; }
 
 private:
-    raw_btree_options make_options() {
-        raw_btree_options options;
+    raw_btree_options make_options(const raw_btree_options& settings) {
+        raw_btree_options options = settings;
         options.value_size = value_size();
         options.key_size = key_size();
         options.user_data = m_state.get();
         options.derive_key = derive_key;
         options.key_less = key_less;
+        if (!settings.key_hash) {
+            // Only the default order guarantees that equal keys have equal representations.
+            constexpr bool default_less = std::is_same_v<KeyLess, std::less<>>
+                                          || std::is_same_v<KeyLess, std::less<key_type>>;
+            if (!default_less && settings.filter_bits_per_key > 0)
+                PREQUEL_THROW(
+                    bad_argument("A key filter with a custom key order requires key_hash."));
+            options.key_hash = std::is_floating_point_v<key_type> ? key_hash : nullptr;
+        }
         return options;
     }
 
@@ -873,6 +1294,17 @@ private:
         return state->less(lhs, rhs);
     }
 
+    // Only used for floating point keys, other keys are hashed by their serialized bytes.
+    static u64 key_hash(const byte* key_buffer, void*) {
+        key_type key = deserialize<key_type>(key_buffer);
+        if constexpr (std::is_floating_point_v<key_type>) {
+            // Positive and negative zero are equal, but their representations differ.
+            if (key == key_type(0))
+                key = key_type(0);
+        }
+        return fnv_1a(key);
+    }
+
 private:
     // Allocated on the heap for stable addresses (user data pointer in raw_btree).
     struct state_t {
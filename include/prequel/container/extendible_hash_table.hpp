@@ -0,0 +1,412 @@
+#ifndef PREQUEL_CONTAINER_EXTENDIBLE_HASH_TABLE_HPP
+#define PREQUEL_CONTAINER_EXTENDIBLE_HASH_TABLE_HPP
+
+#include <prequel/anchor_handle.hpp>
+#include <prequel/binary_format.hpp>
+#include <prequel/container/allocator.hpp>
+#include <prequel/container/array.hpp>
+#include <prequel/container/indexing.hpp>
+#include <prequel/container/iteration.hpp>
+#include <prequel/defs.hpp>
+#include <prequel/engine.hpp>
+#include <prequel/hash.hpp>
+#include <prequel/serialization.hpp>
+
+#include <functional>
+#include <memory>
+#include <ostream>
+
+namespace prequel {
+
+namespace detail {
+
+class raw_extendible_hash_table_impl;
+
+class raw_extendible_hash_table_anchor {
+    // Number of entries.
+    u64 size = 0;
+
+    // Number of allocated buckets.
+    u64 buckets = 0;
+
+    // The directory has 2^global_depth entries.
+    u8 global_depth = 0;
+
+    // Maps the lowest `global_depth` bits of a hash to the bucket that contains it.
+    array<block_index>::anchor directory;
+
+    static constexpr auto get_binary_format() {
+        return binary_format(&raw_extendible_hash_table_anchor::size,
+                             &raw_extendible_hash_table_anchor::buckets,
+                             &raw_extendible_hash_table_anchor::global_depth,
+                             &raw_extendible_hash_table_anchor::directory);
+    }
+
+    friend binary_format_access;
+    friend raw_extendible_hash_table_impl;
+};
+
+} // namespace detail
+
+/// A group of properties required to configure an extendible hash table instance.
+/// The parameters must be semantically equivalent whenever the
+/// hash table is (re-) opened.
+struct raw_extendible_hash_table_options {
+    /// The size of a value, in bytes. Must be > 0.
+    u32 value_size = 0;
+
+    /// Size of a key, in bytes. Keys are derived from values.
+    /// Must be > 0.
+    u32 key_size = 0;
+
+    /// Passed to all callbacks as the last argument.
+    /// Can remain null.
+    void* user_data = nullptr;
+
+    /// Takes a value (`value_size` readable bytes) and derives a search
+    /// key from it. The key must be stored in `key_buffer` and must
+    /// be exactly `key_size` bytes long.
+    void (*derive_key)(const byte* value, byte* key, void* user_data) = nullptr;
+
+    /// Returns a hash value for the given `key` (`key_size` readable bytes).
+    /// Equal keys *must* have equal hash values, the reverse need not be true.
+    u64 (*key_hash)(const byte* key, void* user_data) = nullptr;
+
+    /// Takes two keys (`key_size` readable bytes each) and returns true iff both are equal.
+    /// Two equal keys *must* have the same hash value.
+    bool (*key_equal)(const byte* left_key, const byte* right_key, void* user_data) = nullptr;
+};
+
+/**
+ * An unordered collection of values based on extendible hashing.
+ *
+ * The table consists of a directory and a set of bucket nodes. The directory is an
+ * array of `2^global_depth` bucket addresses, indexed by the lowest `global_depth` bits
+ * of a key's hash. Several directory entries can point to the same bucket.
+ * When a bucket overflows, only that bucket is split (which doubles the directory
+ * if the bucket was referenced by a single entry). Buckets never have overflow nodes.
+ *
+ * As a result, every lookup reads exactly one directory block and one bucket block,
+ * independent of the distribution of the keys. This is in contrast to \ref raw_hash_table,
+ * which splits its buckets in a fixed order and therefore has to maintain overflow chains.
+ * The price is the directory, which requires 8 bytes per entry, and the fact that
+ * the directory grows in steps of powers of two.
+ *
+ * Buckets store the hash of every value, so lookups only compare keys that have the same hash
+ * and splits do not have to recompute any hashes. The user-provided hash values are mixed
+ * before use, so weak hash functions (e.g. FNV-1a for small integers) can be used as well.
+ *
+ * \note A bucket cannot be split if all of its values have the same hash value.
+ * Inserting more than `bucket_capacity()` values with equal hash values results in an exception.
+ *
+ * Buckets are merged with their sibling bucket when they become sparse, but the directory
+ * never shrinks (except when the table is cleared).
+ */
+class raw_extendible_hash_table {
+public:
+    using anchor = detail::raw_extendible_hash_table_anchor;
+
+public:
+    raw_extendible_hash_table(anchor_handle<anchor> anc,
+                              const raw_extendible_hash_table_options& options, allocator& alloc);
+    ~raw_extendible_hash_table();
+
+    raw_extendible_hash_table(raw_extendible_hash_table&& other) noexcept;
+    raw_extendible_hash_table& operator=(raw_extendible_hash_table&& other) noexcept;
+
+    engine& get_engine() const;
+    allocator& get_allocator() const;
+
+    /// Returns the size (in bytes) of every value in the table.
+    u32 value_size() const;
+
+    /// Returns the size (in bytes) of every key in the table.
+    u32 key_size() const;
+
+    /// Returns the number of values that can fit into a bucket.
+    u32 bucket_capacity() const;
+
+    /// Returns true iff the table is empty.
+    bool empty() const;
+
+    /// Returns the number of values in this table.
+    u64 size() const;
+
+    /// Returns the number of buckets.
+    u64 buckets() const;
+
+    /// Returns the global depth of the table, i.e. the number of hash bits used
+    /// to index the directory.
+    u32 global_depth() const;
+
+    /// Returns the number of entries in the directory (`2^global_depth()` for non-empty tables).
+    u64 directory_size() const;
+
+    /// Returns the average fill factor of this table's buckets.
+    double fill_factor() const;
+
+    /// Returns the total size of this datastructure on disk, in bytes.
+    u64 byte_size() const;
+
+    /// Returns the relative overhead of this table compared to a linear file with the same values.
+    /// Computed by dividing the total size of the table by the total size of its values.
+    double overhead() const;
+
+    /// Returns true if the table contains the given key (of size `key_size()`).
+    bool contains(const byte* key) const;
+
+    /// Attempts to find the value associated with the given key
+    /// and stores it in the provided `value` buffer, which must have `value_size()`
+    /// writable bytes.
+    /// Returns true if the value was found.
+    bool find(const byte* key, byte* value) const;
+
+    /// Attempts to insert the given value (of size `value_size()`) into the table.
+    /// Does nothing if a value with the same key already exists.
+    /// Returns true if the value was inserted.
+    bool insert(const byte* value);
+
+    /// Inserts the value (of size `value_size()`) into the table. Overwrites any
+    /// existing value with the same key.
+    /// Returns true if the value was inserted, false if an old value was overwritten.
+    bool insert_or_update(const byte* value);
+
+    /// Removes the value associated with the given key (of size `key_size()`) from the table.
+    /// Returns true if a value existed.
+    bool erase(const byte* key);
+
+    /// Iterates over the values of this table.
+    /// The `iter_func` function will be called for every value of the table,
+    /// until it returns `iteration::stop`.
+    ///
+    /// The `user_data` pointer will be passed to the iteration function on every invocation.
+    ///
+    /// \warning The table must not be modified while iteration is in progress.
+    void iterate(iteration_control (*iter_func)(const byte* value, void* user_data),
+                 void* user_data = nullptr) const;
+
+    template<typename IterFunc>
+    void iterate(IterFunc&& fn) const {
+        auto callback = [](const byte* value, void* user_data) -> iteration_control {
+            IterFunc& fn_ref = *reinterpret_cast<IterFunc*>(user_data);
+            return fn_ref(value);
+        };
+        iterate(+callback, reinterpret_cast<void*>(std::addressof(fn)));
+    }
+
+    /// Removes all data from this table. After this operation completes, the table
+    /// will not occupy any space on disk.
+    /// \post `empty() && byte_size() == 0`.
+    void reset();
+
+    /// Erases all values from this table.
+    /// \post `empty()`.
+    void clear();
+
+    /// Prints debugging information to the output stream.
+    void dump(std::ostream& os) const;
+
+    /// Perform internal consistency checks.
+    void validate() const;
+
+private:
+    detail::raw_extendible_hash_table_impl& impl() const;
+
+private:
+    std::unique_ptr<detail::raw_extendible_hash_table_impl> m_impl;
+};
+
+/**
+ * A typed extendible hash table. See \ref raw_extendible_hash_table.
+ */
+template<typename Value, typename DeriveKey = indexed_by_identity, typename KeyHash = fast_hasher,
+         typename KeyEqual = std::equal_to<>>
+class extendible_hash_table {
+public:
+    /// Typedef for the value type.
+    using value_type = Value;
+
+    /// Typedef for the key type, which is the result of applying the `DeriveKey`
+    /// function on a value.
+    using key_type = remove_cvref_t<std::result_of_t<DeriveKey(Value)>>;
+
+public:
+    class anchor {
+        raw_extendible_hash_table::anchor table;
+
+        static constexpr auto get_binary_format() { return binary_format(&anchor::table); }
+
+        friend extendible_hash_table;
+        friend binary_format_access;
+    };
+
+public:
+    explicit extendible_hash_table(anchor_handle<anchor> anchor_, allocator& alloc_,
+                                   DeriveKey derive_key = DeriveKey(), KeyHash key_hash = KeyHash(),
+                                   KeyEqual key_equal = KeyEqual())
+        : m_state(std::make_unique<state_t>(std::move(derive_key), std::move(key_hash),
+                                            std::move(key_equal)))
+        , m_inner(std::move(anchor_).template member<&anchor::table>(), make_options(), alloc_) {}
+
+    engine& get_engine() const { return m_inner.get_engine(); }
+    allocator& get_allocator() const { return m_inner.get_allocator(); }
+
+    /// Returns the size (in bytes) of every value in the table.
+    static constexpr u32 value_size() { return serialized_size<value_type>(); }
+
+    /// Returns the size (in bytes) of every key in the table.
+    static constexpr u32 key_size() { return serialized_size<key_type>(); }
+
+    /// Returns the number of values that can fit into a bucket.
+    u32 bucket_capacity() const { return m_inner.bucket_capacity(); }
+
+    /// Returns true iff the table is empty.
+    bool empty() const { return m_inner.empty(); }
+
+    /// Returns the number of values in this table.
+    u64 size() const { return m_inner.size(); }
+
+    /// Returns the number of buckets.
+    u64 buckets() const { return m_inner.buckets(); }
+
+    /// Returns the global depth of the table, i.e. the number of hash bits used
+    /// to index the directory.
+    u32 global_depth() const { return m_inner.global_depth(); }
+
+    /// Returns the number of entries in the directory.
+    u64 directory_size() const { return m_inner.directory_size(); }
+
+    /// Returns the average fill factor of this table's buckets.
+    double fill_factor() const { return m_inner.fill_factor(); }
+
+    /// Returns the total size of this datastructure on disk, in bytes.
+    u64 byte_size() const { return m_inner.byte_size(); }
+
+    /// Returns the relative overhead of this table compared to a linear file with the same values.
+    double overhead() const { return m_inner.overhead(); }
+
+    /// Returns true if the table contains the given key.
+    bool contains(const key_type& key) const {
+        serialized_buffer<key_type> buffer = serialize_to_buffer(key);
+        return m_inner.contains(buffer.data());
+    }
+
+    /// Attempts to find the value associated with the given key and writes it to `value`
+    /// on success. Returns true if the value was found.
+    bool find(const key_type& key, value_type& value) const {
+        serialized_buffer<key_type> key_buffer = serialize_to_buffer(key);
+        serialized_buffer<value_type> value_buffer;
+        if (m_inner.find(key_buffer.data(), value_buffer.data())) {
+            value = deserialize<value_type>(value_buffer.data());
+            return true;
+        }
+        return false;
+    }
+
+    /// Attempts to insert the given value into the table.
+    /// Does nothing if a value with the same key already exists.
+    /// Returns true if the value was inserted.
+    bool insert(const value_type& value) {
+        serialized_buffer<value_type> value_buffer = serialize_to_buffer(value);
+        return m_inner.insert(value_buffer.data());
+    }
+
+    /// Inserts the value into the table. Overwrites any
+    /// existing value with the same key.
+    /// Returns true if the value was inserted, false if an old value was overwritten.
+    bool insert_or_update(const value_type& value) {
+        serialized_buffer<value_type> value_buffer = serialize_to_buffer(value);
+        return m_inner.insert_or_update(value_buffer.data());
+    }
+
+    /// Removes the value associated with the given key from the table.
+    /// Returns true if a value existed.
+    bool erase(const key_type& key) {
+        serialized_buffer<key_type> key_buffer = serialize_to_buffer(key);
+        return m_inner.erase(key_buffer.data());
+    }
+
+    template<typename IterFunc>
+    void iterate(IterFunc&& fn) const {
+        m_inner.iterate([&](const byte* raw_value) {
+            value_type value = deserialize<value_type>(raw_value);
+            return fn(value);
+        });
+    }
+
+    /// Removes all data from this table. After this operation completes, the table
+    /// will not occupy any space on disk.
+    /// \post `empty() && byte_size() == 0`.
+    void reset() { m_inner.reset(); }
+
+    /// Erases all values from this table.
+    /// \post `empty()`.
+    void clear() { m_inner.clear(); }
+
+    /// Prints debugging information to the output stream.
+    void dump(std::ostream& os) const { m_inner.dump(os); }
+
+    /// Perform internal consistency checks.
+    void validate() const { m_inner.validate(); }
+
+    const raw_extendible_hash_table& raw() const { return m_inner; }
+
+private:
+    // Allocated on the heap for stables addresses (the user_data pointer points to this object).
+    struct state_t {
+        DeriveKey m_derive_key;
+        KeyHash m_key_hash;
+        KeyEqual m_key_equal;
+
+        state_t(DeriveKey&& derive_key, KeyHash&& key_hash, KeyEqual&& key_equal)
+            : m_derive_key(std::move(derive_key))
+            , m_key_hash(std::move(key_hash))
+            , m_key_equal(std::move(key_equal)) {}
+
+        key_type derive_key(const value_type& v) const { return m_derive_key(v); }
+        u64 key_hash(const key_type& k) const { return m_key_hash(k); }
+        bool key_equal(const key_type& lhs, const key_type& rhs) const {
+            return m_key_equal(lhs, rhs);
+        }
+    };
+
+    raw_extendible_hash_table_options make_options() {
+        raw_extendible_hash_table_options options;
+        options.value_size = value_size();
+        options.key_size = key_size();
+        options.user_data = m_state.get();
+        options.derive_key = derive_key;
+        options.key_hash = key_hash;
+        options.key_equal = key_equal;
+        return options;
+    }
+
+    static void derive_key(const byte* value_buffer, byte* key_buffer, void* user_data) {
+        const state_t* state = static_cast<state_t*>(user_data);
+        value_type value = deserialize<value_type>(value_buffer);
+        key_type key = state->derive_key(value);
+        serialize(key, key_buffer);
+    }
+
+    static u64 key_hash(const byte* key_buffer, void* user_data) {
+        const state_t* state = static_cast<state_t*>(user_data);
+        key_type key = deserialize<key_type>(key_buffer);
+        return state->key_hash(key);
+    }
+
+    static bool
+    key_equal(const byte* left_key_buffer, const byte* right_key_buffer, void* user_data) {
+        const state_t* state = static_cast<state_t*>(user_data);
+        key_type lhs = deserialize<key_type>(left_key_buffer);
+        key_type rhs = deserialize<key_type>(right_key_buffer);
+        return state->key_equal(lhs, rhs);
+    }
+
+private:
+    std::unique_ptr<state_t> m_state;
+    raw_extendible_hash_table m_inner;
+};
+
+} // namespace prequel
+
+#endif // PREQUEL_CONTAINER_EXTENDIBLE_HASH_TABLE_HPP
@@ -5,6 +5,7 @@
 #include <prequel/binary_format.hpp>
 #include <prequel/container/allocator.hpp>
 #include <prequel/container/array.hpp>
+#include <prequel/container/bloom_filter.hpp>
 #include <prequel/container/indexing.hpp>
 #include <prequel/container/iteration.hpp>
 #include <prequel/defs.hpp>
@@ -14,12 +15,15 @@
 
 #include <functional>
 #include <memory>
+#include <optional>
+#include <vector>
 
 namespace prequel {
 
 namespace detail {
 
 class raw_hash_table_impl;
+class raw_hash_table_loader_impl;
 class raw_hash_table_node_view_impl;
 
 class raw_hash_table_anchor {
@@ -88,6 +92,95 @@ struct raw_hash_table_options {
     /// Takes two keys (`key_size` readable bytes each) and returns true iff both are equal.
     /// Two equal keys *must* have the same hash value.
     bool (*key_equal)(const byte* left_key, const byte* right_key, void* user_data) = nullptr;
+
+    /// When > 0, the table maintains a Bloom filter over the hashes of its keys,
+    /// using roughly this many bits per key (see \ref bloom_filter).
+    /// Lookups consult the filter first, which rejects most absent keys with a single
+    /// filter block read instead of walking the bucket's overflow chain.
+    /// 10 bits per key result in a false positive rate of about 1%.
+    ///
+    /// Erased keys remain in the filter until it is rebuilt, which happens when
+    /// the number of insertions exceeds its capacity (it is then resized for twice
+    /// the current number of values). Rebuilding the filter visits all values in the table.
+    ///
+    /// The state of the filter lives in a separate anchor (`raw_hash_table::filter_anchor`)
+    /// that must be passed to the table's constructor, the table's own anchor is not affected.
+    /// This setting can be changed for an existing table (as long as the filter anchor is passed):
+    /// the filter is built (or freed) when the table is opened.
+    u32 filter_bits_per_key = 0;
+
+    /// When true, every bucket node stores the full 64-bit hash of each of its values
+    /// in an array in front of the values. Lookups then search the sorted hashes directly
+    /// and only derive and compare keys for entries with a matching hash, instead of
+    /// invoking `derive_key` and `key_hash` for every visited entry.
+    /// Growing and shrinking the table do not have to rehash the moved values either.
+    /// Most effective when the key callbacks are expensive, e.g. for variable length keys
+    /// that must be loaded from elsewhere. Costs 8 bytes per value, which reduces
+    /// the capacity of a bucket.
+    ///
+    /// This setting changes the on-disk format of bucket nodes: it must not be changed
+    /// for an existing table.
+    bool store_hashes = false;
+
+    /// The table grows (by splitting one bucket at a time) while the average fill factor
+    /// of its primary buckets is above this value. Must be > 0. Values greater than 1
+    /// are allowed: they trade longer overflow chains for fewer primary buckets.
+    double max_fill_factor = 0.8;
+
+    /// The table shrinks (by merging one bucket at a time) while the average fill factor
+    /// of its primary buckets is below this value. Must be smaller than `max_fill_factor`.
+    /// A value of 0 disables shrinking: the buckets of a table are then only freed by `clear()`.
+    ///
+    /// Every split or merge moves the values of a bucket. The gap between both factors
+    /// determines how many values must be erased before a grown table shrinks again,
+    /// so workloads that alternate between insertion and erasure phases should use
+    /// a wide gap (or disable shrinking) to avoid undoing the work of the previous phase.
+    ///
+    /// The fill factor bounds can be changed for an existing table.
+    double min_fill_factor = 0.5;
+};
+
+/// Implements bulk loading for hash tables.
+class raw_hash_table_loader {
+public:
+    raw_hash_table_loader() = delete;
+    ~raw_hash_table_loader();
+
+    // Not copyable.
+    raw_hash_table_loader(const raw_hash_table_loader&) = delete;
+    raw_hash_table_loader& operator=(const raw_hash_table_loader&) = delete;
+
+    raw_hash_table_loader(raw_hash_table_loader&&) noexcept;
+    raw_hash_table_loader& operator=(raw_hash_table_loader&&) noexcept;
+
+    /// Insert a single new value into the table.
+    /// Values with a key that already exists in the table are ignored.
+    void insert(const byte* value);
+
+    /// Insert a number of values (in any order) into the table.
+    /// Values with a key that already exists in the table are ignored.
+    ///
+    /// \warning count is the number of values, *NOT* the number of bytes.
+    void insert(const byte* values, size_t count);
+
+    /// Finalizes the loading procedure. All remaining values will be inserted
+    /// and no more values can be inserted using this loader.
+    void finish();
+
+    /// Discard all values inserted into this loader (finish() must not have been called).
+    /// Frees all allocated blocks, the table will be empty again.
+    void discard();
+
+private:
+    friend class raw_hash_table;
+
+    raw_hash_table_loader(std::unique_ptr<detail::raw_hash_table_loader_impl> impl);
+
+private:
+    detail::raw_hash_table_loader_impl& impl() const;
+
+private:
+    std::unique_ptr<detail::raw_hash_table_loader_impl> m_impl;
 };
 
 /**
@@ -104,15 +197,28 @@ struct raw_hash_table_options {
  * It is therefore crucial that those bits are somewhat uniformly distributed.
  *
  * The FNV-1A hash function has shown good results even for integer keys (it is the default
- * for hash_table<...>).
+ * for hash_table<...>). The \ref fast_hasher is considerably faster, especially for integers
+ * and large keys. Note that the hash function cannot be changed for an existing table.
  */
 class raw_hash_table {
 public:
     using anchor = detail::raw_hash_table_anchor;
+    using filter_anchor = bloom_filter_anchor;
+    using loader = raw_hash_table_loader;
 
 public:
+    /// Constructs the table rooted at the existing anchor.
+    ///
+    /// \throws bad_argument If `options.filter_bits_per_key` is not 0
+    ///         (key filters require a filter anchor, see below).
     raw_hash_table(anchor_handle<anchor> anc, const raw_hash_table_options& options,
                    allocator& alloc);
+
+    /// Constructs the table rooted at the existing anchor. The key filter
+    /// (see `raw_hash_table_options::filter_bits_per_key`) is stored in `filter_anc`,
+    /// which must be passed every time the table is opened.
+    raw_hash_table(anchor_handle<anchor> anc, anchor_handle<filter_anchor> filter_anc,
+                   const raw_hash_table_options& options, allocator& alloc);
     ~raw_hash_table();
 
     raw_hash_table(raw_hash_table&& other) noexcept;
@@ -121,6 +227,26 @@ public:
     engine& get_engine() const;
     allocator& get_allocator() const;
 
+    /// Creates a bulk loading object for this table, which must be empty.
+    /// All primary buckets required for `expected_size` values are allocated immediately,
+    /// so the table does not have to grow (and split its buckets) while loading.
+    /// Values can be inserted in any order: the loader collects them in large batches
+    /// and inserts every batch sorted by bucket, which turns the writes into a mostly
+    /// sequential pass over the bucket storage.
+    ///
+    /// Inserting more than `expected_size` values is allowed, the table will grow as usual.
+    /// The table must not be modified by other means until the loader is finished.
+    loader bulk_load(u64 expected_size);
+
+    /// Grows the table until it has enough primary buckets for `expected_size` values
+    /// (according to `raw_hash_table_options::max_fill_factor`), so that inserting
+    /// up to that many values does not split any buckets.
+    /// Does nothing if the table is already large enough.
+    ///
+    /// \note Unless shrinking is disabled (see `raw_hash_table_options::min_fill_factor`),
+    /// erasing values from a table that is sparse after this call shrinks it again.
+    void reserve(u64 expected_size);
+
     /// Returns the size (in bytes) of every value in the table.
     u32 value_size() const;
 
@@ -150,6 +276,14 @@ public:
     /// Returns the average fill factor of this table's primary buckets.
     double fill_factor() const;
 
+    /// Returns true if the table maintains a filter over its keys
+    /// (see `raw_hash_table_options::filter_bits_per_key`).
+    bool filtered() const;
+
+    /// Returns true if bucket nodes store the hashes of their values
+    /// (see `raw_hash_table_options::store_hashes`).
+    bool stores_hashes() const;
+
     /// Returns the total size of this datastructure on disk, in bytes.
     u64 byte_size() const;
 
@@ -168,6 +302,17 @@ public:
     /// TODO Output parameter unnecessary once we have cursors.
     bool find(const byte* key, byte* value) const;
 
+    /// Looks up `count` keys (stored contiguously, `key_size()` bytes each) at once.
+    /// If `keys[i]` was found, its value is copied to `values + i * value_size()` and
+    /// `found[i]` is set to true, otherwise `found[i]` is set to false.
+    /// Returns the number of keys that were found.
+    ///
+    /// All keys are hashed first and the lookups are sorted by the address of their bucket.
+    /// Buckets are then read in ascending order while the buckets of the next few lookups
+    /// are prefetched (if supported by the engine), so that their reads can overlap.
+    /// Keys in the same bucket only read that bucket once.
+    u64 find_many(const byte* keys, size_t count, byte* values, bool* found) const;
+
     /// Attempts to find the value associated with the given compatible key and stores
     /// it in the provided `value` buffer, which must have `value_size()` writable bytes.
     ///
@@ -227,6 +372,40 @@ public:
         iterate(+callback, reinterpret_cast<void*>(std::addressof(fn)));
     }
 
+    /// Performs a single step of a resumable scan over the values of this table.
+    /// A scan is started with `cursor == 0`. Every call visits complete buckets, starting
+    /// with the bucket identified by `cursor`, until at least `count` values have
+    /// been visited (at least one bucket is always visited). The `iter_func` function is called
+    /// for every visited value. The returned cursor must be passed to the next step,
+    /// the scan is complete when 0 is returned.
+    ///
+    /// Cursors are plain integers that can be stored anywhere (e.g. to resume a scan
+    /// after the table has been reopened). Unlike `iterate()`, the table may be modified
+    /// between the steps of a scan: every value that is present during the entire scan
+    /// is visited at least once. Values that are inserted or erased in the meantime
+    /// may or may not be visited. Values may be visited more than once if the table shrinks
+    /// between two steps.
+    ///
+    /// This works because buckets are visited in the bit-reversed order of the hash bits
+    /// that select them (like Redis' SCAN command): splitting or merging a bucket
+    /// never moves values from the unvisited part of the table into the visited part.
+    ///
+    /// If `iter_func` returns `iteration_control::stop`, the step ends early and
+    /// the returned cursor points to the current bucket (which will be visited again
+    /// from the start).
+    u64 scan(u64 cursor, u64 count,
+             iteration_control (*iter_func)(const byte* value, void* user_data),
+             void* user_data = nullptr) const;
+
+    template<typename IterFunc>
+    u64 scan(u64 cursor, u64 count, IterFunc&& fn) const {
+        auto callback = [](const byte* value, void* user_data) -> iteration_control {
+            IterFunc& fn_ref = *reinterpret_cast<IterFunc*>(user_data);
+            return fn_ref(value);
+        };
+        return scan(cursor, count, +callback, reinterpret_cast<void*>(std::addressof(fn)));
+    }
+
     /// Removes all data from this table. After this operation completes, the table
     /// will not occupy any space on disk.
     /// \post `empty() && byte_size() == 0`.
@@ -318,6 +497,9 @@ public:
         friend binary_format_access;
     };
 
+    /// Anchor of the key filter (optional, see `raw_hash_table_options::filter_bits_per_key`).
+    using filter_anchor = raw_hash_table::filter_anchor;
+
     // TODO Rethink node visitation API, it's awkward.
     class node_view {
     public:
@@ -348,17 +530,87 @@ public:
         const raw_hash_table::node_view& m_inner;
     };
 
+    /// Implements bulk loading for hash tables.
+    class loader {
+    public:
+        loader() = delete;
+        loader(loader&&) noexcept = default;
+        loader& operator=(loader&&) noexcept = default;
+
+        /// Insert a single new value into the table.
+        /// Values with a key that already exists in the table are ignored.
+        void insert(const value_type& value) {
+            auto buffer = serialize_to_buffer(value);
+            m_inner.insert(buffer.data());
+        }
+
+        /// Insert a number of values (in any order) into the table.
+        /// Values with a key that already exists in the table are ignored.
+        template<typename InputIter>
+        void insert(const InputIter& begin, const InputIter& end) {
+            for (auto i = begin; i != end; ++i) {
+                insert(*i);
+            }
+        }
+
+        /// Finalizes the loading procedure. All remaining values will be inserted
+        /// and no more values can be inserted using this loader.
+        void finish() { m_inner.finish(); }
+
+        /// Discard all values inserted into this loader (finish() must not have been called).
+        /// Frees all allocated blocks, the table will be empty again.
+        void discard() { m_inner.discard(); }
+
+    private:
+        friend class hash_table;
+
+        loader(raw_hash_table::loader&& inner)
+            : m_inner(std::move(inner)) {}
+
+    private:
+        raw_hash_table::loader m_inner;
+    };
+
 public:
     explicit hash_table(anchor_handle<anchor> anchor_, allocator& alloc_,
                         DeriveKey derive_key = DeriveKey(), KeyHash key_hash = KeyHash(),
                         KeyEqual key_equal = KeyEqual())
+        : hash_table(std::move(anchor_), alloc_, raw_hash_table_options(), std::move(derive_key),
+                     std::move(key_hash), std::move(key_equal)) {}
+
+    /// Constructs the table rooted at the existing anchor, using the tuning
+    /// settings in `settings` (e.g. `max_fill_factor`). The value size, the key size
+    /// and the callbacks in `settings` are ignored, they are provided by this class.
+    /// Key filters require a filter anchor, use the constructor below to enable them.
+    explicit hash_table(anchor_handle<anchor> anchor_, allocator& alloc_,
+                        const raw_hash_table_options& settings, DeriveKey derive_key = DeriveKey(),
+                        KeyHash key_hash = KeyHash(), KeyEqual key_equal = KeyEqual())
+        : hash_table(std::move(anchor_), anchor_handle<filter_anchor>(), alloc_, settings,
+                     std::move(derive_key), std::move(key_hash), std::move(key_equal)) {}
+
+    /// Constructs the table rooted at the existing anchor, with the key filter
+    /// stored in `filter_anchor_` (see `raw_hash_table_options::filter_bits_per_key`).
+    /// The filter anchor must be passed every time the table is opened.
+    explicit hash_table(anchor_handle<anchor> anchor_, anchor_handle<filter_anchor> filter_anchor_,
+                        allocator& alloc_, const raw_hash_table_options& settings,
+                        DeriveKey derive_key = DeriveKey(), KeyHash key_hash = KeyHash(),
+                        KeyEqual key_equal = KeyEqual())
         : m_state(std::make_unique<state_t>(std::move(derive_key), std::move(key_hash),
                                             std::move(key_equal)))
-        , m_inner(std::move(anchor_).template member<&anchor::table>(), make_options(), alloc_) {}
+        , m_inner(std::move(anchor_).template member<&anchor::table>(),
+                  std::move(filter_anchor_), make_options(settings), alloc_) {}
 
     engine& get_engine() const { return m_inner.get_engine(); }
     allocator& get_allocator() const { return m_inner.get_allocator(); }
 
+    /// Creates a bulk loading object for this table, which must be empty.
+    /// See raw_hash_table::bulk_load().
+    loader bulk_load(u64 expected_size) { return loader(m_inner.bulk_load(expected_size)); }
+
+    /// Grows the table until it has enough primary buckets for `expected_size` values.
+    /// See raw_hash_table::reserve().
+    void reserve(u64 expected_size) { m_inner.reserve(expected_size); }
+
     /// Returns the size (in bytes) of every value in the table.
     static constexpr u32 value_size() { return serialized_size<value_type>(); }
 
@@ -388,6 +640,14 @@ public:
     /// Returns the average fill factor of this table's primary buckets.
     double fill_factor() const { return m_inner.fill_factor(); }
 
+    /// Returns true if the table maintains a filter over its keys
+    /// (see `raw_hash_table_options::filter_bits_per_key`).
+    bool filtered() const { return m_inner.filtered(); }
+
+    /// Returns true if bucket nodes store the hashes of their values
+    /// (see `raw_hash_table_options::store_hashes`).
+    bool stores_hashes() const { return m_inner.stores_hashes(); }
+
     /// Returns the total size of this datastructure on disk, in bytes.
     u64 byte_size() const { return m_inner.byte_size(); }
 
@@ -413,6 +673,31 @@ public:
         return false;
     }
 
+    /// Looks up all keys in `[begin, end)`. The result contains the value
+    /// for every key (in the same order), or an empty optional if the key was not found.
+    /// See raw_hash_table::find_many().
+    template<typename InputIter>
+    std::vector<std::optional<value_type>> find_many(const InputIter& begin,
+                                                     const InputIter& end) const {
+        std::vector<byte> keys;
+        for (auto i = begin; i != end; ++i) {
+            auto key = serialize_to_buffer(*i);
+            keys.insert(keys.end(), key.begin(), key.end());
+        }
+
+        const size_t count = keys.size() / key_size();
+        std::vector<byte> values(count * value_size());
+        std::unique_ptr<bool[]> found(new bool[count]);
+        m_inner.find_many(keys.data(), count, values.data(), found.get());
+
+        std::vector<std::optional<value_type>> result(count);
+        for (size_t i = 0; i < count; ++i) {
+            if (found[i])
+                result[i] = deserialize<value_type>(values.data() + i * value_size());
+        }
+        return result;
+    }
+
     template<typename CompatibleKeyType, typename CompatibleKeyHash, typename CompatibleKeyEquals>
     bool find_compatible(const CompatibleKeyType& key, const CompatibleKeyHash& hash,
                          const CompatibleKeyEquals& equals, value_type& value) const {
@@ -469,6 +754,17 @@ public:
         });
     }
 
+    /// Performs a single step of a resumable scan over the values of this table.
+    /// Start with `cursor == 0` and pass the returned cursor to the next step,
+    /// the scan is complete when 0 is returned. See raw_hash_table::scan().
+    template<typename IterFunc>
+    u64 scan(u64 cursor, u64 count, IterFunc&& fn) const {
+        return m_inner.scan(cursor, count, [&](const byte* raw_value) {
+            value_type value = deserialize<value_type>(raw_value);
+            return fn(value);
+        });
+    }
+
     template<typename VisitFunc>
     void visit(VisitFunc&& fn) const {
         m_inner.visit(
@@ -549,8 +845,8 @@ private:
         return compatible_equals_wrapper<CompatibleKey, CompatibleKeyEquals>(equals);
     }
 
-    raw_hash_table_options make_options() {
-        raw_hash_table_options options;
+    raw_hash_table_options make_options(const raw_hash_table_options& settings) {
+        raw_hash_table_options options = settings;
         options.value_size = value_size();
         options.key_size = key_size();
         options.user_data = m_state.get();
@@ -0,0 +1,563 @@
+#ifndef PREQUEL_CONTAINER_MULTI_BTREE_HPP
+#define PREQUEL_CONTAINER_MULTI_BTREE_HPP
+
+#include <prequel/anchor_handle.hpp>
+#include <prequel/binary_format.hpp>
+#include <prequel/block_index.hpp>
+#include <prequel/container/allocator.hpp>
+#include <prequel/container/btree.hpp>
+#include <prequel/defs.hpp>
+#include <prequel/engine.hpp>
+#include <prequel/serialization.hpp>
+
+#include <memory>
+#include <ostream>
+
+namespace prequel {
+
+class raw_multi_btree;
+class raw_multi_btree_cursor;
+
+namespace detail {
+
+class raw_multi_btree_impl;
+
+/// Serialized state of a multi_btree instance.
+struct raw_multi_btree_anchor {
+    /// The tree that contains one entry (and posting list) for every distinct key.
+    raw_btree_anchor tree;
+
+    /// Total number of values in the tree (including duplicates).
+    u64 size = 0;
+
+    /// Number of blocks allocated for posting lists that are stored out-of-line.
+    u64 overflow_blocks = 0;
+
+    static constexpr auto get_binary_format() {
+        using self = raw_multi_btree_anchor;
+        return binary_format(&self::tree, &self::size, &self::overflow_blocks);
+    }
+};
+
+} // namespace detail
+
+using raw_multi_btree_anchor = detail::raw_multi_btree_anchor;
+
+/// A group of properties required to configure a multi_btree instance.
+/// The parameters must be semantically equivalent whenever the
+/// tree is (re-) opened.
+struct raw_multi_btree_options {
+    /// Size of a key, in bytes. Must be > 0.
+    u32 key_size = 0;
+
+    /// Size of a value, in bytes. Must be > 0.
+    u32 value_size = 0;
+
+    /// Posting lists with up to this many values are stored directly in the leaf nodes of the tree.
+    /// Longer lists are moved to a chain of overflow blocks.
+    ///
+    /// Every entry in a leaf reserves space for this many values, so this
+    /// number should be chosen with the typical number of duplicates in mind.
+    /// A leaf node must be able to store at least 4 entries.
+    /// When set to 0, the largest possible number will be used.
+    u32 max_inline_values = 0;
+
+    /// Passed to all callbacks as the last argument.
+    /// Can remain null.
+    void* user_data = nullptr;
+
+    /// Returns true if `left_key` is less than `right_key`. Both byte buffers
+    /// contain keys and have size `key_size`.
+    bool (*key_less)(const byte* left_key, const byte* right_key, void* user_data) = nullptr;
+};
+
+/// Cursors are used to traverse the (key, value) pairs in a multi_btree.
+/// All values of a key are visited before moving on to the next key.
+///
+/// A cursor is invalidated when the values of its current key are modified; it
+/// must be repositioned (e.g. using `find()`) before it can be used again.
+/// Modifications of other keys do not affect the cursor.
+class raw_multi_btree_cursor {
+public:
+    raw_multi_btree_cursor() = default;
+
+public:
+    /// Returns a pointer to the current key.
+    /// The returned pointer has exactly `key_size` readable bytes.
+    /// Throws an exception if the cursor does not currently point to a valid entry.
+    const byte* key() const;
+
+    /// Returns a pointer to the current value.
+    /// The returned pointer has exactly `value_size` readable bytes and remains
+    /// valid until the cursor is moved.
+    /// Throws an exception if the cursor does not currently point to a valid entry.
+    const byte* value() const;
+
+    /// Returns the number of values associated with the current key.
+    /// Throws an exception if the cursor does not currently point to a valid entry.
+    u64 duplicates() const;
+
+    /// Returns the position of the current value among the values of the current key,
+    /// i.e. a number in `[0, duplicates())`.
+    u64 duplicate_index() const { return m_index; }
+
+    /// True iff this cursor has been positioned at the end of the tree,
+    /// in which case it does not point to a valid entry.
+    bool at_end() const { return m_inner.at_end(); }
+
+    /// Equivalent to `!at_end()`.
+    explicit operator bool() const { return !at_end(); }
+
+    /// Reset the iterator. `at_end()` will return true.
+    void reset();
+
+    /// Move this cursor to the first value of the smallest key in the tree.
+    bool move_min();
+
+    /// Move this cursor to the last value of the largest key in the tree.
+    bool move_max();
+
+    /// Move this cursor to the next value. Moves to the first value
+    /// of the next key once all values of the current key have been visited.
+    bool move_next();
+
+    /// Move this cursor to the previous value. Moves to the last value
+    /// of the previous key once all values of the current key have been visited.
+    bool move_prev();
+
+    /// Move this cursor to the first value of the next key.
+    bool move_next_key();
+
+    /// Move this cursor to the first value of the previous key.
+    bool move_prev_key();
+
+    /// Seeks to the first value of the first key `>= key`.
+    /// Returns true if such an entry was found. Returns false and becomes invalid otherwise.
+    bool lower_bound(const byte* key);
+
+    /// Seeks to the first value of the first key `> key`.
+    /// Returns true if such an entry was found. Returns false and becomes invalid otherwise.
+    bool upper_bound(const byte* key);
+
+    /// Seeks to the first value of the given key.
+    /// Returns true if such an entry was found. Returns false and becomes invalid otherwise.
+    bool find(const byte* key);
+
+    bool operator==(const raw_multi_btree_cursor& other) const {
+        return m_inner == other.m_inner && m_index == other.m_index;
+    }
+    bool operator!=(const raw_multi_btree_cursor& other) const { return !(*this == other); }
+
+private:
+    friend raw_multi_btree;
+
+    // Positions the cursor at the first (or last) value of the inner cursor's entry.
+    raw_multi_btree_cursor(detail::raw_multi_btree_impl* tree, raw_btree::cursor inner,
+                           bool last = false);
+
+    detail::raw_multi_btree_impl& tree() const;
+
+    // Positions the cursor at the first (or last) value of the current entry.
+    bool seek_entry(bool found, bool last = false);
+
+private:
+    detail::raw_multi_btree_impl* m_tree = nullptr;
+    raw_btree::cursor m_inner;
+
+    // Index of the current value among the key's values.
+    u64 m_index = 0;
+
+    // The overflow block that contains the current value (if the values are not inline).
+    block_handle m_block;
+};
+
+/**
+ * An ordered index that maps fixed size keys to one or more fixed size values.
+ *
+ * Every distinct key is stored exactly once, together with its posting list (the
+ * list of values associated with that key). Short posting lists are stored inline
+ * in the btree's leaf nodes, see `raw_multi_btree_options::max_inline_values`.
+ * Longer posting lists are moved to a doubly linked chain of densely packed overflow blocks
+ * (only the last block of a chain may be partially filled).
+ *
+ * The order of the values within a posting list is unspecified.
+ * Values are compared bytewise when they are searched for (e.g. by `erase()`).
+ */
+class raw_multi_btree {
+public:
+    using anchor = raw_multi_btree_anchor;
+    using cursor = raw_multi_btree_cursor;
+
+    using cursor_seek_t = raw_btree::cursor_seek_t;
+
+    static constexpr cursor_seek_t seek_none = raw_btree::seek_none;
+    static constexpr cursor_seek_t seek_min = raw_btree::seek_min;
+    static constexpr cursor_seek_t seek_max = raw_btree::seek_max;
+
+public:
+    /// Constructs the tree rooted at the existing anchor.
+    /// The options must be equivalent every time the tree is opened;
+    /// they are not persisted to disk.
+    raw_multi_btree(anchor_handle<anchor> _anchor, const raw_multi_btree_options& options,
+                    allocator& alloc);
+    ~raw_multi_btree();
+
+    raw_multi_btree(raw_multi_btree&& other) noexcept;
+    raw_multi_btree& operator=(raw_multi_btree&& other) noexcept;
+
+    raw_multi_btree(const raw_multi_btree&) = delete;
+    raw_multi_btree& operator=(const raw_multi_btree&) = delete;
+
+    engine& get_engine() const;
+    allocator& get_allocator() const;
+
+    /// Returns the size (in bytes) of every key in the tree.
+    u32 key_size() const;
+
+    /// Returns the size (in bytes) of every value in the tree.
+    u32 value_size() const;
+
+    /// Returns the maximum number of values of a key that are stored inline.
+    u32 max_inline_values() const;
+
+    /// Returns the maximum number of values in an overflow block.
+    u32 overflow_block_capacity() const;
+
+    /// Returns true if the tree is empty.
+    bool empty() const;
+
+    /// Returns the number of values in this tree (including duplicates).
+    u64 size() const;
+
+    /// Returns the number of distinct keys in this tree.
+    u64 keys() const;
+
+    /// Returns the height of the underlying btree.
+    u32 height() const;
+
+    /// Returns the number of nodes of the underlying btree.
+    u64 nodes() const;
+
+    /// Returns the number of blocks allocated for out-of-line posting lists.
+    u64 overflow_blocks() const;
+
+    /// The size of this datastructure in bytes (not including the anchor).
+    u64 byte_size() const;
+
+    /// Create a new cursor and seek it to the specified position.
+    cursor create_cursor(cursor_seek_t seek = seek_none) const;
+
+    /// Seek to the first value of the given key. The cursor will be invalid
+    /// if the key was not found.
+    cursor find(const byte* key) const;
+
+    /// Seek to the first value of the smallest key `lb` with `lb >= key`.
+    /// The cursor will be invalid if no such key exists within this tree.
+    cursor lower_bound(const byte* key) const;
+
+    /// Seek to the first value of the smallest key `lb` with `lb > key`.
+    /// The cursor will be invalid if no such key exists within this tree.
+    cursor upper_bound(const byte* key) const;
+
+    /// Returns the number of values associated with the given key.
+    u64 count(const byte* key) const;
+
+    /// Returns true if the (key, value) pair exists within the tree.
+    bool contains(const byte* key, const byte* value) const;
+
+    /// Adds the value to the values of the given key. Duplicate (key, value)
+    /// pairs are permitted.
+    void insert(const byte* key, const byte* value);
+
+    /// Removes one occurrence of the (key, value) pair from the tree.
+    /// Returns true if such a pair existed.
+    bool erase(const byte* key, const byte* value);
+
+    /// Removes all values of the given key from the tree.
+    /// Returns the number of removed values.
+    u64 erase_all(const byte* key);
+
+    /// Removes all entries from this tree.
+    /// \post `empty()`.
+    void clear();
+
+    /// Removes all data from this tree. After this operation completes,
+    /// the tree will not occupy any space on disk.
+    /// \post `empty() && byte_size() == 0`.
+    void reset();
+
+    /// Prints debugging information to the output stream.
+    void dump(std::ostream& os) const;
+
+    /// Perform validation of the tree's structure (including the
+    /// out-of-line posting lists).
+    void validate() const;
+
+private:
+    detail::raw_multi_btree_impl& impl() const;
+
+private:
+    std::unique_ptr<detail::raw_multi_btree_impl> m_impl;
+};
+
+/**
+ * An ordered index that maps keys of type `Key` to one or more values of type `Value`.
+ * Keys must be comparable using `<` (which can be overwritten
+ * by specifying the `KeyLess` parameter). Values are compared by their
+ * serialized representation.
+ *
+ * See \ref raw_multi_btree for a description of the storage format.
+ */
+template<typename Key, typename Value, typename KeyLess = std::less<>>
+class multi_btree {
+public:
+    using key_type = Key;
+    using value_type = Value;
+
+public:
+    class anchor {
+        raw_multi_btree::anchor tree;
+
+        static constexpr auto get_binary_format() { return binary_format(&anchor::tree); }
+
+        friend multi_btree;
+        friend binary_format_access;
+    };
+
+public:
+    /// Cursors are used to traverse the (key, value) pairs in a multi_btree.
+    class cursor {
+    public:
+        cursor() = default;
+
+        /// Returns the current key.
+        key_type key() const { return deserialize<key_type>(m_inner.key()); }
+
+        /// Returns the current value.
+        value_type value() const { return deserialize<value_type>(m_inner.value()); }
+
+        /// Returns the number of values associated with the current key.
+        u64 duplicates() const { return m_inner.duplicates(); }
+
+        /// Returns the position of the current value among the values of the current key.
+        u64 duplicate_index() const { return m_inner.duplicate_index(); }
+
+        /// True iff this cursor has been positioned at the end of the tree,
+        /// in which case it does not point to a valid entry.
+        bool at_end() const { return m_inner.at_end(); }
+
+        /// Equivalent to `!at_end()`.
+        explicit operator bool() const { return static_cast<bool>(m_inner); }
+
+        /// Reset the iterator. `at_end()` will return true.
+        void reset() { m_inner.reset(); }
+
+        /// Move this cursor to the first value of the smallest key in the tree.
+        void move_min() { m_inner.move_min(); }
+
+        /// Move this cursor to the last value of the largest key in the tree.
+        void move_max() { m_inner.move_max(); }
+
+        /// Move this cursor to the next value.
+        void move_next() { m_inner.move_next(); }
+
+        /// Move this cursor to the previous value.
+        void move_prev() { m_inner.move_prev(); }
+
+        /// Move this cursor to the first value of the next key.
+        void move_next_key() { m_inner.move_next_key(); }
+
+        /// Move this cursor to the first value of the previous key.
+        void move_prev_key() { m_inner.move_prev_key(); }
+
+        /// Seeks to the first value of the first key `>= key`.
+        bool lower_bound(const key_type& key) {
+            auto buffer = serialize_to_buffer(key);
+            return m_inner.lower_bound(buffer.data());
+        }
+
+        /// Seeks to the first value of the first key `> key`.
+        bool upper_bound(const key_type& key) {
+            auto buffer = serialize_to_buffer(key);
+            return m_inner.upper_bound(buffer.data());
+        }
+
+        /// Seeks to the first value of the given key.
+        bool find(const key_type& key) {
+            auto buffer = serialize_to_buffer(key);
+            return m_inner.find(buffer.data());
+        }
+
+        bool operator==(const cursor& other) const { return m_inner == other.m_inner; }
+        bool operator!=(const cursor& other) const { return m_inner != other.m_inner; }
+
+    private:
+        friend class multi_btree;
+
+        cursor(raw_multi_btree::cursor&& inner)
+            : m_inner(std::move(inner)) {}
+
+    private:
+        raw_multi_btree::cursor m_inner;
+    };
+
+    using cursor_seek_t = raw_multi_btree::cursor_seek_t;
+
+    static constexpr cursor_seek_t seek_none = raw_multi_btree::seek_none;
+    static constexpr cursor_seek_t seek_min = raw_multi_btree::seek_min;
+    static constexpr cursor_seek_t seek_max = raw_multi_btree::seek_max;
+
+public:
+    /// Constructs the tree rooted at the existing anchor.
+    /// Up to `max_inline_values` values of a key are stored inline (0 means: as many as possible).
+    /// `max_inline_values` must be equivalent every time the tree is opened.
+    explicit multi_btree(anchor_handle<anchor> anchor_, allocator& alloc_,
+                         u32 max_inline_values = 0, KeyLess less = KeyLess())
+        : m_state(std::make_unique<state_t>(std::move(less)))
+        , m_inner(std::move(anchor_).template member<&anchor::tree>(),
+                  make_options(max_inline_values), alloc_) {}
+
+    engine& get_engine() const { return m_inner.get_engine(); }
+    allocator& get_allocator() const { return m_inner.get_allocator(); }
+
+    /// Returns the size of a serialized key. This is a compile-time constant.
+    static constexpr u32 key_size() { return serialized_size<key_type>(); }
+
+    /// Returns the size of a serialized value. This is a compile-time constant.
+    static constexpr u32 value_size() { return serialized_size<value_type>(); }
+
+    /// Returns the maximum number of values of a key that are stored inline.
+    u32 max_inline_values() const { return m_inner.max_inline_values(); }
+
+    /// Returns the maximum number of values in an overflow block.
+    u32 overflow_block_capacity() const { return m_inner.overflow_block_capacity(); }
+
+    /// Returns true if the tree is empty.
+    bool empty() const { return m_inner.empty(); }
+
+    /// Returns the number of values in this tree (including duplicates).
+    u64 size() const { return m_inner.size(); }
+
+    /// Returns the number of distinct keys in this tree.
+    u64 keys() const { return m_inner.keys(); }
+
+    /// Returns the height of the underlying btree.
+    u32 height() const { return m_inner.height(); }
+
+    /// Returns the number of nodes of the underlying btree.
+    u64 nodes() const { return m_inner.nodes(); }
+
+    /// Returns the number of blocks allocated for out-of-line posting lists.
+    u64 overflow_blocks() const { return m_inner.overflow_blocks(); }
+
+    /// The size of this datastructure in bytes (not including the anchor).
+    u64 byte_size() const { return m_inner.byte_size(); }
+
+    /// Create a new cursor and seek it to the specified position.
+    cursor create_cursor(cursor_seek_t seek = seek_none) const {
+        return cursor(m_inner.create_cursor(seek));
+    }
+
+    /// Seek to the first value of the given key.
+    cursor find(const key_type& key) const {
+        auto buffer = serialize_to_buffer(key);
+        return cursor(m_inner.find(buffer.data()));
+    }
+
+    /// Seek to the first value of the smallest key `lb` with `lb >= key`.
+    cursor lower_bound(const key_type& key) const {
+        auto buffer = serialize_to_buffer(key);
+        return cursor(m_inner.lower_bound(buffer.data()));
+    }
+
+    /// Seek to the first value of the smallest key `lb` with `lb > key`.
+    cursor upper_bound(const key_type& key) const {
+        auto buffer = serialize_to_buffer(key);
+        return cursor(m_inner.upper_bound(buffer.data()));
+    }
+
+    /// Returns the number of values associated with the given key.
+    u64 count(const key_type& key) const {
+        auto buffer = serialize_to_buffer(key);
+        return m_inner.count(buffer.data());
+    }
+
+    /// Returns true if the (key, value) pair exists within the tree.
+    bool contains(const key_type& key, const value_type& value) const {
+        auto key_buffer = serialize_to_buffer(key);
+        auto value_buffer = serialize_to_buffer(value);
+        return m_inner.contains(key_buffer.data(), value_buffer.data());
+    }
+
+    /// Adds the value to the values of the given key.
+    void insert(const key_type& key, const value_type& value) {
+        auto key_buffer = serialize_to_buffer(key);
+        auto value_buffer = serialize_to_buffer(value);
+        m_inner.insert(key_buffer.data(), value_buffer.data());
+    }
+
+    /// Removes one occurrence of the (key, value) pair from the tree.
+    /// Returns true if such a pair existed.
+    bool erase(const key_type& key, const value_type& value) {
+        auto key_buffer = serialize_to_buffer(key);
+        auto value_buffer = serialize_to_buffer(value);
+        return m_inner.erase(key_buffer.data(), value_buffer.data());
+    }
+
+    /// Removes all values of the given key from the tree.
+    /// Returns the number of removed values.
+    u64 erase_all(const key_type& key) {
+        auto buffer = serialize_to_buffer(key);
+        return m_inner.erase_all(buffer.data());
+    }
+
+    /// Removes all entries from this tree.
+    void clear() { m_inner.clear(); }
+
+    /// Removes all data from this tree.
+    void reset() { m_inner.reset(); }
+
+    /// Prints debugging information to the output stream.
+    void dump(std::ostream& os) const { m_inner.dump(os); }
+
+    /// Perform validation of the tree's structure.
+    void validate() const { m_inner.validate(); }
+
+    /// Returns the raw tree.
+    const raw_multi_btree& raw() const { return m_inner; }
+
+private:
+    raw_multi_btree_options make_options(u32 max_inline_values) {
+        raw_multi_btree_options options;
+        options.key_size = key_size();
+        options.value_size = value_size();
+        options.max_inline_values = max_inline_values;
+        options.user_data = m_state.get();
+        options.key_less = key_less;
+        return options;
+    }
+
+    static bool key_less(const byte* lhs_buffer, const byte* rhs_buffer, void* user_data) {
+        const state_t* state = reinterpret_cast<const state_t*>(user_data);
+        key_type lhs = deserialize<key_type>(lhs_buffer);
+        key_type rhs = deserialize<key_type>(rhs_buffer);
+        return state->m_less(lhs, rhs);
+    }
+
+private:
+    // Allocated on the heap for stable addresses (user data pointer in raw_multi_btree).
+    struct state_t {
+        KeyLess m_less;
+
+        state_t(KeyLess&& less)
+            : m_less(std::move(less)) {}
+    };
+
+private:
+    std::unique_ptr<state_t> m_state;
+    raw_multi_btree m_inner;
+};
+
+} // namespace prequel
+
+#endif // PREQUEL_CONTAINER_MULTI_BTREE_HPP
@@ -0,0 +1,338 @@
+#ifndef PREQUEL_CONTAINER_PRIORITY_QUEUE_HPP
+#define PREQUEL_CONTAINER_PRIORITY_QUEUE_HPP
+
+#include <prequel/anchor_handle.hpp>
+#include <prequel/binary_format.hpp>
+#include <prequel/container/allocator.hpp>
+#include <prequel/container/array.hpp>
+#include <prequel/defs.hpp>
+#include <prequel/engine.hpp>
+#include <prequel/serialization.hpp>
+
+#include <functional>
+#include <memory>
+#include <ostream>
+
+namespace prequel {
+
+namespace detail {
+
+class raw_priority_queue_impl;
+
+class raw_priority_queue_anchor {
+    // Number of values in the queue (buffer and runs).
+    u64 size = 0;
+
+    // Number of blocks allocated for sorted runs.
+    u64 run_blocks = 0;
+
+    // Insertion buffer, organized as a binary min-heap.
+    raw_array::anchor buffer;
+
+    // Descriptors of the sorted runs.
+    raw_array::anchor runs;
+
+    static constexpr auto get_binary_format() {
+        return binary_format(&raw_priority_queue_anchor::size,
+                             &raw_priority_queue_anchor::run_blocks,
+                             &raw_priority_queue_anchor::buffer, &raw_priority_queue_anchor::runs);
+    }
+
+    friend binary_format_access;
+    friend raw_priority_queue_impl;
+};
+
+} // namespace detail
+
+/// A group of properties required to configure a priority queue instance.
+/// The parameters must be semantically equivalent whenever the
+/// priority queue is (re-) opened.
+struct raw_priority_queue_options {
+    /// The size of a value, in bytes. Must be > 0.
+    u32 value_size = 0;
+
+    /// Passed to all callbacks as the last argument.
+    /// Can remain null.
+    void* user_data = nullptr;
+
+    /// Takes two values (`value_size` readable bytes each) and returns true iff
+    /// the left value is strictly less than the right value.
+    /// Must implement a strict weak ordering.
+    bool (*value_less)(const byte* left_value, const byte* right_value, void* user_data) = nullptr;
+
+    /// The maximum size of the insertion buffer, in blocks. Must be > 0.
+    /// Larger buffers produce longer (and therefore fewer) sorted runs.
+    u32 buffer_blocks = 16;
+};
+
+/**
+ * A priority queue for large numbers of values that supports efficient
+ * access to (and removal of) the smallest value.
+ *
+ * The queue is made up of an insertion buffer and a set of sorted runs.
+ * New values are inserted into the buffer, which is a binary heap that spans
+ * only a few blocks (see `raw_priority_queue_options::buffer_blocks`) and therefore
+ * remains in the block cache. When the buffer is full, its values are sorted
+ * and written into a new run (a linked list of blocks). Once `merge_fanout()` runs
+ * of the same level exist, they are merged into a single run of the next level.
+ * Removing the smallest value consumes either the top of the buffer or the head of a run;
+ * the head values of all runs are stored in the run descriptors, so finding the smallest value
+ * does not touch the runs themselves.
+ *
+ * Runs are only ever written and read sequentially and every value is moved at
+ * most once per level, so the amortized number of block writes per operation is
+ * about `log(n / M) / B`, where `B` is the number of values per block and `M` is the size of
+ * the buffer. Consumed run blocks are freed immediately.
+ *
+ * The order in which equal values are removed is unspecified.
+ */
+class raw_priority_queue {
+public:
+    using anchor = detail::raw_priority_queue_anchor;
+
+public:
+    /**
+     * Accesses a priority queue instance rooted at the given anchor.
+     * `options` and `alloc` must be equivalent every time the queue is loaded.
+     */
+    raw_priority_queue(anchor_handle<anchor> anc, const raw_priority_queue_options& options,
+                       allocator& alloc);
+    ~raw_priority_queue();
+
+    raw_priority_queue(raw_priority_queue&& other) noexcept;
+    raw_priority_queue& operator=(raw_priority_queue&& other) noexcept;
+
+    engine& get_engine() const;
+    allocator& get_allocator() const;
+
+    /// Returns the size (in bytes) of every value in the queue.
+    u32 value_size() const;
+
+    /// Returns the maximum number of values in the insertion buffer.
+    u64 buffer_capacity() const;
+
+    /// Returns the number of values that fit into a single block of a sorted run.
+    u32 run_block_capacity() const;
+
+    /// Returns the number of runs of the same level that are merged into a single run.
+    static u32 merge_fanout();
+
+    /// Returns true iff the queue is empty.
+    bool empty() const;
+
+    /// Returns the number of values in the queue.
+    u64 size() const;
+
+    /// Returns the number of values currently stored in the insertion buffer.
+    u64 buffer_size() const;
+
+    /// Returns the number of sorted runs.
+    u64 runs() const;
+
+    /// Returns the number of blocks allocated by the sorted runs.
+    u64 run_blocks() const;
+
+    /// Returns the total size of this datastructure on disk, in bytes.
+    u64 byte_size() const;
+
+    /// Returns the relative overhead of this queue compared to a linear file with the same values.
+    double overhead() const;
+
+    /// Copies the smallest value into the provided buffer, which must be
+    /// at least `value_size()` bytes long.
+    ///
+    /// \throws bad_operation If the queue is empty.
+    void top(byte* value) const;
+
+    /// Inserts a new value into the queue by copying `value_size()` bytes
+    /// from the provided buffer.
+    void push(const byte* value);
+
+    /// Removes the smallest value from the queue.
+    ///
+    /// \throws bad_operation If the queue is empty.
+    void pop();
+
+    /// Removes the smallest value from the queue and copies it into the provided
+    /// buffer, which must be at least `value_size()` bytes long.
+    ///
+    /// \throws bad_operation If the queue is empty.
+    void pop(byte* value);
+
+    /// Removes all values from this queue. After this operation completes, the queue
+    /// will not occupy any space on disk.
+    /// \post `empty() && byte_size() == 0`.
+    void reset();
+
+    /// Removes all values from this queue. The storage of the insertion buffer
+    /// is kept for future insertions.
+    /// \post `empty()`.
+    void clear();
+
+    /// Prints debugging information to the output stream.
+    void dump(std::ostream& os) const;
+
+    /// Perform internal consistency checks.
+    void validate() const;
+
+private:
+    detail::raw_priority_queue_impl& impl() const;
+
+private:
+    std::unique_ptr<detail::raw_priority_queue_impl> m_impl;
+};
+
+/**
+ * A priority queue for values of type `T`. The smallest value (according to `Compare`)
+ * is always at the top of the queue.
+ *
+ * See \ref raw_priority_queue for a description of the implementation.
+ */
+template<typename T, typename Compare = std::less<>>
+class priority_queue {
+public:
+    using value_type = T;
+    using size_type = u64;
+    using value_compare = Compare;
+
+public:
+    class anchor {
+        raw_priority_queue::anchor queue;
+
+        static constexpr auto get_binary_format() { return binary_format(&anchor::queue); }
+
+        friend priority_queue;
+        friend binary_format_access;
+    };
+
+public:
+    /**
+     * Accesses a priority queue instance rooted at the given anchor.
+     * `alloc`, `compare` and `buffer_blocks` must be equivalent every time the queue is loaded.
+     */
+    explicit priority_queue(anchor_handle<anchor> anchor_, allocator& alloc_,
+                            Compare compare = Compare(), u32 buffer_blocks = 16)
+        : m_state(std::make_unique<state_t>(std::move(compare)))
+        , m_inner(std::move(anchor_).template member<&anchor::queue>(), make_options(buffer_blocks),
+                  alloc_) {}
+
+    engine& get_engine() const { return m_inner.get_engine(); }
+    allocator& get_allocator() const { return m_inner.get_allocator(); }
+
+    /// Returns the size (in bytes) of every value in the queue.
+    static constexpr u32 value_size() { return serialized_size<value_type>(); }
+
+    /// Returns the maximum number of values in the insertion buffer.
+    u64 buffer_capacity() const { return m_inner.buffer_capacity(); }
+
+    /// Returns the number of values that fit into a single block of a sorted run.
+    u32 run_block_capacity() const { return m_inner.run_block_capacity(); }
+
+    /// Returns the number of runs of the same level that are merged into a single run.
+    static u32 merge_fanout() { return raw_priority_queue::merge_fanout(); }
+
+    /// Returns true iff the queue is empty.
+    bool empty() const { return m_inner.empty(); }
+
+    /// Returns the number of values in the queue.
+    u64 size() const { return m_inner.size(); }
+
+    /// Returns the number of values currently stored in the insertion buffer.
+    u64 buffer_size() const { return m_inner.buffer_size(); }
+
+    /// Returns the number of sorted runs.
+    u64 runs() const { return m_inner.runs(); }
+
+    /// Returns the number of blocks allocated by the sorted runs.
+    u64 run_blocks() const { return m_inner.run_blocks(); }
+
+    /// Returns the total size of this datastructure on disk, in bytes.
+    u64 byte_size() const { return m_inner.byte_size(); }
+
+    /// Returns the relative overhead of this queue compared to a linear file with the same values.
+    double overhead() const { return m_inner.overhead(); }
+
+    /// Returns the smallest value.
+    ///
+    /// \throws bad_operation If the queue is empty.
+    value_type top() const {
+        serialized_buffer<value_type> buffer;
+        m_inner.top(buffer.data());
+        return deserialize_from_buffer<value_type>(buffer);
+    }
+
+    /// Inserts a new value into the queue.
+    void push(const value_type& value) {
+        serialized_buffer<value_type> buffer = serialize_to_buffer(value);
+        m_inner.push(buffer.data());
+    }
+
+    /// Removes the smallest value from the queue.
+    ///
+    /// \throws bad_operation If the queue is empty.
+    void pop() { m_inner.pop(); }
+
+    /// Removes the smallest value from the queue and returns it.
+    ///
+    /// \throws bad_operation If the queue is empty.
+    value_type pop_min() {
+        serialized_buffer<value_type> buffer;
+        m_inner.pop(buffer.data());
+        return deserialize_from_buffer<value_type>(buffer);
+    }
+
+    /// Removes all values from this queue. After this operation completes, the queue
+    /// will not occupy any space on disk.
+    /// \post `empty() && byte_size() == 0`.
+    void reset() { m_inner.reset(); }
+
+    /// Removes all values from this queue.
+    /// \post `empty()`.
+    void clear() { m_inner.clear(); }
+
+    /// Prints debugging information to the output stream.
+    void dump(std::ostream& os) const { m_inner.dump(os); }
+
+    /// Perform internal consistency checks.
+    void validate() const { m_inner.validate(); }
+
+    const raw_priority_queue& raw() const { return m_inner; }
+
+private:
+    // Allocated on the heap for stables addresses (the user_data pointer points to this object).
+    struct state_t {
+        Compare m_compare;
+
+        state_t(Compare&& compare)
+            : m_compare(std::move(compare)) {}
+
+        bool value_less(const value_type& lhs, const value_type& rhs) const {
+            return m_compare(lhs, rhs);
+        }
+    };
+
+    raw_priority_queue_options make_options(u32 buffer_blocks) {
+        raw_priority_queue_options options;
+        options.value_size = value_size();
+        options.user_data = m_state.get();
+        options.value_less = value_less;
+        options.buffer_blocks = buffer_blocks;
+        return options;
+    }
+
+    static bool
+    value_less(const byte* left_value_buffer, const byte* right_value_buffer, void* user_data) {
+        const state_t* state = static_cast<state_t*>(user_data);
+        value_type lhs = deserialize<value_type>(left_value_buffer);
+        value_type rhs = deserialize<value_type>(right_value_buffer);
+        return state->value_less(lhs, rhs);
+    }
+
+private:
+    std::unique_ptr<state_t> m_state;
+    raw_priority_queue m_inner;
+};
+
+} // namespace prequel
+
+#endif // PREQUEL_CONTAINER_PRIORITY_QUEUE_HPP
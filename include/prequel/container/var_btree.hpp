@@ -0,0 +1,550 @@
+#ifndef PREQUEL_CONTAINER_VAR_BTREE_HPP
+#define PREQUEL_CONTAINER_VAR_BTREE_HPP
+
+#include <prequel/anchor_handle.hpp>
+#include <prequel/binary_format.hpp>
+#include <prequel/container/allocator.hpp>
+#include <prequel/container/btree.hpp>
+#include <prequel/defs.hpp>
+#include <prequel/engine.hpp>
+#include <prequel/serialization.hpp>
+
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace prequel {
+
+class raw_var_btree;
+class raw_var_btree_cursor;
+
+namespace detail {
+
+class raw_var_btree_impl;
+
+/// Serialized state of a var_btree instance.
+struct raw_var_btree_anchor {
+    /// The tree that contains the entries (keys and small values).
+    raw_btree_anchor tree;
+
+    /// Number of blocks allocated for values that are stored out-of-line.
+    u64 overflow_blocks = 0;
+
+    /// Total size of all values, in bytes.
+    u64 value_bytes = 0;
+
+    static constexpr auto get_binary_format() {
+        using self = raw_var_btree_anchor;
+        return binary_format(&self::tree, &self::overflow_blocks, &self::value_bytes);
+    }
+};
+
+} // namespace detail
+
+using raw_var_btree_anchor = detail::raw_var_btree_anchor;
+
+/// A group of properties required to configure a var_btree instance.
+/// The parameters must be semantically equivalent whenever the
+/// tree is (re-) opened.
+struct raw_var_btree_options {
+    /// Size of a key, in bytes. Must be > 0.
+    u32 key_size = 0;
+
+    /// Values up to this size (in bytes) are stored directly in the leaf nodes of the tree.
+    /// Larger values are stored out-of-line in overflow blocks and the tree only
+    /// contains a reference to them, which costs an additional I/O when the value is accessed.
+    ///
+    /// Every entry in a leaf reserves space for an inline value, so this
+    /// size should be chosen with the typical value size in mind.
+    /// A leaf node must be able to store at least 4 entries.
+    /// When set to 0, the largest possible size will be used.
+    u32 max_inline_size = 0;
+
+    /// Passed to all callbacks as the last argument.
+    /// Can remain null.
+    void* user_data = nullptr;
+
+    /// Returns true if `left_key` is less than `right_key`. Both byte buffers
+    /// contain keys and have size `key_size`.
+    bool (*key_less)(const byte* left_key, const byte* right_key, void* user_data) = nullptr;
+};
+
+/// Cursors are used to traverse the entries in a var_btree.
+class raw_var_btree_cursor {
+public:
+    raw_var_btree_cursor() = default;
+
+public:
+    /// Returns a pointer to the current key.
+    /// The returned pointer has exactly `key_size` readable bytes.
+    /// Throws an exception if the cursor does not currently point to a valid entry.
+    const byte* key() const;
+
+    /// Returns the size of the current value, in bytes.
+    /// Throws an exception if the cursor does not currently point to a valid entry.
+    u32 value_size() const;
+
+    /// Returns true if the current value is stored inline (in the tree's leaf node).
+    /// Throws an exception if the cursor does not currently point to a valid entry.
+    bool value_inline() const;
+
+    /// Copies the current value into the buffer, which must have at least `value_size()` bytes.
+    /// Throws an exception if the cursor does not currently point to a valid entry.
+    void read_value(byte* buffer) const;
+
+    /// Returns a copy of the current value.
+    /// Throws an exception if the cursor does not currently point to a valid entry.
+    std::vector<byte> value() const;
+
+    /// Replaces the current value with the given one.
+    /// Throws an exception if the cursor does not currently point to a valid entry.
+    void set_value(const byte* value, u32 value_size);
+
+    /// True iff this cursor has been positioned at the end of the tree,
+    /// in which case it does not point to a valid entry.
+    bool at_end() const { return m_inner.at_end(); }
+
+    /// True iff the entry this cursor pointed to was erased.
+    bool erased() const { return m_inner.erased(); }
+
+    /// Equivalent to `!at_end()`.
+    explicit operator bool() const { return !at_end(); }
+
+    /// Reset the iterator. `at_end()` will return true.
+    void reset() { m_inner.reset(); }
+
+    /// Move this cursor to the smallest key in the tree.
+    bool move_min() { return m_inner.move_min(); }
+
+    /// Move this cursor to the largest key in the tree.
+    bool move_max() { return m_inner.move_max(); }
+
+    /// Move this cursor to the next entry.
+    bool move_next() { return m_inner.move_next(); }
+
+    /// Move this cursor to the previous entry.
+    bool move_prev() { return m_inner.move_prev(); }
+
+    /// Seeks to the first entry with a key `>= key`.
+    /// Returns true if such an entry was found. Returns false and becomes invalid otherwise.
+    bool lower_bound(const byte* key) { return m_inner.lower_bound(key); }
+
+    /// Seeks to the first entry with a key `> key`.
+    /// Returns true if such an entry was found. Returns false and becomes invalid otherwise.
+    bool upper_bound(const byte* key) { return m_inner.upper_bound(key); }
+
+    /// Seeks to the entry with the given key.
+    /// Returns true if such an entry was found. Returns false and becomes invalid otherwise.
+    bool find(const byte* key) { return m_inner.find(key); }
+
+    /// Erases the entry that this cursors points at (including its out-of-line storage).
+    void erase();
+
+    bool operator==(const raw_var_btree_cursor& other) const { return m_inner == other.m_inner; }
+    bool operator!=(const raw_var_btree_cursor& other) const { return !(*this == other); }
+
+private:
+    friend raw_var_btree;
+    friend detail::raw_var_btree_impl;
+
+    raw_var_btree_cursor(detail::raw_var_btree_impl* tree, raw_btree::cursor inner)
+        : m_tree(tree)
+        , m_inner(std::move(inner)) {}
+
+    detail::raw_var_btree_impl& tree() const;
+
+private:
+    detail::raw_var_btree_impl* m_tree = nullptr;
+    raw_btree::cursor m_inner;
+};
+
+/**
+ * An ordered index from fixed size keys to variable size values.
+ *
+ * Entries are stored in a btree. Every entry contains its key and its value,
+ * if the value is small enough (see `raw_var_btree_options::max_inline_size`).
+ * Larger values are stored in a contiguous range of overflow blocks
+ * that is referenced by the entry. The allocator must therefore be able to allocate
+ * contiguous ranges of blocks (e.g. the \ref default_allocator) if values
+ * can exceed the inline size.
+ */
+class raw_var_btree {
+public:
+    using anchor = raw_var_btree_anchor;
+    using cursor = raw_var_btree_cursor;
+
+    struct insert_result {
+        /// Points to the position of the entry.
+        cursor position;
+
+        /// Whether a new entry was inserted into the tree.
+        /// This will be false if an entry with the same key
+        /// already existed within the tree.
+        bool inserted = false;
+
+        insert_result() = default;
+
+        insert_result(cursor position_, bool inserted_)
+            : position(std::move(position_))
+            , inserted(inserted_) {}
+    };
+
+    using cursor_seek_t = raw_btree::cursor_seek_t;
+
+    static constexpr cursor_seek_t seek_none = raw_btree::seek_none;
+    static constexpr cursor_seek_t seek_min = raw_btree::seek_min;
+    static constexpr cursor_seek_t seek_max = raw_btree::seek_max;
+
+public:
+    /// Constructs the tree rooted at the existing anchor.
+    /// The options must be equivalent every time the tree is opened;
+    /// they are not persisted to disk.
+    raw_var_btree(anchor_handle<anchor> _anchor, const raw_var_btree_options& options,
+                  allocator& alloc);
+    ~raw_var_btree();
+
+    raw_var_btree(raw_var_btree&& other) noexcept;
+    raw_var_btree& operator=(raw_var_btree&& other) noexcept;
+
+    raw_var_btree(const raw_var_btree&) = delete;
+    raw_var_btree& operator=(const raw_var_btree&) = delete;
+
+    engine& get_engine() const;
+    allocator& get_allocator() const;
+
+    /// Returns the size (in bytes) of every key in the tree.
+    u32 key_size() const;
+
+    /// Returns the maximum size of a value that is stored inline.
+    u32 max_inline_size() const;
+
+    /// Returns the maximum number of entries in a leaf node.
+    u32 leaf_node_capacity() const;
+
+    /// Returns true if the tree is empty.
+    bool empty() const;
+
+    /// Returns the number of entries in this tree.
+    u64 size() const;
+
+    /// Returns the height of the underlying btree.
+    u32 height() const;
+
+    /// Returns the number of nodes of the underlying btree.
+    u64 nodes() const;
+
+    /// Returns the number of blocks allocated for out-of-line values.
+    u64 overflow_blocks() const;
+
+    /// Returns the total size of all values, in bytes.
+    u64 value_bytes() const;
+
+    /// The size of this datastructure in bytes (not including the anchor).
+    u64 byte_size() const;
+
+    /// Create a new cursor and seek it to the specified position.
+    cursor create_cursor(cursor_seek_t seek = seek_none) const;
+
+    /// Seek to the given key within this tree. The cursor will be invalid
+    /// if the key was not found.
+    cursor find(const byte* key) const;
+
+    /// Seek to the smallest key `lb` with `lb >= key`. The cursor will be invalid
+    /// if no such key exists within this tree.
+    cursor lower_bound(const byte* key) const;
+
+    /// Seek to the smallest key `lb` with `lb > key`. The cursor will be invalid
+    /// if no such key exists within this tree.
+    cursor upper_bound(const byte* key) const;
+
+    /// Attempts to insert the given entry into the tree. The tree will not be modified
+    /// if an entry with the same key already exists.
+    insert_result insert(const byte* key, const byte* value, u32 value_size);
+
+    /// Inserts the entry into the tree. If an entry with the same key already exists,
+    /// its value will be overwritten.
+    insert_result insert_or_update(const byte* key, const byte* value, u32 value_size);
+
+    /// Removes the entry with the given key. Returns true if such an entry existed.
+    bool erase(const byte* key);
+
+    /// Removes all entries from this tree.
+    /// \post `empty()`.
+    void clear();
+
+    /// Removes all data from this tree. After this operation completes,
+    /// the tree will not occupy any space on disk.
+    /// \post `empty() && byte_size() == 0`.
+    void reset();
+
+    /// Prints debugging information to the output stream.
+    void dump(std::ostream& os) const;
+
+    /// Perform validation of the tree's structure (including the references
+    /// to out-of-line values).
+    void validate() const;
+
+private:
+    detail::raw_var_btree_impl& impl() const;
+
+private:
+    std::unique_ptr<detail::raw_var_btree_impl> m_impl;
+};
+
+/**
+ * An ordered index from keys of type `Key` to variable size values (byte strings).
+ * Keys must be comparable using `<` (which can be overwritten
+ * by specifying the `KeyLess` parameter).
+ */
+template<typename Key, typename KeyLess = std::less<>>
+class var_btree {
+public:
+    using key_type = Key;
+
+public:
+    class anchor {
+        raw_var_btree::anchor tree;
+
+        static constexpr auto get_binary_format() { return binary_format(&anchor::tree); }
+
+        friend var_btree;
+        friend binary_format_access;
+    };
+
+public:
+    /// Cursors are used to traverse the entries in a var_btree.
+    class cursor {
+    public:
+        cursor() = default;
+
+        /// Returns the current key.
+        key_type key() const { return deserialize<key_type>(m_inner.key()); }
+
+        /// Returns the size of the current value, in bytes.
+        u32 value_size() const { return m_inner.value_size(); }
+
+        /// Returns true if the current value is stored inline.
+        bool value_inline() const { return m_inner.value_inline(); }
+
+        /// Copies the current value into the buffer, which must have at least `value_size()` bytes.
+        void read_value(byte* buffer) const { m_inner.read_value(buffer); }
+
+        /// Returns a copy of the current value.
+        std::vector<byte> value() const { return m_inner.value(); }
+
+        /// Replaces the current value with the given one.
+        void set_value(const byte* value, u32 value_size) { m_inner.set_value(value, value_size); }
+
+        /// True iff this cursor has been positioned at the end of the tree,
+        /// in which case it does not point to a valid entry.
+        bool at_end() const { return m_inner.at_end(); }
+
+        /// True iff the entry this cursor pointed to was erased.
+        bool erased() const { return m_inner.erased(); }
+
+        /// Equivalent to `!at_end()`.
+        explicit operator bool() const { return static_cast<bool>(m_inner); }
+
+        /// Reset the iterator. `at_end()` will return true.
+        void reset() { m_inner.reset(); }
+
+        /// Move this cursor to the smallest key in the tree.
+        void move_min() { m_inner.move_min(); }
+
+        /// Move this cursor to the largest key in the tree.
+        void move_max() { m_inner.move_max(); }
+
+        /// Move this cursor to the next entry.
+        void move_next() { m_inner.move_next(); }
+
+        /// Move this cursor to the previous entry.
+        void move_prev() { m_inner.move_prev(); }
+
+        /// Seeks to the first entry with a key `>= key`.
+        bool lower_bound(const key_type& key) {
+            auto buffer = serialize_to_buffer(key);
+            return m_inner.lower_bound(buffer.data());
+        }
+
+        /// Seeks to the first entry with a key `> key`.
+        bool upper_bound(const key_type& key) {
+            auto buffer = serialize_to_buffer(key);
+            return m_inner.upper_bound(buffer.data());
+        }
+
+        /// Seeks to the entry with the given key.
+        bool find(const key_type& key) {
+            auto buffer = serialize_to_buffer(key);
+            return m_inner.find(buffer.data());
+        }
+
+        /// Erases the entry that this cursors points at.
+        void erase() { m_inner.erase(); }
+
+        bool operator==(const cursor& other) const { return m_inner == other.m_inner; }
+        bool operator!=(const cursor& other) const { return m_inner != other.m_inner; }
+
+    private:
+        friend class var_btree;
+
+        cursor(raw_var_btree::cursor&& inner)
+            : m_inner(std::move(inner)) {}
+
+    private:
+        raw_var_btree::cursor m_inner;
+    };
+
+    using cursor_seek_t = raw_var_btree::cursor_seek_t;
+
+    static constexpr cursor_seek_t seek_none = raw_var_btree::seek_none;
+    static constexpr cursor_seek_t seek_min = raw_var_btree::seek_min;
+    static constexpr cursor_seek_t seek_max = raw_var_btree::seek_max;
+
+    struct insert_result {
+        cursor position;
+        bool inserted = false;
+
+        insert_result() = default;
+
+        insert_result(cursor position_, bool inserted_)
+            : position(std::move(position_))
+            , inserted(inserted_) {}
+    };
+
+public:
+    /// Constructs the tree rooted at the existing anchor.
+    /// Values up to `max_inline_size` bytes are stored inline (0 means: as large as possible).
+    /// `max_inline_size` must be equivalent every time the tree is opened.
+    explicit var_btree(anchor_handle<anchor> anchor_, allocator& alloc_, u32 max_inline_size = 0,
+                       KeyLess less = KeyLess())
+        : m_state(std::make_unique<state_t>(std::move(less)))
+        , m_inner(std::move(anchor_).template member<&anchor::tree>(),
+                  make_options(max_inline_size), alloc_) {}
+
+    engine& get_engine() const { return m_inner.get_engine(); }
+    allocator& get_allocator() const { return m_inner.get_allocator(); }
+
+    /// Returns the size of a serialized key. This is a compile-time constant.
+    static constexpr u32 key_size() { return serialized_size<key_type>(); }
+
+    /// Returns the maximum size of a value that is stored inline.
+    u32 max_inline_size() const { return m_inner.max_inline_size(); }
+
+    /// Returns the maximum number of entries in a leaf node.
+    u32 leaf_node_capacity() const { return m_inner.leaf_node_capacity(); }
+
+    /// Returns true if the tree is empty.
+    bool empty() const { return m_inner.empty(); }
+
+    /// Returns the number of entries in this tree.
+    u64 size() const { return m_inner.size(); }
+
+    /// Returns the height of the underlying btree.
+    u32 height() const { return m_inner.height(); }
+
+    /// Returns the number of nodes of the underlying btree.
+    u64 nodes() const { return m_inner.nodes(); }
+
+    /// Returns the number of blocks allocated for out-of-line values.
+    u64 overflow_blocks() const { return m_inner.overflow_blocks(); }
+
+    /// Returns the total size of all values, in bytes.
+    u64 value_bytes() const { return m_inner.value_bytes(); }
+
+    /// The size of this datastructure in bytes (not including the anchor).
+    u64 byte_size() const { return m_inner.byte_size(); }
+
+    /// Create a new cursor and seek it to the specified position.
+    cursor create_cursor(cursor_seek_t seek = seek_none) const {
+        return cursor(m_inner.create_cursor(seek));
+    }
+
+    /// Seek to the given key within this tree.
+    cursor find(const key_type& key) const {
+        auto buffer = serialize_to_buffer(key);
+        return cursor(m_inner.find(buffer.data()));
+    }
+
+    /// Seek to the smallest key `lb` with `lb >= key`.
+    cursor lower_bound(const key_type& key) const {
+        auto buffer = serialize_to_buffer(key);
+        return cursor(m_inner.lower_bound(buffer.data()));
+    }
+
+    /// Seek to the smallest key `lb` with `lb > key`.
+    cursor upper_bound(const key_type& key) const {
+        auto buffer = serialize_to_buffer(key);
+        return cursor(m_inner.upper_bound(buffer.data()));
+    }
+
+    /// Attempts to insert the given entry into the tree. The tree will not be modified
+    /// if an entry with the same key already exists.
+    insert_result insert(const key_type& key, const byte* value, u32 value_size) {
+        auto buffer = serialize_to_buffer(key);
+        auto result = m_inner.insert(buffer.data(), value, value_size);
+        return insert_result(cursor(std::move(result.position)), result.inserted);
+    }
+
+    /// Inserts the entry into the tree. If an entry with the same key already exists,
+    /// its value will be overwritten.
+    insert_result insert_or_update(const key_type& key, const byte* value, u32 value_size) {
+        auto buffer = serialize_to_buffer(key);
+        auto result = m_inner.insert_or_update(buffer.data(), value, value_size);
+        return insert_result(cursor(std::move(result.position)), result.inserted);
+    }
+
+    /// Removes the entry with the given key. Returns true if such an entry existed.
+    bool erase(const key_type& key) {
+        auto buffer = serialize_to_buffer(key);
+        return m_inner.erase(buffer.data());
+    }
+
+    /// Removes all entries from this tree.
+    void clear() { m_inner.clear(); }
+
+    /// Removes all data from this tree.
+    void reset() { m_inner.reset(); }
+
+    /// Prints debugging information to the output stream.
+    void dump(std::ostream& os) const { m_inner.dump(os); }
+
+    /// Perform validation of the tree's structure.
+    void validate() const { m_inner.validate(); }
+
+    /// Returns the raw tree.
+    const raw_var_btree& raw() const { return m_inner; }
+
+private:
+    raw_var_btree_options make_options(u32 max_inline_size) {
+        raw_var_btree_options options;
+        options.key_size = key_size();
+        options.max_inline_size = max_inline_size;
+        options.user_data = m_state.get();
+        options.key_less = key_less;
+        return options;
+    }
+
+    static bool key_less(const byte* lhs_buffer, const byte* rhs_buffer, void* user_data) {
+        const state_t* state = reinterpret_cast<const state_t*>(user_data);
+        key_type lhs = deserialize<key_type>(lhs_buffer);
+        key_type rhs = deserialize<key_type>(rhs_buffer);
+        return state->m_less(lhs, rhs);
+    }
+
+private:
+    // Allocated on the heap for stable addresses (user data pointer in raw_var_btree).
+    struct state_t {
+        KeyLess m_less;
+
+        state_t(KeyLess&& less)
+            : m_less(std::move(less)) {}
+    };
+
+private:
+    std::unique_ptr<state_t> m_state;
+    raw_var_btree m_inner;
+};
+
+} // namespace prequel
+
+#endif // PREQUEL_CONTAINER_VAR_BTREE_HPP
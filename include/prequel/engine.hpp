@@ -277,6 +277,12 @@ public:
     /// with zeroes as well.
     block_handle overwrite(block_index index, const byte* data, size_t data_size);
 
+    /// Hints that the block at the given index will be read in the near future.
+    /// Engines may use this to start loading the block in the background.
+    /// Nothing happens if the block is already in memory, if the index is invalid
+    /// or if the engine does not support prefetching.
+    void prefetch(block_index index);
+
     /// Returns the address to the first byte of the given block.
     /// Returns the invalid address if the block index is invalid.
     raw_address to_address(block_index index) const noexcept { return to_address(index, 0); }
@@ -354,6 +360,10 @@ protected:
     virtual void do_grow(u64 n) = 0;
     virtual void do_flush() = 0;
 
+    // Called for blocks that are not currently referenced by any handle.
+    // The default implementation does nothing.
+    virtual void do_prefetch(block_index index);
+
 protected:
     struct pin_result {
         // Block data storage. Remains valid until the block is unpinned.
@@ -62,6 +62,7 @@ private:
     void do_unpin(block_index index, uintptr_t cookie) noexcept override;
     void do_dirty(block_index index, uintptr_t cookie) override;
     void do_flush(block_index index, uintptr_t cookie) override;
+    void do_prefetch(block_index index) override;
 
 private:
     detail::engine_impl::file_engine& impl() const;
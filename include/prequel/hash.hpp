@@ -4,6 +4,8 @@
 #include <prequel/defs.hpp>
 #include <prequel/serialization.hpp>
 
+#include <type_traits>
+
 namespace prequel {
 
 /**
@@ -34,6 +36,101 @@ struct fnv_hasher {
     }
 };
 
+namespace detail {
+
+// Constants of the fast hash function.
+static constexpr u64 fast_hash_p0 = UINT64_C(0xa0761d6478bd642f);
+static constexpr u64 fast_hash_p1 = UINT64_C(0xe7037ed1a0b428db);
+static constexpr u64 fast_hash_p2 = UINT64_C(0x8ebc6af09c88c6e3);
+
+// Computes the full 128 bit product of a and b and stores its low half in a
+// and its high half in b.
+inline void fast_hash_mul128(u64& a, u64& b) noexcept {
+#ifdef __SIZEOF_INT128__
+    // Marked as an extension to keep -pedantic builds working.
+    __extension__ typedef unsigned __int128 u128;
+    const u128 r = static_cast<u128>(a) * b;
+    a = static_cast<u64>(r);
+    b = static_cast<u64>(r >> 64);
+#else
+    const u64 ha = a >> 32, hb = b >> 32, la = static_cast<u32>(a), lb = static_cast<u32>(b);
+    const u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const u64 t = rl + (rm0 << 32);
+    const u64 lo = t + (rm1 << 32);
+    const u64 hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+    a = lo;
+    b = hi;
+#endif
+}
+
+// Multiplies a and b and folds the 128 bit result into 64 bits.
+inline u64 fast_hash_mix(u64 a, u64 b) noexcept {
+    fast_hash_mul128(a, b);
+    return a ^ b;
+}
+
+// Final step of the fast hash function, a and b are the last two input words.
+inline u64 fast_hash_finish(u64 a, u64 b, u64 seed, u64 length) noexcept {
+    a ^= fast_hash_p1;
+    b ^= seed;
+    fast_hash_mul128(a, b);
+    return fast_hash_mix(a ^ fast_hash_p0 ^ length, b ^ fast_hash_p1);
+}
+
+inline u64 fast_hash_seed(u64 seed) noexcept {
+    return seed ^ fast_hash_mix(seed ^ fast_hash_p0, fast_hash_p1);
+}
+
+// Integer types that are serialized as their (big endian) value.
+template<typename T>
+static constexpr bool fast_hash_integer =
+    std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) <= 8;
+
+} // namespace detail
+
+/**
+ * A fast hash function that processes its input 8 bytes at a time, in the style of wyhash.
+ * Every step multiplies two 64-bit words into a 128-bit product and folds the two halves
+ * of that product together, which distributes the entropy of the input over all bits
+ * of the result (including the lowest bits, which are used by \ref raw_hash_table).
+ *
+ * The hash function has a fixed definition and returns the same result on all platforms
+ * (input words are read in big endian byte order, independent of the native byte order).
+ * Like with \ref fnv_1a(const byte*, size_t), the `data` must be in a platform independent format.
+ *
+ * It is not a cryptographic hash function.
+ */
+u64 fast_hash(const byte* data, size_t length, u64 seed = 0) noexcept;
+
+/**
+ * Fast hash of the given value.
+ * Integers are hashed directly, other values are serialized before hashing.
+ * The result is always the same as the hash of the serialized representation of `value`.
+ */
+template<typename T>
+u64 fast_hash(const T& value) noexcept {
+    if constexpr (detail::fast_hash_integer<T>) {
+        // Inputs of up to 8 bytes are read as a single big endian word,
+        // which is exactly the value of the integer.
+        const u64 word = static_cast<std::make_unsigned_t<T>>(value);
+        return detail::fast_hash_finish(word, 0, detail::fast_hash_seed(0), sizeof(T));
+    } else {
+        auto buffer = serialize_to_buffer(value);
+        return fast_hash(buffer.data(), buffer.size());
+    }
+}
+
+/**
+ * An function object that hashes its input using the \ref fast_hash function.
+ * Faster than \ref fnv_hasher, especially for integers and larger keys.
+ */
+struct fast_hasher {
+    template<typename T>
+    u64 operator()(const T& value) const noexcept {
+        return fast_hash(value);
+    }
+};
+
 } // namespace prequel
 
 #endif // PREQUEL_HASH_HPP
@@ -55,6 +55,11 @@ public:
     /// Writes all buffered changes of the file to the disk.
     virtual void sync() = 0;
 
+    /// Hints that `count` bytes starting at `offset` will be read in the near future.
+    /// Implementations may start loading the data in the background.
+    /// The default implementation does nothing.
+    virtual void prefetch(u64 offset, u64 count);
+
     /// Closes this file handle.
     virtual void close() = 0;
 
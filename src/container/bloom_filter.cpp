@@ -0,0 +1,372 @@
+#include <prequel/container/bloom_filter.hpp>
+
+#include <prequel/exception.hpp>
+#include <prequel/formatting.hpp>
+#include <prequel/math.hpp>
+#include <prequel/serialization.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace prequel {
+
+namespace detail {
+
+/*
+ * Layout:
+ * - Filter blocks are plain bit arrays, subdivided into sectors of 512 bits.
+ *   All bits of a hash are set in the same sector.
+ * - Directory blocks are arrays of `block_size / 8` block indices, pointing to the
+ *   directory blocks of the next level or to filter blocks (in the lowest directory level).
+ *   Only the first entries of the rightmost directory blocks may be in use.
+ */
+class bloom_filter_impl : public uses_allocator {
+public:
+    using anchor = bloom_filter_anchor;
+
+    static constexpr u32 sector_bits = 512;
+    static constexpr u32 sector_size = sector_bits / 8;
+    static constexpr u32 max_hashes = 16;
+
+    bloom_filter_impl(anchor_handle<anchor> _anchor, allocator& _alloc)
+        : uses_allocator(_alloc)
+        , m_anchor(std::move(_anchor))
+        , m_block_size(_alloc.block_size())
+        , m_fanout(m_block_size / serialized_size<block_index>()) {
+        if (m_block_size < sector_size) {
+            PREQUEL_THROW(bad_argument(
+                fmt::format("Block size {} is too small for a bloom filter.", m_block_size)));
+        }
+    }
+
+    bloom_filter_impl(const bloom_filter_impl&) = delete;
+    bloom_filter_impl& operator=(const bloom_filter_impl&) = delete;
+
+public:
+    bool initialized() const { return height() > 0; }
+    u64 size() const { return m_anchor.get<&anchor::size>(); }
+    u64 capacity() const { return m_anchor.get<&anchor::capacity>(); }
+    u32 hashes() const { return m_anchor.get<&anchor::hashes>(); }
+    u64 blocks() const { return m_anchor.get<&anchor::blocks>(); }
+
+    u64 byte_size() const {
+        return (blocks() + m_anchor.get<&anchor::directory_blocks>()) * m_block_size;
+    }
+
+    bool may_contain(u64 hash) const {
+        if (!initialized())
+            return true;
+
+        const location loc = locate(hash);
+        block_handle block = get_engine().read(filter_block(loc.block));
+        const byte* sector = block.data() + loc.sector * sector_size;
+
+        bool result = true;
+        for_each_bit(loc, [&](u32 bit) {
+            if (!(sector[bit / 8] & (1 << (bit % 8))))
+                result = false;
+        });
+        return result;
+    }
+
+    void insert(u64 hash) {
+        if (!initialized())
+            PREQUEL_THROW(bad_operation("The filter has not been initialized."));
+
+        const location loc = locate(hash);
+        block_handle block = get_engine().read(filter_block(loc.block));
+
+        // Avoid dirtying the block if all bits are set already.
+        const byte* sector = block.data() + loc.sector * sector_size;
+        bool changed = false;
+        for_each_bit(loc, [&](u32 bit) {
+            if (!(sector[bit / 8] & (1 << (bit % 8))))
+                changed = true;
+        });
+        if (changed) {
+            byte* data = block.writable_data() + loc.sector * sector_size;
+            for_each_bit(loc, [&](u32 bit) { data[bit / 8] |= byte(1 << (bit % 8)); });
+        }
+        m_anchor.set<&anchor::size>(size() + 1);
+    }
+
+    void reset(u64 capacity, u32 bits_per_key) {
+        if (bits_per_key == 0 || bits_per_key > 64)
+            PREQUEL_THROW(bad_argument("Bits per key must be in [1, 64]."));
+
+        capacity = std::max<u64>(capacity, 1);
+        const u64 block_bits = u64(m_block_size) * 8;
+        if (capacity > u64(-1) / bits_per_key)
+            PREQUEL_THROW(bad_argument("Capacity is too large."));
+
+        const u64 blocks = ceil_div(capacity * bits_per_key, block_bits);
+        if (blocks > u64(1) << 32)
+            PREQUEL_THROW(bad_argument("Capacity is too large."));
+
+        u32 height = 1;
+        for (u64 span = 1; span < blocks; span *= m_fanout)
+            ++height;
+
+        const u32 hashes = std::clamp<u32>(
+            static_cast<u32>(std::lround(bits_per_key * 0.69314718)), 1, max_hashes);
+
+        reset();
+
+        std::vector<block_index> allocated;
+        block_index root;
+        try {
+            root = build(height, blocks, allocated);
+        } catch (...) {
+            for (block_index index : allocated)
+                get_allocator().free(index, 1);
+            throw;
+        }
+
+        m_anchor.set<&anchor::size>(0);
+        m_anchor.set<&anchor::capacity>(capacity);
+        m_anchor.set<&anchor::blocks>(blocks);
+        m_anchor.set<&anchor::directory_blocks>(allocated.size() - blocks);
+        m_anchor.set<&anchor::height>(height);
+        m_anchor.set<&anchor::hashes>(hashes);
+        m_anchor.set<&anchor::root>(root);
+    }
+
+    void clear() {
+        if (!initialized())
+            return;
+
+        visit(root(), height(), blocks(), [&](block_index index, bool is_filter) {
+            if (is_filter)
+                get_engine().overwrite_zero(index);
+        });
+        m_anchor.set<&anchor::size>(0);
+    }
+
+    void reset() {
+        if (!initialized())
+            return;
+
+        visit(root(), height(), blocks(),
+              [&](block_index index, bool) { get_allocator().free(index, 1); });
+        m_anchor.set(anchor());
+    }
+
+    void validate() const {
+#define ERROR(...) PREQUEL_THROW(corruption_error(fmt::format("validate: " __VA_ARGS__)));
+
+        if (!initialized()) {
+            if (root() || blocks() || size() || capacity())
+                ERROR("Uninitialized filter has a non-empty state.");
+            return;
+        }
+
+        if (!root())
+            ERROR("Initialized filter has no root.");
+        if (hashes() == 0 || hashes() > max_hashes)
+            ERROR("Invalid number of hashes: {}.", hashes());
+
+        u64 span = 1;
+        for (u32 level = 1; level < height(); ++level)
+            span *= m_fanout;
+        if (blocks() > span || (height() > 1 && blocks() <= span / m_fanout))
+            ERROR("Height {} is inconsistent with the number of blocks {}.", height(), blocks());
+
+        u64 filter_blocks = 0;
+        u64 directory_blocks = 0;
+        visit(root(), height(), blocks(), [&](block_index, bool is_filter) {
+            ++(is_filter ? filter_blocks : directory_blocks);
+        });
+        if (filter_blocks != blocks())
+            ERROR("Number of filter blocks does not match the filter's state.");
+        if (directory_blocks != m_anchor.get<&anchor::directory_blocks>())
+            ERROR("Number of directory blocks does not match the filter's state.");
+
+#undef ERROR
+    }
+
+private:
+    struct location {
+        u64 block = 0;
+        u32 sector = 0;
+
+        // Bit positions (within the sector) are derived by double hashing.
+        u32 first = 0;
+        u32 step = 0;
+    };
+
+    // Finalizer of MurmurHash3. Spreads the entropy of the input over all bits,
+    // so that weak hash functions (e.g. FNV-1a for small integers) can be used as well.
+    static u64 mix(u64 h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    location locate(u64 hash) const {
+        const u64 h = mix(hash);
+        const u64 g = mix(h + 0x9e3779b97f4a7c15ULL);
+
+        location loc;
+        loc.block = ((h >> 32) * blocks()) >> 32;
+        loc.sector = mod_pow2<u32>(static_cast<u32>(h), m_block_size / sector_size);
+        loc.first = static_cast<u32>(g);
+        loc.step = static_cast<u32>(g >> 32) | 1;
+        return loc;
+    }
+
+    template<typename Func>
+    void for_each_bit(const location& loc, Func&& fn) const {
+        u32 bit = loc.first;
+        for (u32 i = 0, n = hashes(); i < n; ++i) {
+            fn(mod_pow2(bit, sector_bits));
+            bit += loc.step;
+        }
+    }
+
+    // Returns the block index of the filter block with the given number.
+    block_index filter_block(u64 number) const {
+        PREQUEL_ASSERT(number < blocks(), "Filter block number out of bounds.");
+
+        u64 span = 1;
+        for (u32 level = 2; level < height(); ++level)
+            span *= m_fanout;
+
+        block_index index = root();
+        for (u32 level = height(); level > 1; --level) {
+            block_handle dir = get_engine().read(index);
+            const u64 child = number / span;
+            number %= span;
+            span /= m_fanout;
+            index = deserialize<block_index>(dir.data() + child * serialized_size<block_index>());
+        }
+        return index;
+    }
+
+    // Builds the subtree of the given height over `blocks` (zeroed) filter blocks.
+    block_index build(u32 height, u64 blocks, std::vector<block_index>& allocated) {
+        block_index index = get_allocator().allocate(1);
+        allocated.push_back(index);
+
+        block_handle block = get_engine().overwrite_zero(index);
+        if (height == 1)
+            return index;
+
+        u64 span = 1;
+        for (u32 level = 2; level < height; ++level)
+            span *= m_fanout;
+
+        std::vector<byte> entries(m_block_size);
+        for (u64 child = 0; child * span < blocks; ++child) {
+            const u64 child_blocks = std::min(span, blocks - child * span);
+            block_index child_index = build(height - 1, child_blocks, allocated);
+            serialize(child_index, entries.data() + child * serialized_size<block_index>());
+        }
+        std::memcpy(block.writable_data(), entries.data(), m_block_size);
+        return index;
+    }
+
+    // Visits all blocks in the subtree of the given height over `blocks` filter blocks
+    // (children before their parents).
+    template<typename Func>
+    void visit(block_index index, u32 height, u64 blocks, Func&& fn) const {
+        if (height > 1) {
+            u64 span = 1;
+            for (u32 level = 2; level < height; ++level)
+                span *= m_fanout;
+
+            std::vector<block_index> children;
+            {
+                block_handle dir = get_engine().read(index);
+                for (u64 child = 0; child * span < blocks; ++child) {
+                    children.push_back(deserialize<block_index>(
+                        dir.data() + child * serialized_size<block_index>()));
+                }
+            }
+            for (u64 child = 0; child < children.size(); ++child)
+                visit(children[child], height - 1, std::min(span, blocks - child * span), fn);
+        }
+        fn(index, height == 1);
+    }
+
+    u32 height() const { return m_anchor.get<&anchor::height>(); }
+    block_index root() const { return m_anchor.get<&anchor::root>(); }
+
+private:
+    anchor_handle<anchor> m_anchor;
+    u32 m_block_size = 0;
+    u32 m_fanout = 0;
+};
+
+} // namespace detail
+
+bloom_filter::bloom_filter(anchor_handle<anchor> _anchor, allocator& alloc)
+    : m_impl(std::make_unique<detail::bloom_filter_impl>(std::move(_anchor), alloc)) {}
+
+bloom_filter::~bloom_filter() {}
+
+bloom_filter::bloom_filter(bloom_filter&& other) noexcept
+    : m_impl(std::move(other.m_impl)) {}
+
+bloom_filter& bloom_filter::operator=(bloom_filter&& other) noexcept {
+    if (this != &other)
+        m_impl = std::move(other.m_impl);
+    return *this;
+}
+
+engine& bloom_filter::get_engine() const {
+    return impl().get_engine();
+}
+allocator& bloom_filter::get_allocator() const {
+    return impl().get_allocator();
+}
+
+bool bloom_filter::initialized() const {
+    return impl().initialized();
+}
+u64 bloom_filter::size() const {
+    return impl().size();
+}
+u64 bloom_filter::capacity() const {
+    return impl().capacity();
+}
+u32 bloom_filter::hashes() const {
+    return impl().hashes();
+}
+u64 bloom_filter::blocks() const {
+    return impl().blocks();
+}
+u64 bloom_filter::byte_size() const {
+    return impl().byte_size();
+}
+
+bool bloom_filter::may_contain(u64 hash) const {
+    return impl().may_contain(hash);
+}
+void bloom_filter::insert(u64 hash) {
+    impl().insert(hash);
+}
+
+void bloom_filter::reset(u64 capacity, u32 bits_per_key) {
+    impl().reset(capacity, bits_per_key);
+}
+void bloom_filter::clear() {
+    impl().clear();
+}
+void bloom_filter::reset() {
+    impl().reset();
+}
+
+void bloom_filter::validate() const {
+    impl().validate();
+}
+
+detail::bloom_filter_impl& bloom_filter::impl() const {
+    PREQUEL_ASSERT(m_impl, "Invalid bloom filter.");
+    return *m_impl;
+}
+
+} // namespace prequel
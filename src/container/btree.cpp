@@ -18,7 +18,12 @@ namespace prequel {
 
 raw_btree::raw_btree(anchor_handle<anchor> _anchor, const raw_btree_options& options,
                      allocator& alloc)
-    : m_impl(std::make_unique<detail::btree_impl::tree>(std::move(_anchor), options, alloc)) {}
+    : raw_btree(std::move(_anchor), anchor_handle<filter_anchor>(), options, alloc) {}
+
+raw_btree::raw_btree(anchor_handle<anchor> _anchor, anchor_handle<filter_anchor> _filter_anchor,
+                     const raw_btree_options& options, allocator& alloc)
+    : m_impl(std::make_unique<detail::btree_impl::tree>(
+          std::move(_anchor), std::move(_filter_anchor), options, alloc)) {}
 
 raw_btree::~raw_btree() {}
 
@@ -75,7 +80,7 @@ double raw_btree::fill_factor() const {
 }
 
 u64 raw_btree::byte_size() const {
-    return nodes() * get_engine().block_size();
+    return nodes() * get_engine().block_size() + impl().filter_byte_size();
 }
 
 double raw_btree::overhead() const {
@@ -86,12 +91,22 @@ raw_btree_cursor raw_btree::create_cursor(raw_btree::cursor_seek_t seek) const {
     return raw_btree_cursor(impl().create_cursor(seek));
 }
 
+raw_btree_cursor raw_btree::create_lazy_cursor(raw_btree::cursor_seek_t seek) const {
+    return raw_btree_cursor(impl().create_cursor(seek, true));
+}
+
 raw_btree_cursor raw_btree::find(const byte* key) const {
     auto c = create_cursor(raw_btree::seek_none);
     c.find(key);
     return c;
 }
 
+u64 raw_btree::find_many(const byte* keys, size_t count, byte* values, bool* found) const {
+    if (count > 0 && (!keys || !values || !found))
+        PREQUEL_THROW(bad_argument("Keys, values and found flags must not be null."));
+    return impl().find_many(keys, count, values, found);
+}
+
 raw_btree_cursor raw_btree::lower_bound(const byte* key) const {
     auto c = create_cursor(raw_btree::seek_none);
     c.lower_bound(key);
@@ -104,6 +119,28 @@ raw_btree_cursor raw_btree::upper_bound(const byte* key) const {
     return c;
 }
 
+bool raw_btree::counted() const {
+    return impl().counted();
+}
+
+bool raw_btree::filtered() const {
+    return impl().filtered();
+}
+
+u64 raw_btree::rank(const byte* key) const {
+    return impl().rank(key);
+}
+
+raw_btree_cursor raw_btree::select(u64 index) const {
+    auto c = create_cursor(raw_btree::seek_none);
+    impl().select(index, c.impl());
+    return c;
+}
+
+u64 raw_btree::count(const byte* lower, const byte* upper) const {
+    return impl().count(lower, upper);
+}
+
 raw_btree::insert_result raw_btree::insert(const byte* value) {
     auto c = create_cursor(raw_btree::seek_none);
     bool inserted = c.insert(value);
@@ -116,6 +153,24 @@ raw_btree::insert_result raw_btree::insert_or_update(const byte* value) {
     return insert_result(std::move(c), inserted);
 }
 
+u64 raw_btree::insert_sorted_batch(const byte* values, size_t count) {
+    if (count > 0 && !values)
+        PREQUEL_THROW(bad_argument("Values are null."));
+    return impl().insert_sorted(values, count);
+}
+
+u64 raw_btree::erase_range(const byte* lower, const byte* upper) {
+    if (!lower || !upper)
+        PREQUEL_THROW(bad_argument("Keys are null."));
+    return impl().erase_range(lower, upper);
+}
+
+bool raw_btree::compact(u64 max_leaves) {
+    if (max_leaves == 0)
+        PREQUEL_THROW(bad_argument("Must process at least one leaf."));
+    return impl().compact(max_leaves);
+}
+
 void raw_btree::reset() {
     impl().clear();
 }
@@ -127,6 +182,10 @@ raw_btree_loader raw_btree::bulk_load() {
     return raw_btree_loader(impl().bulk_load());
 }
 
+raw_btree_loader raw_btree::bulk_append() {
+    return raw_btree_loader(impl().bulk_append());
+}
+
 void raw_btree::dump(std::ostream& os) const {
     return impl().dump(os);
 }
@@ -161,8 +220,10 @@ raw_btree_cursor::raw_btree_cursor(std::unique_ptr<detail::btree_impl::cursor> i
 
 raw_btree_cursor::raw_btree_cursor(const raw_btree_cursor& other) {
     if (other.m_impl) {
-        if (!m_impl || m_impl->tree() != other.m_impl->tree()) {
-            m_impl = std::make_unique<detail::btree_impl::cursor>(other.m_impl->tree());
+        if (!m_impl || m_impl->tree() != other.m_impl->tree()
+            || m_impl->lazy() != other.m_impl->lazy()) {
+            m_impl = std::make_unique<detail::btree_impl::cursor>(other.m_impl->tree(),
+                                                                  other.m_impl->lazy());
         }
         m_impl->copy(*other.m_impl);
     }
@@ -178,8 +239,10 @@ raw_btree_cursor& raw_btree_cursor::operator=(const raw_btree_cursor& other) {
         if (!other.m_impl) {
             m_impl.reset();
         } else {
-            if (!m_impl || m_impl->tree() != other.m_impl->tree()) {
-                m_impl = std::make_unique<detail::btree_impl::cursor>(other.m_impl->tree());
+            if (!m_impl || m_impl->tree() != other.m_impl->tree()
+                || m_impl->lazy() != other.m_impl->lazy()) {
+                m_impl = std::make_unique<detail::btree_impl::cursor>(other.m_impl->tree(),
+                                                                      other.m_impl->lazy());
             }
             m_impl->copy(*other.m_impl);
         }
@@ -207,11 +270,22 @@ u32 raw_btree_cursor::key_size() const {
     return impl().key_size();
 }
 
+bool raw_btree_cursor::lazy() const {
+    return m_impl && impl().lazy();
+}
+
+// Lazy cursors must be synchronized with the tree before their position is observed.
 bool raw_btree_cursor::at_end() const {
-    return !m_impl || impl().at_end();
+    if (!m_impl)
+        return true;
+    impl().sync();
+    return impl().at_end();
 }
 bool raw_btree_cursor::erased() const {
-    return m_impl && impl().erased();
+    if (!m_impl)
+        return false;
+    impl().sync();
+    return impl().erased();
 }
 
 void raw_btree_cursor::reset() {
@@ -253,6 +327,7 @@ void raw_btree_cursor::set(const byte* data) {
     return impl().set(data);
 }
 const byte* raw_btree_cursor::get() const {
+    impl().sync();
     return impl().get();
 }
 
@@ -262,11 +337,13 @@ void raw_btree_cursor::validate() const {
 
 bool raw_btree_cursor::operator==(const raw_btree_cursor& other) const {
     if (!m_impl) {
-        return !other.m_impl || other.impl().at_end();
+        return other.at_end();
     }
     if (!other.m_impl) {
-        return impl().at_end();
+        return at_end();
     }
+    impl().sync();
+    other.impl().sync();
     return impl() == other.impl();
 }
 
@@ -307,6 +384,10 @@ void raw_btree_loader::insert(const byte* values, size_t count) {
     return impl().insert(values, count);
 }
 
+void raw_btree_loader::insert_parallel(const byte* values, size_t count, u32 threads) {
+    return impl().insert_parallel(values, count, threads);
+}
+
 void raw_btree_loader::finish() {
     impl().finish();
 }
@@ -27,9 +27,10 @@ private:
     };
 
     enum flags_t {
-        INVALID = 1 << 0,    ///< When the cursor is at the end or was otherwise invalidated.
-        DELETED = 1 << 1,    ///< When the current element was deleted.
-        INPROGRESS = 1 << 2, ///< When an operation is not yet complete.
+        INVALID = 1 << 0,       ///< When the cursor is at the end or was otherwise invalidated.
+        DELETED = 1 << 1,       ///< When the current element was deleted.
+        INPROGRESS = 1 << 2,    ///< When an operation is not yet complete.
+        STALE_PARENTS = 1 << 3, ///< When the parent stack was dropped after following a leaf link.
     };
 
     btree_impl::tree* m_tree = nullptr;
@@ -37,9 +38,19 @@ private:
     /// Tracked cursors are linked together in a list.
     /// When elements are inserted or removed, existing cursors are updated
     /// so that they keep pointing at the same element.
+    /// Lazy cursors are kept in a separate list that is only used when the tree is destroyed.
     boost::intrusive::list_member_hook<> m_cursors;
 
-    // Parents of the current leaf node.
+    // Lazy cursors are not updated by modifications. Instead, they remember the key of their
+    // current value and the tree's versions at the time they were positioned. If the tree
+    // has been modified since then, they validate their position (see sync()).
+    bool m_lazy = false;
+    u64 m_version = 0;
+    u64 m_structure_version = 0;
+    key_buffer m_key;
+
+    // Parents of the current leaf node. Empty if the STALE_PARENTS flag is set,
+    // in which case the tree recomputes the stack when it is needed again.
     std::vector<internal_entry> m_parents;
 
     // The current leaf node.
@@ -48,11 +59,15 @@ private:
     // The current value's index in its leaf.
     u32 m_index = 0;
 
+    // Holds a copy of the current value if the leaf does not store complete values
+    // (leaf prefix compression), see get().
+    mutable std::vector<byte> m_value;
+
     // A combination of flags_t values.
     int m_flags = 0;
 
 public:
-    inline explicit cursor(btree_impl::tree* parent);
+    inline explicit cursor(btree_impl::tree* parent, bool lazy = false);
     inline ~cursor();
 
     cursor(const cursor&) = delete;
@@ -63,6 +78,12 @@ public:
 
     btree_impl::tree* tree() const { return m_tree; }
 
+    bool lazy() const { return m_lazy; }
+
+    // Repositions a lazy cursor if the tree has been modified since the cursor last moved.
+    // Called before the cursor's position is used. Does nothing for tracked cursors.
+    inline void sync();
+
     void reset_to_zero() {
         m_flags = 0;
         m_parents.clear();
@@ -74,12 +95,14 @@ public:
     // The old flags can get saved.
     void reset_to_invalid(int saved_flags = 0) {
         reset_to_zero();
-        m_flags |= saved_flags;
+        m_flags |= saved_flags & ~STALE_PARENTS;
         m_flags |= INVALID;
     }
 
     bool invalid() const { return m_flags & INVALID; }
 
+    bool parents_stale() const { return m_flags & STALE_PARENTS; }
+
 public:
     inline u32 value_size() const;
     inline u32 key_size() const;
@@ -110,6 +133,15 @@ private:
     template<bool max>
     inline void init_position();
 
+private:
+    // Remembers the current key and the tree's version (lazy cursors only).
+    // Called after the cursor has been positioned.
+    inline void remember_position();
+
+    // Moves a lazy cursor into the list of tracked cursors (or back again). Lazy cursors
+    // are tracked while they modify the tree themselves, so that they take part in the fixups.
+    inline void set_tracked(bool tracked);
+
 private:
     inline void check_tree_valid() const;
     inline void check_element_valid() const;
@@ -4,12 +4,14 @@
 #include "cursor.hpp"
 #include "tree.hpp"
 
+#include <prequel/deferred.hpp>
 #include <prequel/exception.hpp>
 
 namespace prequel::detail::btree_impl {
 
-cursor::cursor(btree_impl::tree* parent)
-    : m_tree(parent) {
+cursor::cursor(btree_impl::tree* parent, bool lazy)
+    : m_tree(parent)
+    , m_lazy(lazy) {
     if (m_tree)
         m_tree->link_cursor(this);
     reset_to_invalid();
@@ -25,10 +27,74 @@ void cursor::copy(const cursor& other) {
         return;
 
     PREQUEL_ASSERT(m_tree == other.m_tree, "Cursors must belong to the same tree.");
+    PREQUEL_ASSERT(m_lazy == other.m_lazy, "Cursors must be of the same kind.");
     m_parents = other.m_parents;
     m_leaf = other.m_leaf;
     m_index = other.m_index;
     m_flags = other.m_flags;
+    m_version = other.m_version;
+    m_structure_version = other.m_structure_version;
+    m_key = other.m_key;
+}
+
+void cursor::sync() {
+    if (!m_lazy || !m_tree || m_version == m_tree->version())
+        return;
+    if ((m_flags & INVALID) && !(m_flags & DELETED))
+        return; // At the end, or not positioned at all.
+
+    // An erased value has been replaced by its successor, which is the first value with a
+    // greater key. Otherwise, the value might have been erased since the cursor last moved.
+    const bool deleted = m_flags & DELETED;
+
+    // Shortcut for lazy cursors: if no nodes have been changed structurally, the leaf and
+    // the parent path are still correct. Only the index within the leaf must be searched again.
+    if (m_structure_version == m_tree->structure_version() && !(m_flags & INVALID)) {
+        const u32 index = deleted ? m_tree->upper_bound(m_leaf, m_key.data())
+                                  : m_tree->lower_bound(m_leaf, m_key.data());
+        if (index < m_leaf.get_size()) {
+            m_index = index;
+            if (!deleted) {
+                key_buffer key;
+                m_tree->leaf_key(m_leaf, index, key.data());
+                if (!m_tree->key_equal(key.data(), m_key.data()))
+                    m_flags |= DELETED;
+            }
+            m_version = m_tree->version();
+            return;
+        }
+        // Otherwise the successor is in another leaf.
+    }
+
+    if (deleted) {
+        m_tree->upper_bound(m_key.data(), *this);
+    } else {
+        m_tree->lower_bound(m_key.data(), *this);
+    }
+    if (deleted || (m_flags & INVALID) || !m_tree->value_equal_key(get(), m_key.data()))
+        m_flags |= DELETED;
+    m_version = m_tree->version();
+    m_structure_version = m_tree->structure_version();
+}
+
+void cursor::remember_position() {
+    if (!m_lazy || !m_tree)
+        return;
+
+    m_version = m_tree->version();
+    m_structure_version = m_tree->structure_version();
+    if (!(m_flags & (INVALID | DELETED)))
+        m_tree->leaf_key(m_leaf, m_index, m_key.data());
+}
+
+void cursor::set_tracked(bool tracked) {
+    PREQUEL_ASSERT(m_tree, "Cursor must belong to a tree.");
+    if (tracked == !m_lazy)
+        return;
+
+    m_tree->unlink_cursor(this);
+    m_lazy = !tracked;
+    m_tree->link_cursor(this);
 }
 
 void cursor::check_tree_valid() const {
@@ -46,7 +112,7 @@ void cursor::check_element_valid() const {
         PREQUEL_THROW(bad_cursor("Bad cursor."));
 
 #ifdef PREQUEL_DEBUG
-    {
+    if (!parents_stale()) {
         const u32 height = m_tree->height();
         PREQUEL_ASSERT(m_parents.size() + 1 == height,
                        "Cursor does not have enough nodes on the stack.");
@@ -148,16 +214,19 @@ void cursor::init_position() {
 
 bool cursor::move_min() {
     init_position<false>();
+    remember_position();
     return !at_end();
 }
 
 bool cursor::move_max() {
     init_position<true>();
+    remember_position();
     return !at_end();
 }
 
 bool cursor::move_prev() {
     check_tree_valid();
+    sync();
 
     if (m_flags & DELETED) {
         m_flags &= ~DELETED;
@@ -169,36 +238,26 @@ bool cursor::move_prev() {
 
     if (m_index > 0) {
         --m_index;
+        remember_position();
         return true;
     }
 
-    // Find a parent that is not yet at index 0.
-    auto rpos = std::find_if(m_parents.rbegin(), m_parents.rend(),
-                             [&](const internal_entry& entry) { return entry.index > 0; });
-    if (rpos == m_parents.rend()) {
+    m_flags |= INPROGRESS;
+    if (!m_tree->prev_leaf(*this)) {
         reset_to_invalid();
         return false;
     }
 
-    // Decrement the index in this parent node, then walk to the leaf level and set all indices to size - 1.
-    // Note that rpos.base() is the element *after* the parent.
-    m_flags |= INPROGRESS;
-    auto pos = std::prev(rpos.base());
-    pos->index -= 1;
-    for (auto child_pos = pos + 1; child_pos != m_parents.end(); ++child_pos, ++pos) {
-        child_pos->node = m_tree->read_internal(pos->node.get_child(pos->index));
-        child_pos->index = child_pos->node.get_child_count() - 1;
-    }
-
-    m_leaf = m_tree->read_leaf(pos->node.get_child(pos->index));
     PREQUEL_ASSERT(m_leaf.get_size() > 0, "Leaf cannot be empty.");
     m_index = m_leaf.get_size() - 1;
     m_flags &= ~INPROGRESS;
+    remember_position();
     return true;
 }
 
 bool cursor::move_next() {
     check_tree_valid();
+    sync();
 
     if (m_flags & DELETED) {
         m_flags &= ~DELETED;
@@ -211,74 +270,89 @@ bool cursor::move_next() {
     }
 
     if (m_index < m_leaf.get_size()) {
+        remember_position();
         return true;
     }
 
-    // Find a parent that is not yet at it's last index.
-    auto rpos = std::find_if(m_parents.rbegin(), m_parents.rend(), [&](const internal_entry& entry) {
-        return entry.index + 1 < entry.node.get_child_count();
-    });
-    if (rpos == m_parents.rend()) {
+    m_flags |= INPROGRESS;
+    if (!m_tree->next_leaf(*this)) {
         reset_to_invalid();
         return false;
     }
 
-    // Increment the index in this parent node, then walk to the leaf level and set all indices to 0.
-    // Note that rpos.base() is the element *after* the parent.
-    m_flags |= INPROGRESS;
-    auto pos = std::prev(rpos.base());
-    pos->index++;
-    for (auto child_pos = pos + 1; child_pos != m_parents.end(); ++child_pos, ++pos) {
-        child_pos->node = m_tree->read_internal(pos->node.get_child(pos->index));
-        child_pos->index = 0;
-    }
-
-    m_leaf = m_tree->read_leaf(pos->node.get_child(pos->index));
     PREQUEL_ASSERT(m_leaf.get_size() > 0, "Leaf cannot be empty.");
     m_index = 0;
     m_flags &= ~INPROGRESS;
+    remember_position();
     return true;
 }
 
 bool cursor::lower_bound(const byte* key) {
     check_tree_valid();
     m_tree->lower_bound(key, *this);
+    remember_position();
     return !at_end();
 }
 
 bool cursor::upper_bound(const byte* key) {
     check_tree_valid();
     m_tree->upper_bound(key, *this);
+    remember_position();
     return !at_end();
 }
 
 bool cursor::find(const byte* key) {
     check_tree_valid();
     m_tree->find(key, *this);
+    remember_position();
     return !at_end();
 }
 
 bool cursor::insert(const byte* value, bool overwrite) {
     check_tree_valid();
-    bool inserted = m_tree->insert(value, *this);
-    if (!inserted && overwrite) {
-        m_leaf.set(m_index, value);
+
+    bool inserted;
+    {
+        const bool lazy = m_lazy;
+        set_tracked(true);
+        deferred restore = [&] { set_tracked(!lazy); };
+
+        inserted = m_tree->insert(value, *this);
+        if (!inserted && overwrite) {
+            m_leaf.set(m_index, value);
+        }
     }
+    remember_position();
     return inserted;
 }
 
 void cursor::erase() {
+    sync();
     check_element_valid();
-    m_tree->erase(*this);
+
+    {
+        const bool lazy = m_lazy;
+        set_tracked(true);
+        deferred restore = [&] { set_tracked(!lazy); };
+
+        m_tree->erase(*this);
+    }
+    remember_position();
 }
 
 const byte* cursor::get() const {
     check_element_valid();
-    return m_leaf.get(m_index);
+    if (!m_leaf.prefixed())
+        return m_leaf.get(m_index);
+
+    m_value.resize(m_leaf.value_size());
+    m_leaf.get(m_index, m_value.data(), m_leaf.value_size());
+    return m_value.data();
 }
 
 void cursor::set(const byte* value) {
     PREQUEL_ASSERT(value, "Nullpointer instead of a value.");
+    sync();
     check_element_valid();
 
     key_buffer k1, k2;
@@ -287,6 +361,7 @@ void cursor::set(const byte* value) {
     if (std::memcmp(k1.data(), k2.data(), m_tree->key_size()) != 0) {
         PREQUEL_THROW(bad_argument("The key derived from the new value differs from the old key."));
     }
+    m_tree->check_value(value);
 
     m_leaf.set(m_index, value);
 }
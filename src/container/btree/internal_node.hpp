@@ -12,16 +12,31 @@ namespace prequel::detail::btree_impl {
 
 // Node layout:
 // - Header
+// - Key prefix (only with prefix compression): prefix length (u32) and the prefix bytes
 // - Array of search keys (N - 1)
-// - Array of child pointers (N)
+// - Array of child pointers (N), each followed by the size of the child's subtree
+//   (only in counted trees)
 //
 // Keys are in sorted order. There are N child pointers and N - 1 keys.
 // The subtree at child[i] contains values `<= key[i]`.
 // The subree at child[N - 1] contains values that are greater than all the other keys.
+//
+// With prefix compression, every key that can ever be stored in this node
+// (i.e. every key between the node's lower and upper bound, as defined by the parent)
+// starts with the node's prefix. The prefix is therefore stored only once and
+// the key array only contains the remaining `key_size - prefix_size` bytes of every key.
+// The capacity N of a node grows with the length of its prefix.
+// Prefix compression requires that keys are ordered like byte strings (i.e. like memcmp).
+//
+// In counted trees, every child pointer is stored together with the number of values
+// in the child's subtree. The subtree sizes are moved together with their child pointers.
 class internal_node {
     // Size of a child pointer.
     static constexpr auto block_index_size = serialized_size<block_index>();
 
+    // Size of a subtree size (only in counted trees).
+    static constexpr auto subtree_size_size = serialized_size<u64>();
+
     struct header {
         u32 size = 0; // Number of children in this node <= capacity.
 
@@ -31,13 +46,18 @@ class internal_node {
 public:
     internal_node() = default;
 
-    internal_node(block_handle block, u32 key_size, u32 max_children)
+    // The capacity `max_children` is the capacity of a node without a prefix.
+    internal_node(block_handle block, u32 key_size, u32 max_children, bool prefixed,
+                  bool counted)
         : m_handle(std::move(block), 0)
         , m_key_size(key_size)
-        , m_max_children(max_children) {
+        , m_max_children(max_children)
+        , m_prefixed(prefixed)
+        , m_counted(counted) {
         PREQUEL_ASSERT(key_size > 0, "Invalid key size");
         PREQUEL_ASSERT(max_children > 1, "Invalid capacity");
-        PREQUEL_ASSERT(compute_size(max_children, key_size) <= m_handle.block().block_size(),
+        PREQUEL_ASSERT(compute_size(max_children, key_size, prefixed, 0, counted)
+                           <= m_handle.block().block_size(),
                        "Node is too large.");
     }
 
@@ -45,19 +65,33 @@ public:
     const block_handle& block() const { return m_handle.block(); }
     block_index index() const { return block().index(); }
 
-    void init() { m_handle.set(header()); }
+    void init() {
+        m_handle.set(header());
+        if (m_prefixed)
+            m_handle.block().set<u32>(offset_of_prefix_size(), 0);
+    }
 
     u32 get_child_count() const { return m_handle.get<&header::size>(); }
     void set_child_count(u32 new_size) const {
-        PREQUEL_ASSERT(new_size <= m_max_children, "Invalid size");
+        PREQUEL_ASSERT(new_size <= max_children(), "Invalid size");
         m_handle.set<&header::size>(new_size);
     }
 
+    // The key must start with the node's prefix.
     void set_key(u32 index, const byte* key) const {
-        m_handle.block().write(offset_of_key(index), key, m_key_size);
+        const u32 prefix = prefix_size();
+        PREQUEL_ASSERT(std::memcmp(key, prefix_data(), prefix) == 0,
+                       "Key does not start with the node's prefix.");
+        m_handle.block().write(offset_of_key(index), key + prefix, m_key_size - prefix);
     }
 
-    const byte* get_key(u32 index) const { return m_handle.block().data() + offset_of_key(index); }
+    // Copies the complete key at the given index into the buffer (`key_size` bytes).
+    void get_key(u32 index, byte* buffer) const {
+        const u32 prefix = prefix_size();
+        std::memcpy(buffer, prefix_data(), prefix);
+        std::memcpy(buffer + prefix, m_handle.block().data() + offset_of_key(index),
+                    m_key_size - prefix);
+    }
 
     void set_child(u32 index, block_index child) const {
         m_handle.block().set(offset_of_child(index), child);
@@ -67,9 +101,21 @@ public:
         return m_handle.block().get<block_index>(offset_of_child(index));
     }
 
+    // Number of values in the subtree of the child at the given index (counted trees only).
+    void set_subtree_size(u32 index, u64 size) const {
+        PREQUEL_ASSERT(m_counted, "Node does not store subtree sizes.");
+        m_handle.block().set(offset_of_child(index) + block_index_size, size);
+    }
+
+    u64 get_subtree_size(u32 index) const {
+        PREQUEL_ASSERT(m_counted, "Node does not store subtree sizes.");
+        return m_handle.block().get<u64>(offset_of_child(index) + block_index_size);
+    }
+
     // Pre: 1 <= index <= get_child_count
     // Post: keys[index - 1] == split_key, children[index] == new_child.
     // Other keys and children will be shifted to the right.
+    // The subtree size of a new child is initialized to 0 (in this and the following functions).
     inline void insert_split_result(u32 index, const byte* split_key, block_index new_child) const;
 
     // Insert a (key, value)-pair at the front.
@@ -79,7 +125,8 @@ public:
     inline void append_entry(const byte* key, block_index child) const;
 
     // Sets the content (child_count - 1 keys and child_count children) of this node.
-    // Used during bulk loading.
+    // The keys are complete keys, i.e. they include the prefix (if any).
+    // Subtree sizes must be set separately. Used during bulk loading.
     inline void set_entries(const byte* keys, const block_index* children, u32 child_count);
 
     // Removes the child at the given index (and its key, if there is one).
@@ -88,57 +135,118 @@ public:
 
     // Merge with the right neighbor. The split key is the key that currently
     // represents this node in the parent.
+    // All keys of the neighbor must start with this node's prefix.
     inline void append_from_right(const byte* split_key, const internal_node& neighbor) const;
 
     // Merge with the left neighbor. The split key is the key that currently
     // represents the neighbor in the parent.
+    // All keys of the neighbor must start with this node's prefix.
     inline void prepend_from_left(const byte* split_key, const internal_node& neighbor) const;
 
     /// Moves half of this node's keys and children into the right node.
     /// Sets the split key to the key that should go in the middle.
+    /// The right node inherits this node's prefix.
     inline void split(const internal_node& right, byte* split_key) const;
 
-    u32 min_children() const { return compute_min_children(max_children()); }
-    u32 max_children() const { return m_max_children; }
+    /// Replaces the prefix of this node (only with prefix compression).
+    /// All keys in this node must start with the new prefix and the
+    /// node must not have more children than its new capacity permits.
+    /// Shortening the prefix is always possible for nodes that are not overflowing
+    /// the capacity of a node without prefix.
+    inline void set_prefix(const byte* prefix, u32 prefix_size) const;
+
+    /// Length of the common prefix of all keys in this node. Always 0 without prefix compression.
+    u32 prefix_size() const {
+        return m_prefixed ? m_handle.block().get<u32>(offset_of_prefix_size()) : 0;
+    }
+
+    /// Points to the common prefix of all keys in this node (`prefix_size()` bytes).
+    const byte* prefix_data() const { return m_handle.block().data() + offset_of_prefix(); }
+
+    bool prefixed() const { return m_prefixed; }
+
+    bool counted() const { return m_counted; }
 
-    u32 max_keys() const { return m_max_children - 1; }
+    u32 min_children() const { return compute_min_children(m_max_children); }
+    u32 max_children() const {
+        return m_prefixed ? compute_max_children(block().block_size(), m_key_size, true,
+                                                 prefix_size(), m_counted)
+                          : m_max_children;
+    }
+
+    u32 max_keys() const { return max_children() - 1; }
     u32 key_size() const { return m_key_size; }
 
 public:
-    static u32 compute_max_children(u32 block_size, u32 key_size) {
-        u32 hdr_size = serialized_size<header>();
-        u32 ptr_size = block_index_size;
+    static u32 compute_max_children(u32 block_size, u32 key_size, bool prefixed = false,
+                                    u32 prefix_size = 0, bool counted = false) {
+        PREQUEL_ASSERT(prefix_size < key_size, "Invalid prefix size.");
+
+        u32 hdr_size = compute_header_size(prefixed, prefix_size);
+        u32 stored_key_size = key_size - prefix_size;
+        u32 ptr_size = compute_child_size(counted);
         if (block_size < hdr_size)
             return 0;
 
-        return (block_size - hdr_size + key_size) / (key_size + ptr_size);
+        return (block_size - hdr_size + stored_key_size) / (stored_key_size + ptr_size);
     }
 
     static u32 compute_min_children(u32 max_children) { return max_children / 2; }
 
-    static u32 compute_size(u32 max_children, u32 key_size) {
+    static u32 compute_size(u32 max_children, u32 key_size, bool prefixed = false,
+                            u32 prefix_size = 0, bool counted = false) {
         PREQUEL_ASSERT(max_children > 1, "Invalid node capacity.");
 
-        u32 hdr_size = serialized_size<header>();
-        u32 ptr_size = block_index_size;
-        return hdr_size + (max_children - 1) * key_size + max_children * ptr_size;
+        u32 hdr_size = compute_header_size(prefixed, prefix_size);
+        u32 ptr_size = compute_child_size(counted);
+        return hdr_size + (max_children - 1) * (key_size - prefix_size) + max_children * ptr_size;
     }
 
 private:
+    static u32 compute_child_size(bool counted) {
+        return counted ? block_index_size + subtree_size_size : block_index_size;
+    }
+
+    // Size of a child entry (child pointer and subtree size, if any).
+    u32 child_size() const { return compute_child_size(m_counted); }
+
+    // Writes the child pointer (and an empty subtree size) to the child entry.
+    inline void init_child(byte* entry, block_index child) const;
+
+    static u32 compute_header_size(bool prefixed, u32 prefix_size) {
+        u32 size = serialized_size<header>();
+        if (prefixed)
+            size += serialized_size<u32>() + prefix_size;
+        return size;
+    }
+
+    // Size of a key, without the prefix.
+    u32 stored_key_size() const { return m_key_size - prefix_size(); }
+
+    u32 offset_of_prefix_size() const { return serialized_size<header>(); }
+
+    u32 offset_of_prefix() const { return offset_of_prefix_size() + serialized_size<u32>(); }
+
+    u32 offset_of_keys() const {
+        return m_prefixed ? offset_of_prefix() + prefix_size() : serialized_size<header>();
+    }
+
     u32 offset_of_child(u32 index) const {
         PREQUEL_ASSERT(index <= max_children(), "Child index out of bounds");
-        return serialized_size<header>() + (max_keys() * m_key_size) + (index * block_index_size);
+        return offset_of_keys() + (max_keys() * stored_key_size()) + (index * child_size());
     }
 
     u32 offset_of_key(u32 index) const {
         PREQUEL_ASSERT(index <= max_keys(), "Key index ouf bounds");
-        return serialized_size<header>() + m_key_size * index;
+        return offset_of_keys() + stored_key_size() * index;
     }
 
 private:
     handle<header> m_handle;
-    u32 m_key_size = 0;     // Size of a search key
-    u32 m_max_children = 0; // Number of CHILDREN per node (there can be `capacity - 1` keys).
+    u32 m_key_size = 0;      // Size of a search key
+    u32 m_max_children = 0;  // Number of CHILDREN per node (without prefix).
+    bool m_prefixed = false; // True if the node stores a common key prefix.
+    bool m_counted = false;  // True if the node stores subtree sizes.
 };
 
 } // namespace prequel::detail::btree_impl
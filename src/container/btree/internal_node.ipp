@@ -3,6 +3,10 @@
 
 #include "internal_node.hpp"
 
+#include "base.hpp"
+
+#include <vector>
+
 namespace prequel::detail::btree_impl {
 
 void internal_node::insert_split_result(u32 index, const byte* split_key,
@@ -11,18 +15,18 @@ void internal_node::insert_split_result(u32 index, const byte* split_key,
     PREQUEL_ASSERT(index >= 1 && index <= get_child_count(), "Index out of bounds");
 
     const u32 child_count = get_child_count();
+    const u32 key_size = stored_key_size();
     byte* const data = m_handle.block().writable_data();
 
     // Shift keys to the right, then update key[index - 1]
     byte* const key_begin = data + offset_of_key(index - 1);
-    std::memmove(key_begin + m_key_size, key_begin, m_key_size * ((child_count - 1) - (index - 1)));
-    std::memmove(key_begin, split_key, m_key_size);
+    std::memmove(key_begin + key_size, key_begin, key_size * ((child_count - 1) - (index - 1)));
+    set_key(index - 1, split_key);
 
     // Shift children to the right, then update children[index]
     byte* const child_begin = data + offset_of_child(index);
-    std::memmove(child_begin + block_index_size, child_begin,
-                 block_index_size * (child_count - index));
-    prequel::serialize(new_child, child_begin);
+    std::memmove(child_begin + child_size(), child_begin, child_size() * (child_count - index));
+    init_child(child_begin, new_child);
 
     set_child_count(child_count + 1);
 }
@@ -34,11 +38,11 @@ void internal_node::prepend_entry(const byte* key, block_index child) const {
     byte* const data = m_handle.block().writable_data();
 
     // Shift all keys and children to the right.
-    std::memmove(data + offset_of_key(1), data + offset_of_key(0), m_key_size * (child_count - 1));
-    std::memmove(data + offset_of_child(1), data + offset_of_child(0),
-                 block_index_size * child_count);
-    std::memmove(data + offset_of_key(0), key, m_key_size);
-    prequel::serialize(child, data + offset_of_child(0));
+    std::memmove(data + offset_of_key(1), data + offset_of_key(0),
+                 stored_key_size() * (child_count - 1));
+    std::memmove(data + offset_of_child(1), data + offset_of_child(0), child_size() * child_count);
+    set_key(0, key);
+    init_child(data + offset_of_child(0), child);
 
     set_child_count(child_count + 1);
 }
@@ -49,8 +53,8 @@ void internal_node::append_entry(const byte* key, block_index child) const {
     const u32 child_count = get_child_count();
     byte* const data = m_handle.block().writable_data();
 
-    std::memmove(data + offset_of_key(child_count - 1), key, m_key_size);
-    prequel::serialize(child, data + offset_of_child(child_count));
+    set_key(child_count - 1, key);
+    init_child(data + offset_of_child(child_count), child);
 
     set_child_count(child_count + 1);
 }
@@ -63,12 +67,18 @@ void internal_node::set_entries(const byte* keys, const block_index* children, u
     byte* data = m_handle.block().writable_data();
 
     // Insert the keys and the child pointers.
-    std::memmove(data + offset_of_key(0), keys, m_key_size * (child_count - 1));
+    if (prefix_size() == 0) {
+        std::memmove(data + offset_of_key(0), keys, m_key_size * (child_count - 1));
+    } else {
+        for (u32 i = 0; i < child_count - 1; ++i) {
+            set_key(i, keys + i * m_key_size);
+        }
+    }
     {
         byte* child_cursor = data + offset_of_child(0);
         for (u32 i = 0; i < child_count; ++i) {
-            prequel::serialize(children[i], child_cursor);
-            child_cursor += serialized_size<block_index>();
+            init_child(child_cursor, children[i]);
+            child_cursor += child_size();
         }
     }
     set_child_count(child_count);
@@ -81,10 +91,10 @@ void internal_node::remove_child(u32 index) const {
     byte* const data = m_handle.block().writable_data();
 
     std::memmove(data + offset_of_child(index), data + offset_of_child(index + 1),
-                 block_index_size * (child_count - index - 1));
+                 child_size() * (child_count - index - 1));
     if (index != child_count - 1) {
         std::memmove(data + offset_of_key(index), data + offset_of_key(index + 1),
-                     m_key_size * (child_count - index - 2));
+                     stored_key_size() * (child_count - index - 2));
     }
     set_child_count(child_count - 1);
 }
@@ -100,11 +110,19 @@ void internal_node::append_from_right(const byte* split_key, const internal_node
     byte* data = m_handle.block().writable_data();
     const byte* neighbor_data = neighbor.m_handle.block().data();
 
-    std::memmove(data + offset_of_key(child_count - 1), split_key, key_size());
-    std::memmove(data + offset_of_key(child_count), neighbor_data + offset_of_key(0),
-                 (neighbor_child_count - 1) * key_size());
-    std::memmove(data + offset_of_child(child_count), neighbor_data + offset_of_child(0),
-                 neighbor_child_count * block_index_size);
+    set_key(child_count - 1, split_key);
+    if (prefix_size() == neighbor.prefix_size()) {
+        std::memmove(data + offset_of_key(child_count), neighbor_data + neighbor.offset_of_key(0),
+                     (neighbor_child_count - 1) * stored_key_size());
+    } else {
+        key_buffer key;
+        for (u32 i = 0; i < neighbor_child_count - 1; ++i) {
+            neighbor.get_key(i, key.data());
+            set_key(child_count + i, key.data());
+        }
+    }
+    std::memmove(data + offset_of_child(child_count), neighbor_data + neighbor.offset_of_child(0),
+                 neighbor_child_count * child_size());
 
     set_child_count(child_count + neighbor_child_count);
 }
@@ -122,16 +140,24 @@ void internal_node::prepend_from_left(const byte* split_key, const internal_node
 
     // Shift existing keys and children to the right.
     std::memmove(data + offset_of_key(neighbor_child_count), data + offset_of_key(0),
-                 (child_count - 1) * key_size());
+                 (child_count - 1) * stored_key_size());
     std::memmove(data + offset_of_child(neighbor_child_count), data + offset_of_child(0),
-                 child_count * block_index_size);
+                 child_count * child_size());
 
     // Insert keys and children from the left node.
-    std::memmove(data + offset_of_key(0), neighbor_data + offset_of_key(0),
-                 (neighbor_child_count - 1) * key_size());
-    std::memmove(data + offset_of_key(neighbor_child_count - 1), split_key, key_size());
-    std::memmove(data + offset_of_child(0), neighbor_data + offset_of_child(0),
-                 neighbor_child_count * block_index_size);
+    if (prefix_size() == neighbor.prefix_size()) {
+        std::memmove(data + offset_of_key(0), neighbor_data + neighbor.offset_of_key(0),
+                     (neighbor_child_count - 1) * stored_key_size());
+    } else {
+        key_buffer key;
+        for (u32 i = 0; i < neighbor_child_count - 1; ++i) {
+            neighbor.get_key(i, key.data());
+            set_key(i, key.data());
+        }
+    }
+    set_key(neighbor_child_count - 1, split_key);
+    std::memmove(data + offset_of_child(0), neighbor_data + neighbor.offset_of_child(0),
+                 neighbor_child_count * child_size());
 
     set_child_count(child_count + neighbor_child_count);
 }
@@ -140,6 +166,9 @@ void internal_node::split(const internal_node& right, byte* split_key) const {
     PREQUEL_ASSERT(get_child_count() == max_children(), "Node must be full.");
     PREQUEL_ASSERT(right.get_child_count() == 0, "Right node must be empty.");
     PREQUEL_ASSERT(key_size() == right.key_size(), "Key size missmatch.");
+
+    if (m_prefixed)
+        right.set_prefix(prefix_data(), prefix_size());
     PREQUEL_ASSERT(max_children() == right.max_children(), "Capacity missmatch.");
 
     const u32 child_count = get_child_count();
@@ -150,17 +179,54 @@ void internal_node::split(const internal_node& right, byte* split_key) const {
     const byte* left_data = block().data();
 
     std::memmove(right_data + offset_of_key(0), left_data + offset_of_key(left_count),
-                 key_size() * (right_count - 1));
+                 stored_key_size() * (right_count - 1));
     std::memmove(right_data + offset_of_child(0), left_data + offset_of_child(left_count),
-                 block_index_size * right_count);
+                 child_size() * right_count);
 
     // Rescue split key.
-    std::memmove(split_key, left_data + offset_of_key(left_count - 1), key_size());
+    get_key(left_count - 1, split_key);
 
     set_child_count(left_count);
     right.set_child_count(right_count);
 }
 
+void internal_node::set_prefix(const byte* prefix, u32 new_prefix_size) const {
+    PREQUEL_ASSERT(m_prefixed, "Node does not support prefixes.");
+    PREQUEL_ASSERT(new_prefix_size < m_key_size, "Prefix is too long.");
+
+    const u32 child_count = get_child_count();
+    PREQUEL_ASSERT(child_count <= compute_max_children(block().block_size(), m_key_size, true,
+                                                       new_prefix_size, m_counted),
+                   "Too many children for the new prefix.");
+
+    // The prefix might point into this node.
+    key_buffer new_prefix;
+    std::memcpy(new_prefix.data(), prefix, new_prefix_size);
+
+    // Save the current content in complete form, then rewrite the node using the new layout.
+    // Child entries (including their subtree sizes) do not depend on the prefix.
+    std::vector<byte> keys(child_count > 0 ? (child_count - 1) * m_key_size : 0);
+    std::vector<byte> children(child_count * child_size());
+    for (u32 i = 0; i + 1 < child_count; ++i) {
+        get_key(i, keys.data() + i * m_key_size);
+    }
+    std::memcpy(children.data(), block().data() + offset_of_child(0), children.size());
+
+    byte* data = m_handle.block().writable_data();
+    m_handle.block().set<u32>(offset_of_prefix_size(), new_prefix_size);
+    std::memcpy(data + offset_of_prefix(), new_prefix.data(), new_prefix_size);
+    for (u32 i = 0; i + 1 < child_count; ++i) {
+        set_key(i, keys.data() + i * m_key_size);
+    }
+    m_handle.block().write(offset_of_child(0), children.data(), children.size());
+}
+
+void internal_node::init_child(byte* entry, block_index child) const {
+    prequel::serialize(child, entry);
+    if (m_counted)
+        prequel::serialize(u64(0), entry + block_index_size);
+}
+
 } // namespace prequel::detail::btree_impl
 
 #endif // PREQUEL_BTREE_INTERNAL_NODE_IPP
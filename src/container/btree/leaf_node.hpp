@@ -1,22 +1,34 @@
 #ifndef PREQUEL_BTREE_LEAF_NODE_HPP
 #define PREQUEL_BTREE_LEAF_NODE_HPP
 
+#include <prequel/block_index.hpp>
 #include <prequel/defs.hpp>
 #include <prequel/handle.hpp>
 #include <prequel/serialization.hpp>
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 namespace prequel::detail::btree_impl {
 
 // Node layout:
 // - Header
+// - Links to the previous and next leaf (only if the tree uses linked leaves)
+// - Value prefix (only with leaf prefix compression): prefix length (u32) and the prefix bytes
 // - Array of values (N)
 //
 // Values are ordered by their key.
+//
+// With leaf prefix compression, every value starts with its key and every key that can
+// ever be stored in this leaf (i.e. every key between the leaf's lower and upper bound,
+// as defined by the parent) starts with the leaf's prefix. The prefix is therefore stored
+// only once and the value array only contains the remaining `value_size - prefix_size` bytes
+// of every value. The capacity N of a leaf grows with the length of its prefix.
 class leaf_node {
 private:
-    // Note: no next/prev pointers, no type tag, no depth info.
+    // Note: no type tag, no depth info. Sibling pointers are optional
+    // and live directly behind the header (see raw_btree_options::linked_leaves).
     struct header {
         u32 size = 0; // Number of values in this node <= capacity.
 
@@ -26,71 +38,199 @@ private:
 public:
     leaf_node() = default;
 
-    leaf_node(block_handle block, u32 value_size, u32 max_children)
+    // The capacity `max_children` is the capacity of a leaf without a prefix.
+    leaf_node(block_handle block, u32 value_size, u32 max_children, bool linked,
+              bool prefixed = false)
         : m_handle(std::move(block), 0)
         , m_value_size(value_size)
-        , m_max_children(max_children) {}
+        , m_max_children(max_children)
+        , m_linked(linked)
+        , m_prefixed(prefixed) {}
 
     bool valid() const { return m_handle.valid(); }
     const block_handle& block() const { return m_handle.block(); }
     block_index index() const { return block().index(); }
 
-    void init() { m_handle.set(header()); }
+    void init() {
+        m_handle.set(header());
+        if (m_linked) {
+            set_prev(block_index());
+            set_next(block_index());
+        }
+        if (m_prefixed)
+            m_handle.block().set<u32>(offset_of_prefix_size(), 0);
+    }
+
+    bool linked() const { return m_linked; }
+
+    // Sibling pointers. Only available if the node was created with `linked == true`.
+    block_index get_prev() const {
+        PREQUEL_ASSERT(m_linked, "Leaf nodes are not linked.");
+        return m_handle.block().get<block_index>(offset_of_prev());
+    }
+    void set_prev(block_index prev) const {
+        PREQUEL_ASSERT(m_linked, "Leaf nodes are not linked.");
+        m_handle.block().set(offset_of_prev(), prev);
+    }
+
+    block_index get_next() const {
+        PREQUEL_ASSERT(m_linked, "Leaf nodes are not linked.");
+        return m_handle.block().get<block_index>(offset_of_next());
+    }
+    void set_next(block_index next) const {
+        PREQUEL_ASSERT(m_linked, "Leaf nodes are not linked.");
+        m_handle.block().set(offset_of_next(), next);
+    }
 
     u32 get_size() const { return m_handle.get<&header::size>(); }
     void set_size(u32 new_size) const {
-        PREQUEL_ASSERT(new_size <= m_max_children, "Invalid size");
+        PREQUEL_ASSERT(new_size <= max_size(), "Invalid size");
         m_handle.set<&header::size>(new_size);
     }
 
-    u32 min_size() const { return m_max_children / 2; }
-    u32 max_size() const { return m_max_children; }
+    u32 max_size() const {
+        return m_prefixed ? capacity(block().block_size(), m_value_size, m_linked, true,
+                                     prefix_size())
+                          : m_max_children;
+    }
     u32 value_size() const { return m_value_size; }
 
+    // The value must start with the leaf's prefix.
     void set(u32 index, const byte* value) const {
-        PREQUEL_ASSERT(index < m_max_children, "Index out of bounds.");
-        m_handle.block().write(offset_of_value(index), value, m_value_size);
+        PREQUEL_ASSERT(index < max_size(), "Index out of bounds.");
+        m_handle.block().write(offset_of_value(index), stored_part(value), stored_value_size());
     }
 
+    // Points to the complete value. Only available for leaves without a prefix,
+    // use the overload below otherwise.
     const byte* get(u32 index) const {
+        PREQUEL_ASSERT(!m_prefixed, "Leaf values are stored without their prefix.");
         PREQUEL_ASSERT(index < m_max_children, "Index out of bounds.");
         return m_handle.block().data() + offset_of_value(index);
     }
 
+    // Copies the first `n` bytes of the complete value at the given index into the buffer.
+    void get(u32 index, byte* buffer, u32 n) const {
+        PREQUEL_ASSERT(index < max_size(), "Index out of bounds.");
+        PREQUEL_ASSERT(n <= m_value_size, "Too many bytes.");
+        const u32 prefix = std::min(prefix_size(), n);
+        std::memcpy(buffer, prefix_data(), prefix);
+        std::memcpy(buffer + prefix, m_handle.block().data() + offset_of_value(index), n - prefix);
+    }
+
+    /// Replaces the prefix of this leaf (only with leaf prefix compression).
+    /// All values in this leaf must start with the new prefix and the
+    /// leaf must not have more values than its new capacity permits.
+    inline void set_prefix(const byte* prefix, u32 prefix_size) const;
+
+    /// Length of the common prefix of all values in this leaf.
+    /// Always 0 without leaf prefix compression.
+    u32 prefix_size() const {
+        return m_prefixed ? m_handle.block().get<u32>(offset_of_prefix_size()) : 0;
+    }
+
+    /// Points to the common prefix of all values in this leaf (`prefix_size()` bytes).
+    const byte* prefix_data() const { return m_handle.block().data() + offset_of_prefix(); }
+
+    bool prefixed() const { return m_prefixed; }
+
     // Insert the new value at the given index and shift values to the right.
     inline void insert_nonfull(u32 index, const byte* value) const;
 
-    // Insert a range of values at the end. For bulk loading.
+    // Insert a range of values (stored contiguously) at the end. For bulk loading.
     inline void append_nonfull(const byte* values, u32 count) const;
 
+    // Insert `count` values in a single pass. `values[i]` is inserted in front of the value
+    // that is currently at `positions[i]` (or at the end, if that equals the size).
+    // Positions must be sorted and the node must have enough space for all values.
+    inline void merge_nonfull(const byte* const* values, const u32* positions, u32 count) const;
+
     // Perform a node split and insert the new value at the appropriate position.
     // `mid` is the size of *this, after the split (other values end up in new_leaf).
     // If index < mid, then the new value is in the left node, at the given index.
     // Otherwise the new value is in new_leaf, at `index - mid`.
     inline void insert_full(u32 index, const byte* value, u32 mid, const leaf_node& new_leaf) const;
 
-    // Removes the value at the given index and shifts all values after it to the left.
-    inline void remove(u32 index) const;
+    // Removes `count` values starting at the given index and shifts all values after them
+    // to the left.
+    inline void remove(u32 index, u32 count = 1) const;
 
     // Append all values from the right neighbor.
+    // All values of the neighbor must start with this leaf's prefix.
     inline void append_from_right(const leaf_node& neighbor) const;
 
     // Prepend all values from the left neighbor.
+    // All values of the neighbor must start with this leaf's prefix.
     inline void prepend_from_left(const leaf_node& neighbor) const;
 
 public:
-    static u32 capacity(u32 block_size, u32 value_size) {
-        u32 hdr = serialized_size<header>();
+    // Writes the image of a complete leaf node into `block` without going through the engine,
+    // for example to prepare leaves concurrently. Returns the number of bytes written;
+    // the rest of the block must be zero.
+    static u32 write_image(byte* block, u32 value_size, bool linked, const byte* values,
+                           u32 count, block_index prev, block_index next) {
+        header h;
+        h.size = count;
+        serialize(h, block);
+        if (linked) {
+            serialize(prev, block + serialized_size<header>());
+            serialize(next, block + serialized_size<header>() + serialized_size<block_index>());
+        }
+        std::memcpy(block + values_offset(linked), values, size_t(value_size) * count);
+        return values_offset(linked) + value_size * count;
+    }
+
+    static u32 capacity(u32 block_size, u32 value_size, bool linked, bool prefixed = false,
+                        u32 prefix_size = 0) {
+        PREQUEL_ASSERT(prefix_size < value_size, "Invalid prefix size.");
+
+        u32 hdr = values_offset(linked);
+        if (prefixed)
+            hdr += serialized_size<u32>() + prefix_size;
         if (block_size < hdr)
             return 0;
-        return (block_size - hdr) / value_size;
+        return (block_size - hdr) / (value_size - prefix_size);
     }
 
 private:
+    static constexpr u32 values_offset(bool linked) {
+        return serialized_size<header>() + (linked ? 2 * serialized_size<block_index>() : 0);
+    }
+
+    u32 offset_of_prev() const { return serialized_size<header>(); }
+
+    u32 offset_of_next() const {
+        return serialized_size<header>() + serialized_size<block_index>();
+    }
+
+    u32 offset_of_prefix_size() const { return values_offset(m_linked); }
+
+    u32 offset_of_prefix() const { return offset_of_prefix_size() + serialized_size<u32>(); }
+
+    u32 offset_of_values() const {
+        return m_prefixed ? offset_of_prefix() + prefix_size() : values_offset(m_linked);
+    }
+
     u32 offset_of_value(u32 index) const {
-        return serialized_size<header>() + m_value_size * index;
+        return offset_of_values() + stored_value_size() * index;
     }
 
+    // Size of a value, without the prefix.
+    u32 stored_value_size() const { return m_value_size - prefix_size(); }
+
+    // Strips the prefix from a complete value.
+    const byte* stored_part(const byte* value) const {
+        const u32 prefix = prefix_size();
+        PREQUEL_ASSERT(std::memcmp(value, prefix_data(), prefix) == 0,
+                       "Value does not start with the leaf's prefix.");
+        return value + prefix;
+    }
+
+    // Copies `count` values from `source` (starting at `source_index`) into this leaf
+    // (starting at `index`). The prefix of this leaf must be a prefix of the source's prefix.
+    inline void copy_values(u32 index, const leaf_node& source, u32 source_index,
+                            u32 count) const;
+
     /// Insert a value into a sequence and perform a split at the same time.
     /// Values exist in `left`, and `right` is treated as empty.
     /// After the insertion, exactly `mid` entries will remain in `left` and the remaining
@@ -117,7 +257,9 @@ private:
 private:
     handle<header> m_handle;
     u32 m_value_size = 0;   // Size of a single value
-    u32 m_max_children = 0; // Max number of values per node
+    u32 m_max_children = 0;  // Max number of values per node (without prefix)
+    bool m_linked = false;   // True if the node stores sibling pointers
+    bool m_prefixed = false; // True if the node stores a common value prefix
 };
 
 } // namespace prequel::detail::btree_impl
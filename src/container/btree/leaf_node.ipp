@@ -6,85 +6,169 @@
 namespace prequel::detail::btree_impl {
 
 void leaf_node::insert_nonfull(u32 index, const byte* value) const {
-    PREQUEL_ASSERT(index < m_max_children, "Index out of bounds.");
+    PREQUEL_ASSERT(index < max_size(), "Index out of bounds.");
     PREQUEL_ASSERT(index <= get_size(), "Unexpected index (not in range).");
 
     u32 size = get_size();
+    u32 stored_size = stored_value_size();
     byte* data = m_handle.block().writable_data();
     std::memmove(data + offset_of_value(index + 1), data + offset_of_value(index),
-                 (size - index) * m_value_size);
-    std::memmove(data + offset_of_value(index), value, m_value_size);
+                 (size - index) * stored_size);
+    std::memmove(data + offset_of_value(index), stored_part(value), stored_size);
     set_size(size + 1);
 }
 
 void leaf_node::append_nonfull(const byte* values, u32 count) const {
     PREQUEL_ASSERT(count > 0, "Useless call.");
-    PREQUEL_ASSERT(count <= m_max_children, "Count out of bounds.");
-    PREQUEL_ASSERT(get_size() <= m_max_children - count, "Insert range out of bounds.");
+    PREQUEL_ASSERT(count <= max_size(), "Count out of bounds.");
+    PREQUEL_ASSERT(get_size() <= max_size() - count, "Insert range out of bounds.");
 
     const u32 old_size = get_size();
     byte* data = m_handle.block().writable_data();
-    std::memmove(data + offset_of_value(old_size), values, m_value_size * count);
+    if (prefix_size() == 0) {
+        std::memmove(data + offset_of_value(old_size), values, m_value_size * count);
+    } else {
+        const u32 stored_size = stored_value_size();
+        for (u32 i = 0; i < count; ++i) {
+            std::memcpy(data + offset_of_value(old_size + i),
+                        stored_part(values + i * m_value_size), stored_size);
+        }
+    }
     set_size(old_size + count);
 }
 
+void leaf_node::merge_nonfull(const byte* const* values, const u32* positions, u32 count) const {
+    PREQUEL_ASSERT(count > 0, "Useless call.");
+    PREQUEL_ASSERT(get_size() <= max_size() - count, "Insert range out of bounds.");
+
+    // Walk backwards and move every run of old values to its final position,
+    // which is shifted by the number of new values in front of it.
+    const u32 size = get_size();
+    const u32 stored_size = stored_value_size();
+    byte* data = m_handle.block().writable_data();
+    u32 end = size;
+    for (u32 i = count; i-- > 0;) {
+        const u32 pos = positions[i];
+        PREQUEL_ASSERT(pos <= end, "Positions must be sorted.");
+
+        std::memmove(data + offset_of_value(pos + i + 1), data + offset_of_value(pos),
+                     (end - pos) * stored_size);
+        std::memcpy(data + offset_of_value(pos + i), stored_part(values[i]), stored_size);
+        end = pos;
+    }
+    set_size(size + count);
+}
+
 void leaf_node::insert_full(u32 index, const byte* value, u32 mid, const leaf_node& new_leaf) const {
-    PREQUEL_ASSERT(mid <= m_max_children, "Mid out of bounds.");
+    const u32 max = max_size();
+    PREQUEL_ASSERT(mid <= max, "Mid out of bounds.");
     PREQUEL_ASSERT(m_value_size == new_leaf.m_value_size, "Value size missmatch.");
     PREQUEL_ASSERT(m_max_children == new_leaf.m_max_children, "Capacity missmatch.");
     PREQUEL_ASSERT(new_leaf.get_size() == 0, "New leaf must be empty.");
-    PREQUEL_ASSERT(get_size() == m_max_children, "Old leaf must be full.");
+    PREQUEL_ASSERT(get_size() == max, "Old leaf must be full.");
+
+    // The new leaf inherits this leaf's prefix, its values are a subset of the old ones.
+    if (m_prefixed)
+        new_leaf.set_prefix(prefix_data(), prefix_size());
 
     byte* left = m_handle.block().writable_data() + offset_of_value(0);
-    byte* right = new_leaf.block().writable_data() + offset_of_value(0);
-    sequence_insert(m_value_size, left, right, m_max_children, mid, index, value);
+    byte* right = new_leaf.block().writable_data() + new_leaf.offset_of_value(0);
+    sequence_insert(stored_value_size(), left, right, max, mid, index, stored_part(value));
     set_size(mid);
-    new_leaf.set_size(m_max_children + 1 - mid);
+    new_leaf.set_size(max + 1 - mid);
 }
 
-void leaf_node::remove(u32 index) const {
-    PREQUEL_ASSERT(index < m_max_children, "Index out of bounds.");
-    PREQUEL_ASSERT(index < get_size(), "Unexpected index (not in range).");
+void leaf_node::remove(u32 index, u32 count) const {
+    PREQUEL_ASSERT(index < max_size(), "Index out of bounds.");
+    PREQUEL_ASSERT(count > 0 && count <= get_size() - index, "Unexpected range (not in range).");
 
     u32 size = get_size();
     byte* data = m_handle.block().writable_data();
-    std::memmove(data + offset_of_value(index), data + offset_of_value(index + 1),
-                 (size - index - 1) * m_value_size);
-    set_size(size - 1);
+    std::memmove(data + offset_of_value(index), data + offset_of_value(index + count),
+                 (size - index - count) * stored_value_size());
+    set_size(size - count);
 }
 
 void leaf_node::append_from_right(const leaf_node& neighbor) const {
-    PREQUEL_ASSERT(get_size() + neighbor.get_size() <= m_max_children, "Too many values.");
+    PREQUEL_ASSERT(get_size() + neighbor.get_size() <= max_size(), "Too many values.");
     PREQUEL_ASSERT(value_size() == neighbor.value_size(), "Value size missmatch.");
 
     u32 size = get_size();
     u32 neighbor_size = neighbor.get_size();
-
-    byte* data = m_handle.block().writable_data();
-    const byte* neighbor_data = neighbor.m_handle.block().data();
-
-    std::memmove(data + offset_of_value(size), neighbor_data + offset_of_value(0),
-                 neighbor_size * value_size());
+    copy_values(size, neighbor, 0, neighbor_size);
     set_size(size + neighbor_size);
 }
 
 void leaf_node::prepend_from_left(const leaf_node& neighbor) const {
-    PREQUEL_ASSERT(get_size() + neighbor.get_size() <= m_max_children, "Too many values.");
+    PREQUEL_ASSERT(get_size() + neighbor.get_size() <= max_size(), "Too many values.");
     PREQUEL_ASSERT(value_size() == neighbor.value_size(), "Value size missmatch.");
 
     u32 size = get_size();
     u32 neighbor_size = neighbor.get_size();
 
     byte* data = m_handle.block().writable_data();
-    const byte* neighbor_data = neighbor.m_handle.block().data();
-
     std::memmove(data + offset_of_value(neighbor_size), data + offset_of_value(0),
-                 size * value_size());
-    std::memmove(data + offset_of_value(0), neighbor_data + offset_of_value(0),
-                 neighbor_size * value_size());
+                 size * stored_value_size());
+    copy_values(0, neighbor, 0, neighbor_size);
     set_size(size + neighbor_size);
 }
 
+void leaf_node::set_prefix(const byte* prefix, u32 new_prefix_size) const {
+    PREQUEL_ASSERT(m_prefixed, "Node does not support prefixes.");
+    PREQUEL_ASSERT(new_prefix_size < m_value_size, "Prefix is too long.");
+
+    const u32 size = get_size();
+    PREQUEL_ASSERT(size <= capacity(block().block_size(), m_value_size, m_linked, true,
+                                    new_prefix_size),
+                   "Too many values for the new prefix.");
+
+    // The prefix might point into this node.
+    std::vector<byte> new_prefix(prefix, prefix + new_prefix_size);
+
+    // Save the current content in complete form, then rewrite the node using the new layout.
+    std::vector<byte> values(size * m_value_size);
+    for (u32 i = 0; i < size; ++i) {
+        get(i, values.data() + i * m_value_size, m_value_size);
+    }
+
+    byte* data = m_handle.block().writable_data();
+    m_handle.block().set<u32>(offset_of_prefix_size(), new_prefix_size);
+    std::memcpy(data + offset_of_prefix(), new_prefix.data(), new_prefix_size);
+    for (u32 i = 0; i < size; ++i) {
+        set(i, values.data() + i * m_value_size);
+    }
+}
+
+void leaf_node::copy_values(u32 index, const leaf_node& source, u32 source_index,
+                            u32 count) const {
+    const u32 prefix = prefix_size();
+    const u32 source_prefix = source.prefix_size();
+    PREQUEL_ASSERT(prefix <= source_prefix
+                       && std::memcmp(prefix_data(), source.prefix_data(), prefix) == 0,
+                   "Values of the source do not start with this leaf's prefix.");
+
+    byte* data = m_handle.block().writable_data();
+    const byte* source_data = source.m_handle.block().data();
+    if (prefix == source_prefix) {
+        std::memmove(data + offset_of_value(index),
+                     source_data + source.offset_of_value(source_index),
+                     count * stored_value_size());
+        return;
+    }
+
+    // The part of the source's prefix that is not covered by this leaf's prefix
+    // becomes part of every stored value.
+    const byte* extra = source.prefix_data() + prefix;
+    const u32 extra_size = source_prefix - prefix;
+    const u32 source_stored_size = source.stored_value_size();
+    for (u32 i = 0; i < count; ++i) {
+        byte* dest = data + offset_of_value(index + i);
+        std::memcpy(dest, extra, extra_size);
+        std::memcpy(dest + extra_size, source_data + source.offset_of_value(source_index + i),
+                    source_stored_size);
+    }
+}
+
 void leaf_node::sequence_insert(u32 value_size, byte* left, byte* right, u32 count, u32 mid,
                                 u32 insert_index, const byte* value) {
     PREQUEL_ASSERT(mid > 0 && mid <= count, "index can't be used as mid");
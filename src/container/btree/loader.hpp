@@ -12,7 +12,17 @@
 
 namespace prequel::detail::btree_impl {
 
-// Future: Implement bulk loading for non-emtpy trees (i.e. all keys must be > max).
+// Builds a tree bottom-up from sorted values.
+//
+// Non-empty trees can be extended with values that are greater than the current maximum
+// (see init_append()). The loader then takes over the rightmost path of the tree:
+// the existing entries of the path's internal nodes are copied into the proto nodes and
+// the rightmost leaf is copied into the first new leaf. The tree itself remains unchanged
+// until finish() replaces the old path, which means that discard() can still roll back.
+//
+// With leaf prefix compression, the capacity of a leaf depends on its key range, which
+// is only known once the leaf's last value has been seen. Values are therefore collected
+// in memory and a leaf is emitted as soon as the next value would not fit anymore.
 class loader {
 public:
     inline loader(btree_impl::tree& tree);
@@ -20,8 +30,15 @@ public:
     loader(const loader&) = delete;
     loader& operator=(const loader&) = delete;
 
+    // Continue the rightmost path of the (non-empty) tree. Must be called before
+    // any values have been inserted.
+    inline void init_append();
+
     inline void insert(const byte* values, size_t count);
 
+    // Like insert(), but complete leaves are prepared by `threads` worker threads.
+    inline void insert_parallel(const byte* values, size_t count, u32 threads);
+
     inline void finish();
 
     inline void discard();
@@ -32,27 +49,72 @@ private:
     // This scheme ensures that we never emit internal nodes that are too empty.
     // Note that we can emit *leaf*-nodes that are too empty because the tree
     // already has a special case for them.
+    //
+    // With prefix compression, the capacity of a node depends on its prefix.
+    // The proto node is then large enough for the largest possible node.
     struct proto_internal_node {
         std::vector<byte> keys;
         std::vector<block_index> children;
+        std::vector<u64> subtree_sizes; // Number of values in every child (counted trees).
         u32 size = 0;
         u32 capacity = 0;
+
+        // Max key of the last node emitted on this level (prefix compression only).
+        std::vector<byte> lower_key;
+        bool has_lower_key = false;
     };
 
     proto_internal_node make_internal_node() {
         proto_internal_node node;
-        node.capacity = m_internal_max_children + m_internal_min_children;
+        node.capacity = m_internal_max_node_children + m_internal_min_children;
         node.keys.resize(node.capacity * m_key_size);
         node.children.resize(node.capacity);
+        node.subtree_sizes.resize(node.capacity);
         return node;
     }
 
-    inline void insert_child(size_t index, const byte* key, block_index child);
-    inline void flush_internal(size_t index, proto_internal_node& node, u32 count);
+    // Throws if values cannot be inserted in the loader's current state.
+    inline void check_insert(const byte* values);
+
+    // Builds `count` full leaves from the values in parallel and inserts them into
+    // the proto nodes. The current leaf must have been flushed.
+    inline void insert_leaves_parallel(const byte* values, size_t count, u32 threads);
+
+    inline void insert_child(size_t index, const byte* key, block_index child, u64 subtree_size);
+
+    // Emits the first `count` entries as a new internal node.
+    // `last` must be true if no more entries will be added to this level.
+    inline void flush_internal(size_t index, proto_internal_node& node, u32 count, bool last);
+
+    // Returns the maximum number of entries (from the front of the proto node)
+    // that fit into a single internal node.
+    inline u32 max_flush_count(const proto_internal_node& node, bool last) const;
 
-    inline void insert_child_nonfull(proto_internal_node& node, const byte* key, block_index child);
+    // Returns the prefix size of a node made from the first `count` entries.
+    inline u32 node_prefix(const proto_internal_node& node, u32 count, bool last) const;
+
+    inline void insert_child_nonfull(proto_internal_node& node, const byte* key, block_index child,
+                                     u64 subtree_size);
+    inline void start_leaf();
     inline void flush_leaf();
 
+    // Leaf prefix compression only.
+    inline void insert_compressed(const byte* values, size_t count);
+
+    // Emits the first `count` pending values as a new leaf.
+    // `last` must be true for the rightmost leaf, which has no upper bound.
+    inline void flush_pending(u32 count, bool last);
+
+    u32 pending_count() const { return m_pending.size() / m_value_size; }
+    const byte* pending_value(u32 index) const { return m_pending.data() + index * m_value_size; }
+
+    // Frees the subtree unless it belongs to the existing tree (append mode).
+    inline void discard_subtree(block_index root, u32 level);
+
+    // Frees the old rightmost path of the tree (append mode) and updates
+    // leaf links and cursors that referenced it.
+    inline void replace_rightmost_path();
+
     enum state_t { STATE_OK, STATE_ERROR, STATE_FINALIZED };
 
 private:
@@ -60,7 +122,9 @@ private:
     btree_impl::tree& m_tree;
     const u32 m_internal_min_children;
     const u32 m_internal_max_children;
-    const u32 m_leaf_max_values;
+    const u32 m_internal_max_node_children; // Largest possible node (with prefix compression).
+    const u32 m_internal_load_children; // Target number of children (bulk_load_fill_factor).
+    const u32 m_leaf_max_values;        // Target number of values (bulk_load_fill_factor).
     const u32 m_value_size;
     const u32 m_key_size;
     state_t m_state = STATE_OK;
@@ -74,6 +138,22 @@ private:
     // The last entry is the root. Unique pointer for stable addresses.
     std::vector<std::unique_ptr<proto_internal_node>> m_parents;
     leaf_node m_leaf;
+    leaf_node m_last_leaf; // Previous leaf, kept for linking (if enabled).
+
+    // Leaf prefix compression only.
+    std::vector<byte> m_pending; // Values of the current leaf (complete).
+    key_buffer m_lower_key;      // Max key of the last leaf, if any (lower bound of the next one).
+    bool m_has_lower_key = false;
+    u32 m_copied = 0; // Number of pending values copied from the old rightmost leaf (append mode).
+
+    // Append mode only.
+    bool m_append = false;
+    bool m_check_first_key = false;      // The first value must be greater than the old max.
+    block_index m_old_root;              // Root of the tree at the start (to detect changes).
+    u64 m_old_size = 0;                  // Size of the tree at the start.
+    std::vector<block_index> m_old_path; // Rightmost path of the tree, root first, leaf last.
+    std::vector<block_index> m_borrowed; // Sorted children of the old path that are kept.
+    block_index m_first_leaf;            // Copy of the old rightmost leaf.
 };
 
 } // namespace prequel::detail::btree_impl
@@ -7,19 +7,98 @@
 #include <prequel/deferred.hpp>
 #include <prequel/exception.hpp>
 
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 namespace prequel::detail::btree_impl {
 
 loader::loader(btree_impl::tree& tree)
     : m_tree(tree)
     , m_internal_min_children(m_tree.internal_node_min_chlidren())
     , m_internal_max_children(m_tree.internal_node_max_children())
-    , m_leaf_max_values(m_tree.leaf_node_max_values())
+    , m_internal_max_node_children(
+          m_tree.prefix_compression()
+              ? internal_node::compute_max_children(m_tree.get_engine().block_size(),
+                                                    m_tree.key_size(), true, m_tree.key_size() - 1,
+                                                    m_tree.counted())
+              : m_internal_max_children)
+    , m_internal_load_children(m_tree.internal_node_load_children())
+    , m_leaf_max_values(m_tree.leaf_node_load_values(m_tree.leaf_node_max_values()))
     , m_value_size(m_tree.value_size())
     , m_key_size(m_tree.key_size()) {}
 
-void loader::insert(const byte* values, size_t count) {
-    if (count == 0)
-        return;
+void loader::init_append() {
+    PREQUEL_ASSERT(!m_tree.empty(), "Tree must not be empty.");
+    PREQUEL_ASSERT(m_size == 0 && m_parents.empty(), "Loader must be unused.");
+
+    m_append = true;
+    m_check_first_key = true;
+    m_old_root = m_tree.root();
+    m_old_size = m_tree.size();
+    m_size = m_old_size;
+
+    // Copy all but the last entry of every node on the rightmost path into the proto node
+    // of the same level. The last child is on the path itself and will be rebuilt.
+    const u32 levels = m_tree.height() - 1;
+    m_parents.resize(levels);
+
+    key_buffer lower_key;
+    bool has_lower_key = false;
+    block_index current = m_tree.root();
+    for (u32 level = levels; level > 0; --level) {
+        const internal_node node = m_tree.read_internal(current);
+        const u32 count = node.get_child_count() - 1;
+
+        auto proto = std::make_unique<proto_internal_node>(make_internal_node());
+        for (u32 i = 0; i < count; ++i) {
+            node.get_key(i, proto->keys.data() + i * m_key_size);
+            proto->children[i] = node.get_child(i);
+            if (m_tree.counted())
+                proto->subtree_sizes[i] = node.get_subtree_size(i);
+            m_borrowed.push_back(proto->children[i]);
+        }
+        proto->size = count;
+        if (has_lower_key) {
+            proto->lower_key.assign(lower_key.data(), lower_key.data() + m_key_size);
+            proto->has_lower_key = true;
+        }
+        m_parents[level - 1] = std::move(proto);
+
+        node.get_key(count - 1, lower_key.data());
+        has_lower_key = true;
+        m_old_path.push_back(current);
+        current = node.get_child(count);
+    }
+    std::sort(m_borrowed.begin(), m_borrowed.end());
+
+    // New values are appended to a copy of the rightmost leaf.
+    const leaf_node old_leaf = m_tree.read_leaf(current);
+    m_old_path.push_back(current);
+
+    m_leaf = m_tree.create_leaf();
+    if (m_tree.leaf_prefix_compression()) {
+        // The old leaf's values remain pending until the prefix of the new leaf is known.
+        m_copied = old_leaf.get_size();
+        m_pending.resize(m_copied * m_value_size);
+        for (u32 i = 0; i < m_copied; ++i)
+            old_leaf.get(i, m_pending.data() + i * m_value_size, m_value_size);
+        if (has_lower_key) {
+            m_lower_key = lower_key;
+            m_has_lower_key = true;
+        }
+    } else {
+        m_leaf.append_nonfull(old_leaf.get(0), old_leaf.get_size());
+    }
+    if (m_tree.linked_leaves())
+        m_leaf.set_prev(old_leaf.get_prev());
+    m_first_leaf = m_leaf.index();
+    if (levels > 0)
+        m_leftmost_leaf = m_tree.leftmost();
+}
+
+void loader::check_insert(const byte* values) {
     if (!values)
         PREQUEL_THROW(bad_argument("Values are null."));
     if (m_state == STATE_ERROR)
@@ -27,17 +106,41 @@ void loader::insert(const byte* values, size_t count) {
     if (m_state == STATE_FINALIZED)
         PREQUEL_THROW(bad_operation("This loader was already finalized."));
 
+    if (m_check_first_key) {
+        key_buffer max_key, key;
+        if (m_tree.leaf_prefix_compression())
+            m_tree.derive_key(pending_value(pending_count() - 1), max_key.data());
+        else
+            m_tree.leaf_key(m_leaf, m_leaf.get_size() - 1, max_key.data());
+        m_tree.derive_key(values, key.data());
+        if (!m_tree.key_less(max_key.data(), key.data()))
+            PREQUEL_THROW(bad_argument("Values must be greater than the maximum of the tree."));
+        m_check_first_key = false;
+    }
+}
+
+void loader::insert(const byte* values, size_t count) {
+    if (count == 0)
+        return;
+    check_insert(values);
+
     deferred guard = [&] { m_state = STATE_ERROR; };
 
+    if (m_tree.leaf_prefix_compression()) {
+        insert_compressed(values, count);
+        guard.disable();
+        return;
+    }
+
     while (count > 0) {
         if (!m_leaf.valid()) {
-            m_leaf = m_tree.create_leaf();
+            start_leaf();
         }
 
         u32 leaf_size = m_leaf.get_size();
-        if (leaf_size == m_leaf_max_values) {
+        if (leaf_size >= m_leaf_max_values) {
             flush_leaf();
-            m_leaf = m_tree.create_leaf();
+            start_leaf();
             leaf_size = 0;
         }
 
@@ -54,18 +157,182 @@ void loader::insert(const byte* values, size_t count) {
     guard.disable();
 }
 
+void loader::insert_parallel(const byte* values, size_t count, u32 threads) {
+    if (count == 0)
+        return;
+    check_insert(values);
+
+    // Leaves cannot be prepared independently because their capacity depends on their neighbors.
+    if (m_tree.leaf_prefix_compression()) {
+        insert(values, count);
+        return;
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Top up the current leaf first, the remaining values then start at a leaf boundary.
+    if (m_leaf.valid()) {
+        const u32 leaf_size = m_leaf.get_size();
+        const size_t take =
+            std::min<size_t>(count, m_leaf_max_values - std::min(leaf_size, m_leaf_max_values));
+        if (take > 0) {
+            insert(values, take);
+            values += take * m_value_size;
+            count -= take;
+        }
+        if (count == 0)
+            return;
+
+        deferred guard = [&] { m_state = STATE_ERROR; };
+        flush_leaf();
+        guard.disable();
+    }
+
+    const size_t full_leaves = count / m_leaf_max_values;
+    if (full_leaves > 0) {
+        insert_leaves_parallel(values, full_leaves, threads);
+        values += full_leaves * m_leaf_max_values * m_value_size;
+        count -= full_leaves * m_leaf_max_values;
+    }
+    if (count > 0)
+        insert(values, count);
+}
+
+// Leaves are prepared as block images in memory because the engine is not thread safe.
+// Workers copy the values and derive the max key of every leaf; the calling thread then
+// writes the images and registers the leaves with their (proto-) parents, as usual.
+void loader::insert_leaves_parallel(const byte* values, size_t count, u32 threads) {
+    PREQUEL_ASSERT(!m_leaf.valid(), "The current leaf must have been flushed.");
+
+    // Bounds the memory used for images while keeping all threads busy.
+    static constexpr size_t leaves_per_thread = 256;
+
+    deferred guard = [&] { m_state = STATE_ERROR; };
+
+    const u32 block_size = m_tree.get_engine().block_size();
+    const bool linked = m_tree.linked_leaves();
+    const size_t leaf_bytes = size_t(m_leaf_max_values) * m_value_size;
+    const size_t batch_size = leaves_per_thread * threads;
+
+    std::vector<block_index> indices;
+    std::vector<byte> images;
+    std::vector<u32> image_sizes;
+    std::vector<byte> keys;
+    for (size_t first = 0; first < count; first += batch_size) {
+        const size_t batch = std::min(batch_size, count - first);
+        const byte* batch_values = values + first * leaf_bytes;
+
+        // Reserve the blocks in advance, the workers need them for leaf links.
+        // Blocks that have not been registered with a parent are freed on error.
+        size_t registered = 0;
+        indices.clear();
+        deferred cleanup = [&] {
+            for (size_t i = registered; i < indices.size(); ++i)
+                m_tree.free_leaf(indices[i]);
+        };
+        for (size_t i = 0; i < batch; ++i)
+            indices.push_back(m_tree.allocate_leaf());
+
+        const block_index prev = m_last_leaf.valid() ? m_last_leaf.index() : block_index();
+        images.resize(batch * block_size);
+        image_sizes.resize(batch);
+        keys.resize(batch * m_key_size);
+        auto build = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const byte* leaf_values = batch_values + i * leaf_bytes;
+                image_sizes[i] = leaf_node::write_image(
+                    images.data() + i * block_size, m_value_size, linked, leaf_values,
+                    m_leaf_max_values, i > 0 ? indices[i - 1] : prev,
+                    i + 1 < batch ? indices[i + 1] : block_index());
+                m_tree.derive_key(leaf_values + (m_leaf_max_values - 1) * m_value_size,
+                                  keys.data() + i * m_key_size);
+            }
+        };
+
+        // One contiguous range of leaves per thread. Exceptions are rethrown here.
+        const size_t per_thread = (batch + threads - 1) / threads;
+        if (per_thread == batch) {
+            build(0, batch);
+        } else {
+            std::vector<std::thread> workers;
+            std::exception_ptr error;
+            std::mutex error_mutex;
+            for (size_t begin = 0; begin < batch; begin += per_thread) {
+                const size_t end = std::min(begin + per_thread, batch);
+                workers.emplace_back([&, begin, end] {
+                    try {
+                        build(begin, end);
+                    } catch (...) {
+                        std::lock_guard lock(error_mutex);
+                        if (!error)
+                            error = std::current_exception();
+                    }
+                });
+            }
+            for (auto& worker : workers)
+                worker.join();
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        if (linked && m_last_leaf.valid())
+            m_last_leaf.set_next(indices[0]);
+
+        for (size_t i = 0; i < batch; ++i) {
+            block_handle block = m_tree.get_engine().overwrite(
+                indices[i], images.data() + i * block_size, image_sizes[i]);
+            insert_child(0, keys.data() + i * m_key_size, indices[i], m_leaf_max_values);
+            registered += 1;
+            m_size += m_leaf_max_values;
+
+            if (!m_leftmost_leaf)
+                m_leftmost_leaf = indices[i];
+            m_rightmost_leaf = indices[i];
+            if (i + 1 == batch)
+                m_last_leaf = m_tree.as_leaf(std::move(block));
+        }
+        cleanup.disable();
+    }
+
+    guard.disable();
+}
+
 void loader::finish() {
-    if (!m_tree.empty())
+    if (m_append) {
+        if (m_tree.root() != m_old_root || m_tree.size() != m_old_size)
+            PREQUEL_THROW(bad_operation("The tree was modified while loading."));
+        if (m_size == m_old_size) {
+            discard(); // Nothing to do, the tree remains unchanged.
+            return;
+        }
+    } else if (!m_tree.empty()) {
         PREQUEL_THROW(bad_operation("The tree must be empty."));
+    }
 
     if (m_size == 0)
         return; // Nothing to do, the tree remains empty.
 
+    if (!m_pending.empty()) {
+        // The last leaf extends to the largest possible key, which might require a shorter
+        // prefix. Split off the last few values if the leaf is too large for that prefix.
+        const u32 pending = pending_count();
+        const byte* lower = m_has_lower_key ? m_lower_key.data() : nullptr;
+        if (pending > m_tree.leaf_node_max_values(m_tree.common_prefix(lower, nullptr))) {
+            u32 count = pending - std::max(1u, m_leaf_max_values / 2);
+            if (m_leaf.valid())
+                count = std::max(count, m_copied); // Values of the old leaf stay together.
+            flush_pending(count, false);
+        }
+        flush_pending(pending_count(), true);
+    }
+
     if (m_leaf.valid()) {
         PREQUEL_ASSERT(m_leaf.get_size() > 0, "Leaves must not be empty.");
         flush_leaf();
         m_leaf = leaf_node();
     }
+    m_last_leaf = leaf_node();
 
     // Loop over all internal nodes and flush them to the next level.
     // The parents vector will grow as needed because of the insert_child(index + 1) calls.
@@ -84,10 +351,16 @@ void loader::finish() {
                            "Not enough entries for one internal node.");
         }
 
-        if (node.size > m_internal_max_children) {
-            flush_internal(index, node, (node.size + 1) / 2);
+        // Emit the remaining entries. If they don't fit into a single node,
+        // make sure that the last node is not too empty.
+        while (node.size > 0) {
+            u32 count = max_flush_count(node, true);
+            if (count < node.size && node.size - count < m_internal_min_children) {
+                // Nodes may be less than full because of the fill factor.
+                count = node.size <= m_internal_max_children ? node.size : (node.size + 1) / 2;
+            }
+            flush_internal(index, node, count, true);
         }
-        flush_internal(index, node, node.size);
     }
 
     PREQUEL_ASSERT(m_parents.size() > 0 && m_parents.back()->size == 1,
@@ -96,9 +369,16 @@ void loader::finish() {
     m_tree.set_height(m_parents.size());
     m_tree.set_root(m_parents.back()->children[0]);
     m_tree.set_size(m_size);
+    m_tree.modified();
     m_tree.set_leftmost(m_leftmost_leaf);
     m_tree.set_rightmost(m_rightmost_leaf);
+    if (m_append)
+        replace_rightmost_path();
     m_state = STATE_FINALIZED;
+
+    // Built from scratch, the filter is sized for the loaded tree.
+    if (m_tree.filtered())
+        m_tree.rebuild_filter();
 }
 
 void loader::discard() {
@@ -106,22 +386,68 @@ void loader::discard() {
         m_state = STATE_FINALIZED;
 
     if (m_leaf.valid()) {
-        m_tree.clear_subtree(m_leaf.index(), 0);
+        discard_subtree(m_leaf.index(), 0);
         m_leaf = leaf_node();
     }
+    m_last_leaf = leaf_node();
+    m_pending.clear();
 
     // The level of the child entries in the following nodes.
     u32 level = 0;
     for (auto& nodeptr : m_parents) {
         proto_internal_node& node = *nodeptr;
         for (size_t child = 0; child < node.size; ++child) {
-            m_tree.clear_subtree(node.children[child], level);
+            discard_subtree(node.children[child], level);
         }
         node.size = 0;
         ++level;
     }
 }
 
+void loader::discard_subtree(block_index root, u32 level) {
+    if (std::binary_search(m_borrowed.begin(), m_borrowed.end(), root))
+        return; // Part of the existing tree.
+
+    if (level > 0) {
+        const internal_node node = m_tree.read_internal(root);
+        const u32 child_count = node.get_child_count();
+        for (u32 i = 0; i < child_count; ++i)
+            discard_subtree(node.get_child(i), level - 1);
+        m_tree.free_internal(root);
+    } else {
+        m_tree.free_leaf(root);
+    }
+}
+
+void loader::replace_rightmost_path() {
+    PREQUEL_ASSERT(m_append, "Loader must be in append mode.");
+
+    const block_index old_leaf = m_old_path.back();
+    const leaf_node first_leaf = m_tree.read_leaf(m_first_leaf);
+    if (m_tree.linked_leaves()) {
+        if (block_index prev = first_leaf.get_prev())
+            m_tree.read_leaf(prev).set_next(m_first_leaf);
+    }
+
+    m_tree.apply_append_load(old_leaf, first_leaf);
+
+    for (size_t i = 0; i < m_old_path.size() - 1; ++i)
+        m_tree.free_internal(m_old_path[i]);
+    m_tree.free_leaf(old_leaf);
+    m_old_path.clear();
+    m_borrowed.clear();
+}
+
+void loader::start_leaf() {
+    PREQUEL_ASSERT(!m_leaf.valid(), "There must be no active leaf.");
+
+    m_leaf = m_tree.create_leaf();
+    if (m_tree.linked_leaves() && m_last_leaf.valid()) {
+        m_leaf.set_prev(m_last_leaf.index());
+        m_last_leaf.set_next(m_leaf.index());
+    }
+}
+
 // Note: Invalidates references to nodes on the parent stack.
 void loader::flush_leaf() {
     PREQUEL_ASSERT(m_leaf.valid(), "Leaf must be valid.");
@@ -130,18 +456,70 @@ void loader::flush_leaf() {
     // Insert the leaf into its (proto-) parent. If that parent becomes full,
     // emit a new node and register that one it's parent etc.
     key_buffer child_key;
-    m_tree.derive_key(m_leaf.get(m_leaf.get_size() - 1), child_key.data());
-    insert_child(0, child_key.data(), m_leaf.index());
+    m_tree.leaf_key(m_leaf, m_leaf.get_size() - 1, child_key.data());
+    insert_child(0, child_key.data(), m_leaf.index(), m_leaf.get_size());
 
     if (!m_leftmost_leaf) {
         m_leftmost_leaf = m_leaf.index();
     }
     m_rightmost_leaf = m_leaf.index();
+    m_last_leaf = std::move(m_leaf);
     m_leaf = leaf_node();
 }
 
+void loader::insert_compressed(const byte* values, size_t count) {
+    key_buffer key, last_key;
+    for (; count > 0; --count, values += m_value_size) {
+        m_tree.check_value(values);
+        m_tree.derive_key(values, key.data());
+
+        // Unsorted values would not share the prefix of their leaf.
+        const u32 pending = pending_count();
+        const byte* last = m_has_lower_key ? m_lower_key.data() : nullptr;
+        if (pending > 0) {
+            m_tree.derive_key(pending_value(pending - 1), last_key.data());
+            last = last_key.data();
+        }
+        if (last && m_tree.key_less(key.data(), last))
+            PREQUEL_THROW(bad_argument("Values must be sorted."));
+
+        // The key range of the current leaf would end at the new key. Its values share
+        // a shorter prefix the larger that range becomes.
+        const byte* lower = m_has_lower_key ? m_lower_key.data() : nullptr;
+        if (pending > 0
+            && pending >= m_tree.leaf_node_load_values(
+                   m_tree.leaf_node_max_values(m_tree.common_prefix(lower, key.data()))))
+            flush_pending(pending, false);
+
+        m_pending.insert(m_pending.end(), values, values + m_value_size);
+        m_size += 1;
+    }
+}
+
+void loader::flush_pending(u32 count, bool last) {
+    PREQUEL_ASSERT(count > 0 && count <= pending_count(), "Invalid number of values.");
+
+    key_buffer max_key;
+    m_tree.derive_key(pending_value(count - 1), max_key.data());
+
+    // All keys of the leaf's range start with the prefix, in particular its max key.
+    const byte* lower = m_has_lower_key ? m_lower_key.data() : nullptr;
+    const u32 prefix = m_tree.common_prefix(lower, last ? nullptr : max_key.data());
+
+    if (!m_leaf.valid())
+        start_leaf();
+    PREQUEL_ASSERT(m_leaf.get_size() == 0, "Leaf must be empty.");
+    m_leaf.set_prefix(max_key.data(), prefix);
+    m_leaf.append_nonfull(m_pending.data(), count);
+    m_pending.erase(m_pending.begin(), m_pending.begin() + size_t(count) * m_value_size);
+
+    m_lower_key = max_key;
+    m_has_lower_key = true;
+    flush_leaf();
+}
+
 // Note: Invalidates references to nodes on the parent stack.
-void loader::insert_child(size_t index, const byte* key, block_index child) {
+void loader::insert_child(size_t index, const byte* key, block_index child, u64 subtree_size) {
     PREQUEL_ASSERT(index <= m_parents.size(), "Invalid parent index.");
 
     if (index == m_parents.size()) {
@@ -150,40 +528,85 @@ void loader::insert_child(size_t index, const byte* key, block_index child) {
 
     proto_internal_node& node = *m_parents[index];
     if (node.size == node.capacity) {
-        flush_internal(index, node, m_internal_max_children);
+        flush_internal(index, node, max_flush_count(node, false), false);
     }
-    insert_child_nonfull(node, key, child);
+    insert_child_nonfull(node, key, child, subtree_size);
 }
 
 // Flush count entries from the node to the next level.
 // Note: Invalidates references to nodes on the parent stack.
-void loader::flush_internal(size_t index, proto_internal_node& node, u32 count) {
+void loader::flush_internal(size_t index, proto_internal_node& node, u32 count, bool last) {
     PREQUEL_ASSERT(index < m_parents.size(), "Invalid node index.");
     PREQUEL_ASSERT(m_parents[index].get() == &node, "Node address mismatch.");
     PREQUEL_ASSERT(count <= node.size, "Cannot flush that many elements.");
-    PREQUEL_ASSERT(count <= m_internal_max_children, "Too many elements for a tree node.");
+    PREQUEL_ASSERT(count <= m_internal_max_node_children, "Too many elements for a tree node.");
 
     internal_node tree_node = m_tree.create_internal();
     deferred cleanup = [&] { m_tree.free_internal(tree_node.index()); };
 
     // Copy first `count` entries into the real node, then forward max key and node index
     // to the next level.
+    const byte* max_key = node.keys.data() + m_key_size * (count - 1);
+    if (m_tree.prefix_compression()) {
+        tree_node.set_prefix(node.keys.data(), node_prefix(node, count, last));
+        node.lower_key.assign(max_key, max_key + m_key_size);
+        node.has_lower_key = true;
+    }
     tree_node.set_entries(node.keys.data(), node.children.data(), count);
-    insert_child(index + 1, node.keys.data() + m_key_size * (count - 1), tree_node.index());
+
+    u64 subtree_size = 0;
+    if (m_tree.counted()) {
+        for (u32 i = 0; i < count; ++i) {
+            tree_node.set_subtree_size(i, node.subtree_sizes[i]);
+            subtree_size += node.subtree_sizes[i];
+        }
+    }
+    insert_child(index + 1, max_key, tree_node.index(), subtree_size);
     cleanup.disable();
 
     // Shift `count` values to the left.
     std::copy_n(node.children.begin() + count, node.size - count, node.children.begin());
+    std::copy_n(node.subtree_sizes.begin() + count, node.size - count,
+                node.subtree_sizes.begin());
     std::memmove(node.keys.data(), node.keys.data() + count * m_key_size,
                  (node.size - count) * m_key_size);
     node.size = node.size - count;
 }
 
-void loader::insert_child_nonfull(proto_internal_node& node, const byte* key, block_index child) {
+u32 loader::max_flush_count(const proto_internal_node& node, bool last) const {
+    if (m_tree.prefix_compression() && m_internal_load_children == m_internal_max_children) {
+        // The capacity of a node shrinks when it gets more entries (because their common prefix
+        // becomes shorter). Find the largest number of entries that still fit.
+        const u32 block_size = m_tree.get_engine().block_size();
+        for (u32 count = node.size; count > m_internal_max_children; --count) {
+            const u32 prefix = node_prefix(node, count, last);
+            if (count <= internal_node::compute_max_children(block_size, m_key_size, true, prefix,
+                                                             m_tree.counted()))
+                return count;
+        }
+    }
+    return std::min(node.size, m_internal_load_children);
+}
+
+u32 loader::node_prefix(const proto_internal_node& node, u32 count, bool last) const {
+    PREQUEL_ASSERT(count > 0 && count <= node.size, "Invalid entry count.");
+
+    // The node's key range starts after the max key of the previous node on this level.
+    // It ends with its own max key, unless this is the last node on this level,
+    // which is part of the rightmost path of the tree.
+    const byte* lower = node.has_lower_key ? node.lower_key.data() : nullptr;
+    const byte* upper =
+        last && count == node.size ? nullptr : node.keys.data() + m_key_size * (count - 1);
+    return m_tree.common_prefix(lower, upper);
+}
+
+void loader::insert_child_nonfull(proto_internal_node& node, const byte* key, block_index child,
+                                  u64 subtree_size) {
     PREQUEL_ASSERT(node.size < node.capacity, "Node is full.");
 
     std::memcpy(node.keys.data() + node.size * m_key_size, key, m_key_size);
     node.children[node.size] = child;
+    node.subtree_sizes[node.size] = subtree_size;
     node.size += 1;
 }
 
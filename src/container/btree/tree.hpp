@@ -6,12 +6,18 @@
 
 #include <prequel/anchor_handle.hpp>
 #include <prequel/container/allocator.hpp>
+#include <prequel/container/bloom_filter.hpp>
 #include <prequel/container/btree.hpp>
 #include <prequel/defs.hpp>
 #include <prequel/engine.hpp>
+#include <prequel/hash.hpp>
 
 #include <boost/intrusive/list.hpp>
 
+#include <algorithm>
+#include <array>
+#include <optional>
+
 namespace prequel::detail::btree_impl {
 
 using index_iterator = detail::identity_iterator<u32>;
@@ -20,7 +26,8 @@ class tree : public uses_allocator {
     using anchor = detail::raw_btree_anchor;
 
 public:
-    inline tree(anchor_handle<anchor> _anchor, const raw_btree_options& opts, allocator& alloc);
+    inline tree(anchor_handle<anchor> _anchor, anchor_handle<bloom_filter_anchor> _filter_anchor,
+                const raw_btree_options& opts, allocator& alloc);
     inline ~tree();
 
     tree(const tree&) = delete;
@@ -31,11 +38,40 @@ public:
 
     u32 value_size() const { return m_options.value_size; }
     u32 key_size() const { return m_options.key_size; }
+    bool linked_leaves() const { return m_options.linked_leaves; }
+    bool prefix_compression() const { return m_options.prefix_compression; }
+    bool leaf_prefix_compression() const { return m_options.leaf_prefix_compression; }
+    bool counted() const { return m_options.counted; }
+    bool filtered() const { return m_options.filter_bits_per_key > 0; }
+
+    u64 filter_byte_size() const { return m_filter ? m_filter->byte_size() : 0; }
 
     u32 leaf_node_max_values() const { return m_leaf_capacity; }
+
+    // Minimum number of values in leaves other than the leftmost and rightmost leaf.
+    u32 leaf_node_min_values() const { return m_leaf_min_values; }
+
+    // Number of values the bulk loader puts into a leaf with the given capacity.
+    u32 leaf_node_load_values(u32 capacity) const {
+        const u32 values = static_cast<u32>(capacity * m_options.bulk_load_fill_factor);
+        return std::clamp(values, std::max(m_leaf_min_values, u32(1)), capacity);
+    }
+
+    // Capacity of a leaf with the given prefix (only if leaf_prefix_compression() is true).
+    u32 leaf_node_max_values(u32 prefix_size) const {
+        return leaf_node::capacity(get_engine().block_size(), value_size(), linked_leaves(),
+                                   true, prefix_size);
+    }
     u32 internal_node_max_children() const { return m_internal_max_children; }
     u32 internal_node_min_chlidren() const { return m_internal_min_children; }
 
+    // Number of children the bulk loader puts into an internal node.
+    u32 internal_node_load_children() const {
+        const u32 children =
+            static_cast<u32>(m_internal_max_children * m_options.bulk_load_fill_factor);
+        return std::clamp(children, m_internal_min_children, m_internal_max_children);
+    }
+
     // Returns left < right
     bool key_less(const byte* left_key, const byte* right_key) const {
         return m_options.key_less(left_key, right_key, m_options.user_data);
@@ -66,29 +102,78 @@ public:
         return m_options.derive_key(value, buffer, m_options.user_data);
     }
 
+    // Returns key(leaf[index]). Avoids copying the complete value for prefixed leaves.
+    void leaf_key(const leaf_node& leaf, u32 index, byte* buffer) const {
+        if (!leaf.prefixed())
+            return derive_key(leaf.get(index), buffer);
+
+        // Values start with their keys.
+        leaf.get(index, buffer, key_size());
+    }
+
+    // Throws if the value cannot be stored in this tree.
+    // With leaf prefix compression, every value must start with its key.
+    inline void check_value(const byte* value) const;
+
     // Seek the cursor to the lower bound of key.
     inline void lower_bound(const byte* key, cursor& cursor) const;
 
     // Seek the cursor to the upper bound of key.
     inline void upper_bound(const byte* key, cursor& cursor) const;
 
-    // Find the key (or fail).
+    // Find the key (or fail). Consults the filter first (if any).
     inline void find(const byte* key, cursor& cursor) const;
 
+    // Looks up `count` keys (stored contiguously, in any order). The values of found keys are
+    // copied to `values[i * value_size()]` and `found[i]` is set accordingly.
+    // The keys are visited in sorted order, so that internal nodes on shared paths are only
+    // read once and leaves are read in ascending order. Returns the number of found keys.
+    inline u64 find_many(const byte* keys, size_t count, byte* values, bool* found) const;
+
+    // Order statistics (only if counted() is true).
+    // Returns the number of values with a key less than `key`.
+    inline u64 rank(const byte* key) const;
+
+    // Seek the cursor to the value with the given index (in sorted order).
+    inline void select(u64 index, cursor& cursor) const;
+
+    // Returns the number of values with `lower <= key < upper`.
+    // Uses the subtree sizes if counted() is true, otherwise the values are visited.
+    inline u64 count(const byte* lower, const byte* upper) const;
+
     // Insert the value into the tree (or do nothing if the key exists).
     // Points to the value (old or new) after the operation completed.
     inline bool insert(const byte* value, cursor& cursor);
 
+    // Insert a sorted sequence of values (skipping existing keys) one leaf at a time.
+    // Returns the number of inserted values.
+    inline u64 insert_sorted(const byte* values, size_t count);
+
     /// Erase the element that is currently being pointed at by this cursor.
     inline void erase(cursor& cursor);
 
+    // Erase all values with `lower <= key < upper`. Subtrees between the first and the last
+    // leaf of the range are freed without visiting their values (leaf by leaf with prefix
+    // compression), only the two boundary leaves are rebalanced. Returns the number of
+    // erased values.
+    inline u64 erase_range(const byte* lower, const byte* upper);
+
+    // Relocates up to `max_leaves` leaves (in key order, continuing where the last call
+    // stopped) into a contiguous extent and merges neighboring leaves that fit into one.
+    // Returns true when the end of the tree has been reached.
+    inline bool compact(u64 max_leaves);
+
     inline void clear();
 
     inline void clear_subtree(block_index root, u32 level);
 
     inline std::unique_ptr<loader> bulk_load();
 
-    inline std::unique_ptr<cursor> create_cursor(raw_btree::cursor_seek_t seek);
+    // Like bulk_load(), but non-empty trees are supported as long as all new values
+    // are greater than the current maximum.
+    inline std::unique_ptr<loader> bulk_append();
+
+    inline std::unique_ptr<cursor> create_cursor(raw_btree::cursor_seek_t seek, bool lazy = false);
 
     inline void dump(std::ostream& os) const;
 
@@ -107,6 +192,53 @@ private:
     // Exactly like split(const leaf_node&, byte*) but for internal nodes.
     inline internal_node split(const internal_node& old_internal, byte* split_key);
 
+    // Prefix compression (only if prefix_compression() is true).
+    // Returns the length of the common prefix of all keys in the range [lower, upper].
+    // Null pointers stand for the smallest (lower) or the largest (upper) possible key.
+    inline u32 common_prefix(const byte* lower, const byte* upper) const;
+
+    // Makes the first `prefix_size` bytes of `key` the new prefix of the node,
+    // if that prefix is longer than the current one.
+    inline void extend_prefix(const internal_node& node, const byte* key, u32 prefix_size);
+
+    // Shortens the prefix of the node to its common prefix with the given byte string.
+    inline void shorten_prefix(const internal_node& node, const byte* prefix, u32 prefix_size);
+
+    // Leaf prefix compression (only if leaf_prefix_compression() is true).
+    // Like the functions above, but for leaf nodes.
+    inline void extend_prefix(const leaf_node& leaf, const byte* key, u32 prefix_size);
+    inline void shorten_prefix(const leaf_node& leaf, const byte* prefix, u32 prefix_size);
+
+    // Returns the length of the common prefix of the leaf's prefix and the given byte string.
+    inline u32 shared_prefix(const leaf_node& leaf, const byte* prefix, u32 prefix_size) const;
+
+    // The key range (lower, upper] of the cursor's leaf, as defined by its parents.
+    struct key_range {
+        key_buffer lower, upper;
+        bool has_lower = false, has_upper = false;
+
+        // Null pointers stand for unbounded ranges (see common_prefix()).
+        const byte* lower_key() const { return has_lower ? lower.data() : nullptr; }
+        const byte* upper_key() const { return has_upper ? upper.data() : nullptr; }
+    };
+
+    inline key_range leaf_range(const cursor& cursor) const;
+
+    // Subtree sizes (only if counted() is true).
+    // Returns the number of values in the subtree rooted at the given node.
+    inline u64 subtree_size(const internal_node& node) const;
+    u64 subtree_size(const leaf_node& leaf) const { return leaf.get_size(); }
+
+    // Adds `delta` to the subtree sizes on the cursor's path, after a value
+    // was inserted into (or removed from) the cursor's leaf.
+    inline void add_subtree_sizes(const cursor& cursor, i64 delta);
+
+    // A child has been moved from `neighbor` (at `neighbor_child`) to `node` (at `node_child`).
+    // Moves its subtree size and updates the sizes of both nodes in their parent.
+    inline void move_subtree_size(const internal_node& parent, const internal_node& node,
+                                  u32 node_index, u32 node_child, const internal_node& neighbor,
+                                  u32 neighbor_index, u32 neighbor_child);
+
     // The root was split. Make sure that all (valid) cursors include the new root in their path.
     inline void apply_root_split(const internal_node& new_root, const internal_node& left_leaf,
                                  const internal_node& right_leaf);
@@ -117,11 +249,71 @@ private:
     inline void apply_child_split(const internal_node& parent, u32 left_level, u32 left_index,
                                   const internal_node& left, const internal_node& right);
 
+    // The loader has replaced the rightmost path of the tree. The values of `old_leaf`
+    // have been copied into `new_leaf`.
+    inline void apply_append_load(block_index old_leaf, const leaf_node& new_leaf);
+
 private:
+    // Erase `count` values, starting with the one pointed at by the cursor,
+    // from the cursor's leaf. Rebalances the leaf afterwards.
+    inline void erase_run(cursor& cursor, u32 count);
+
+    // Like erase_run(), but the leaf is not rebalanced.
+    inline void remove_run(cursor& cursor, u32 count);
+
+    // Steals values from or merges with a neighbor if the cursor's leaf is underflowing.
+    inline void rebalance_leaf(cursor& cursor);
+
+    // Frees the subtree closest to the root that only contains values in `[lower, upper)`
+    // and lies between the leaves of `first` (first value in the range) and `last`
+    // (first value after the range). Both cursors are repositioned.
+    // Returns false if there is no such subtree.
+    inline bool
+    erase_covered_subtree(const byte* lower, const byte* upper, cursor& first, cursor& last,
+                          u64& erased);
+
+    // Frees the subtree rooted at the given child of the cursor's parent at `stack_index`
+    // without visiting its values and removes it from its parent. Cursors in the subtree
+    // are moved to `successor`. Returns the number of erased values.
+    inline u64 erase_subtree(cursor& cursor, u32 stack_index, u32 child_index,
+                             const btree_impl::cursor& successor);
+
+    // Removes the cursor's leaf (which must be empty and not the leftmost or rightmost leaf)
+    // from the tree. A neighbor takes over its key range. Returns false if that is not
+    // possible because the neighbor's values would not fit (leaf prefix compression).
+    inline bool erase_empty_leaf(cursor& cursor);
+
+    // Merges the right neighbors of the cursor's leaf into it, as long as their
+    // values fit (with respect to the bulk load fill factor). Used by compact().
+    inline void merge_right_neighbors(cursor& cursor);
+
+    // Moves the cursor's leaf to the (allocated but unused) block `target`
+    // and frees the old block.
+    inline void relocate_leaf(cursor& cursor, block_index target);
+
+    // Position of the most recent insertion into recently modified leaves, used to detect
+    // sequential insertion patterns (see raw_btree_options::adaptive_splits).
+    struct insert_hint {
+        block_index leaf;
+        u32 index = 0;
+    };
+    static constexpr size_t insert_hint_slots = 64;
+
+    // Returns the hint slot for the given leaf. Leaves are mapped to a slot
+    // by their block index, collisions simply replace the previous entry.
+    insert_hint& get_insert_hint(block_index leaf) {
+        return m_insert_hints[leaf.value() % insert_hint_slots];
+    }
+
     // Handle the deletion of a leaf node in its parent node(s).
     inline void
     propagate_leaf_deletion(cursor& cursor, block_index child_node, u32 child_node_index);
 
+    // Handle the deletion of a child of the cursor's parent at `stack_index`
+    // in that node and its parents.
+    inline void propagate_child_deletion(cursor& cursor, u32 stack_index, block_index child_node,
+                                         u32 child_node_index);
+
     // Steal an entry from the neighboring node and put it into the leaf.
     inline void steal_leaf_entry(const internal_node& parent, const leaf_node& leaf, u32 leaf_index,
                                  const leaf_node& neighbor, u32 neighbor_index);
@@ -160,6 +352,31 @@ public:
     inline bool next_leaf(cursor& cursor) const;
     inline bool prev_leaf(cursor& cursor) const;
 
+    // Recomputes the parent stack of a cursor after it moved through leaf links.
+    inline void restore_parents(cursor& cursor) const;
+
+private:
+    // Key filter (only if filtered() is true).
+    u64 key_hash(const byte* key) const {
+        return m_options.key_hash ? m_options.key_hash(key, m_options.user_data)
+                                  : fnv_1a(key, key_size());
+    }
+
+    // Adds the key of a newly inserted value to the filter.
+    // Rebuilds the filter instead if it has reached its capacity.
+    inline void filter_insert(const byte* value);
+
+    // Reinitializes the filter for twice the current size and inserts all keys.
+    inline void rebuild_filter();
+
+private:
+    // Leaf links (only if linked_leaves() is true).
+    // Inserts `leaf` into the chain of leaves, directly to the right of `left`.
+    inline void link_leaf(const leaf_node& left, const leaf_node& leaf);
+
+    // Removes `leaf` from the chain of leaves.
+    inline void unlink_leaf(const leaf_node& leaf);
+
 private:
     template<typename Func>
     inline void visit_nodes(Func&& fn) const;
@@ -177,6 +394,9 @@ private:
     inline leaf_node create_leaf();
     inline internal_node create_internal();
 
+    // Allocates the block for a new leaf without initializing it.
+    inline block_index allocate_leaf();
+
     inline void free_leaf(block_index leaf);
     inline void free_internal(block_index internal);
 
@@ -188,9 +408,37 @@ private:
     using cursor_list_type = boost::intrusive::list<
         cursor, boost::intrusive::member_hook<cursor, decltype(cursor::m_cursors), &cursor::m_cursors>>;
 
-    inline void link_cursor(cursor* cursor) { m_cursors.push_back(*cursor); }
+    inline void link_cursor(cursor* cursor) { cursor_list(cursor).push_back(*cursor); }
+
+    inline void unlink_cursor(cursor* cursor) {
+        auto& list = cursor_list(cursor);
+        list.erase(list.iterator_to(*cursor));
+    }
+
+    cursor_list_type& cursor_list(cursor* cursor) {
+        return cursor->lazy() ? m_lazy_cursors : m_cursors;
+    }
+
+    // Invalidates the positions of lazy cursors.
+    void modified() { ++m_version; }
+
+    // Invalidates the node paths of lazy cursors. Called whenever nodes are created or
+    // destroyed or when entries move between nodes. Also invalidates their positions,
+    // because some structural changes (e.g. splits during a failed insertion) do not
+    // modify any value.
+    void restructured() {
+        ++m_version;
+        ++m_structure_version;
+    }
+
+public:
+    // Incremented for every modification of the tree (in memory only).
+    u64 version() const { return m_version; }
 
-    inline void unlink_cursor(cursor* cursor) { m_cursors.erase(m_cursors.iterator_to(*cursor)); }
+    // Incremented for every structural modification of the tree (in memory only).
+    // As long as it remains the same, every value stays in its leaf and the path from
+    // the root to every leaf does not change. Values may still move within their leaf.
+    u64 structure_version() const { return m_structure_version; }
 
 public:
     // Persistent tree state accessors
@@ -222,12 +470,30 @@ public:
 private:
     anchor_handle<anchor> m_anchor;
     raw_btree_options m_options;
+    std::optional<bloom_filter> m_filter; // Only if a filter anchor was provided.
     u32 m_internal_max_children;
     u32 m_internal_min_children;
     u32 m_leaf_capacity;
+    u32 m_leaf_min_values;
+
+    // See get_insert_hint().
+    std::array<insert_hint, insert_hint_slots> m_insert_hints;
 
-    // List of all active cursors.
+    // List of all active cursors that are updated by modifications.
     mutable cursor_list_type m_cursors;
+
+    // List of all active lazy cursors (only used to invalidate them when the tree is destroyed).
+    mutable cursor_list_type m_lazy_cursors;
+
+    // See version() and structure_version().
+    u64 m_version = 0;
+    u64 m_structure_version = 0;
+
+    // Progress of the current compaction pass (see compact()): the max key and the address
+    // of the last leaf that has been processed.
+    bool m_compact_active = false;
+    key_buffer m_compact_key;
+    block_index m_compact_leaf;
 };
 
 } // namespace prequel::detail::btree_impl
@@ -3,6 +3,7 @@
 
 #include "tree.hpp"
 
+#include <prequel/deferred.hpp>
 #include <prequel/detail/fix.hpp>
 #include <prequel/exception.hpp>
 #include <prequel/formatting.hpp>
@@ -13,7 +14,8 @@
 
 namespace prequel::detail::btree_impl {
 
-tree::tree(anchor_handle<anchor> _anchor, const raw_btree_options& opts, allocator& alloc)
+tree::tree(anchor_handle<anchor> _anchor, anchor_handle<bloom_filter_anchor> _filter_anchor,
+           const raw_btree_options& opts, allocator& alloc)
     : uses_allocator(alloc)
     , m_anchor(std::move(_anchor))
     , m_options(opts) {
@@ -28,10 +30,23 @@ tree::tree(anchor_handle<anchor> _anchor, const raw_btree_options& opts, allocat
         PREQUEL_THROW(bad_argument("No derive_key function provided."));
     if (!m_options.key_less)
         PREQUEL_THROW(bad_argument("No key_less function provided."));
-
-    m_leaf_capacity = leaf_node::capacity(get_engine().block_size(), value_size());
-    m_internal_max_children =
-        internal_node::compute_max_children(get_engine().block_size(), key_size());
+    if (m_options.filter_bits_per_key > 64)
+        PREQUEL_THROW(bad_argument("Filters with more than 64 bits per key are not supported."));
+    if (m_options.filter_bits_per_key > 0 && !_filter_anchor)
+        PREQUEL_THROW(bad_argument("Key filters require a filter anchor."));
+    if (!(m_options.bulk_load_fill_factor > 0 && m_options.bulk_load_fill_factor <= 1))
+        PREQUEL_THROW(bad_argument("The bulk load fill factor must be in (0, 1]."));
+    if (!(m_options.min_leaf_fill_factor > 0 && m_options.min_leaf_fill_factor <= 0.5))
+        PREQUEL_THROW(bad_argument("The minimum leaf fill factor must be in (0, 0.5]."));
+    if (m_options.leaf_prefix_compression && m_options.key_size > m_options.value_size)
+        PREQUEL_THROW(bad_argument("Leaf prefix compression requires values that start with "
+                                   "their keys (the key size exceeds the value size)."));
+
+    m_leaf_capacity = leaf_node::capacity(get_engine().block_size(), value_size(),
+                                          linked_leaves(), leaf_prefix_compression());
+    m_leaf_min_values = static_cast<u32>(m_leaf_capacity * m_options.min_leaf_fill_factor);
+    m_internal_max_children = internal_node::compute_max_children(
+        get_engine().block_size(), key_size(), prefix_compression(), 0, counted());
     m_internal_min_children = internal_node::compute_min_children(m_internal_max_children);
 
     if (m_leaf_capacity < 2) {
@@ -44,16 +59,39 @@ tree::tree(anchor_handle<anchor> _anchor, const raw_btree_options& opts, allocat
             fmt::format("Block size {} is too small (cannot fit 4 children into one internal node)",
                         get_engine().block_size())));
     }
+
+    // The filter setting may have changed since the tree was last opened.
+    if (_filter_anchor) {
+        m_filter.emplace(std::move(_filter_anchor), alloc);
+        if (!filtered()) {
+            m_filter->reset();
+        } else if (!m_filter->initialized() && !empty()) {
+            rebuild_filter();
+        }
+    }
 }
 
 tree::~tree() {
     // Invalidate all existing cursors.
-    for (auto& cursor : m_cursors) {
-        cursor.reset_to_invalid();
-        cursor.m_tree = nullptr;
+    for (auto* list : {&m_cursors, &m_lazy_cursors}) {
+        for (auto& cursor : *list) {
+            cursor.reset_to_invalid();
+            cursor.m_tree = nullptr;
+        }
     }
 }
 
+void tree::check_value(const byte* value) const {
+    if (!leaf_prefix_compression())
+        return;
+
+    key_buffer key;
+    derive_key(value, key.data());
+    if (std::memcmp(key.data(), value, key_size()) != 0)
+        PREQUEL_THROW(
+            bad_argument("With leaf prefix compression, values must start with their key."));
+}
+
 bool tree::value_less(const byte* left_value, const byte* right_value) const {
     key_buffer left_key, right_key;
     derive_key(left_value, left_key.data());
@@ -117,6 +155,31 @@ void tree::seek_bound(const byte* key, cursor& cursor) const {
 }
 
 bool tree::next_leaf(cursor& cursor) const {
+    if (linked_leaves()) {
+        const block_index next = cursor.m_leaf.get_next();
+        if (!next)
+            return false;
+
+        // Keep the parent stack up to date as long as that is free, i.e.
+        // as long as the next leaf has the same parent. Otherwise, drop the stack
+        // and recompute it once it is needed again.
+        if (!cursor.parents_stale() && !cursor.m_parents.empty()) {
+            auto& entry = cursor.m_parents.back();
+            if (entry.index + 1 < entry.node.get_child_count()) {
+                entry.index++;
+                PREQUEL_ASSERT(entry.node.get_child(entry.index) == next,
+                               "Leaf link and parent must be consistent.");
+            } else {
+                cursor.m_parents.clear();
+                cursor.m_flags |= cursor.STALE_PARENTS;
+            }
+        }
+
+        cursor.m_leaf = read_leaf(next);
+        get_engine().prefetch(cursor.m_leaf.get_next());
+        return true;
+    }
+
     // Find a parent that is not yet at it's last index.
     auto rpos =
         std::find_if(cursor.m_parents.rbegin(), cursor.m_parents.rend(), [&](const auto& entry) {
@@ -140,6 +203,29 @@ bool tree::next_leaf(cursor& cursor) const {
 }
 
 bool tree::prev_leaf(cursor& cursor) const {
+    if (linked_leaves()) {
+        const block_index prev = cursor.m_leaf.get_prev();
+        if (!prev)
+            return false;
+
+        // See next_leaf().
+        if (!cursor.parents_stale() && !cursor.m_parents.empty()) {
+            auto& entry = cursor.m_parents.back();
+            if (entry.index > 0) {
+                entry.index--;
+                PREQUEL_ASSERT(entry.node.get_child(entry.index) == prev,
+                               "Leaf link and parent must be consistent.");
+            } else {
+                cursor.m_parents.clear();
+                cursor.m_flags |= cursor.STALE_PARENTS;
+            }
+        }
+
+        cursor.m_leaf = read_leaf(prev);
+        get_engine().prefetch(cursor.m_leaf.get_prev());
+        return true;
+    }
+
     // Find a parent that is not yet at index 0.
     auto rpos = std::find_if(cursor.m_parents.rbegin(), cursor.m_parents.rend(),
                              [&](const auto& entry) { return entry.index > 0; });
@@ -160,6 +246,50 @@ bool tree::prev_leaf(cursor& cursor) const {
     return true;
 }
 
+void tree::restore_parents(cursor& cursor) const {
+    PREQUEL_ASSERT(cursor.parents_stale(), "Parents are not stale.");
+    PREQUEL_ASSERT(cursor.m_leaf.valid() && cursor.m_leaf.get_size() > 0,
+                   "Cursor must point to a non-empty leaf.");
+
+    // Every key in the leaf leads to the leaf when searching from the root.
+    key_buffer key;
+    leaf_key(cursor.m_leaf, 0, key.data());
+
+    cursor.m_parents.resize(height() - 1);
+    block_index current = root();
+    for (u32 level = height() - 1; level > 0; --level) {
+        auto& entry = cursor.m_parents[height() - 1 - level];
+        entry.node = read_internal(current);
+        entry.index = lower_bound(entry.node, key.data());
+        current = entry.node.get_child(entry.index);
+    }
+    PREQUEL_ASSERT(current == cursor.m_leaf.index(), "Search must arrive at the cursor's leaf.");
+
+    cursor.m_flags &= ~cursor.STALE_PARENTS;
+}
+
+void tree::link_leaf(const leaf_node& left, const leaf_node& leaf) {
+    PREQUEL_ASSERT(linked_leaves(), "Leaves are not linked.");
+
+    const block_index next = left.get_next();
+    leaf.set_prev(left.index());
+    leaf.set_next(next);
+    left.set_next(leaf.index());
+    if (next)
+        read_leaf(next).set_prev(leaf.index());
+}
+
+void tree::unlink_leaf(const leaf_node& leaf) {
+    PREQUEL_ASSERT(linked_leaves(), "Leaves are not linked.");
+
+    const block_index prev = leaf.get_prev();
+    const block_index next = leaf.get_next();
+    if (prev)
+        read_leaf(prev).set_next(next);
+    if (next)
+        read_leaf(next).set_prev(prev);
+}
+
 void tree::lower_bound(const byte* key, cursor& cursor) const {
     return seek_bound<seek_bound_lower>(key, cursor);
 }
@@ -169,22 +299,235 @@ void tree::upper_bound(const byte* key, cursor& cursor) const {
 }
 
 void tree::find(const byte* key, cursor& cursor) const {
+    if (filtered() && !m_filter->may_contain(key_hash(key))) {
+        cursor.reset_to_invalid();
+        return;
+    }
+
     seek_bound<seek_bound_find>(key, cursor);
     if (cursor.at_end())
         return;
 
     PREQUEL_ASSERT(cursor.m_index < cursor.m_leaf.get_size(), "Invalid index.");
-    if (!value_equal_key(cursor.m_leaf.get(cursor.m_index), key)) {
+    key_buffer found;
+    leaf_key(cursor.m_leaf, cursor.m_index, found.data());
+    if (!key_equal(found.data(), key)) {
         cursor.reset_to_invalid();
     }
 }
 
+u64 tree::find_many(const byte* keys, size_t count, byte* values, bool* found) const {
+    const u32 ks = key_size();
+    const u32 vs = value_size();
+    std::fill_n(found, count, false);
+    if (height() == 0)
+        return 0;
+
+    std::vector<size_t> order;
+    order.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!filtered() || m_filter->may_contain(key_hash(keys + i * ks)))
+            order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return key_less(keys + a * ks, keys + b * ks); });
+
+    struct path_entry {
+        internal_node node;
+        u32 index = 0;
+    };
+
+    // The current search path from the root to the current leaf.
+    // Because the keys are sorted, the next key is either contained in the subtree of an
+    // entry's current child or in a child to its right.
+    const u32 depth = height() - 1;
+    std::vector<path_entry> path(depth);
+    leaf_node leaf;
+
+    // Returns true if the child at the given level of the path contains the key.
+    key_buffer separator;
+    auto child_contains = [&](u32 level, const byte* key) {
+        const path_entry& entry = path[level];
+        if (entry.index + 1 == entry.node.get_child_count())
+            return true;
+        entry.node.get_key(entry.index, separator.data());
+        return !key_less(separator.data(), key);
+    };
+
+    // Leaves are prefetched for the next few keys that belong to the current
+    // lowest internal node, so that their reads can overlap.
+    static constexpr size_t prefetch_distance = 16;
+    size_t prefetched = 0;
+    auto prefetch_leaves = [&](size_t position) {
+        const path_entry& entry = path[depth - 1];
+        block_index last = entry.node.get_child(entry.index);
+        for (size_t i = std::max(prefetched, position + 1);
+             i < order.size() && i <= position + prefetch_distance; ++i) {
+            const byte* key = keys + order[i] * ks;
+            for (u32 level = 0; level < depth - 1; ++level) {
+                if (!child_contains(level, key))
+                    return;
+            }
+
+            const block_index child = entry.node.get_child(lower_bound(entry.node, key));
+            if (child != last) {
+                get_engine().prefetch(child);
+                last = child;
+            }
+            prefetched = i + 1;
+        }
+    };
+
+    u64 result = 0;
+    key_buffer leaf_key_buffer;
+    for (size_t i = 0; i < order.size(); ++i) {
+        const byte* key = keys + order[i] * ks;
+
+        // Keep the longest prefix of the path that still leads to the key.
+        u32 level = 0;
+        if (!leaf.valid()) {
+            if (depth == 0)
+                leaf = read_leaf(root());
+            else
+                path[0].node = read_internal(root());
+        } else {
+            while (level < depth && child_contains(level, key))
+                ++level;
+        }
+
+        for (; level < depth; ++level) {
+            path_entry& entry = path[level];
+            entry.index = lower_bound(entry.node, key);
+
+            const block_index child = entry.node.get_child(entry.index);
+            if (level + 1 < depth) {
+                path[level + 1].node = read_internal(child);
+            } else {
+                prefetch_leaves(i);
+                leaf = read_leaf(child);
+            }
+        }
+
+        const u32 index = lower_bound(leaf, key);
+        if (index < leaf.get_size()) {
+            leaf_key(leaf, index, leaf_key_buffer.data());
+            if (key_equal(leaf_key_buffer.data(), key)) {
+                leaf.get(index, values + order[i] * vs, vs);
+                found[order[i]] = true;
+                ++result;
+            }
+        }
+    }
+    return result;
+}
+
+u64 tree::rank(const byte* key) const {
+    if (!counted())
+        PREQUEL_THROW(bad_operation("The tree does not store subtree sizes."));
+    if (height() == 0)
+        return 0;
+
+    // All children to the left of the search path contain only smaller keys.
+    u64 result = 0;
+    block_index current = root();
+    for (u32 level = height() - 1; level > 0; --level) {
+        internal_node node = read_internal(current);
+        const u32 index = lower_bound(node, key);
+        for (u32 i = 0; i < index; ++i)
+            result += node.get_subtree_size(i);
+        current = node.get_child(index);
+    }
+    return result + lower_bound(read_leaf(current), key);
+}
+
+void tree::select(u64 index, cursor& cursor) const {
+    PREQUEL_ASSERT(cursor.m_tree == this, "Cursor does not belong to this tree.");
+    if (!counted())
+        PREQUEL_THROW(bad_operation("The tree does not store subtree sizes."));
+
+    if (index >= size()) {
+        cursor.reset_to_invalid();
+        return;
+    }
+
+    cursor.reset_to_zero();
+    cursor.m_parents.resize(height() - 1);
+    block_index current = root();
+    for (u32 level = height() - 1; level > 0; --level) {
+        auto& entry = cursor.m_parents[height() - 1 - level];
+        entry.node = read_internal(current);
+
+        // Skip children until the remaining index falls into a child's subtree.
+        const u32 child_count = entry.node.get_child_count();
+        u32 child = 0;
+        for (; child < child_count - 1; ++child) {
+            const u64 child_size = entry.node.get_subtree_size(child);
+            if (index < child_size)
+                break;
+            index -= child_size;
+        }
+        entry.index = child;
+        current = entry.node.get_child(child);
+    }
+
+    cursor.m_leaf = read_leaf(current);
+    PREQUEL_ASSERT(index < cursor.m_leaf.get_size(), "Inconsistent subtree sizes.");
+    cursor.m_index = index;
+}
+
+u64 tree::count(const byte* lower, const byte* upper) const {
+    if (!key_less(lower, upper))
+        return 0;
+    if (counted())
+        return rank(upper) - rank(lower);
+
+    u64 result = 0;
+    btree_impl::cursor c(const_cast<tree*>(this));
+    for (lower_bound(lower, c); !c.at_end(); c.move_next()) {
+        key_buffer key;
+        derive_key(c.get(), key.data());
+        if (!key_less(key.data(), upper))
+            break;
+        ++result;
+    }
+    return result;
+}
+
+void tree::filter_insert(const byte* value) {
+    if (!filtered())
+        return;
+    if (!m_filter->initialized() || m_filter->size() >= m_filter->capacity()) {
+        rebuild_filter();
+        return;
+    }
+
+    key_buffer key;
+    derive_key(value, key.data());
+    m_filter->insert(key_hash(key.data()));
+}
+
+void tree::rebuild_filter() {
+    PREQUEL_ASSERT(filtered(), "The tree does not have a filter.");
+
+    // Small trees get a filter that fills a single block.
+    const u32 bits_per_key = m_options.filter_bits_per_key;
+    const u64 min_capacity = u64(get_engine().block_size()) * 8 / bits_per_key;
+    m_filter->reset(std::max(2 * size(), min_capacity), bits_per_key);
+
+    btree_impl::cursor c(this);
+    for (c.move_min(); !c.at_end(); c.move_next()) {
+        key_buffer key;
+        derive_key(c.get(), key.data());
+        m_filter->insert(key_hash(key.data()));
+    }
+}
+
 u32 tree::lower_bound(const leaf_node& leaf, const byte* search_key) const {
     const u32 size = leaf.get_size();
     index_iterator result = std::lower_bound(index_iterator(0), index_iterator(size), search_key,
                                              [&](u32 i, const byte* key) {
                                                  key_buffer buffer;
-                                                 derive_key(leaf.get(i), buffer.data());
+                                                 leaf_key(leaf, i, buffer.data());
                                                  return key_less(buffer.data(), key);
                                              });
     return *result;
@@ -196,7 +539,11 @@ u32 tree::lower_bound(const internal_node& internal, const byte* search_key) con
     const u32 keys = internal.get_child_count() - 1;
     index_iterator result =
         std::lower_bound(index_iterator(0), index_iterator(keys), search_key,
-                         [&](u32 i, const byte* key) { return key_less(internal.get_key(i), key); });
+                         [&](u32 i, const byte* key) {
+                             key_buffer buffer;
+                             internal.get_key(i, buffer.data());
+                             return key_less(buffer.data(), key);
+                         });
     return *result;
 }
 
@@ -205,7 +552,7 @@ u32 tree::upper_bound(const leaf_node& leaf, const byte* search_key) const {
     index_iterator result = std::upper_bound(index_iterator(0), index_iterator(size), search_key,
                                              [&](const byte* key, u32 i) {
                                                  key_buffer buffer;
-                                                 derive_key(leaf.get(i), buffer.data());
+                                                 leaf_key(leaf, i, buffer.data());
                                                  return key_less(key, buffer.data());
                                              });
     return *result;
@@ -217,7 +564,11 @@ u32 tree::upper_bound(const internal_node& internal, const byte* search_key) con
     const u32 keys = internal.get_child_count() - 1;
     index_iterator result =
         std::upper_bound(index_iterator(0), index_iterator(keys), search_key,
-                         [&](const byte* key, u32 i) { return key_less(key, internal.get_key(i)); });
+                         [&](const byte* key, u32 i) {
+                             key_buffer buffer;
+                             internal.get_key(i, buffer.data());
+                             return key_less(key, buffer.data());
+                         });
     return *result;
 }
 
@@ -240,6 +591,7 @@ u32 tree::upper_bound(const internal_node& internal, const byte* search_key) con
 //          and remember which key they pointed to in their local storage. When the value is required again, they simply
 //          traverse the tree and move to the value again. I don't like that solution right now.
 bool tree::insert(const byte* value, cursor& cursor) {
+    check_value(value);
     if (empty()) {
         leaf_node leaf = create_leaf();
         leaf.set(0, value);
@@ -247,6 +599,7 @@ bool tree::insert(const byte* value, cursor& cursor) {
 
         set_height(1);
         set_size(1);
+        modified();
         set_root(leaf.index());
         set_leftmost(leaf.index());
         set_rightmost(leaf.index());
@@ -254,6 +607,7 @@ bool tree::insert(const byte* value, cursor& cursor) {
         cursor.reset_to_zero();
         cursor.m_leaf = std::move(leaf);
         cursor.m_index = 0;
+        filter_insert(value);
         return true;
     }
 
@@ -270,11 +624,20 @@ bool tree::insert(const byte* value, cursor& cursor) {
     const leaf_node leaf = cursor.m_leaf;
     const u32 insert_index = cursor.m_index;
     const u32 leaf_size = cursor.m_leaf.get_size();
-    if (insert_index < leaf_size && value_equal_key(leaf.get(insert_index), key.data())) {
-        cursor.m_flags &= ~cursor.INPROGRESS;
-        return false; // Equivalent value exists.
+    if (insert_index < leaf_size) {
+        key_buffer existing;
+        leaf_key(leaf, insert_index, existing.data());
+        if (key_equal(existing.data(), key.data())) {
+            cursor.m_flags &= ~cursor.INPROGRESS;
+            return false; // Equivalent value exists.
+        }
     }
 
+    // The new value is part of every subtree on the path. Splits below recompute
+    // the sizes of the affected children.
+    if (counted())
+        add_subtree_sizes(cursor, 1);
+
     if (leaf_size < leaf.max_size()) {
         // Simple case: enough space in the leaf.
         leaf.insert_nonfull(insert_index, value);
@@ -295,13 +658,36 @@ bool tree::insert(const byte* value, cursor& cursor) {
                 return leaf_size;
             if (leaf.index() == leftmost())
                 return u32(1);
+
+            // Split at the insertion point if the insertions into this leaf follow a
+            // sequential pattern. Only the new half will receive further insertions.
+            const insert_hint& hint = get_insert_hint(leaf.index());
+            const bool sequential =
+                m_options.adaptive_splits && hint.leaf == leaf.index()
+                && (insert_index == hint.index || insert_index == hint.index + 1);
+            if (sequential) {
+                const u32 min_values = std::max(leaf_node_min_values(), u32(1));
+                return std::clamp(insert_index, min_values, leaf_size + 1 - min_values);
+            }
             return (leaf_size + 2) / 2;
         }();
         leaf.insert_full(insert_index, value, left_size, new_leaf);
+        if (linked_leaves())
+            link_leaf(leaf, new_leaf);
 
         // The split key and the new leaf pointer must be inserted into the parent.
         key_buffer split_key;
-        derive_key(leaf.get(left_size - 1), split_key.data());
+        leaf_key(leaf, left_size - 1, split_key.data());
+
+        // Both halves cover a smaller key range than the old leaf. Their values
+        // are likely to share a longer prefix now.
+        if (leaf_prefix_compression()) {
+            const key_range range = leaf_range(cursor);
+            extend_prefix(leaf, split_key.data(),
+                          common_prefix(range.lower_key(), split_key.data()));
+            extend_prefix(new_leaf, split_key.data(),
+                          common_prefix(split_key.data(), range.upper_key()));
+        }
 
         // New leaf is to the right of the old one, leftmost can be ignored.
         if (leaf.index() == rightmost())
@@ -312,6 +698,10 @@ bool tree::insert(const byte* value, cursor& cursor) {
         if (height() == 1) {
             const internal_node new_root =
                 create_root(leaf.index(), new_leaf.index(), split_key.data());
+            if (counted()) {
+                new_root.set_subtree_size(0, leaf.get_size());
+                new_root.set_subtree_size(1, new_leaf.get_size());
+            }
 
             for (auto& c : m_cursors) {
                 if (c.invalid())
@@ -320,6 +710,7 @@ bool tree::insert(const byte* value, cursor& cursor) {
                 PREQUEL_ASSERT(c.m_leaf.index() == leaf.index(),
                                "Must point to the existing root.");
                 PREQUEL_ASSERT(c.m_parents.empty(), "There cannot be any internal nodes.");
+                c.m_flags &= ~c.STALE_PARENTS; // Complete after the new root was pushed.
 
                 if (&c != &cursor && c.m_index >= insert_index)
                     c.m_index += 1;
@@ -340,11 +731,27 @@ bool tree::insert(const byte* value, cursor& cursor) {
             const internal_node& parent = cursor.m_parents.back().node;
             const u32 index_in_parent = cursor.m_parents.back().index;
             parent.insert_split_result(index_in_parent + 1, split_key.data(), new_leaf.index());
+            if (counted()) {
+                parent.set_subtree_size(index_in_parent, leaf.get_size());
+                parent.set_subtree_size(index_in_parent + 1, new_leaf.get_size());
+            }
 
             for (auto& c : m_cursors) {
                 if (c.invalid())
                     continue;
 
+                if (c.parents_stale()) {
+                    if (c.m_leaf.index() != leaf.index())
+                        continue;
+                    if (c.m_index >= insert_index)
+                        c.m_index += 1;
+                    if (c.m_index >= left_size) {
+                        c.m_leaf = new_leaf;
+                        c.m_index -= left_size;
+                    }
+                    continue;
+                }
+
                 auto& parent_entry = c.m_parents.back();
                 if (parent_entry.node.index() != parent.index())
                     continue;
@@ -372,12 +779,118 @@ bool tree::insert(const byte* value, cursor& cursor) {
 
     cursor.m_flags &= ~cursor.INPROGRESS;
     set_size(size() + 1);
+    modified();
+    filter_insert(value);
+    if (m_options.adaptive_splits)
+        get_insert_hint(cursor.m_leaf.index()) = {cursor.m_leaf.index(), cursor.m_index};
     return true;
 }
 
+// Insert a sorted sequence of values. Only the first value destined for a leaf is inserted
+// normally (which includes the descent from the root and at most one split of the leaf).
+// The following values that belong into the same leaf are merged into it in a single pass,
+// until either the leaf is full or a value exceeds the leaf's key range.
+u64 tree::insert_sorted(const byte* values, size_t count) {
+    btree_impl::cursor c(this);
+    key_buffer key, last_key, upper_key;
+    std::vector<const byte*> merge_values;
+    std::vector<u32> merge_positions;
+
+    u64 inserted = 0;
+    bool has_last_key = false;
+    while (count > 0) {
+        derive_key(values, key.data());
+        if (has_last_key && key_less(key.data(), last_key.data()))
+            PREQUEL_THROW(bad_argument("Values must be sorted."));
+
+        if (insert(values, c))
+            ++inserted;
+        last_key = key;
+        has_last_key = true;
+        values += value_size();
+        count -= 1;
+
+        // Values up to the key of the nearest parent in which the path does not
+        // follow the last child belong into the same leaf.
+        bool has_upper = false;
+        for (auto pos = c.m_parents.rbegin(); pos != c.m_parents.rend(); ++pos) {
+            if (pos->index + 1 < pos->node.get_child_count()) {
+                pos->node.get_key(pos->index, upper_key.data());
+                has_upper = true;
+                break;
+            }
+        }
+
+        const leaf_node leaf = c.m_leaf;
+        const u32 leaf_size = leaf.get_size();
+        const u32 leaf_free = leaf.max_size() - leaf_size;
+        u32 leaf_pos = c.m_index + 1;
+
+        bool unsorted = false;
+        merge_values.clear();
+        merge_positions.clear();
+        while (count > 0 && merge_values.size() < leaf_free) {
+            derive_key(values, key.data());
+            if (key_less(key.data(), last_key.data())) {
+                unsorted = true; // Keep the values collected so far.
+                break;
+            }
+            check_value(values);
+            if (has_upper && key_less(upper_key.data(), key.data()))
+                break;
+
+            // Skip duplicates within the sequence and keys that already exist in the leaf.
+            if (key_less(last_key.data(), key.data())) {
+                key_buffer existing;
+                for (; leaf_pos < leaf_size; ++leaf_pos) {
+                    leaf_key(leaf, leaf_pos, existing.data());
+                    if (!key_less(existing.data(), key.data()))
+                        break;
+                }
+                if (leaf_pos == leaf_size || key_less(key.data(), existing.data())) {
+                    merge_values.push_back(values);
+                    merge_positions.push_back(leaf_pos);
+                }
+                last_key = key;
+            }
+            values += value_size();
+            count -= 1;
+        }
+
+        if (!merge_values.empty()) {
+            const u32 merged = merge_values.size();
+            leaf.merge_nonfull(merge_values.data(), merge_positions.data(), merged);
+            for (auto& other : m_cursors) {
+                if (other.invalid() || other.m_leaf.index() != leaf.index())
+                    continue;
+
+                // Number of new values in front of the cursor's value.
+                other.m_index += std::upper_bound(merge_positions.begin(),
+                                                  merge_positions.end(), other.m_index)
+                                 - merge_positions.begin();
+            }
+            if (counted())
+                add_subtree_sizes(c, merged);
+            set_size(size() + merged);
+            modified();
+            inserted += merged;
+            for (const byte* value : merge_values)
+                filter_insert(value);
+        }
+        if (unsorted)
+            PREQUEL_THROW(bad_argument("Values must be sorted."));
+    }
+    return inserted;
+}
+
 void tree::seek_insert_location(const byte* key, cursor& cursor) {
     PREQUEL_ASSERT(height() > 0, "Tree must not be empty at this point.");
 
+    // Key range of the current node (only tracked with prefix compression).
+    // The range is unbounded as long as the flags are false.
+    key_buffer lower_key, upper_key;
+    bool has_lower = false, has_upper = false;
+
     // For every level of internal nodes.
     block_index current = root();
     for (u32 level = height() - 1; level > 0; --level) {
@@ -401,6 +914,10 @@ void tree::seek_insert_location(const byte* key, cursor& cursor) {
                 // Root split
                 internal_node new_root =
                     create_root(internal.index(), new_internal.index(), split_key.data());
+                if (counted()) {
+                    new_root.set_subtree_size(0, subtree_size(internal));
+                    new_root.set_subtree_size(1, subtree_size(new_internal));
+                }
                 apply_root_split(new_root, internal, new_internal);
             } else {
                 // Split node with a parent.
@@ -414,13 +931,39 @@ void tree::seek_insert_location(const byte* key, cursor& cursor) {
                                "Parent does not point to this node at the given index");
                 parent.insert_split_result(index_in_parent + 1, split_key.data(),
                                            new_internal.index());
+                if (counted()) {
+                    parent.set_subtree_size(index_in_parent, subtree_size(internal));
+                    parent.set_subtree_size(index_in_parent + 1, subtree_size(new_internal));
+                }
                 apply_child_split(parent, level, index_in_parent, internal, new_internal);
             }
+
+            // Both halves cover a smaller key range than the old node. Their keys
+            // are likely to share a longer prefix now.
+            if (prefix_compression()) {
+                const byte* lower = has_lower ? lower_key.data() : nullptr;
+                const byte* upper = has_upper ? upper_key.data() : nullptr;
+                extend_prefix(internal, split_key.data(), common_prefix(lower, split_key.data()));
+                extend_prefix(new_internal, split_key.data(),
+                              common_prefix(split_key.data(), upper));
+            }
         }
 
         // Update with (possibly changed) node info.
         const auto& last_entry = cursor.m_parents.back();
         current = last_entry.node.get_child(last_entry.index);
+
+        if (prefix_compression()) {
+            const internal_node& node = last_entry.node;
+            if (last_entry.index > 0) {
+                node.get_key(last_entry.index - 1, lower_key.data());
+                has_lower = true;
+            }
+            if (last_entry.index < node.get_child_count() - 1) {
+                node.get_key(last_entry.index, upper_key.data());
+                has_upper = true;
+            }
+        }
     }
 
     // Reached the leaf level. Note that the leaf node can be full at this point.
@@ -449,13 +992,117 @@ internal_node tree::split(const internal_node& old_internal, byte* split_key) {
     return new_internal;
 }
 
+u32 tree::common_prefix(const byte* lower, const byte* upper) const {
+    // The last byte is never part of the prefix, keys in a node are unique.
+    const u32 size = key_size() - 1;
+    for (u32 i = 0; i < size; ++i) {
+        const byte l = lower ? lower[i] : byte(0);
+        const byte u = upper ? upper[i] : byte(0xff);
+        if (l != u)
+            return i;
+    }
+    return size;
+}
+
+void tree::extend_prefix(const internal_node& node, const byte* key, u32 prefix_size) {
+    PREQUEL_ASSERT(prefix_compression(), "Prefix compression must be enabled.");
+    if (prefix_size > node.prefix_size())
+        node.set_prefix(key, prefix_size);
+}
+
+void tree::shorten_prefix(const internal_node& node, const byte* prefix, u32 prefix_size) {
+    PREQUEL_ASSERT(prefix_compression(), "Prefix compression must be enabled.");
+
+    const u32 node_prefix_size = node.prefix_size();
+    const byte* node_prefix = node.prefix_data();
+    const u32 size = std::min(node_prefix_size, prefix_size);
+    u32 common = 0;
+    while (common < size && node_prefix[common] == prefix[common])
+        ++common;
+    if (common < node_prefix_size)
+        node.set_prefix(node_prefix, common);
+}
+
+void tree::extend_prefix(const leaf_node& leaf, const byte* key, u32 prefix_size) {
+    PREQUEL_ASSERT(leaf_prefix_compression(), "Leaf prefix compression must be enabled.");
+    if (prefix_size > leaf.prefix_size())
+        leaf.set_prefix(key, prefix_size);
+}
+
+void tree::shorten_prefix(const leaf_node& leaf, const byte* prefix, u32 prefix_size) {
+    PREQUEL_ASSERT(leaf_prefix_compression(), "Leaf prefix compression must be enabled.");
+
+    const u32 common = shared_prefix(leaf, prefix, prefix_size);
+    if (common < leaf.prefix_size())
+        leaf.set_prefix(leaf.prefix_data(), common);
+}
+
+u32 tree::shared_prefix(const leaf_node& leaf, const byte* prefix, u32 prefix_size) const {
+    const u32 size = std::min(leaf.prefix_size(), prefix_size);
+    const byte* leaf_prefix = leaf.prefix_data();
+    u32 common = 0;
+    while (common < size && leaf_prefix[common] == prefix[common])
+        ++common;
+    return common;
+}
+
+tree::key_range tree::leaf_range(const cursor& cursor) const {
+    PREQUEL_ASSERT(!cursor.parents_stale(), "The cursor's parents must be known.");
+
+    // The nearest parents in which the path does not follow the first (last) child
+    // define the lower (upper) bound.
+    key_range range;
+    for (auto pos = cursor.m_parents.rbegin(); pos != cursor.m_parents.rend(); ++pos) {
+        if (!range.has_lower && pos->index > 0) {
+            pos->node.get_key(pos->index - 1, range.lower.data());
+            range.has_lower = true;
+        }
+        if (!range.has_upper && pos->index + 1 < pos->node.get_child_count()) {
+            pos->node.get_key(pos->index, range.upper.data());
+            range.has_upper = true;
+        }
+    }
+    return range;
+}
+
+u64 tree::subtree_size(const internal_node& node) const {
+    PREQUEL_ASSERT(counted(), "The tree does not store subtree sizes.");
+
+    u64 result = 0;
+    const u32 child_count = node.get_child_count();
+    for (u32 i = 0; i < child_count; ++i)
+        result += node.get_subtree_size(i);
+    return result;
+}
+
+void tree::add_subtree_sizes(const cursor& cursor, i64 delta) {
+    PREQUEL_ASSERT(counted(), "The tree does not store subtree sizes.");
+    PREQUEL_ASSERT(!cursor.parents_stale(), "The cursor's path must be complete.");
+
+    for (const auto& entry : cursor.m_parents) {
+        const u64 size = entry.node.get_subtree_size(entry.index);
+        entry.node.set_subtree_size(entry.index, size + u64(delta));
+    }
+}
+
+void tree::move_subtree_size(const internal_node& parent, const internal_node& node,
+                             u32 node_index, u32 node_child, const internal_node& neighbor,
+                             u32 neighbor_index, u32 neighbor_child) {
+    PREQUEL_ASSERT(counted(), "The tree does not store subtree sizes.");
+
+    const u64 size = neighbor.get_subtree_size(neighbor_child);
+    node.set_subtree_size(node_child, size);
+    parent.set_subtree_size(node_index, parent.get_subtree_size(node_index) + size);
+    parent.set_subtree_size(neighbor_index, parent.get_subtree_size(neighbor_index) - size);
+}
+
 void tree::apply_root_split(const internal_node& new_root, const internal_node& left_internal,
                             const internal_node& right_internal) {
     // All children with index >= left_child_count have moved to the right node.
     const u32 left_child_count = left_internal.get_child_count();
 
     for (auto& cursor : m_cursors) {
-        if (cursor.invalid())
+        if (cursor.invalid() || cursor.parents_stale())
             continue;
 
         PREQUEL_ASSERT(!cursor.m_parents.empty(),
@@ -497,7 +1144,7 @@ void tree::apply_child_split(const internal_node& parent, u32 left_level, u32 le
     // All children with index >= left_child count are now in the right node.
     const u32 left_child_count = left_internal.get_child_count();
     for (auto& cursor : m_cursors) {
-        if (cursor.invalid())
+        if (cursor.invalid() || cursor.parents_stale())
             continue;
 
         PREQUEL_ASSERT(parent_stack_index < cursor.m_parents.size(),
@@ -530,32 +1177,323 @@ void tree::apply_child_split(const internal_node& parent, u32 left_level, u32 le
     }
 }
 
+void tree::apply_append_load(block_index old_leaf, const leaf_node& new_leaf) {
+    // Cursors on the old leaf keep their position in its copy. Internal nodes on the
+    // right side of the tree have been replaced, so every parent stack is recomputed.
+    for (auto& c : m_cursors) {
+        if (c.invalid())
+            continue;
+
+        if (c.m_leaf.index() == old_leaf)
+            c.m_leaf = new_leaf;
+        c.m_parents.clear();
+        c.m_flags |= c.STALE_PARENTS;
+        if (!linked_leaves())
+            restore_parents(c);
+    }
+}
+
 // This is the 'normal' erase algorithm for btrees because the cursor already has references
 // to all nodes the stack an we do not need to discover the position of the to-be-deleted value.
 // We still have to respect the fact that the preparatory splits during insertion will result
 // in slightly less than half full internal nodes.
 void tree::erase(cursor& cursor) {
+    erase_run(cursor, 1);
+}
+
+u64 tree::erase_range(const byte* lower, const byte* upper) {
+    if (!key_less(lower, upper))
+        return 0;
+
+    // Points to the first value in the range.
+    btree_impl::cursor first(this);
+    lower_bound(lower, first);
+    if (first.at_end())
+        return 0;
+
+    // Points to the first value after the range.
+    btree_impl::cursor last(this);
+    lower_bound(upper, last);
+    if (!last.at_end() && last.m_leaf.index() == first.m_leaf.index()) {
+        const u32 count = last.m_index - first.m_index;
+        if (count > 0)
+            erase_run(first, count);
+        return count;
+    }
+
+    // The range spans multiple leaves. The values of the last leaf that fall into
+    // the range are removed first, so rebalancing never moves them into another leaf.
+    u64 erased = 0;
+    if (!last.at_end() && last.m_index > 0) {
+        const u32 count = last.m_index;
+        last.m_index = 0;
+        remove_run(last, count);
+        erased += count;
+    }
+
+    // Remove everything between the first and the last leaf.
+    if (!prefix_compression() && !leaf_prefix_compression()) {
+        bool more = true;
+        while (more)
+            more = erase_covered_subtree(lower, upper, first, last, erased);
+    } else {
+        // Freeing a subtree widens the key range of its neighbor, which would
+        // require shorter prefixes along an entire path of the neighbor. Leaves are
+        // removed one at a time instead (from right to left), the leaf to the right
+        // takes over their key range.
+        while (1) {
+            lower_bound(upper, last);
+            if (last.at_end()) {
+                if (!first.move_max())
+                    break;
+            } else {
+                first.copy(last);
+                if (!first.move_prev())
+                    break;
+            }
+
+            key_buffer key;
+            leaf_key(first.m_leaf, 0, key.data());
+            if (key_less(key.data(), lower))
+                break;
+
+            const u32 count = first.m_leaf.get_size();
+            first.m_index = 0;
+            erase_run(first, count);
+            erased += count;
+        }
+    }
+
+    // Remove the remaining values of the first leaf. The leaf may steal from (or merge with)
+    // its right neighbor, which no longer contains any values in the range.
+    lower_bound(lower, first);
+    if (!first.at_end()) {
+        const u32 end = lower_bound(first.m_leaf, upper);
+        if (end > first.m_index) {
+            const u32 count = end - first.m_index;
+            erase_run(first, count);
+            erased += count;
+        }
+    }
+
+    // The last leaf may still be underflowing.
+    lower_bound(upper, last);
+    if (!last.at_end())
+        rebalance_leaf(last);
+    return erased;
+}
+
+bool tree::erase_covered_subtree(const byte* lower, const byte* upper, cursor& first,
+                                 cursor& last, u64& erased) {
+    if (height() <= 1)
+        return false;
+
+    lower_bound(lower, first);
+    lower_bound(upper, last);
+    if (first.at_end())
+        return false;
+    if (first.parents_stale())
+        restore_parents(first);
+    if (!last.at_end() && last.parents_stale())
+        restore_parents(last);
+
+    // Children to the right of the first cursor's path are covered if their largest
+    // possible key is less than `upper`. The key range of the rightmost child of the root
+    // is unbounded, it is only covered if there are no values after the range.
+    u32 first_stack = u32(-1);
+    {
+        key_buffer bound;
+        bool bounded = false;
+        for (u32 stack = 0; stack < first.m_parents.size(); ++stack) {
+            const auto& entry = first.m_parents[stack];
+            const u32 child_count = entry.node.get_child_count();
+            const u32 child = entry.index + 1;
+            if (child < child_count) {
+                bool covered;
+                if (child < child_count - 1) {
+                    key_buffer key;
+                    entry.node.get_key(child, key.data());
+                    covered = key_less(key.data(), upper);
+                } else {
+                    covered = bounded ? key_less(bound.data(), upper) : last.at_end();
+                }
+                if (covered) {
+                    first_stack = stack;
+                    break;
+                }
+
+                entry.node.get_key(entry.index, bound.data());
+                bounded = true;
+            }
+        }
+    }
+
+    // Children to the left of the last cursor's path are covered if their
+    // smallest possible key is not less than `lower`.
+    u32 last_stack = u32(-1);
+    if (!last.at_end()) {
+        key_buffer bound;
+        bool bounded = false;
+        for (u32 stack = 0; stack < last.m_parents.size() && stack < first_stack; ++stack) {
+            const auto& entry = last.m_parents[stack];
+            if (entry.index > 0) {
+                bool covered;
+                if (entry.index > 1) {
+                    key_buffer key;
+                    entry.node.get_key(entry.index - 2, key.data());
+                    covered = !key_less(key.data(), lower);
+                } else {
+                    covered = bounded && !key_less(bound.data(), lower);
+                }
+                if (covered) {
+                    last_stack = stack;
+                    break;
+                }
+
+                entry.node.get_key(entry.index - 1, bound.data());
+                bounded = true;
+            }
+        }
+    }
+
+    // The subtree closest to the root is freed first. The neighbors of the nodes that
+    // must be rebalanced afterwards are therefore never completely inside the range.
+    if (last_stack < first_stack) {
+        erased += erase_subtree(last, last_stack, last.m_parents[last_stack].index - 1, last);
+    } else if (first_stack != u32(-1)) {
+        erased += erase_subtree(first, first_stack, first.m_parents[first_stack].index + 1, last);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+u64 tree::erase_subtree(cursor& cursor, u32 stack_index, u32 child_index,
+                        const btree_impl::cursor& successor) {
+    PREQUEL_ASSERT(!cursor.parents_stale(), "The cursor's path must be complete.");
+    PREQUEL_ASSERT(stack_index < cursor.m_parents.size(), "Stack index out of bounds.");
+
+    const internal_node parent = cursor.m_parents[stack_index].node;
+    const block_index child = parent.get_child(child_index);
+    const u32 child_level = height() - 2 - stack_index;
+
+    // Gather the nodes of the subtree. Leaves are only read if their size is unknown.
+    u64 values = counted() ? parent.get_subtree_size(child_index) : 0;
+    std::vector<block_index> leaves;
+    std::vector<block_index> internals;
+    detail::fix visit = [&](auto& self, block_index index, u32 level) -> void {
+        if (level == 0) {
+            leaves.push_back(index);
+            if (!counted())
+                values += read_leaf(index).get_size();
+            return;
+        }
+
+        const internal_node node = read_internal(index);
+        const u32 child_count = node.get_child_count();
+        for (u32 i = 0; i < child_count; ++i)
+            self(node.get_child(i), level - 1);
+        internals.push_back(index);
+    };
+    visit(child, child_level);
+
+    PREQUEL_ASSERT(leaves.front() != leftmost(), "The leftmost leaf is never covered.");
+    if (leaves.back() == rightmost()) {
+        PREQUEL_ASSERT(child_index > 0, "Rightmost leaf must have a left neighbor.");
+        block_index prev = parent.get_child(child_index - 1);
+        for (u32 level = child_level; level > 0; --level) {
+            const internal_node node = read_internal(prev);
+            prev = node.get_child(node.get_child_count() - 1);
+        }
+        set_rightmost(prev);
+    }
+    if (linked_leaves()) {
+        const block_index prev = read_leaf(leaves.front()).get_prev();
+        const block_index next = read_leaf(leaves.back()).get_next();
+        if (prev)
+            read_leaf(prev).set_next(next);
+        if (next)
+            read_leaf(next).set_prev(prev);
+    }
+
+    // Cursors in the subtree point to the successor of the erased values.
+    std::sort(leaves.begin(), leaves.end());
+    for (auto& c : m_cursors) {
+        if (c.invalid() || !std::binary_search(leaves.begin(), leaves.end(), c.m_leaf.index()))
+            continue;
+
+        if (successor.at_end()) {
+            c.reset_to_invalid(c.DELETED);
+        } else {
+            c.m_leaf = successor.m_leaf;
+            c.m_index = successor.m_index;
+            c.m_parents = successor.m_parents;
+            c.m_flags = (c.m_flags | c.DELETED) & ~c.STALE_PARENTS;
+        }
+    }
+
+    set_size(size() - values);
+    modified();
+    if (counted()) {
+        for (u32 i = 0; i < stack_index; ++i) {
+            const auto& entry = cursor.m_parents[i];
+            entry.node.set_subtree_size(entry.index,
+                                        entry.node.get_subtree_size(entry.index) - values);
+        }
+    }
+
+    for (block_index leaf : leaves)
+        free_leaf(leaf);
+    for (block_index internal : internals)
+        free_internal(internal);
+    propagate_child_deletion(cursor, stack_index, child, child_index);
+    return values;
+}
+
+void tree::erase_run(cursor& cursor, u32 count) {
+    remove_run(cursor, count);
+    rebalance_leaf(cursor);
+}
+
+void tree::remove_run(cursor& cursor, u32 count) {
     PREQUEL_ASSERT(!(cursor.m_flags & cursor.INVALID), "Cursor must not be invalid.");
     PREQUEL_ASSERT(!(cursor.m_flags & cursor.DELETED),
                    "Cursor must not point to a deleted element.");
+    if (cursor.parents_stale())
+        restore_parents(cursor);
     PREQUEL_ASSERT(cursor.m_parents.size() == this->height() - 1,
                    "Not enough nodes on the parent stack.");
     PREQUEL_ASSERT(height() > 0, "The tree cannot be empty.");
+    PREQUEL_ASSERT(count > 0 && count <= cursor.m_leaf.get_size() - cursor.m_index,
+                   "Run must be within the leaf.");
 
     leaf_node leaf = cursor.m_leaf;
     const u32 index = cursor.m_index;
 
-    leaf.remove(index);
-    set_size(size() - 1);
+    leaf.remove(index, count);
+    set_size(size() - count);
+    modified();
+    if (counted())
+        add_subtree_sizes(cursor, -static_cast<i64>(count));
 
     for (auto& c : m_cursors) {
         if (c.invalid() || c.m_leaf.index() != leaf.index())
             continue;
-        if (c.m_index == index)
+        if (c.m_index >= index + count) {
+            c.m_index -= count;
+        } else if (c.m_index >= index) {
+            c.m_index = index;
             c.m_flags |= c.DELETED;
-        else if (c.m_index > index)
-            c.m_index -= 1;
+        }
     }
+}
+
+void tree::rebalance_leaf(cursor& cursor) {
+    PREQUEL_ASSERT(!(cursor.m_flags & cursor.INVALID), "Cursor must not be invalid.");
+    if (cursor.parents_stale())
+        restore_parents(cursor);
+
+    const leaf_node leaf = cursor.m_leaf;
 
     // Handle the root leaf.
     if (cursor.m_parents.empty()) {
@@ -583,44 +1521,20 @@ void tree::erase(cursor& cursor) {
         // completely empty. This is an optimization for the likely case that the user
         // inserts and deletes at the end or the beginning (splitting is optimized similarily).
         if (leaf.get_size() == 0) {
-            // Other nodes remain. Move cursors from this node (they are "deleted")
-            // to the left/right neighbor and propagate the node erasure to the parents.
-            const internal_node& parent = cursor.m_parents.back().node;
-            u32 index_in_parent = cursor.m_parents.back().index;
-
-            u32 neighbor_index;
-            leaf_node neighbor;
-            u32 index_in_neighbor;
-            if (leaf.index() == leftmost()) {
-                neighbor_index = index_in_parent + 1;
-                neighbor = read_leaf(parent.get_child(neighbor_index));
-                index_in_neighbor = 0;
-            } else {
-                neighbor_index = index_in_parent - 1;
-                neighbor = read_leaf(parent.get_child(neighbor_index));
-                index_in_neighbor = neighbor.get_size();
+            // If the neighbor's values do not fit with the shortened prefix,
+            // the empty leaf steals one of them instead of being deleted.
+            if (!erase_empty_leaf(cursor)) {
+                const internal_node& parent = cursor.m_parents.back().node;
+                const u32 index_in_parent = cursor.m_parents.back().index;
+                const u32 neighbor_index =
+                    leaf.index() == leftmost() ? index_in_parent + 1 : index_in_parent - 1;
+                steal_leaf_entry(parent, leaf, index_in_parent,
+                                 read_leaf(parent.get_child(neighbor_index)), neighbor_index);
             }
 
-            // I'm not a fan of loading the neighbor here because it means an additional I/O
-            // just to load the other leaf node in order to move the cursor there.
-            for (auto& c : m_cursors) {
-                if (c.invalid() || c.m_leaf.index() != leaf.index())
-                    continue;
-                c.m_leaf = neighbor;
-                c.m_index = index_in_neighbor;
-                c.m_parents.back().index = neighbor_index;
-            }
-
-            if (leaf.index() == leftmost())
-                set_leftmost(neighbor.index());
-            else
-                set_rightmost(neighbor.index());
-            free_leaf(leaf.index());
-            propagate_leaf_deletion(cursor, leaf.index(), index_in_parent);
-
             // If there are only two leaves remaining we will merge them back together if both are
             // somewhat empty. Two leaf nodes with a single element each just look too stupid.
-        } else if (leaf_nodes() == 2 && size() <= leaf.max_size()) {
+        } else if (leaf_nodes() == 2 && size() <= leaf_node_max_values()) {
             const internal_node& parent = cursor.m_parents.back().node;
             if (leaf.index() == leftmost()) {
                 leaf_node right = read_leaf(parent.get_child(1));
@@ -639,32 +1553,42 @@ void tree::erase(cursor& cursor) {
     }
 
     // Handle all other leaf nodes. Leaf is not the root and not leftmost/rightmost.
-    if (leaf.get_size() >= leaf.min_size())
+    if (leaf.get_size() >= leaf_node_min_values())
+        return;
+
+    // Empty leaves (e.g. in the middle of an erased range) are removed without
+    // moving any values into them.
+    if (leaf.get_size() == 0 && erase_empty_leaf(cursor))
         return;
+
     PREQUEL_ASSERT(cursor.m_parents.size() > 0, "Must have parents.");
     const internal_node& parent = cursor.m_parents.back().node;
     const u32 index_in_parent = cursor.m_parents.back().index;
 
-    // Attempt to steal entries from the right node.
+    // Attempt to steal entries from the neighbors. A single erase needs at most one
+    // value, a run of erased values may need more than that.
     leaf_node right;
     if (index_in_parent + 1 < parent.get_child_count()) {
         right = read_leaf(parent.get_child(index_in_parent + 1));
-        if (right.get_size() > right.min_size()
-            || (right.index() == rightmost() && right.get_size() > 1)) {
+        while (leaf.get_size() < leaf_node_min_values()
+               && (right.get_size() > leaf_node_min_values()
+                   || (right.index() == rightmost() && right.get_size() > 1))) {
             steal_leaf_entry(parent, leaf, index_in_parent, right, index_in_parent + 1);
-            return;
         }
+        if (leaf.get_size() >= leaf_node_min_values())
+            return;
     }
 
-    // Attempt to steal entries from the left node.
     leaf_node left;
     if (index_in_parent > 0) {
         left = read_leaf(parent.get_child(index_in_parent - 1));
-        if ((left.get_size() > left.min_size()
-             || (left.index() == leftmost() && left.get_size() > 1))) {
+        while (leaf.get_size() < leaf_node_min_values()
+               && (left.get_size() > leaf_node_min_values()
+                   || (left.index() == leftmost() && left.get_size() > 1))) {
             steal_leaf_entry(parent, leaf, index_in_parent, left, index_in_parent - 1);
-            return;
         }
+        if (leaf.get_size() >= leaf_node_min_values())
+            return;
     }
 
     // Merge with one of the leaves.
@@ -686,13 +1610,193 @@ void tree::erase(cursor& cursor) {
     propagate_leaf_deletion(cursor, child_node, child_node_index);
 }
 
+bool tree::erase_empty_leaf(cursor& cursor) {
+    const leaf_node leaf = cursor.m_leaf;
+    const internal_node& parent = cursor.m_parents.back().node;
+    const u32 index_in_parent = cursor.m_parents.back().index;
+    PREQUEL_ASSERT(leaf.get_size() == 0, "The leaf must be empty.");
+
+    // The right neighbor takes over the key range of this leaf, unless the leaf
+    // is its parent's last child (this matches internal_node::remove_child()).
+    // Leftmost leaves are always the first child, rightmost leaves always the last one.
+    u32 neighbor_index;
+    leaf_node neighbor;
+    u32 index_in_neighbor;
+    if (index_in_parent + 1 < parent.get_child_count()) {
+        neighbor_index = index_in_parent + 1;
+        neighbor = read_leaf(parent.get_child(neighbor_index));
+        index_in_neighbor = 0;
+    } else {
+        neighbor_index = index_in_parent - 1;
+        neighbor = read_leaf(parent.get_child(neighbor_index));
+        index_in_neighbor = neighbor.get_size();
+    }
+
+    // The neighbor's prefix must be shortened to cover the new range. The range of the
+    // leftmost and rightmost leaves extends to the smallest (or largest) possible key.
+    if (leaf_prefix_compression()) {
+        key_buffer bound;
+        const byte* prefix = leaf.prefix_data();
+        u32 prefix_size = leaf.prefix_size();
+        if (leaf.index() == leftmost() || leaf.index() == rightmost()) {
+            std::fill_n(bound.data(), key_size(), leaf.index() == leftmost() ? 0x00 : 0xff);
+            prefix = bound.data();
+            prefix_size = key_size();
+        }
+
+        const u32 shared = shared_prefix(neighbor, prefix, prefix_size);
+        if (neighbor.get_size() > leaf_node_max_values(shared))
+            return false;
+        shorten_prefix(neighbor, prefix, prefix_size);
+    }
+
+    // I'm not a fan of loading the neighbor here because it means an additional I/O
+    // just to load the other leaf node in order to move the cursor there.
+    for (auto& c : m_cursors) {
+        if (c.invalid() || c.m_leaf.index() != leaf.index())
+            continue;
+        c.m_leaf = neighbor;
+        c.m_index = index_in_neighbor;
+        if (!c.parents_stale())
+            c.m_parents.back().index = neighbor_index;
+    }
+
+    if (leaf.index() == leftmost())
+        set_leftmost(neighbor.index());
+    if (leaf.index() == rightmost())
+        set_rightmost(neighbor.index());
+    if (linked_leaves())
+        unlink_leaf(leaf);
+    free_leaf(leaf.index());
+    propagate_leaf_deletion(cursor, leaf.index(), index_in_parent);
+    return true;
+}
+
+bool tree::compact(u64 max_leaves) {
+    PREQUEL_ASSERT(max_leaves > 0, "Must process at least one leaf.");
+    if (height() == 0) {
+        m_compact_active = false;
+        return true;
+    }
+
+    btree_impl::cursor c(this);
+    if (m_compact_active) {
+        upper_bound(m_compact_key.data(), c);
+        if (c.at_end()) {
+            m_compact_active = false;
+            return true;
+        }
+    } else {
+        c.move_min();
+        m_compact_leaf = block_index();
+    }
+
+    // Leaves are written to the extent in key order. The extent is allocated
+    // when the first leaf must be moved, unused blocks are freed at the end.
+    block_index extent;
+    u64 extent_size = 0;
+    u64 extent_used = 0;
+    deferred free_unused = [&] {
+        if (extent_used < extent_size)
+            get_allocator().free(extent + extent_used, extent_size - extent_used);
+    };
+
+    bool done = false;
+    for (u64 processed = 0; processed < max_leaves; ++processed) {
+        if (c.parents_stale())
+            restore_parents(c);
+        merge_right_neighbors(c);
+
+        // Leaves that already follow their predecessor on disk stay where they are.
+        if (!m_compact_leaf || c.m_leaf.index() != m_compact_leaf + 1) {
+            if (extent_used == extent_size) {
+                const u64 size = std::min(max_leaves - processed, leaf_nodes());
+                extent = get_allocator().allocate(size);
+                extent_size = size;
+                extent_used = 0;
+            }
+            relocate_leaf(c, extent + extent_used);
+            ++extent_used;
+        }
+
+        leaf_key(c.m_leaf, c.m_leaf.get_size() - 1, m_compact_key.data());
+        m_compact_leaf = c.m_leaf.index();
+        m_compact_active = true;
+        if (!next_leaf(c)) {
+            done = true;
+            break;
+        }
+    }
+
+    if (done)
+        m_compact_active = false;
+    return done;
+}
+
+void tree::merge_right_neighbors(cursor& cursor) {
+    const u32 max_values = leaf_node_load_values(leaf_node_max_values());
+    while (!cursor.m_parents.empty()) {
+        const internal_node& parent = cursor.m_parents.back().node;
+        const u32 index_in_parent = cursor.m_parents.back().index;
+        if (index_in_parent + 1 >= parent.get_child_count())
+            break;
+
+        const leaf_node& leaf = cursor.m_leaf;
+        const leaf_node right = read_leaf(parent.get_child(index_in_parent + 1));
+        if (leaf.get_size() + right.get_size() > max_values)
+            break;
+
+        modified();
+        merge_leaf(parent, leaf, index_in_parent, right, index_in_parent + 1);
+        free_leaf(right.index());
+        propagate_leaf_deletion(cursor, right.index(), index_in_parent + 1);
+    }
+}
+
+void tree::relocate_leaf(cursor& cursor, block_index target) {
+    modified();
+    restructured();
+
+    const leaf_node leaf = cursor.m_leaf;
+    const leaf_node moved = as_leaf(
+        get_engine().overwrite(target, leaf.block().data(), get_engine().block_size()));
+
+    if (cursor.m_parents.empty()) {
+        set_root(target);
+    } else {
+        const auto& entry = cursor.m_parents.back();
+        entry.node.set_child(entry.index, target);
+    }
+    if (leftmost() == leaf.index())
+        set_leftmost(target);
+    if (rightmost() == leaf.index())
+        set_rightmost(target);
+    if (linked_leaves()) {
+        if (block_index prev = leaf.get_prev())
+            read_leaf(prev).set_next(target);
+        if (block_index next = leaf.get_next())
+            read_leaf(next).set_prev(target);
+    }
+
+    for (auto& c : m_cursors) {
+        if (!c.invalid() && c.m_leaf.index() == leaf.index())
+            c.m_leaf = moved;
+    }
+    get_allocator().free(leaf.index(), 1);
+}
+
 // Called when the leaf node `child_node` has been merged with a neighbor and now has to be removed from its parent.
 // The internal nodes up the stack might have to be merged as well.
 void tree::propagate_leaf_deletion(cursor& cursor, block_index child_node, u32 child_node_index) {
     PREQUEL_ASSERT(!cursor.m_parents.empty(), "There must be internal node parents.");
+    propagate_child_deletion(cursor, cursor.m_parents.size() - 1, child_node, child_node_index);
+}
+
+void tree::propagate_child_deletion(cursor& cursor, u32 stack_index, block_index child_node,
+                                    u32 child_node_index) {
+    PREQUEL_ASSERT(stack_index < cursor.m_parents.size(), "Stack index out of bounds.");
 
     // Walk up the stack and merge nodes if necessary.
-    u32 stack_index = cursor.m_parents.size() - 1;
     internal_node node = cursor.m_parents[stack_index].node;
     while (1) {
         PREQUEL_ASSERT(cursor.m_parents.at(stack_index).node.index() == node.index(),
@@ -704,7 +1808,7 @@ void tree::propagate_leaf_deletion(cursor& cursor, block_index child_node, u32 c
         // Remove the child and shift cursors to the left.
         node.remove_child(child_node_index);
         for (auto& c : m_cursors) {
-            if (c.invalid())
+            if (c.invalid() || c.parents_stale())
                 continue;
 
             auto& entry = c.m_parents[stack_index];
@@ -724,8 +1828,14 @@ void tree::propagate_leaf_deletion(cursor& cursor, block_index child_node, u32 c
                 set_height(height() - 1);
                 free_internal(node.index());
 
+                // The new root covers the entire key range.
+                if (prefix_compression() && height() > 1)
+                    shorten_prefix(read_internal(root()), nullptr, 0);
+                if (leaf_prefix_compression() && height() == 1)
+                    shorten_prefix(read_leaf(root()), nullptr, 0);
+
                 for (auto& c : m_cursors) {
-                    if (c.invalid())
+                    if (c.invalid() || c.parents_stale())
                         continue;
                     PREQUEL_ASSERT(!c.m_parents.empty()
                                        && c.m_parents[0].node.index() == node.index(),
@@ -787,6 +1897,8 @@ void tree::propagate_leaf_deletion(cursor& cursor, block_index child_node, u32 c
 
 void tree::steal_leaf_entry(const internal_node& parent, const leaf_node& leaf, u32 leaf_index,
                             const leaf_node& neighbor, u32 neighbor_index) {
+    restructured();
+
     const u32 parent_children = parent.get_child_count();
     const u32 leaf_size = leaf.get_size();
     const u32 neighbor_size = neighbor.get_size();
@@ -800,15 +1912,25 @@ void tree::steal_leaf_entry(const internal_node& parent, const leaf_node& leaf,
     PREQUEL_ASSERT(parent.get_child(neighbor_index) == neighbor.index(), "Neighbor index wrong.");
     PREQUEL_ASSERT(neighbor_size > 1, "At least one value must remain after stealing one.");
 
+    std::vector<byte> value(value_size());
     if (leaf_index < parent_children - 1 && neighbor_index == leaf_index + 1) {
+        // The moved value becomes the new upper bound of this leaf.
+        key_buffer key;
+        leaf_key(neighbor, 0, key.data());
+        if (leaf_prefix_compression())
+            shorten_prefix(leaf, key.data(), key_size());
+
         // Move elements
-        leaf.insert_nonfull(leaf_size, neighbor.get(0));
+        neighbor.get(0, value.data(), value_size());
+        leaf.insert_nonfull(leaf_size, value.data());
         neighbor.remove(0);
 
         // Update max key of this node in parent.
-        key_buffer key;
-        derive_key(leaf.get(leaf_size), key.data());
         parent.set_key(leaf_index, key.data());
+        if (counted()) {
+            parent.set_subtree_size(leaf_index, leaf_size + 1);
+            parent.set_subtree_size(neighbor_index, neighbor_size - 1);
+        }
 
         // Rewrite all cursors.
         for (auto& c : m_cursors) {
@@ -817,20 +1939,30 @@ void tree::steal_leaf_entry(const internal_node& parent, const leaf_node& leaf,
             if (c.m_index == 0) {
                 c.m_leaf = leaf;
                 c.m_index = leaf_size;
-                c.m_parents.back().index -= 1;
+                if (!c.parents_stale())
+                    c.m_parents.back().index -= 1;
             } else {
                 c.m_index -= 1;
             }
         }
     } else if (leaf_index > 0 && neighbor_index == leaf_index - 1) {
+        // The neighbor's new max key becomes the new lower bound of this leaf.
+        key_buffer key;
+        leaf_key(neighbor, neighbor_size - 2, key.data());
+        if (leaf_prefix_compression())
+            shorten_prefix(leaf, key.data(), key_size());
+
         // Move elements
-        leaf.insert_nonfull(0, neighbor.get(neighbor_size - 1));
+        neighbor.get(neighbor_size - 1, value.data(), value_size());
+        leaf.insert_nonfull(0, value.data());
         neighbor.remove(neighbor_size - 1);
 
         // Update max key of the neighbor node in parent.
-        key_buffer key;
-        derive_key(neighbor.get(neighbor_size - 2), key.data());
         parent.set_key(leaf_index - 1, key.data());
+        if (counted()) {
+            parent.set_subtree_size(leaf_index, leaf_size + 1);
+            parent.set_subtree_size(neighbor_index, neighbor_size - 1);
+        }
 
         // Rewrite all cursors.
         for (auto& c : m_cursors) {
@@ -843,7 +1975,8 @@ void tree::steal_leaf_entry(const internal_node& parent, const leaf_node& leaf,
                 if (c.m_index >= neighbor_size - 1) {
                     c.m_leaf = leaf;
                     c.m_index -= neighbor_size - 1;
-                    c.m_parents.back().index += 1;
+                    if (!c.parents_stale())
+                        c.m_parents.back().index += 1;
                 }
             }
         }
@@ -856,6 +1989,8 @@ void tree::steal_leaf_entry(const internal_node& parent, const leaf_node& leaf,
 void tree::steal_internal_entry(const internal_node& parent, u32 stack_index,
                                 const internal_node& node, u32 node_index,
                                 const internal_node& neighbor, u32 neighbor_index) {
+    restructured();
+
     const u32 parent_children = parent.get_child_count();
     const u32 node_children = node.get_child_count();
     const u32 neighbor_children = neighbor.get_child_count();
@@ -873,13 +2008,23 @@ void tree::steal_internal_entry(const internal_node& parent, u32 stack_index,
 
     if (node_index < parent_children - 1 && neighbor_index == node_index + 1) {
         // Taking from the right neighbor. We have to update our own key after this op.
-        node.append_entry(parent.get_key(node_index), neighbor.get_child(0));
-        parent.set_key(node_index, neighbor.get_key(0));
+        key_buffer key, new_key;
+        parent.get_key(node_index, key.data());
+        neighbor.get_key(0, new_key.data());
+
+        // The node's range now extends up to the new key.
+        if (prefix_compression())
+            shorten_prefix(node, new_key.data(), key_size());
+
+        node.append_entry(key.data(), neighbor.get_child(0));
+        parent.set_key(node_index, new_key.data());
+        if (counted())
+            move_subtree_size(parent, node, node_index, node_children, neighbor, neighbor_index, 0);
         neighbor.remove_child(0);
 
         // Update cursors.
         for (auto& c : m_cursors) {
-            if (c.invalid())
+            if (c.invalid() || c.parents_stale())
                 continue;
 
             auto& parent_entry = c.m_parents[stack_index - 1];
@@ -898,14 +2043,25 @@ void tree::steal_internal_entry(const internal_node& parent, u32 stack_index,
     } else if (node_index > 0 && neighbor_index == node_index - 1) {
         // Taking from the left neighbor. The appropriate key (the max) is stored
         // in the parent node and needs to be taken + replaced.
-        node.prepend_entry(parent.get_key(neighbor_index),
-                           neighbor.get_child(neighbor_children - 1));
-        parent.set_key(neighbor_index, neighbor.get_key(neighbor_children - 2));
+        key_buffer key, new_key;
+        parent.get_key(neighbor_index, key.data());
+        neighbor.get_key(neighbor_children - 2, new_key.data());
+
+        // The node's range now starts after the new key.
+        if (prefix_compression())
+            shorten_prefix(node, new_key.data(), key_size());
+
+        node.prepend_entry(key.data(), neighbor.get_child(neighbor_children - 1));
+        parent.set_key(neighbor_index, new_key.data());
+        if (counted()) {
+            move_subtree_size(parent, node, node_index, 0, neighbor, neighbor_index,
+                              neighbor_children - 1);
+        }
         neighbor.remove_child(neighbor_children - 1);
 
         // Update cursors.
         for (auto& c : m_cursors) {
-            if (c.invalid())
+            if (c.invalid() || c.parents_stale())
                 continue;
 
             auto& parent_entry = c.m_parents[stack_index - 1];
@@ -939,16 +2095,30 @@ void tree::merge_leaf(const internal_node& parent, const leaf_node& leaf, u32 le
     PREQUEL_ASSERT(parent.get_child(leaf_index) == leaf.index(), "Leaf index wrong.");
     PREQUEL_ASSERT(parent.get_child(neighbor_index) == neighbor.index(), "Neighbor index wrong.");
 
+    // The leaf takes over the neighbor's key range.
+    if (leaf_prefix_compression())
+        shorten_prefix(leaf, neighbor.prefix_data(), neighbor.prefix_size());
+
     if (leaf_index < parent_children - 1 && neighbor_index == leaf_index + 1) {
         // Merge with the node to the right.
         leaf.append_from_right(neighbor);
+        if (counted())
+            parent.set_subtree_size(leaf_index, leaf.get_size());
         if (rightmost() == neighbor.index())
             set_rightmost(leaf.index());
+        if (linked_leaves())
+            unlink_leaf(neighbor);
 
-        // Update the key since the leaf's max value changed.
+        // Update the key since the leaf's max value changed. With leaf prefixes,
+        // the key ranges of the following leaves must not change: the leaf
+        // inherits the neighbor's separator instead.
         if (neighbor_index != parent_children - 1) {
             key_buffer key;
-            derive_key(leaf.get(leaf_size + neighbor_size - 1), key.data());
+            if (leaf_prefix_compression()) {
+                parent.get_key(neighbor_index, key.data());
+            } else {
+                leaf_key(leaf, leaf_size + neighbor_size - 1, key.data());
+            }
             parent.set_key(leaf_index, key.data());
         }
 
@@ -958,13 +2128,18 @@ void tree::merge_leaf(const internal_node& parent, const leaf_node& leaf, u32 le
 
             c.m_leaf = leaf;
             c.m_index += leaf_size;
-            c.m_parents.back().index -= 1;
+            if (!c.parents_stale())
+                c.m_parents.back().index -= 1;
         }
     } else if (leaf_index > 0 && neighbor_index == leaf_index - 1) {
         // Merge with the node to the left.
         leaf.prepend_from_left(neighbor);
+        if (counted())
+            parent.set_subtree_size(leaf_index, leaf.get_size());
         if (leftmost() == neighbor.index())
             set_leftmost(leaf.index());
+        if (linked_leaves())
+            unlink_leaf(neighbor);
 
         for (auto& c : m_cursors) {
             if (c.invalid())
@@ -974,7 +2149,8 @@ void tree::merge_leaf(const internal_node& parent, const leaf_node& leaf, u32 le
                 c.m_index += neighbor_size;
             } else if (c.m_leaf.index() == neighbor.index()) {
                 c.m_leaf = leaf;
-                c.m_parents.back().index += 1;
+                if (!c.parents_stale())
+                    c.m_parents.back().index += 1;
             }
         }
     } else {
@@ -1000,15 +2176,26 @@ void tree::merge_internal(const internal_node& parent, u32 stack_index, const in
 
     if (node_index < parent_children - 1 && neighbor_index == node_index + 1) {
         // Merge with the right neighbor.
-        node.append_from_right(parent.get_key(node_index), neighbor);
+        // The merged node covers the key ranges of both nodes.
+        if (prefix_compression())
+            shorten_prefix(node, neighbor.prefix_data(), neighbor.prefix_size());
+
+        key_buffer key;
+        parent.get_key(node_index, key.data());
+        node.append_from_right(key.data(), neighbor);
+        if (counted()) {
+            parent.set_subtree_size(node_index, parent.get_subtree_size(node_index)
+                                                    + parent.get_subtree_size(neighbor_index));
+        }
 
         if (neighbor_index != parent_children - 1) {
-            parent.set_key(node_index, parent.get_key(neighbor_index));
+            parent.get_key(neighbor_index, key.data());
+            parent.set_key(node_index, key.data());
         }
 
         // Update all cursors.
         for (auto& c : m_cursors) {
-            if (c.invalid())
+            if (c.invalid() || c.parents_stale())
                 continue;
 
             auto& parent_entry = c.m_parents[stack_index - 1];
@@ -1022,11 +2209,20 @@ void tree::merge_internal(const internal_node& parent, u32 stack_index, const in
 
     } else if (node_index > 0 && neighbor_index == node_index - 1) {
         // Merge with the left neighbor.
-        node.prepend_from_left(parent.get_key(neighbor_index), neighbor);
+        if (prefix_compression())
+            shorten_prefix(node, neighbor.prefix_data(), neighbor.prefix_size());
+
+        key_buffer key;
+        parent.get_key(neighbor_index, key.data());
+        node.prepend_from_left(key.data(), neighbor);
+        if (counted()) {
+            parent.set_subtree_size(node_index, parent.get_subtree_size(node_index)
+                                                    + parent.get_subtree_size(neighbor_index));
+        }
 
         // Update all cursors.
         for (auto& c : m_cursors) {
-            if (c.invalid())
+            if (c.invalid() || c.parents_stale())
                 continue;
 
             auto& parent_entry = c.m_parents[stack_index - 1];
@@ -1044,8 +2240,11 @@ void tree::merge_internal(const internal_node& parent, u32 stack_index, const in
 }
 
 void tree::clear() {
+    if (m_filter)
+        m_filter->reset();
     if (empty())
         return;
+    restructured();
 
     // Invalidate all cursors first.
     for (auto& c : m_cursors) {
@@ -1063,6 +2262,7 @@ void tree::clear() {
     set_rightmost({});
     set_height(0);
     set_size(0);
+    modified();
     set_internal_nodes(0);
     set_leaf_nodes(0);
 
@@ -1107,8 +2307,15 @@ std::unique_ptr<loader> tree::bulk_load() {
     return std::make_unique<loader>(*this);
 }
 
-std::unique_ptr<cursor> tree::create_cursor(raw_btree::cursor_seek_t seek) {
-    auto c = std::make_unique<cursor>(this);
+std::unique_ptr<loader> tree::bulk_append() {
+    auto result = std::make_unique<loader>(*this);
+    if (!empty())
+        result->init_append();
+    return result;
+}
+
+std::unique_ptr<cursor> tree::create_cursor(raw_btree::cursor_seek_t seek, bool lazy) {
+    auto c = std::make_unique<cursor>(this, lazy);
 
     switch (seek) {
     case raw_btree::seek_none: break;
@@ -1177,11 +2384,25 @@ void tree::dump(std::ostream& os) const {
                        "  Children: {}\n",
                        node.index(), parent, level, child_count);
 
+            if (node.prefixed()) {
+                fmt::print(os, "  Prefix: {}\n",
+                           format_hex(node.prefix_data(), node.prefix_size()));
+            }
+            auto print_size = [&](u32 i) {
+                if (node.counted())
+                    fmt::print(os, " [{} values]", node.get_subtree_size(i));
+            };
             for (u32 i = 0; i < child_count - 1; ++i) {
-                fmt::print(os, "  {}: @{} (<= {})\n", i, node.get_child(i),
-                           format_hex(node.get_key(i), node.key_size()));
+                key_buffer key;
+                node.get_key(i, key.data());
+                fmt::print(os, "  {}: @{} (<= {})", i, node.get_child(i),
+                           format_hex(key.data(), node.key_size()));
+                print_size(i);
+                os << "\n";
             }
-            fmt::print(os, "  {}: @{}\n", child_count - 1, node.get_child(child_count - 1));
+            fmt::print(os, "  {}: @{}", child_count - 1, node.get_child(child_count - 1));
+            print_size(child_count - 1);
+            os << "\n";
             return true;
         }
 
@@ -1194,8 +2415,20 @@ void tree::dump(std::ostream& os) const {
                        "  Parent: @{}\n"
                        "  Values: {}\n",
                        leaf.index(), parent, size);
+            if (leaf.linked()) {
+                fmt::print(os,
+                           "  Previous: @{}\n"
+                           "  Next: @{}\n",
+                           leaf.get_prev(), leaf.get_next());
+            }
+            if (leaf.prefixed()) {
+                fmt::print(os, "  Prefix: {}\n",
+                           format_hex(leaf.prefix_data(), leaf.prefix_size()));
+            }
+            std::vector<byte> value(leaf.value_size());
             for (u32 i = 0; i < size; ++i) {
-                fmt::print(os, "  {}: {}\n", i, format_hex(leaf.get(i), leaf.value_size()));
+                leaf.get(i, value.data(), leaf.value_size());
+                fmt::print(os, "  {}: {}\n", i, format_hex(value.data(), leaf.value_size()));
             }
             return true;
         }
@@ -1223,7 +2456,8 @@ void tree::visit(bool (*visit_fn)(const raw_btree::node_view& node, void* user_d
             const internal_node& node = check_internal();
             if (index >= node.get_child_count() - 1)
                 PREQUEL_THROW(bad_argument("Key index out of bounds."));
-            return node.get_key(index);
+            node.get_key(index, m_key.data());
+            return m_key.data();
         }
 
         virtual block_index child(u32 index) const {
@@ -1240,7 +2474,12 @@ void tree::visit(bool (*visit_fn)(const raw_btree::node_view& node, void* user_d
             const leaf_node& node = check_leaf();
             if (index >= node.get_size())
                 PREQUEL_THROW(bad_argument("Value index out of bounds."));
-            return node.get(index);
+            if (!node.prefixed())
+                return node.get(index);
+
+            m_value.resize(node.value_size());
+            node.get(index, m_value.data(), node.value_size());
+            return m_value.data();
         }
 
         const internal_node& check_internal() const {
@@ -1261,6 +2500,8 @@ void tree::visit(bool (*visit_fn)(const raw_btree::node_view& node, void* user_d
         block_index m_parent;
         block_index m_address;
         std::variant<leaf_node, internal_node> m_node;
+        mutable key_buffer m_key; // Internal nodes may not store complete keys.
+        mutable std::vector<byte> m_value; // Leaf nodes may not store complete values.
     };
 
     struct visitor_t {
@@ -1302,15 +2543,17 @@ void tree::validate() const {
     struct checker {
         const class tree* tree;
 
-        const u32 min_values = tree->m_leaf_capacity / 2;
-        const u32 max_values = tree->m_leaf_capacity;
+        const u32 min_values = tree->m_leaf_min_values;
         const u32 min_children = tree->m_internal_max_children / 2;
-        const u32 max_children = tree->m_internal_max_children;
 
         u64 seen_values = 0;
         u64 seen_leaf_nodes = 0;
         u64 seen_internal_nodes = 0;
 
+        // Leaf links (if enabled).
+        block_index last_leaf;
+        block_index expected_next;
+
         checker(const class tree* tree_)
             : tree(tree_) {}
 
@@ -1321,7 +2564,7 @@ void tree::validate() const {
                 PREQUEL_ERROR("Key is greater than the upper bound.");
         };
 
-        void check_leaf(const context& ctx, const leaf_node& leaf) {
+        u64 check_leaf(const context& ctx, const leaf_node& leaf) {
             if (!ctx.lower_key && tree->leftmost() != leaf.index()) {
                 PREQUEL_ERROR("Only the leftmost leaf can have an unbounded lower key.");
             }
@@ -1340,29 +2583,71 @@ void tree::validate() const {
                 && leaf.index() != tree->leftmost() && leaf.index() != tree->rightmost()) {
                 PREQUEL_ERROR("Leaf is underflowing.");
             }
-            if (size > max_values) {
+            if (size > leaf.max_size()) {
                 PREQUEL_ERROR("Leaf is overflowing.");
             }
+            if (tree->leaf_prefix_compression()) {
+                check_prefix(ctx, leaf.prefix_data(), leaf.prefix_size());
+            }
 
+            std::vector<byte> value(tree->value_size());
             for (u32 i = 0; i < size; ++i) {
                 key_buffer key;
-                tree->derive_key(leaf.get(i), key.data());
+                tree->leaf_key(leaf, i, key.data());
                 check_key(ctx, key.data());
 
+                if (leaf.prefixed()) {
+                    key_buffer derived;
+                    leaf.get(i, value.data(), tree->value_size());
+                    tree->derive_key(value.data(), derived.data());
+                    if (std::memcmp(key.data(), derived.data(), tree->key_size()) != 0)
+                        PREQUEL_ERROR("Value does not start with its key.");
+                }
+
+                if (tree->filtered() && !tree->m_filter->may_contain(tree->key_hash(key.data())))
+                    PREQUEL_ERROR("Key is missing from the filter.");
+
                 if (i > 0) {
                     key_buffer prev;
-                    tree->derive_key(leaf.get(i - 1), prev.data());
+                    tree->leaf_key(leaf, i - 1, prev.data());
                     if (!tree->key_less(prev.data(), key.data())) {
                         PREQUEL_ERROR("Leaf entries are not sorted.");
                     }
                 }
             }
 
+            if (tree->linked_leaves()) {
+                if (leaf.get_prev() != last_leaf) {
+                    PREQUEL_ERROR("Leaf does not point to its left neighbor.");
+                }
+                if (last_leaf && expected_next != leaf.index()) {
+                    PREQUEL_ERROR("Leaf is not pointed to by its left neighbor.");
+                }
+                last_leaf = leaf.index();
+                expected_next = leaf.get_next();
+            }
+
             seen_leaf_nodes += 1;
             seen_values += size;
+            return size;
         };
 
-        void check_internal(const context& ctx, const internal_node& node) {
+        void check_prefix(const context& ctx, const byte* prefix, u32 prefix_size) {
+            // All keys in the node's range (including the bounds) must start with the prefix.
+            if (prefix_size >= tree->key_size()) {
+                PREQUEL_ERROR("Prefix is too long.");
+            }
+            for (u32 i = 0; i < prefix_size; ++i) {
+                const byte lower = ctx.lower_key ? ctx.lower_key[i] : byte(0);
+                const byte upper = ctx.upper_key ? ctx.upper_key[i] : byte(0xff);
+                if (lower != prefix[i] || upper != prefix[i]) {
+                    PREQUEL_ERROR("Prefix is not shared by the node's key range.");
+                }
+            }
+        }
+
+        // Returns the number of values in the node's subtree.
+        u64 check_internal(const context& ctx, const internal_node& node) {
             const u32 child_count = node.get_child_count();
             if (child_count < min_children && node.index() != tree->root()) {
                 PREQUEL_ERROR("Internal node is underflowing.");
@@ -1370,43 +2655,65 @@ void tree::validate() const {
             if (child_count < 2 && node.index() != tree->root()) {
                 PREQUEL_ERROR("Root is too empty.");
             }
-            if (child_count > max_children) {
+            if (child_count > node.max_children()) {
                 PREQUEL_ERROR("Internal node is overflowing.");
             }
+            if (tree->prefix_compression()) {
+                check_prefix(ctx, node.prefix_data(), node.prefix_size());
+            }
 
-            check_key(ctx, node.get_key(0));
+            // Complete copies of the node's keys, they serve as bounds for the children.
+            const u32 key_size = tree->key_size();
+            std::vector<byte> keys((child_count - 1) * key_size);
+            for (u32 i = 0; i < child_count - 1; ++i) {
+                node.get_key(i, keys.data() + i * key_size);
+            }
+            auto get_key = [&](u32 i) { return keys.data() + i * key_size; };
+
+            check_key(ctx, get_key(0));
+
+            // Checks the child and its subtree size (if stored).
+            u64 total = 0;
+            auto check_child = [&](const context& child_ctx, u32 i) {
+                const u64 size = check(child_ctx, node.get_child(i));
+                if (tree->counted() && node.get_subtree_size(i) != size) {
+                    PREQUEL_ERROR("Subtree size does not match the child's number of values.");
+                }
+                total += size;
+            };
 
             context child_ctx;
             child_ctx.parent = node.index();
             child_ctx.level = ctx.level - 1;
             child_ctx.lower_key = ctx.lower_key;
-            child_ctx.upper_key = node.get_key(0);
-            check_key(child_ctx, node.get_key(0));
-            check(child_ctx, node.get_child(0));
+            child_ctx.upper_key = get_key(0);
+            check_key(child_ctx, get_key(0));
+            check_child(child_ctx, 0);
 
             for (u32 i = 1; i < child_count - 1; ++i) {
-                check_key(ctx, node.get_key(i));
-                if (!tree->key_less(node.get_key(i - 1), node.get_key(i))) {
+                check_key(ctx, get_key(i));
+                if (!tree->key_less(get_key(i - 1), get_key(i))) {
                     PREQUEL_ERROR("Internal node entries are not sorted.");
                 }
 
-                child_ctx.lower_key = node.get_key(i - 1);
-                child_ctx.upper_key = node.get_key(i);
-                check(child_ctx, node.get_child(i));
+                child_ctx.lower_key = get_key(i - 1);
+                child_ctx.upper_key = get_key(i);
+                check_child(child_ctx, i);
             }
 
-            child_ctx.lower_key = node.get_key(child_count - 2);
+            child_ctx.lower_key = get_key(child_count - 2);
             child_ctx.upper_key = ctx.upper_key;
-            check(child_ctx, node.get_child(child_count - 1));
+            check_child(child_ctx, child_count - 1);
 
             seen_internal_nodes += 1;
+            return total;
         };
 
-        void check(const context& ctx, block_index node_index) {
+        u64 check(const context& ctx, block_index node_index) {
             if (ctx.level == 0) {
-                check_leaf(ctx, tree->read_leaf(node_index));
+                return check_leaf(ctx, tree->read_leaf(node_index));
             } else {
-                check_internal(ctx, tree->read_internal(node_index));
+                return check_internal(ctx, tree->read_internal(node_index));
             }
         }
 
@@ -1421,6 +2728,9 @@ void tree::validate() const {
                 check(ctx, tree->root());
             }
 
+            if (expected_next) {
+                PREQUEL_ERROR("The rightmost leaf must not have a right neighbor.");
+            }
             if (seen_values != tree->size()) {
                 PREQUEL_ERROR("Value count does not match the tree's size.");
             }
@@ -1435,47 +2745,67 @@ void tree::validate() const {
 
     checker(this).run();
 
+    if (m_filter) {
+        m_filter->validate();
+        if (filtered() && !empty() && !m_filter->initialized())
+            PREQUEL_ERROR("Non-empty tree does not have a filter.");
+        if (!filtered() && m_filter->initialized())
+            PREQUEL_ERROR("Tree has a filter although filtering is disabled.");
+    }
+
 #undef PREQUEL_ERROR
 }
 
 void tree::free_leaf(block_index leaf) {
     PREQUEL_ASSERT(leaf_nodes() > 0, "Invalid state");
+    restructured();
     get_allocator().free(leaf, 1);
     set_leaf_nodes(leaf_nodes() - 1);
 }
 
 void tree::free_internal(block_index internal) {
     PREQUEL_ASSERT(internal_nodes() > 0, "Invalid state");
+    restructured();
     get_allocator().free(internal, 1);
     set_internal_nodes(internal_nodes() - 1);
 }
 
 leaf_node tree::create_leaf() {
-    auto index = get_allocator().allocate(1);
-    set_leaf_nodes(leaf_nodes() + 1);
-
+    auto index = allocate_leaf();
     auto block = get_engine().overwrite_zero(index);
-    auto node = leaf_node(std::move(block), value_size(), m_leaf_capacity);
+    auto node = leaf_node(std::move(block), value_size(), m_leaf_capacity, linked_leaves(),
+                          leaf_prefix_compression());
     node.init();
     return node;
 }
 
+block_index tree::allocate_leaf() {
+    restructured();
+    auto index = get_allocator().allocate(1);
+    set_leaf_nodes(leaf_nodes() + 1);
+    return index;
+}
+
 internal_node tree::create_internal() {
+    restructured();
     auto index = get_allocator().allocate(1);
     set_internal_nodes(internal_nodes() + 1);
 
     auto block = get_engine().overwrite_zero(index);
-    auto node = internal_node(std::move(block), key_size(), m_internal_max_children);
+    auto node = internal_node(std::move(block), key_size(), m_internal_max_children,
+                              prefix_compression(), counted());
     node.init();
     return node;
 }
 
 leaf_node tree::as_leaf(block_handle handle) const {
-    return leaf_node(std::move(handle), value_size(), m_leaf_capacity);
+    return leaf_node(std::move(handle), value_size(), m_leaf_capacity, linked_leaves(),
+                     leaf_prefix_compression());
 }
 
 internal_node tree::as_internal(block_handle handle) const {
-    return internal_node(std::move(handle), key_size(), m_internal_max_children);
+    return internal_node(std::move(handle), key_size(), m_internal_max_children,
+                         prefix_compression(), counted());
 }
 
 leaf_node tree::read_leaf(block_index index) const {
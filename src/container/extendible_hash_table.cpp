@@ -0,0 +1,706 @@
+#include <prequel/container/extendible_hash_table.hpp>
+
+#include <prequel/exception.hpp>
+#include <prequel/formatting.hpp>
+#include <prequel/handle.hpp>
+#include <prequel/math.hpp>
+
+#include <fmt/ostream.h>
+
+#include <array>
+
+namespace prequel {
+
+namespace detail {
+
+namespace {
+
+static constexpr u32 max_key_size = 256;
+
+using key_buffer = std::array<byte, max_key_size>;
+
+// The directory has at most 2^max_global_depth entries. Reaching this limit
+// requires many values whose hashes share their lowest bits.
+static constexpr u32 max_global_depth = 40;
+
+// Buckets are merged with their sibling if their combined size is at most
+// this fraction of a bucket's capacity.
+static constexpr double merge_fill_factor = 0.5;
+
+// Returns a mask for the lowest `bits` bits of a hash.
+u64 low_bits(u32 bits) {
+    PREQUEL_ASSERT(bits < 64, "Too many bits.");
+    return (u64(1) << bits) - 1;
+}
+
+// Finalizer of MurmurHash3. Spreads the entropy of the input over all bits,
+// so that weak hash functions (e.g. FNV-1a for small integers) can be used as well.
+u64 mix(u64 h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * A bucket stores up to `capacity` values together with their hashes.
+ * Values are not ordered: new values are appended and removed values are replaced
+ * by the last value of the bucket.
+ *
+ * Layout: header | hashes[capacity] | values[capacity].
+ *
+ * All hashes in a bucket with local depth `d` have the same lowest `d` bits.
+ */
+class bucket_block {
+private:
+    struct header {
+        // Number of hash bits shared by all values in this bucket.
+        u32 depth = 0;
+
+        // Number of values in this bucket.
+        u32 size = 0;
+
+        static constexpr auto get_binary_format() {
+            return binary_format(&header::depth, &header::size);
+        }
+    };
+
+public:
+    bucket_block() = default;
+
+    bucket_block(block_handle handle, u32 value_size, u32 capacity)
+        : m_handle(std::move(handle), 0)
+        , m_value_size(value_size)
+        , m_capacity(capacity) {
+        PREQUEL_ASSERT(capacity > 0, "Invalid capacity.");
+        PREQUEL_ASSERT(value_size > 0, "Invalid value size.");
+        PREQUEL_ASSERT(offset_of_value(capacity) <= m_handle.block().block_size(),
+                       "Capacity is too large.");
+    }
+
+    void init(u32 depth) const {
+        header h;
+        h.depth = depth;
+        m_handle.set(h);
+    }
+
+    u32 capacity() const { return m_capacity; }
+
+    block_index index() const { return m_handle.block().index(); }
+    bool valid() const { return index().valid(); }
+    explicit operator bool() const { return valid(); }
+
+    bool full() const { return get_size() == capacity(); }
+    bool empty() const { return get_size() == 0; }
+
+    u32 get_depth() const { return m_handle.get<&header::depth>(); }
+    void set_depth(u32 depth) const { m_handle.set<&header::depth>(depth); }
+
+    u32 get_size() const { return m_handle.get<&header::size>(); }
+    void set_size(u32 size) const { m_handle.set<&header::size>(size); }
+
+    u64 get_hash(u32 index) const {
+        PREQUEL_ASSERT(index < get_size(), "Index out of bounds.");
+        return deserialize<u64>(m_handle.block().data() + offset_of_hash(index));
+    }
+
+    const byte* get_value(u32 index) const {
+        PREQUEL_ASSERT(index < get_size(), "Index out of bounds.");
+        return m_handle.block().data() + offset_of_value(index);
+    }
+
+    void set_value(u32 index, const byte* value) const {
+        PREQUEL_ASSERT(index < get_size(), "Index out of bounds.");
+        std::memmove(m_handle.block().writable_data() + offset_of_value(index), value,
+                     m_value_size);
+    }
+
+    void append(const byte* value, u64 hash) const {
+        PREQUEL_ASSERT(!full(), "Bucket is full.");
+
+        const u32 size = get_size();
+        byte* data = m_handle.block().writable_data();
+        serialize(hash, data + offset_of_hash(size));
+        std::memmove(data + offset_of_value(size), value, m_value_size);
+        set_size(size + 1);
+    }
+
+    // Replaces the value at the given index with the last value.
+    void remove(u32 index) const {
+        PREQUEL_ASSERT(index < get_size(), "Index out of bounds.");
+
+        const u32 last = get_size() - 1;
+        if (index != last) {
+            byte* data = m_handle.block().writable_data();
+            std::memmove(data + offset_of_hash(index), data + offset_of_hash(last),
+                         serialized_size<u64>());
+            std::memmove(data + offset_of_value(index), data + offset_of_value(last),
+                         m_value_size);
+        }
+        set_size(last);
+    }
+
+public:
+    static u32 compute_capacity(u32 block_size, u32 value_size) {
+        const u32 header_size = serialized_size<header>();
+        if (block_size <= header_size)
+            return 0;
+        return (block_size - header_size) / (value_size + serialized_size<u64>());
+    }
+
+private:
+    u32 offset_of_hash(u32 index) const {
+        return serialized_size<header>() + serialized_size<u64>() * index;
+    }
+
+    u32 offset_of_value(u32 index) const {
+        return serialized_size<header>() + serialized_size<u64>() * m_capacity
+               + m_value_size * index;
+    }
+
+private:
+    handle<header> m_handle;
+    u32 m_value_size = 0;
+    u32 m_capacity = 0;
+};
+
+} // namespace
+
+class raw_extendible_hash_table_impl : public uses_allocator {
+public:
+    using anchor = raw_extendible_hash_table_anchor;
+
+    static constexpr u32 npos = u32(-1);
+
+public:
+    raw_extendible_hash_table_impl(anchor_handle<anchor> _anchor,
+                                   const raw_extendible_hash_table_options& _opts,
+                                   allocator& _alloc);
+
+public:
+    u32 value_size() const { return m_options.value_size; }
+    u32 key_size() const { return m_options.key_size; }
+    u32 bucket_capacity() const { return m_bucket_capacity; }
+
+    u64 size() const { return m_anchor.get<&anchor::size>(); }
+    bool empty() const { return size() == 0; }
+    u64 buckets() const { return m_anchor.get<&anchor::buckets>(); }
+    u32 global_depth() const { return m_anchor.get<&anchor::global_depth>(); }
+    u64 directory_size() const { return m_directory.size(); }
+
+    double fill_factor() const {
+        return buckets() == 0 ? 0 : double(size()) / double(buckets() * bucket_capacity());
+    }
+
+    u64 byte_size() const {
+        return m_directory.byte_size() + buckets() * get_engine().block_size();
+    }
+
+    double overhead() const {
+        return empty() ? 1.0 : double(byte_size()) / double(size() * value_size());
+    }
+
+    bool find(const byte* key, byte* value) const;
+    bool insert(const byte* value, bool overwrite);
+    bool erase(const byte* key);
+
+    void iterate(iteration_control (*iter_func)(const byte* value, void* user_data),
+                 void* user_data) const;
+
+    void clear();
+    void dump(std::ostream& os) const;
+    void validate() const;
+
+private:
+    // Returns the directory index for the given hash.
+    u64 directory_index(u64 hash) const { return hash & low_bits(global_depth()); }
+
+    // Returns the index of the value with the given key and hash, or npos.
+    u32 find_in_bucket(const bucket_block& bucket, const byte* key, u64 hash) const;
+
+    // Splits the bucket referenced by the directory entry `index`.
+    // Doubles the directory if the bucket is only referenced by a single entry.
+    void split(u64 index, const bucket_block& bucket);
+
+    // Merges the bucket referenced by the directory entry `index` with its sibling
+    // (repeatedly) while both are sparse enough.
+    void merge(u64 index, bucket_block bucket);
+
+    // Points all directory entries that share the lowest `depth` bits with `index` to `block`.
+    void set_entries(u64 index, u32 depth, block_index block);
+
+    bucket_block read_bucket(block_index index) const;
+    bucket_block create_bucket(u32 depth);
+    void free_bucket(block_index index);
+
+    u64 key_hash(const byte* key) const {
+        return mix(m_options.key_hash(key, m_options.user_data));
+    }
+
+    bool key_equal(const byte* lhs, const byte* rhs) const {
+        return m_options.key_equal(lhs, rhs, m_options.user_data);
+    }
+
+    void derive_key(const byte* value, byte* key) const {
+        m_options.derive_key(value, key, m_options.user_data);
+    }
+
+    void set_size(u64 size) { m_anchor.set<&anchor::size>(size); }
+    void set_buckets(u64 buckets) { m_anchor.set<&anchor::buckets>(buckets); }
+    void set_global_depth(u32 depth) {
+        m_anchor.set<&anchor::global_depth>(static_cast<u8>(depth));
+    }
+
+private:
+    anchor_handle<anchor> m_anchor;
+    raw_extendible_hash_table_options m_options;
+    array<block_index> m_directory;
+    u32 m_bucket_capacity = 0;
+};
+
+raw_extendible_hash_table_impl::raw_extendible_hash_table_impl(
+    anchor_handle<anchor> _anchor, const raw_extendible_hash_table_options& _opts,
+    allocator& _alloc)
+    : uses_allocator(_alloc)
+    , m_anchor(std::move(_anchor))
+    , m_options(_opts)
+    , m_directory(m_anchor.member<&anchor::directory>(), _alloc) {
+    if (m_options.value_size == 0)
+        PREQUEL_THROW(bad_argument("Zero value size."));
+    if (m_options.key_size == 0)
+        PREQUEL_THROW(bad_argument("Zero key size."));
+    if (m_options.key_size > max_key_size)
+        PREQUEL_THROW(
+            bad_argument(fmt::format("Key sizes larger than {} are not supported.", max_key_size)));
+    if (!m_options.derive_key)
+        PREQUEL_THROW(bad_argument("No derive_key function provided."));
+    if (!m_options.key_hash)
+        PREQUEL_THROW(bad_argument("No key_hash function provided."));
+    if (!m_options.key_equal)
+        PREQUEL_THROW(bad_argument("No key_equal function provided."));
+
+    m_bucket_capacity =
+        bucket_block::compute_capacity(get_engine().block_size(), m_options.value_size);
+    if (m_bucket_capacity == 0) {
+        PREQUEL_THROW(bad_argument(
+            fmt::format("Block size {} is too small (cannot fit a single value into a bucket)",
+                        get_engine().block_size())));
+    }
+}
+
+bool raw_extendible_hash_table_impl::find(const byte* key, byte* value) const {
+    if (m_directory.empty())
+        return false;
+
+    const u64 hash = key_hash(key);
+    bucket_block bucket = read_bucket(m_directory.get(directory_index(hash)));
+    const u32 index = find_in_bucket(bucket, key, hash);
+    if (index == npos)
+        return false;
+
+    if (value)
+        std::memcpy(value, bucket.get_value(index), value_size());
+    return true;
+}
+
+bool raw_extendible_hash_table_impl::insert(const byte* value, bool overwrite) {
+    key_buffer key;
+    derive_key(value, key.data());
+    const u64 hash = key_hash(key.data());
+
+    if (m_directory.empty()) {
+        bucket_block bucket = create_bucket(0);
+        m_directory.push_back(bucket.index());
+        set_global_depth(0);
+    }
+
+    u64 index = directory_index(hash);
+    bucket_block bucket = read_bucket(m_directory.get(index));
+    const u32 existing = find_in_bucket(bucket, key.data(), hash);
+    if (existing != npos) {
+        if (overwrite)
+            bucket.set_value(existing, value);
+        return false;
+    }
+
+    while (bucket.full()) {
+        // Splitting cannot separate values with identical hashes.
+        bool separable = false;
+        for (u32 i = 0, n = bucket.get_size(); i < n; ++i) {
+            if (bucket.get_hash(i) != hash) {
+                separable = true;
+                break;
+            }
+        }
+        if (!separable)
+            PREQUEL_THROW(bad_operation("Too many values with the same hash."));
+
+        split(index, bucket);
+        index = directory_index(hash);
+        bucket = read_bucket(m_directory.get(index));
+    }
+
+    bucket.append(value, hash);
+    set_size(size() + 1);
+    return true;
+}
+
+bool raw_extendible_hash_table_impl::erase(const byte* key) {
+    if (m_directory.empty())
+        return false;
+
+    const u64 hash = key_hash(key);
+    const u64 index = directory_index(hash);
+    bucket_block bucket = read_bucket(m_directory.get(index));
+    const u32 pos = find_in_bucket(bucket, key, hash);
+    if (pos == npos)
+        return false;
+
+    bucket.remove(pos);
+    set_size(size() - 1);
+    merge(index, std::move(bucket));
+    return true;
+}
+
+void raw_extendible_hash_table_impl::iterate(
+    iteration_control (*iter_func)(const byte* value, void* user_data), void* user_data) const {
+    if (!iter_func)
+        PREQUEL_THROW(bad_argument("Invalid iteration function."));
+
+    // Every bucket is visited through its lowest directory entry.
+    const u64 entries = m_directory.size();
+    for (u64 i = 0; i < entries; ++i) {
+        bucket_block bucket = read_bucket(m_directory.get(i));
+        if (i > low_bits(bucket.get_depth()))
+            continue;
+
+        for (u32 j = 0, n = bucket.get_size(); j < n; ++j) {
+            if (iter_func(bucket.get_value(j), user_data) == iteration_control::stop)
+                return;
+        }
+    }
+}
+
+void raw_extendible_hash_table_impl::clear() {
+    // Backwards, so that buckets are freed after all of their other entries have been visited.
+    for (u64 i = m_directory.size(); i-- > 0;) {
+        const block_index block = m_directory.get(i);
+        const u32 depth = read_bucket(block).get_depth();
+        if (i <= low_bits(depth))
+            free_bucket(block);
+    }
+    PREQUEL_ASSERT(buckets() == 0, "Must have freed all buckets.");
+
+    m_directory.reset();
+    set_size(0);
+    set_global_depth(0);
+}
+
+void raw_extendible_hash_table_impl::dump(std::ostream& os) const {
+    fmt::print(os,
+               "Raw extendible hash table:\n"
+               "  Value size:      {}\n"
+               "  Key size:        {}\n"
+               "  Block size:      {}\n"
+               "  Bucket capacity: {}\n"
+               "  Size:            {}\n"
+               "  Buckets:         {}\n"
+               "  Global depth:    {}\n"
+               "  Fill factor:     {}\n",
+               value_size(), key_size(), get_engine().block_size(), bucket_capacity(), size(),
+               buckets(), global_depth(), fill_factor());
+
+    const u64 entries = m_directory.size();
+    for (u64 i = 0; i < entries; ++i) {
+        bucket_block bucket = read_bucket(m_directory.get(i));
+        if (i > low_bits(bucket.get_depth())) {
+            fmt::print(os, "\n  Entry {}: @{}\n", i, bucket.index());
+            continue;
+        }
+
+        fmt::print(os,
+                   "\n"
+                   "  Entry {}: Bucket @{}:\n"
+                   "    Depth: {}\n"
+                   "    Size: {}\n",
+                   i, bucket.index(), bucket.get_depth(), bucket.get_size());
+        for (u32 j = 0, n = bucket.get_size(); j < n; ++j) {
+            fmt::print(os, "    {:>4}: {} (Hash: {})\n", j,
+                       format_hex(bucket.get_value(j), value_size()), bucket.get_hash(j));
+        }
+    }
+}
+
+void raw_extendible_hash_table_impl::validate() const {
+#define PREQUEL_ERROR(...) PREQUEL_THROW(corruption_error(fmt::format("validate: " __VA_ARGS__)));
+
+    const u64 entries = m_directory.size();
+    if (entries == 0) {
+        if (size() != 0 || buckets() != 0 || global_depth() != 0)
+            PREQUEL_ERROR("Table without a directory must be empty.");
+        return;
+    }
+
+    if (global_depth() > max_global_depth)
+        PREQUEL_ERROR("Global depth is too large.");
+    if (entries != u64(1) << global_depth())
+        PREQUEL_ERROR("Directory size does not match the global depth.");
+
+    u64 seen_values = 0;
+    u64 seen_buckets = 0;
+    key_buffer key;
+    for (u64 i = 0; i < entries; ++i) {
+        const block_index block = m_directory.get(i);
+        bucket_block bucket = read_bucket(block);
+
+        const u32 depth = bucket.get_depth();
+        if (depth > global_depth())
+            PREQUEL_ERROR("Local depth is larger than the global depth.");
+
+        const u64 mask = low_bits(depth);
+        if (i > mask) {
+            if (m_directory.get(i & mask) != block)
+                PREQUEL_ERROR("Directory entries of a bucket are inconsistent.");
+            continue;
+        }
+
+        const u32 values = bucket.get_size();
+        if (values > bucket_capacity())
+            PREQUEL_ERROR("Bucket size is larger than its capacity.");
+        for (u32 j = 0; j < values; ++j) {
+            derive_key(bucket.get_value(j), key.data());
+            const u64 hash = key_hash(key.data());
+            if (bucket.get_hash(j) != hash)
+                PREQUEL_ERROR("Stored hash does not match the value's hash.");
+            if ((hash & mask) != i)
+                PREQUEL_ERROR("Value is in the wrong bucket.");
+        }
+
+        seen_values += values;
+        seen_buckets += 1;
+    }
+
+    if (seen_values != size())
+        PREQUEL_ERROR("Inconsistent value count.");
+    if (seen_buckets != buckets())
+        PREQUEL_ERROR("Inconsistent bucket count.");
+
+#undef PREQUEL_ERROR
+}
+
+u32 raw_extendible_hash_table_impl::find_in_bucket(const bucket_block& bucket, const byte* key,
+                                                   u64 hash) const {
+    key_buffer bucket_key;
+    for (u32 i = 0, n = bucket.get_size(); i < n; ++i) {
+        if (bucket.get_hash(i) != hash)
+            continue;
+
+        derive_key(bucket.get_value(i), bucket_key.data());
+        if (key_equal(key, bucket_key.data()))
+            return i;
+    }
+    return npos;
+}
+
+void raw_extendible_hash_table_impl::split(u64 index, const bucket_block& bucket) {
+    const u32 depth = bucket.get_depth();
+    if (depth == global_depth()) {
+        if (depth == max_global_depth)
+            PREQUEL_THROW(bad_operation("The directory has reached its maximum size."));
+
+        // Double the directory, the upper half is a copy of the lower half.
+        const u64 entries = m_directory.size();
+        m_directory.reserve(entries * 2);
+        for (u64 i = 0; i < entries; ++i)
+            m_directory.push_back(m_directory.get(i));
+        set_global_depth(depth + 1);
+    }
+
+    // Values with bit `depth` set move into the new bucket.
+    bucket_block sibling = create_bucket(depth + 1);
+    bucket.set_depth(depth + 1);
+    for (u32 i = 0; i < bucket.get_size();) {
+        const u64 hash = bucket.get_hash(i);
+        if (hash & (u64(1) << depth)) {
+            sibling.append(bucket.get_value(i), hash);
+            bucket.remove(i);
+        } else {
+            ++i;
+        }
+    }
+
+    set_entries((index & low_bits(depth)) | (u64(1) << depth), depth + 1, sibling.index());
+}
+
+void raw_extendible_hash_table_impl::merge(u64 index, bucket_block bucket) {
+    const u32 max_size = static_cast<u32>(bucket_capacity() * merge_fill_factor);
+
+    while (u32 depth = bucket.get_depth()) {
+        const u64 bit = u64(1) << (depth - 1);
+        bucket_block sibling = read_bucket(m_directory.get(index ^ bit));
+        if (sibling.get_depth() != depth || bucket.get_size() + sibling.get_size() > max_size)
+            return;
+
+        // The bucket without bit `depth - 1` survives.
+        if (index & bit) {
+            std::swap(bucket, sibling);
+            index ^= bit;
+        }
+        for (u32 i = 0, n = sibling.get_size(); i < n; ++i)
+            bucket.append(sibling.get_value(i), sibling.get_hash(i));
+        bucket.set_depth(depth - 1);
+
+        const block_index freed = sibling.index();
+        sibling = bucket_block();
+        set_entries(index | bit, depth, bucket.index());
+        free_bucket(freed);
+
+        index &= low_bits(depth - 1);
+    }
+}
+
+void raw_extendible_hash_table_impl::set_entries(u64 index, u32 depth, block_index block) {
+    const u64 entries = m_directory.size();
+    const u64 step = u64(1) << depth;
+    for (u64 i = index & low_bits(depth); i < entries; i += step)
+        m_directory.set(i, block);
+}
+
+bucket_block raw_extendible_hash_table_impl::read_bucket(block_index index) const {
+    PREQUEL_ASSERT(index, "Invalid bucket index.");
+    return bucket_block(get_engine().read(index), value_size(), bucket_capacity());
+}
+
+bucket_block raw_extendible_hash_table_impl::create_bucket(u32 depth) {
+    block_index index = get_allocator().allocate(1);
+    bucket_block bucket(get_engine().overwrite_zero(index), value_size(), bucket_capacity());
+    bucket.init(depth);
+    set_buckets(buckets() + 1);
+    return bucket;
+}
+
+void raw_extendible_hash_table_impl::free_bucket(block_index index) {
+    get_allocator().free(index, 1);
+    set_buckets(buckets() - 1);
+}
+
+} // namespace detail
+
+raw_extendible_hash_table::raw_extendible_hash_table(
+    anchor_handle<anchor> anc, const raw_extendible_hash_table_options& options, allocator& alloc)
+    : m_impl(std::make_unique<detail::raw_extendible_hash_table_impl>(std::move(anc), options,
+                                                                      alloc)) {}
+
+raw_extendible_hash_table::~raw_extendible_hash_table() {}
+
+raw_extendible_hash_table::raw_extendible_hash_table(raw_extendible_hash_table&& other) noexcept
+    : m_impl(std::move(other.m_impl)) {}
+
+raw_extendible_hash_table& raw_extendible_hash_table::
+operator=(raw_extendible_hash_table&& other) noexcept {
+    if (this != &other) {
+        m_impl = std::move(other.m_impl);
+    }
+    return *this;
+}
+
+engine& raw_extendible_hash_table::get_engine() const {
+    return impl().get_engine();
+}
+allocator& raw_extendible_hash_table::get_allocator() const {
+    return impl().get_allocator();
+}
+
+u32 raw_extendible_hash_table::value_size() const {
+    return impl().value_size();
+}
+u32 raw_extendible_hash_table::key_size() const {
+    return impl().key_size();
+}
+u32 raw_extendible_hash_table::bucket_capacity() const {
+    return impl().bucket_capacity();
+}
+bool raw_extendible_hash_table::empty() const {
+    return impl().empty();
+}
+u64 raw_extendible_hash_table::size() const {
+    return impl().size();
+}
+u64 raw_extendible_hash_table::buckets() const {
+    return impl().buckets();
+}
+u32 raw_extendible_hash_table::global_depth() const {
+    return impl().global_depth();
+}
+u64 raw_extendible_hash_table::directory_size() const {
+    return impl().directory_size();
+}
+double raw_extendible_hash_table::fill_factor() const {
+    return impl().fill_factor();
+}
+u64 raw_extendible_hash_table::byte_size() const {
+    return impl().byte_size();
+}
+double raw_extendible_hash_table::overhead() const {
+    return impl().overhead();
+}
+
+bool raw_extendible_hash_table::contains(const byte* key) const {
+    if (!key)
+        PREQUEL_THROW(bad_argument("Key is null."));
+    return impl().find(key, nullptr);
+}
+
+bool raw_extendible_hash_table::find(const byte* key, byte* value) const {
+    if (!key)
+        PREQUEL_THROW(bad_argument("Key is null."));
+    if (!value)
+        PREQUEL_THROW(bad_argument("Value is null."));
+    return impl().find(key, value);
+}
+
+bool raw_extendible_hash_table::insert(const byte* value) {
+    if (!value)
+        PREQUEL_THROW(bad_argument("Value is null."));
+    return impl().insert(value, false);
+}
+
+bool raw_extendible_hash_table::insert_or_update(const byte* value) {
+    if (!value)
+        PREQUEL_THROW(bad_argument("Value is null."));
+    return impl().insert(value, true);
+}
+
+bool raw_extendible_hash_table::erase(const byte* key) {
+    if (!key)
+        PREQUEL_THROW(bad_argument("Key is null."));
+    return impl().erase(key);
+}
+
+void raw_extendible_hash_table::iterate(
+    iteration_control (*iter_func)(const byte* value, void* user_data), void* user_data) const {
+    impl().iterate(iter_func, user_data);
+}
+
+void raw_extendible_hash_table::reset() {
+    impl().clear();
+}
+void raw_extendible_hash_table::clear() {
+    impl().clear();
+}
+
+void raw_extendible_hash_table::dump(std::ostream& os) const {
+    impl().dump(os);
+}
+void raw_extendible_hash_table::validate() const {
+    impl().validate();
+}
+
+detail::raw_extendible_hash_table_impl& raw_extendible_hash_table::impl() const {
+    PREQUEL_ASSERT(m_impl, "Invalid extendible hash table instance.");
+    return *m_impl;
+}
+
+} // namespace prequel
@@ -7,7 +7,12 @@
 
 #include <fmt/ostream.h>
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <deque>
+#include <optional>
+#include <tuple>
 #include <vector>
 
 namespace prequel {
@@ -20,12 +25,6 @@ static constexpr u32 max_key_size = 256;
 
 using key_buffer = std::array<byte, max_key_size>;
 
-// Hash tables with a larger load will grow.
-static constexpr double max_fill_factor = 0.8;
-
-// Hash tables with a lower load will shrink.
-static constexpr double min_fill_factor = 0.5;
-
 // Max power of two used as a bucket range size.
 static constexpr u32 bucket_range_max_power = 20;
 
@@ -81,6 +80,10 @@ static constexpr std::array<u64, precomputed_bucket_ranges> bucket_range_size_su
  *
  * Important: Entries within a single bucket node are ordered by their hash value.
  *
+ * If the table stores hashes, the hash of every value is stored in an array between
+ * the header and the values (at the same index), which makes it possible to search
+ * a node without deriving keys from its values.
+ *
  * TODO: Overflow nodes should collapse in order to reclaim space.
  * (Note that space will already eventually be reclaimed by split or shrink operations).
  */
@@ -101,14 +104,14 @@ private:
 public:
     bucket_node() = default;
 
-    bucket_node(block_handle handle, u32 value_size, u32 capacity)
+    bucket_node(block_handle handle, u32 value_size, u32 capacity, bool stores_hashes)
         : m_handle(std::move(handle), 0)
         , m_value_size(value_size)
-        , m_capacity(capacity) {
+        , m_capacity(capacity)
+        , m_stores_hashes(stores_hashes) {
         PREQUEL_ASSERT(capacity > 0, "Invalid capacity.");
         PREQUEL_ASSERT(value_size > 0, "Invalid value size.");
-        PREQUEL_ASSERT(serialized_size<header>() + capacity * value_size
-                           <= m_handle.block().block_size(),
+        PREQUEL_ASSERT(offset_of_value(capacity) <= m_handle.block().block_size(),
                        "Capacity is too large.");
     }
 
@@ -132,6 +135,15 @@ public:
 
     void set_size(u32 new_size) const { m_handle.set<&header::size>(new_size); }
 
+    // True if the hashes of the values are stored in this node.
+    bool stores_hashes() const { return m_stores_hashes; }
+
+    u64 get_hash(u32 index) const {
+        PREQUEL_ASSERT(m_stores_hashes, "Hashes are not stored.");
+        PREQUEL_ASSERT(index < m_capacity, "Index out of bounds.");
+        return deserialize<u64>(m_handle.block().data() + offset_of_hash(index));
+    }
+
     const byte* get_value(u32 index) const {
         PREQUEL_ASSERT(index < m_capacity, "Index out of bounds.");
 
@@ -148,13 +160,19 @@ public:
         std::memmove(data, value, m_value_size);
     }
 
-    u32 insert(u32 index, const byte* value) const {
+    // The hash is only used if the node stores hashes.
+    u32 insert(u32 index, const byte* value, u64 hash) const {
         PREQUEL_ASSERT(!full(), "Node is full.");
         PREQUEL_ASSERT(index < m_capacity, "Index is over capacity.");
         PREQUEL_ASSERT(index <= get_size(), "Index is out of bounds.");
 
         const u32 size = get_size();
         byte* data = m_handle.block().writable_data();
+        if (m_stores_hashes) {
+            std::memmove(data + offset_of_hash(index + 1), data + offset_of_hash(index),
+                         (size - index) * serialized_size<u64>());
+            serialize(hash, data + offset_of_hash(index));
+        }
         std::memmove(data + offset_of_value(index + 1), data + offset_of_value(index),
                      (size - index) * m_value_size);
         std::memmove(data + offset_of_value(index), value, m_value_size);
@@ -169,32 +187,54 @@ public:
         const u32 size = get_size();
 
         byte* data = m_handle.block().writable_data();
+        if (m_stores_hashes) {
+            std::memmove(data + offset_of_hash(index), data + offset_of_hash(index + 1),
+                         (size - index - 1) * serialized_size<u64>());
+        }
         std::memmove(data + offset_of_value(index), data + offset_of_value(index + 1),
                      (size - index - 1) * m_value_size);
         set_size(size - 1);
     }
 
 public:
-    static u32 compute_capacity(u32 block_size, u32 value_size) {
+    static u32 compute_capacity(u32 block_size, u32 value_size, bool stores_hashes) {
         u32 header_size = serialized_size<header>();
         if (block_size <= header_size)
             return 0;
 
-        return (block_size - header_size) / value_size;
+        const u32 entry_size = value_size + (stores_hashes ? serialized_size<u64>() : 0);
+        return (block_size - header_size) / entry_size;
     }
 
 private:
+    u32 offset_of_hash(u32 hash_index) const {
+        PREQUEL_ASSERT(hash_index <= m_capacity, "Hash index out of bounds.");
+        return serialized_size<header>() + serialized_size<u64>() * hash_index;
+    }
+
     u32 offset_of_value(u32 value_index) const {
         PREQUEL_ASSERT(value_index <= m_capacity, "Value index out of bounds.");
-        return serialized_size<header>() + m_value_size * value_index;
+        const u32 hashes_size = m_stores_hashes ? serialized_size<u64>() * m_capacity : 0;
+        return serialized_size<header>() + hashes_size + m_value_size * value_index;
     }
 
 private:
     handle<header> m_handle;
     u32 m_value_size = 0;
     u32 m_capacity = 0;
+    bool m_stores_hashes = false;
 };
 
+// Reverses the order of the bits in v.
+u64 reverse_bits(u64 v) {
+    v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+    v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    v = ((v >> 8) & 0x00FF00FF00FF00FFULL) | ((v & 0x00FF00FF00FF00FFULL) << 8);
+    v = ((v >> 16) & 0x0000FFFF0000FFFFULL) | ((v & 0x0000FFFF0000FFFFULL) << 16);
+    return (v >> 32) | (v << 32);
+}
+
 // Unique type to make byte array / void pointer mistakes impossible.
 struct compatible_key_t {
     const void* data = nullptr;
@@ -284,8 +324,9 @@ public:
     using anchor = raw_hash_table_anchor;
 
 public:
-    raw_hash_table_impl(anchor_handle<anchor> _anchor, const raw_hash_table_options& _opts,
-                        allocator& _alloc);
+    raw_hash_table_impl(anchor_handle<anchor> _anchor,
+                        anchor_handle<bloom_filter_anchor> _filter_anchor,
+                        const raw_hash_table_options& _opts, allocator& _alloc);
 
 public:
     u32 value_size() const { return m_options.value_size; }
@@ -301,9 +342,13 @@ public:
     u64 allocated_buckets() const { return allocated_primary_buckets() + overflow_buckets(); }
 
     u64 byte_size() const {
-        return m_bucket_ranges.byte_size() + allocated_buckets() * get_engine().block_size();
+        return m_bucket_ranges.byte_size() + allocated_buckets() * get_engine().block_size()
+               + (m_filter ? m_filter->byte_size() : 0);
     }
 
+    bool filtered() const { return m_options.filter_bits_per_key > 0; }
+    bool stores_hashes() const { return m_options.store_hashes; }
+
     // Returns the average fill factor of the table's primary buckets.
     double load() const;
 
@@ -312,7 +357,23 @@ public:
     bool insert(const byte* value, bool overwrite);
     bool contains(const byte* key) const;
 
+    // Allocates the primary buckets for `expected` values at once, so that
+    // they can be inserted without growing the table. The table must be empty.
+    void presize(u64 expected);
+
+    // Grows the table until it has enough primary buckets for `expected` values.
+    void reserve(u64 expected);
+
+    // Returns the number of primary buckets required for `expected` values.
+    u64 required_buckets(u64 expected) const;
+
+    // Inserts the values (like insert() without overwrite). The values are sorted
+    // by their bucket first, so the buckets are visited in order.
+    // Returns the number of inserted values.
+    u64 insert_batch(const byte* values, size_t count);
+
     bool find(const byte* key, byte* value) const;
+    u64 find_many(const byte* keys, size_t count, byte* values, bool* found) const;
     bool find_compatible(const void* compatible_key,
                          const std::function<u64(const void*)>& compatible_hash,
                          const std::function<bool(const void*, const byte*)>& compatible_equals,
@@ -326,6 +387,10 @@ public:
     void iterate(iteration_control (*iter_func)(const byte* value, void* user_data),
                  void* user_data) const;
 
+    u64 scan(u64 cursor, u64 count,
+             iteration_control (*iter_func)(const byte* value, void* user_data),
+             void* user_data) const;
+
     void
     visit(const std::function<iteration_control(const raw_hash_table::node_view&)>& visit_func) const;
 
@@ -335,6 +400,10 @@ public:
     void clear();
 
 private:
+    // Inserts the value with the given key and hash.
+    // The key must have been derived from the value.
+    bool insert_hashed(const byte* value, const byte* key, u64 hash, bool overwrite);
+
     // Find the given key using the provided hash and equality functions.
     // TODO: Generalize other operations too?
     template<typename KeyType, typename KeyHasher, typename KeyEquals>
@@ -350,8 +419,11 @@ private:
     bool insert_into_bucket(const bucket_node& primary_bucket, const byte* value, const byte* key,
                             u64 hash, bucket_node& found_node, u32& found_index);
 
-    // Helper function for grow + split, should eventually be replaced.
-    void insert_into_bucket(const bucket_node& primary_bucket, const byte* value);
+    // Inserts a value that is known to be unique into the bucket (used by shrink).
+    void insert_unique(const bucket_node& primary_bucket, const byte* value, u64 hash);
+
+    // Inserts the value into the (non-full) node, at the position determined by its hash.
+    void insert_sorted(const bucket_node& node, const byte* value, u64 hash) const;
 
     // Iterate through the bucket and try to find the key.
     bool find_in_bucket(const bucket_node& primary_bucket, const byte* key, u64 key_hash,
@@ -368,6 +440,19 @@ private:
     bool grow();
     bool shrink();
 
+    // Splits the bucket into itself and a new primary bucket at `scale + bucket_index`.
+    void split_bucket(u64 bucket_index, u64 scale);
+
+    // Returns false if the filter proves that no key with that hash exists.
+    bool filter_may_contain(u64 hash) const { return !filtered() || m_filter->may_contain(hash); }
+
+    // Adds the hash of a newly inserted key to the filter.
+    // Rebuilds the filter instead if it has reached its capacity.
+    void filter_insert(u64 hash);
+
+    // Reinitializes the filter for twice the current size and inserts all keys.
+    void rebuild_filter();
+
     void free_overflow_chain(block_index overflow_node);
 
 private:
@@ -399,6 +484,9 @@ private:
     u64 bucket_for_key(const byte* key) const;
     u64 bucket_for_hash(u64 hash) const;
 
+    // Returns the number of hash bits that select the given primary bucket.
+    u32 bucket_hash_bits(u64 bucket_index) const;
+
     // Computes the hash of that value by deriving the key first, and then hashing the key.
     u64 value_hash(const byte* value) const;
 
@@ -411,6 +499,9 @@ private:
     // Derive a key from the value, using the user-provided callback function.
     void derive_key(const byte* value, byte* key) const;
 
+    // Returns the hash of the value at that index. Uses the stored hash if possible.
+    u64 entry_hash(const bucket_node& node, u32 index) const;
+
 private:
     // Anchor access
     u64 get_size() const { return m_anchor.get<&anchor::size>(); }
@@ -432,6 +523,7 @@ private:
     anchor_handle<raw_hash_table_anchor> m_anchor;
     raw_hash_table_options m_options;
     array<block_index> m_bucket_ranges;
+    std::optional<bloom_filter> m_filter; // Only if a filter anchor was provided.
 
     u32 m_bucket_capacity = 0;
 };
@@ -475,7 +567,73 @@ private:
     bucket_node m_node;
 };
 
+// Collects values in batches of roughly this size before inserting them.
+static constexpr size_t loader_batch_size = size_t(1) << 23;
+
+class raw_hash_table_loader_impl {
+public:
+    raw_hash_table_loader_impl(raw_hash_table_impl& table, u64 expected)
+        : m_table(&table)
+        , m_batch_values(std::max<size_t>(1, loader_batch_size / table.value_size())) {
+        m_table->presize(expected);
+    }
+
+    raw_hash_table_loader_impl(const raw_hash_table_loader_impl&) = delete;
+    raw_hash_table_loader_impl& operator=(const raw_hash_table_loader_impl&) = delete;
+
+    void insert(const byte* values, size_t count) {
+        if (!values)
+            PREQUEL_THROW(bad_argument("Values are null."));
+        check_active();
+
+        const u32 value_size = m_table->value_size();
+        while (count > 0) {
+            const size_t buffered = m_buffer.size() / value_size;
+            const size_t n = std::min(count, m_batch_values - buffered);
+            m_buffer.insert(m_buffer.end(), values, values + n * value_size);
+            values += n * value_size;
+            count -= n;
+
+            if (buffered + n == m_batch_values)
+                flush();
+        }
+    }
+
+    void finish() {
+        check_active();
+        flush();
+        m_done = true;
+    }
+
+    void discard() {
+        check_active();
+        m_buffer.clear();
+        m_table->clear();
+        m_done = true;
+    }
+
+private:
+    void check_active() const {
+        if (m_done)
+            PREQUEL_THROW(bad_operation("This loader was already finalized."));
+    }
+
+    void flush() {
+        if (m_buffer.empty())
+            return;
+        m_table->insert_batch(m_buffer.data(), m_buffer.size() / m_table->value_size());
+        m_buffer.clear();
+    }
+
+private:
+    raw_hash_table_impl* m_table = nullptr;
+    size_t m_batch_values = 0;
+    std::vector<byte> m_buffer;
+    bool m_done = false;
+};
+
 raw_hash_table_impl::raw_hash_table_impl(anchor_handle<anchor> _anchor,
+                                         anchor_handle<bloom_filter_anchor> _filter_anchor,
                                          const raw_hash_table_options& _opts, allocator& _alloc)
     : uses_allocator(_alloc)
     , m_anchor(std::move(_anchor))
@@ -494,21 +652,49 @@ raw_hash_table_impl::raw_hash_table_impl(anchor_handle<anchor> _anchor,
         PREQUEL_THROW(bad_argument("No key_hash function provided."));
     if (!m_options.key_equal)
         PREQUEL_THROW(bad_argument("No key_equal function provided."));
+    if (m_options.filter_bits_per_key > 64)
+        PREQUEL_THROW(bad_argument("Filters with more than 64 bits per key are not supported."));
+    if (m_options.filter_bits_per_key > 0 && !_filter_anchor)
+        PREQUEL_THROW(bad_argument("Key filters require a filter anchor."));
+    if (!(m_options.max_fill_factor > 0) || !std::isfinite(m_options.max_fill_factor))
+        PREQUEL_THROW(bad_argument("The maximum fill factor must be a positive number."));
+    if (!(m_options.min_fill_factor >= 0)
+        || !(m_options.min_fill_factor < m_options.max_fill_factor))
+        PREQUEL_THROW(bad_argument(
+            "The minimum fill factor must be non-negative and less than the maximum fill factor."));
 
     const u32 block_size = get_engine().block_size();
 
-    m_bucket_capacity = bucket_node::compute_capacity(block_size, m_options.value_size);
+    m_bucket_capacity =
+        bucket_node::compute_capacity(block_size, m_options.value_size, stores_hashes());
     if (m_bucket_capacity == 0) {
         PREQUEL_THROW(bad_argument(
             fmt::format("Block size {} is too small (cannot fit a single value into a bucket)",
                         get_engine().block_size())));
     }
+
+    // The filter setting may have changed since the table was last opened.
+    if (_filter_anchor) {
+        m_filter.emplace(std::move(_filter_anchor), _alloc);
+        if (!filtered()) {
+            m_filter->reset();
+        } else if (!m_filter->initialized() && !empty()) {
+            rebuild_filter();
+        }
+    }
 }
 
 bool raw_hash_table_impl::insert(const byte* value, bool overwrite) {
     if (!value)
         PREQUEL_THROW(bad_argument("Value is null."));
 
+    key_buffer key;
+    derive_key(value, key.data());
+    return insert_hashed(value, key.data(), key_hash(key.data()), overwrite);
+}
+
+bool raw_hash_table_impl::insert_hashed(const byte* value, const byte* key, u64 hash,
+                                        bool overwrite) {
     if (get_primary_buckets() == 0) {
         PREQUEL_ASSERT(get_size() == 0, "Empty hash tables have no elements.");
         PREQUEL_ASSERT(get_level() == 0, "Empty hash tables have 0 level.");
@@ -516,17 +702,13 @@ bool raw_hash_table_impl::insert(const byte* value, bool overwrite) {
         allocate_primary_bucket(0);
     }
 
-    key_buffer key;
-    derive_key(value, key.data());
-
-    const u64 hash = key_hash(key.data());
     const u64 bucket_index = bucket_for_hash(hash);
     const bucket_node bucket = read_primary_bucket(bucket_index);
 
     {
         bucket_node found_node;
         u32 found_index = 0;
-        if (!insert_into_bucket(bucket, value, key.data(), hash, found_node, found_index)) {
+        if (!insert_into_bucket(bucket, value, key, hash, found_node, found_index)) {
             if (overwrite) {
                 found_node.set_value(found_index, value);
                 return true;
@@ -537,14 +719,105 @@ bool raw_hash_table_impl::insert(const byte* value, bool overwrite) {
     }
 
     set_size(get_size() + 1);
+    filter_insert(hash);
 
-    while (load() > max_fill_factor) {
+    while (load() > m_options.max_fill_factor) {
         if (!grow())
             break;
     }
     return true;
 }
 
+void raw_hash_table_impl::presize(u64 expected) {
+    if (get_primary_buckets() != 0 || !empty())
+        PREQUEL_THROW(bad_operation("The table must be empty."));
+
+    const u64 buckets = required_buckets(expected);
+
+    // A table with 2^level + step primary buckets. Buckets below the step
+    // pointer have already been split.
+    const u8 level = static_cast<u8>(log2(buckets));
+    const u64 step = buckets - (u64(1) << level);
+
+    try {
+        for (u64 index = 0; index < buckets; ++index)
+            allocate_primary_bucket(index);
+    } catch (...) {
+        clear();
+        throw;
+    }
+    set_level(level);
+    set_step(step);
+
+    if (filtered()) {
+        const u32 bits_per_key = m_options.filter_bits_per_key;
+        const u64 min_capacity = u64(get_engine().block_size()) * 8 / bits_per_key;
+        m_filter->reset(std::max(expected, min_capacity), bits_per_key);
+    }
+}
+
+void raw_hash_table_impl::reserve(u64 expected) {
+    if (get_primary_buckets() == 0) {
+        if (expected > 0)
+            presize(expected);
+        return;
+    }
+
+    const u64 buckets = required_buckets(expected);
+    while (get_primary_buckets() < buckets) {
+        if (!grow())
+            break;
+    }
+}
+
+u64 raw_hash_table_impl::required_buckets(u64 expected) const {
+    // Enough buckets to stay below the maximum fill factor.
+    const double bucket_values = double(m_bucket_capacity) * m_options.max_fill_factor;
+    const double buckets = std::ceil(double(expected) / bucket_values);
+    if (buckets >= double(u64(1) << 63))
+        PREQUEL_THROW(bad_argument("Expected size is too large."));
+    return std::max<u64>(1, static_cast<u64>(buckets));
+}
+
+u64 raw_hash_table_impl::insert_batch(const byte* values, size_t count) {
+    if (!values)
+        PREQUEL_THROW(bad_argument("Values are null."));
+
+    struct entry {
+        u64 bucket;
+        u64 hash;
+        size_t index;
+    };
+
+    const u32 key_size = this->key_size();
+    const u32 value_size = this->value_size();
+
+    std::vector<byte> keys(count * key_size);
+    std::vector<entry> entries(count);
+    for (size_t i = 0; i < count; ++i) {
+        byte* key = keys.data() + i * key_size;
+        derive_key(values + i * value_size, key);
+
+        entry& e = entries[i];
+        e.hash = key_hash(key);
+        e.bucket = get_primary_buckets() > 0 ? bucket_for_hash(e.hash) : 0;
+        e.index = i;
+    }
+
+    // Equal keys keep their relative order, so the first one is inserted.
+    std::sort(entries.begin(), entries.end(), [](const entry& lhs, const entry& rhs) {
+        return std::tie(lhs.bucket, lhs.hash, lhs.index)
+               < std::tie(rhs.bucket, rhs.hash, rhs.index);
+    });
+
+    u64 inserted = 0;
+    for (const entry& e : entries) {
+        inserted += insert_hashed(values + e.index * value_size, keys.data() + e.index * key_size,
+                                  e.hash, false);
+    }
+    return inserted;
+}
+
 bool raw_hash_table_impl::contains(const byte* key) const {
     if (!key)
         PREQUEL_THROW(bad_argument("Key is null."));
@@ -555,6 +828,9 @@ bool raw_hash_table_impl::contains(const byte* key) const {
     bucket_node found_node;
     u32 found_index;
     const u64 hash = key_hash(key);
+    if (!filter_may_contain(hash))
+        return false;
+
     const bucket_node primary_bucket = read_primary_bucket(bucket_for_hash(hash));
     return find_in_bucket(primary_bucket, key, hash, found_node, found_index);
 }
@@ -570,6 +846,66 @@ bool raw_hash_table_impl::find(const byte* key, byte* value) const {
                      value);
 }
 
+u64 raw_hash_table_impl::find_many(const byte* keys, size_t count, byte* values,
+                                   bool* found) const {
+    const u32 ks = key_size();
+    const u32 vs = value_size();
+    std::fill_n(found, count, false);
+    if (empty())
+        return 0;
+
+    struct lookup {
+        block_index bucket;
+        u64 hash;
+        size_t index;
+    };
+
+    std::vector<lookup> lookups;
+    lookups.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const u64 hash = key_hash(keys + i * ks);
+        if (filter_may_contain(hash))
+            lookups.push_back({bucket_address(bucket_for_hash(hash)), hash, i});
+    }
+
+    // Primary buckets are allocated in large contiguous ranges, so sorting
+    // by address results in (mostly) sequential reads.
+    std::sort(lookups.begin(), lookups.end(), [](const lookup& lhs, const lookup& rhs) {
+        return std::tie(lhs.bucket, lhs.hash) < std::tie(rhs.bucket, rhs.hash);
+    });
+
+    // The buckets of the next few lookups are prefetched, so that their reads can overlap.
+    static constexpr size_t prefetch_distance = 16;
+    size_t prefetched = 0;
+
+    auto key_equals = [&](const byte* lhs, const byte* rhs) { return key_equal(lhs, rhs); };
+
+    u64 result = 0;
+    bucket_node primary_bucket;
+    for (size_t i = 0; i < lookups.size(); ++i) {
+        for (; prefetched < lookups.size() && prefetched <= i + prefetch_distance; ++prefetched) {
+            if (prefetched == 0 || lookups[prefetched].bucket != lookups[prefetched - 1].bucket)
+                get_engine().prefetch(lookups[prefetched].bucket);
+        }
+
+        const lookup& l = lookups[i];
+        if (!primary_bucket || primary_bucket.index() != l.bucket) {
+            primary_bucket = read_bucket(l.bucket);
+            get_engine().prefetch(primary_bucket.get_next());
+        }
+
+        bucket_node found_node;
+        u32 found_index = 0;
+        if (find_in_bucket(primary_bucket, keys + l.index * ks, l.hash, key_equals, found_node,
+                           found_index)) {
+            std::memmove(values + l.index * vs, found_node.get_value(found_index), vs);
+            found[l.index] = true;
+            ++result;
+        }
+    }
+    return result;
+}
+
 bool raw_hash_table_impl::find_compatible(
     const void* compatible_key, const std::function<u64(const void*)>& compatible_hash,
     const std::function<bool(const void*, const byte*)>& compatible_equals, byte* value) const {
@@ -649,6 +985,51 @@ end:
     return;
 }
 
+/*
+ * The cursor contains the low bits of the hashes in the next bucket.
+ * A bucket selected by k hash bits contains all values whose hashes have the same k low bits.
+ * If the bits of the hashes are reversed, every bucket corresponds to an aligned interval
+ * of the reversed hash space (of size 2^(64 - k)) and the buckets form a partition of that space.
+ * The scan walks through the reversed space in ascending order: it visits the bucket
+ * that contains the (reversed) cursor and then advances the cursor to the end of that bucket's
+ * interval. Splits and merges only change the partition, so the part of the space that
+ * lies before the cursor has always been visited completely.
+ */
+u64 raw_hash_table_impl::scan(u64 cursor, u64 count,
+                              iteration_control (*iter_func)(const byte* value, void* user_data),
+                              void* user_data) const {
+    if (!iter_func)
+        PREQUEL_THROW(bad_argument("Iteration function is null."));
+
+    if (get_primary_buckets() == 0)
+        return 0;
+
+    u64 visited = 0;
+    do {
+        const u64 bucket_index = bucket_for_hash(cursor);
+        for (bucket_node node = read_primary_bucket(bucket_index);;) {
+            const u32 values = node.get_size();
+            for (u32 value_index = 0; value_index < values; ++value_index) {
+                if (iter_func(node.get_value(value_index), user_data) == iteration_control::stop)
+                    return cursor;
+            }
+            visited += values;
+
+            block_index next = node.get_next();
+            if (!next)
+                break;
+            node = read_bucket(next);
+        }
+
+        // Increment the reversed cursor at the lowest bit of the bucket's interval.
+        // The bits below that position are set to one first so that they overflow to zero.
+        const u32 bits = bucket_hash_bits(bucket_index);
+        const u64 mask = bits >= 64 ? u64(-1) : (u64(1) << bits) - 1;
+        cursor = reverse_bits(reverse_bits(cursor | ~mask) + 1);
+    } while (cursor != 0 && visited < count);
+    return cursor;
+}
+
 void raw_hash_table_impl::visit(
     const std::function<iteration_control(const raw_hash_table::node_view& node)>& visit_func) const {
     if (!visit_func)
@@ -691,14 +1072,16 @@ void raw_hash_table_impl::dump(std::ostream& os) const {
                "  Key size:         {}\n"
                "  Block size:       {}\n"
                "  Bucket capacity:  {}\n"
+               "  Stored hashes:    {}\n"
                "  Size:             {}\n"
                "  Primary buckets:  {}\n"
                "  Overflow buckets: {}\n"
                "  Split pointer:    {}\n"
                "  Level:            {}\n"
                "  Load:             {}\n",
-               value_size(), key_size(), get_engine().block_size(), bucket_capacity(), size(),
-               primary_buckets(), overflow_buckets(), get_step(), get_level(), load());
+               value_size(), key_size(), get_engine().block_size(), bucket_capacity(),
+               stores_hashes(), size(), primary_buckets(), overflow_buckets(), get_step(),
+               get_level(), load());
 
     if (!m_bucket_ranges.empty()) {
         fmt::print(os, "\n");
@@ -778,20 +1161,20 @@ void raw_hash_table_impl::validate() const {
         while (1) {
             const u32 values = bucket.get_size();
 
-            const byte* last_value = nullptr;
+            u64 last_hash = 0;
             for (u32 value_index = 0; value_index < values; ++value_index) {
-                const byte* value = bucket.get_value(value_index);
-                if (bucket_for_value(value) != bucket_index)
+                const u64 hash = value_hash(bucket.get_value(value_index));
+                if (bucket.stores_hashes() && bucket.get_hash(value_index) != hash)
+                    PREQUEL_ERROR("Stored hash does not match the value's hash.");
+                if (bucket_for_hash(hash) != bucket_index)
                     PREQUEL_ERROR("Value is in wrong bucket.");
+                if (!filter_may_contain(hash))
+                    PREQUEL_ERROR("Key is missing from the filter.");
 
-                if (last_value) {
-                    u64 last_hash = value_hash(last_value);
-                    u64 hash = value_hash(value);
-                    if (hash < last_hash) {
-                        PREQUEL_ERROR("Values in a node must be sorted.");
-                    }
+                if (value_index > 0 && hash < last_hash) {
+                    PREQUEL_ERROR("Values in a node must be sorted.");
                 }
-                last_value = value;
+                last_hash = hash;
             }
 
             seen_values += values;
@@ -812,10 +1195,21 @@ void raw_hash_table_impl::validate() const {
     if (seen_overflow_buckets != get_overflow_buckets())
         PREQUEL_ERROR("Inconsistent number of overflow buckets.");
 
+    if (m_filter) {
+        m_filter->validate();
+        if (filtered() && !empty() && !m_filter->initialized())
+            PREQUEL_ERROR("Non-empty table does not have a filter.");
+        if (!filtered() && m_filter->initialized())
+            PREQUEL_ERROR("Table has a filter although filtering is disabled.");
+    }
+
 #undef PREQUEL_ERROR
 }
 
 void raw_hash_table_impl::clear() {
+    if (m_filter)
+        m_filter->reset();
+
     const u64 primary_buckets = get_primary_buckets();
     if (primary_buckets == 0)
         return;
@@ -834,6 +1228,38 @@ void raw_hash_table_impl::clear() {
     set_level(0);
 }
 
+void raw_hash_table_impl::filter_insert(u64 hash) {
+    if (!filtered())
+        return;
+    if (!m_filter->initialized() || m_filter->size() >= m_filter->capacity()) {
+        rebuild_filter();
+        return;
+    }
+    m_filter->insert(hash);
+}
+
+void raw_hash_table_impl::rebuild_filter() {
+    PREQUEL_ASSERT(filtered(), "The table does not have a filter.");
+
+    // Small tables get a filter that fills a single block.
+    const u32 bits_per_key = m_options.filter_bits_per_key;
+    const u64 min_capacity = u64(get_engine().block_size()) * 8 / bits_per_key;
+    m_filter->reset(std::max(2 * size(), min_capacity), bits_per_key);
+
+    const u64 primary_buckets = get_primary_buckets();
+    for (u64 bucket_index = 0; bucket_index < primary_buckets; ++bucket_index) {
+        for (bucket_node node = read_primary_bucket(bucket_index);;) {
+            for (u32 i = 0, n = node.get_size(); i < n; ++i)
+                m_filter->insert(entry_hash(node, i));
+
+            block_index next = node.get_next();
+            if (!next)
+                break;
+            node = read_bucket(next);
+        }
+    }
+}
+
 template<typename KeyType, typename KeyHasher, typename KeyEquals>
 bool raw_hash_table_impl::find_impl(const KeyType& key, const KeyHasher& hasher,
                                     const KeyEquals& equals, byte* value) const {
@@ -843,6 +1269,9 @@ bool raw_hash_table_impl::find_impl(const KeyType& key, const KeyHasher& hasher,
         return false;
 
     const u64 hash = hasher(key);
+    if (!filter_may_contain(hash))
+        return false;
+
     const bucket_node primary_bucket = read_primary_bucket(bucket_for_hash(hash));
     bucket_node found_node;
     u32 found_index = 0;
@@ -862,6 +1291,9 @@ bool raw_hash_table_impl::erase_impl(const KeyType& key, const KeyHasher& hasher
     bucket_node found_node;
     u32 found_index = 0;
     const u64 hash = hasher(key);
+    if (!filter_may_contain(hash))
+        return false;
+
     const bucket_node primary_bucket = read_primary_bucket(bucket_for_hash(hash));
     if (!find_in_bucket(primary_bucket, key, hash, equals, found_node, found_index)) {
         return false;
@@ -870,17 +1302,17 @@ bool raw_hash_table_impl::erase_impl(const KeyType& key, const KeyHasher& hasher
     found_node.remove(found_index);
     set_size(get_size() - 1);
 
-    if (empty()) {
-        PREQUEL_ASSERT(get_size() == 0, "Empty hash tables have no elements.");
+    while (load() < m_options.min_fill_factor) {
+        if (!shrink())
+            break;
+    }
+
+    // Empty tables with more than one bucket remain if shrinking is disabled.
+    if (empty() && get_primary_buckets() == 1) {
         PREQUEL_ASSERT(get_level() == 0, "Empty hash tables have 0 level.");
         PREQUEL_ASSERT(get_step() == 0, "Empty hash table cannot have nonzero step pointers.");
-        free_overflow_chain(primary_bucket.get_next());
+        free_overflow_chain(read_primary_bucket(0).get_next());
         free_primary_bucket(0);
-    } else {
-        while (load() < min_fill_factor) {
-            if (!shrink())
-                break;
-        }
     }
 
     return true;
@@ -936,29 +1368,40 @@ bool raw_hash_table_impl::insert_into_bucket(const bucket_node& primary_bucket,
         node.set_next(insert_node.index());
     }
 
-    insert_node.insert(insert_index, value);
+    insert_node.insert(insert_index, value, hash);
     return true;
 }
 
-/*
- * FIXME ineffecient because the calling code knows that the key is unique.
- * Grow() and shink() need to be improved.
- */
-void raw_hash_table_impl::insert_into_bucket(const bucket_node& primary_bucket, const byte* value) {
+void raw_hash_table_impl::insert_unique(const bucket_node& primary_bucket, const byte* value,
+                                        u64 hash) {
     PREQUEL_ASSERT(primary_bucket, "Invalid primary bucket.");
     PREQUEL_ASSERT(value, "Value is null.");
 
-    key_buffer key;
-    derive_key(value, key.data());
+    // The key cannot exist already, so the value can be inserted into the first
+    // node that has space, at the position determined by its hash.
+    bucket_node node = primary_bucket;
+    while (node.full()) {
+        block_index next = node.get_next();
+        if (!next) {
+            bucket_node overflow = allocate_overflow_bucket();
+            node.set_next(overflow.index());
+            node = std::move(overflow);
+            break;
+        }
+        node = read_bucket(next);
+    }
 
-    u64 hash = key_hash(key.data());
+    insert_sorted(node, value, hash);
+}
 
-    bucket_node found_node;
-    u32 found_index = 0;
-    bool inserted =
-        insert_into_bucket(primary_bucket, value, key.data(), hash, found_node, found_index);
-    PREQUEL_ASSERT(inserted, "Key must be unique.");
-    unused(inserted);
+void raw_hash_table_impl::insert_sorted(const bucket_node& node, const byte* value,
+                                        u64 hash) const {
+    PREQUEL_ASSERT(!node.full(), "Node is full.");
+
+    auto iter = std::upper_bound(
+        identity_iterator<u32>(0), identity_iterator<u32>(node.get_size()), hash,
+        [&](u64 h, u32 index) { return h < entry_hash(node, index); });
+    node.insert(*iter, value, hash);
 }
 
 bool raw_hash_table_impl::find_in_bucket(const bucket_node& primary_bucket, const byte* search_key,
@@ -981,14 +1424,9 @@ bool raw_hash_table_impl::find_in_node(const bucket_node& node, const KeyType& s
     /*
      * Binary search. Entries are sorted by hash.
      */
-    auto iter = std::lower_bound(identity_iterator<u32>(0), identity_iterator<u32>(size),
-                                 search_hash, [&](u32 index, u64 hash) {
-                                     const byte* value = node.get_value(index);
-
-                                     derive_key(value, other_key.data());
-                                     const u64 other_hash = key_hash(other_key.data());
-                                     return other_hash < hash;
-                                 });
+    auto iter = std::lower_bound(
+        identity_iterator<u32>(0), identity_iterator<u32>(size), search_hash,
+        [&](u32 index, u64 hash) { return entry_hash(node, index) < hash; });
 
     /*
      * Iterate starting from the found position. Continue the search
@@ -999,15 +1437,24 @@ bool raw_hash_table_impl::find_in_node(const bucket_node& node, const KeyType& s
     u32 index = *iter;
     while (index != size) {
         const byte* value = node.get_value(index);
-        derive_key(value, other_key.data());
 
-        const u64 hash = key_hash(other_key.data());
+        // With stored hashes, keys are only derived for entries with a matching hash.
+        u64 hash;
+        if (node.stores_hashes()) {
+            hash = node.get_hash(index);
+        } else {
+            derive_key(value, other_key.data());
+            hash = key_hash(other_key.data());
+        }
+
         if (hash != search_hash) {
             PREQUEL_ASSERT(hash > search_hash, "Order invariant.");
             position = index;
             return false;
         }
 
+        if (node.stores_hashes())
+            derive_key(value, other_key.data());
         if (equals(search_key, other_key.data())) {
             position = index;
             return true;
@@ -1064,70 +1511,83 @@ bool raw_hash_table_impl::grow() {
         set_level(level);
     }
 
+    split_bucket(step, scale);
+    set_step(step + 1);
+    return true;
+}
+
+void raw_hash_table_impl::split_bucket(u64 bucket_index, u64 scale) {
+    PREQUEL_ASSERT(bucket_index < scale, "Bucket index must be below the split scale.");
+    PREQUEL_ASSERT(get_primary_buckets() == scale + bucket_index,
+                   "The new bucket must be the next primary bucket.");
+
     /*
-     * Split the bucket pointed to by the step pointer and redistribute
-     * its values.
-     *
-     * TODO: Make this better, see below.
-     *
-     * The current approach is neither efficient nor very sound, because
-     * the values are removed first (a destructive operation) and then re-inserted.
-     * If any insertion fails (e.g. because no space can be allocated for overflow buckets),
-     * then all values will be lost.
-     *
-     * Also, all values will be distributed between the old and the new bucket, so running
-     * the entire insertion algorithm again every time is wasteful.
+     * Split the bucket at `bucket_index` by partitioning its chain into itself and
+     * the new bucket at `scale + bucket_index`. Values with the `scale` bit set in their
+     * hash move to the new bucket.
      *
-     * Hint for the future: since we allocate one more primarry bucket, that bucket and the existing
-     * oveflow buckets should be enough to hold the two split bucket chains.
+     * The chain is processed one node at a time: the contents of a node are copied
+     * to a buffer and the node becomes available for reuse. Both output chains
+     * take their nodes from the set of nodes that have been read completely.
+     * After j nodes have been read, the output chains contain at most j * capacity values,
+     * which fit into j + 1 nodes (the j nodes read so far and the new primary bucket).
+     * The split therefore never allocates after the new primary bucket has been created,
+     * so it cannot fail midway because of a failed allocation.
+     * Overflow nodes that are still unused at the end are freed.
      */
+    bucket_node new_bucket = allocate_primary_bucket(scale + bucket_index);
 
-    // Extract all values from the existing bucket and empty it.
-    std::vector<byte> split_values;
-    {
-        bucket_node current = read_primary_bucket(step);
-        allocate_primary_bucket(scale + step);
+    std::vector<byte> values(size_t(m_bucket_capacity) * value_size());
+    std::vector<u64> hashes(m_bucket_capacity);
+    std::deque<block_index> free_nodes;
 
-        bool current_is_overflow = false;
-        while (1) {
-            const u32 size = current.get_size();
-            split_values.reserve(split_values.size() + size * value_size());
+    // The tail nodes of the output chains: [0] for the old bucket, [1] for the new one.
+    bucket_node targets[2];
+    targets[1] = std::move(new_bucket);
 
-            for (u32 i = 0; i < size; ++i) {
-                const byte* value = current.get_value(i);
-                split_values.insert(split_values.end(), value, value + value_size());
-            }
+    bucket_node current = read_primary_bucket(bucket_index);
+    bool current_is_overflow = false;
+    while (1) {
+        const u32 size = current.get_size();
+        for (u32 i = 0; i < size; ++i) {
+            std::memcpy(values.data() + size_t(i) * value_size(), current.get_value(i),
+                        value_size());
+            hashes[i] = entry_hash(current, i);
+        }
 
-            // Free or reset the current bucket. Overflow buckets are freed,
-            // the primary bucket stays around.
-            const block_index next = current.get_next();
-            if (current_is_overflow) {
-                free_overflow_bucket(current.index());
-            } else {
-                current.set_next(block_index());
-                current.set_size(0);
-            }
+        const block_index next = current.get_next();
+        if (current_is_overflow) {
+            free_nodes.push_back(current.index());
+        } else {
+            current.set_next(block_index());
+            current.set_size(0);
+            targets[0] = current;
+        }
 
-            if (!next) {
-                break;
+        for (u32 i = 0; i < size; ++i) {
+            bucket_node& target = targets[(hashes[i] & scale) != 0];
+            if (target.full()) {
+                PREQUEL_ASSERT(!free_nodes.empty(), "There must be a free node.");
+                bucket_node node = read_bucket(free_nodes.front());
+                free_nodes.pop_front();
+                node.set_next(block_index());
+                node.set_size(0);
+
+                target.set_next(node.index());
+                target = std::move(node);
             }
-
-            current = read_bucket(next);
-            current_is_overflow = true;
+            insert_sorted(target, values.data() + size_t(i) * value_size(), hashes[i]);
         }
-    }
-
-    set_step(++step);
 
-    for (size_t i = 0; i < split_values.size(); i += value_size()) {
-        const byte* value = split_values.data() + i;
+        if (!next)
+            break;
 
-        // Note that this will always be either the bucket we are splitting
-        // or the bucket we have just allocated.
-        const u64 bucket_index = bucket_for_value(value);
-        insert_into_bucket(read_primary_bucket(bucket_index), value);
+        current = read_bucket(next);
+        current_is_overflow = true;
     }
-    return true;
+
+    for (block_index node : free_nodes)
+        free_overflow_bucket(node);
 }
 
 bool raw_hash_table_impl::shrink() {
@@ -1160,6 +1620,7 @@ bool raw_hash_table_impl::shrink() {
 
     // Extract values from the bucket; then delete it.
     std::vector<byte> merge_values;
+    std::vector<u64> merge_hashes;
     {
         const u64 bucket_index = get_primary_buckets() - 1;
         bucket_node current = read_primary_bucket(bucket_index);
@@ -1168,10 +1629,12 @@ bool raw_hash_table_impl::shrink() {
         while (1) {
             const u32 size = current.get_size();
             merge_values.reserve(merge_values.size() + size * value_size());
+            merge_hashes.reserve(merge_hashes.size() + size);
 
             for (u32 i = 0; i < size; ++i) {
                 const byte* value = current.get_value(i);
                 merge_values.insert(merge_values.end(), value, value + value_size());
+                merge_hashes.push_back(entry_hash(current, i));
             }
 
             // Free the bucket appropriately.
@@ -1193,11 +1656,12 @@ bool raw_hash_table_impl::shrink() {
 
     set_step(--step);
 
-    for (size_t i = 0; i < merge_values.size(); i += value_size()) {
-        const byte* value = merge_values.data() + i;
-        const u64 bucket_index = bucket_for_value(value);
+    for (size_t i = 0; i < merge_hashes.size(); ++i) {
+        const byte* value = merge_values.data() + i * value_size();
+        const u64 hash = merge_hashes[i];
+        const u64 bucket_index = bucket_for_hash(hash);
         PREQUEL_ASSERT(bucket_index == step, "Invariant");
-        insert_into_bucket(read_primary_bucket(bucket_index), value);
+        insert_unique(read_primary_bucket(bucket_index), value, hash);
     }
     return true;
 }
@@ -1236,7 +1700,7 @@ bucket_node raw_hash_table_impl::allocate_primary_bucket(u64 index) {
     PREQUEL_ASSERT(index < allocated_primary_buckets(), "Not enough buckets for that index.");
     block_index bucket_ptr = bucket_address(index);
     block_handle handle = get_engine().overwrite_zero(bucket_ptr);
-    bucket_node node(std::move(handle), value_size(), m_bucket_capacity);
+    bucket_node node(std::move(handle), value_size(), m_bucket_capacity, stores_hashes());
     node.init();
 
     set_primary_buckets(index + 1);
@@ -1263,7 +1727,7 @@ void raw_hash_table_impl::free_primary_bucket(u64 index) {
 bucket_node raw_hash_table_impl::allocate_overflow_bucket() {
     block_index bucket_ptr = get_allocator().allocate(1);
     block_handle handle = get_engine().overwrite_zero(bucket_ptr);
-    bucket_node node(std::move(handle), value_size(), m_bucket_capacity);
+    bucket_node node(std::move(handle), value_size(), m_bucket_capacity, stores_hashes());
     node.init();
 
     set_overflow_buckets(get_overflow_buckets() + 1);
@@ -1282,7 +1746,8 @@ bucket_node raw_hash_table_impl::read_primary_bucket(u64 bucket_index) const {
 }
 
 bucket_node raw_hash_table_impl::read_bucket(block_index bucket_ptr) const {
-    return bucket_node(get_engine().read(bucket_ptr), value_size(), m_bucket_capacity);
+    return bucket_node(get_engine().read(bucket_ptr), value_size(), m_bucket_capacity,
+                       stores_hashes());
 }
 
 double raw_hash_table_impl::load() const {
@@ -1312,6 +1777,17 @@ u64 raw_hash_table_impl::bucket_for_hash(u64 hash) const {
     return index;
 }
 
+u32 raw_hash_table_impl::bucket_hash_bits(u64 bucket_index) const {
+    PREQUEL_ASSERT(bucket_index < get_primary_buckets(), "Bucket index out of range.");
+
+    // Buckets that have already been split in this round (and the new buckets
+    // created by those splits) use one more bit.
+    const u8 level = get_level();
+    if (bucket_index < get_step() || bucket_index >= (u64(1) << level))
+        return level + 1;
+    return level;
+}
+
 u64 raw_hash_table_impl::value_hash(const byte* value) const {
     PREQUEL_ASSERT(value, "Value is null.");
     key_buffer key;
@@ -1319,6 +1795,12 @@ u64 raw_hash_table_impl::value_hash(const byte* value) const {
     return key_hash(key.data());
 }
 
+u64 raw_hash_table_impl::entry_hash(const bucket_node& node, u32 index) const {
+    if (node.stores_hashes())
+        return node.get_hash(index);
+    return value_hash(node.get_value(index));
+}
+
 u64 raw_hash_table_impl::key_hash(const byte* key) const {
     PREQUEL_ASSERT(key, "Null key.");
     return m_options.key_hash(key, m_options.user_data);
@@ -1346,7 +1828,13 @@ void raw_hash_table_impl::derive_key(const byte* value, byte* key) const {
 
 raw_hash_table::raw_hash_table(anchor_handle<anchor> anchor_,
                                const raw_hash_table_options& options_, allocator& alloc_)
-    : m_impl(std::make_unique<detail::raw_hash_table_impl>(std::move(anchor_), options_, alloc_)) {}
+    : raw_hash_table(std::move(anchor_), anchor_handle<filter_anchor>(), options_, alloc_) {}
+
+raw_hash_table::raw_hash_table(anchor_handle<anchor> anchor_,
+                               anchor_handle<filter_anchor> filter_anchor_,
+                               const raw_hash_table_options& options_, allocator& alloc_)
+    : m_impl(std::make_unique<detail::raw_hash_table_impl>(
+          std::move(anchor_), std::move(filter_anchor_), options_, alloc_)) {}
 
 raw_hash_table::~raw_hash_table() {}
 
@@ -1367,6 +1855,15 @@ allocator& raw_hash_table::get_allocator() const {
     return impl().get_allocator();
 }
 
+raw_hash_table_loader raw_hash_table::bulk_load(u64 expected_size) {
+    return raw_hash_table_loader(
+        std::make_unique<detail::raw_hash_table_loader_impl>(impl(), expected_size));
+}
+
+void raw_hash_table::reserve(u64 expected_size) {
+    impl().reserve(expected_size);
+}
+
 u32 raw_hash_table::value_size() const {
     return impl().value_size();
 }
@@ -1397,6 +1894,12 @@ u64 raw_hash_table::allocated_buckets() const {
 double raw_hash_table::fill_factor() const {
     return impl().load();
 }
+bool raw_hash_table::filtered() const {
+    return impl().filtered();
+}
+bool raw_hash_table::stores_hashes() const {
+    return impl().stores_hashes();
+}
 u64 raw_hash_table::byte_size() const {
     return impl().byte_size();
 }
@@ -1413,6 +1916,12 @@ bool raw_hash_table::find(const byte* key, byte* value) const {
     return impl().find(key, value);
 }
 
+u64 raw_hash_table::find_many(const byte* keys, size_t count, byte* values, bool* found) const {
+    if (count > 0 && (!keys || !values || !found))
+        PREQUEL_THROW(bad_argument("Keys, values and found flags must not be null."));
+    return impl().find_many(keys, count, values, found);
+}
+
 bool raw_hash_table::find_compatible(
     const void* compatible_key, const std::function<u64(const void*)>& compatible_hash,
     const std::function<bool(const void*, const byte*)>& compatible_equals, byte* value) const {
@@ -1448,6 +1957,12 @@ void raw_hash_table::iterate(iteration_control (*iter_func)(const byte* value, v
     impl().iterate(iter_func, user_data);
 }
 
+u64 raw_hash_table::scan(u64 cursor, u64 count,
+                         iteration_control (*iter_func)(const byte* value, void* user_data),
+                         void* user_data) const {
+    return impl().scan(cursor, count, iter_func, user_data);
+}
+
 void raw_hash_table::dump(std::ostream& os) const {
     impl().dump(os);
 }
@@ -1500,4 +2015,50 @@ const byte* raw_hash_table::node_view::value(u32 index) const {
     return m_impl->value(index);
 }
 
+// --------------------------------
+//
+//   Loader public interface
+//
+// --------------------------------
+
+raw_hash_table_loader::raw_hash_table_loader(
+    std::unique_ptr<detail::raw_hash_table_loader_impl> impl)
+    : m_impl(std::move(impl)) {
+    PREQUEL_ASSERT(m_impl, "Invalid impl pointer.");
+}
+
+raw_hash_table_loader::~raw_hash_table_loader() {}
+
+raw_hash_table_loader::raw_hash_table_loader(raw_hash_table_loader&& other) noexcept
+    : m_impl(std::move(other.m_impl)) {}
+
+raw_hash_table_loader& raw_hash_table_loader::operator=(raw_hash_table_loader&& other) noexcept {
+    if (this != &other) {
+        m_impl = std::move(other.m_impl);
+    }
+    return *this;
+}
+
+detail::raw_hash_table_loader_impl& raw_hash_table_loader::impl() const {
+    if (!m_impl)
+        PREQUEL_THROW(bad_operation("Invalid loader instance."));
+    return *m_impl;
+}
+
+void raw_hash_table_loader::insert(const byte* value) {
+    insert(value, 1);
+}
+
+void raw_hash_table_loader::insert(const byte* values, size_t count) {
+    impl().insert(values, count);
+}
+
+void raw_hash_table_loader::finish() {
+    impl().finish();
+}
+
+void raw_hash_table_loader::discard() {
+    impl().discard();
+}
+
 } // namespace prequel
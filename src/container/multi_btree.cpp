@@ -0,0 +1,747 @@
+#include <prequel/container/multi_btree.hpp>
+
+#include <prequel/deferred.hpp>
+#include <prequel/exception.hpp>
+#include <prequel/formatting.hpp>
+#include <prequel/math.hpp>
+
+#include "btree/leaf_node.hpp"
+
+#include <fmt/ostream.h>
+
+#include <vector>
+
+namespace prequel {
+
+namespace detail {
+
+/*
+ * Every distinct key is stored in an entry with the following layout:
+ * - Key (key_size bytes)
+ * - Number of values for that key (u64)
+ * - Payload (max(max_inline_values * value_size, 2 * sizeof(block_index)) bytes).
+ *
+ * If the number of values is <= max_inline_values, the values are stored in the
+ * payload directly. Otherwise, the payload contains the indices of the first and the
+ * last block of a doubly linked chain of overflow blocks. Every overflow block
+ * has the following layout:
+ * - Index of the previous block (block_index)
+ * - Index of the next block (block_index)
+ * - Values (overflow_capacity * value_size bytes).
+ *
+ * All blocks except for the last one are completely full, which means that the
+ * position of a value within the chain can be computed from its index.
+ * Erasing a value moves the last value of the chain into the hole.
+ */
+class raw_multi_btree_impl : public uses_allocator {
+public:
+    using anchor = raw_multi_btree_anchor;
+
+    raw_multi_btree_impl(anchor_handle<anchor> anchor_, const raw_multi_btree_options& options,
+                         allocator& alloc_);
+
+    raw_multi_btree_impl(const raw_multi_btree_impl&) = delete;
+    raw_multi_btree_impl& operator=(const raw_multi_btree_impl&) = delete;
+
+    raw_btree& tree() { return m_tree; }
+    const raw_btree& tree() const { return m_tree; }
+
+    u32 key_size() const { return m_key_size; }
+    u32 value_size() const { return m_value_size; }
+    u32 max_inline_values() const { return m_max_inline_values; }
+    u32 overflow_capacity() const { return m_overflow_capacity; }
+    u32 entry_size() const { return m_tree.value_size(); }
+
+    u64 size() const { return m_anchor.get<&anchor::size>(); }
+    u64 overflow_blocks() const { return m_anchor.get<&anchor::overflow_blocks>(); }
+
+    u64 byte_size() const {
+        return m_tree.byte_size() + overflow_blocks() * get_engine().block_size();
+    }
+
+    u64 count(const byte* key) const;
+    bool contains(const byte* key, const byte* value) const;
+
+    void insert(const byte* key, const byte* value);
+    bool erase(const byte* key, const byte* value);
+    u64 erase_all(const byte* key);
+
+    void clear();
+    void reset();
+
+    void dump(std::ostream& os) const;
+    void validate() const;
+
+public:
+    // Entry accessors.
+    u64 entry_count(const byte* entry) const { return deserialize<u64>(entry + m_key_size); }
+
+    bool entry_inline(const byte* entry) const { return entry_count(entry) <= m_max_inline_values; }
+
+    const byte* inline_value(const byte* entry, u64 index) const {
+        PREQUEL_ASSERT(entry_inline(entry), "Values are not stored inline.");
+        return entry_payload(entry) + index * m_value_size;
+    }
+
+    block_index entry_head(const byte* entry) const {
+        PREQUEL_ASSERT(!entry_inline(entry), "Values are stored inline.");
+        return deserialize<block_index>(entry_payload(entry));
+    }
+
+    block_index entry_tail(const byte* entry) const {
+        PREQUEL_ASSERT(!entry_inline(entry), "Values are stored inline.");
+        return deserialize<block_index>(entry_payload(entry) + serialized_size<block_index>());
+    }
+
+    // Overflow block accessors.
+    block_index block_prev(const block_handle& block) const { return block.get<block_index>(0); }
+
+    block_index block_next(const block_handle& block) const {
+        return block.get<block_index>(serialized_size<block_index>());
+    }
+
+    u32 block_value_offset(u64 index) const {
+        return 2 * serialized_size<block_index>() + u32(index % m_overflow_capacity) * m_value_size;
+    }
+
+private:
+    static raw_btree_options make_options(const raw_multi_btree_options& options, u32 block_size);
+
+    static u32 compute_max_inline_values(const raw_multi_btree_options& options, u32 block_size);
+
+    const byte* entry_payload(const byte* entry) const {
+        return entry + m_key_size + serialized_size<u64>();
+    }
+
+    byte* entry_payload(byte* entry) const { return entry + m_key_size + serialized_size<u64>(); }
+
+    void set_entry_count(byte* entry, u64 count) const { serialize(count, entry + m_key_size); }
+
+    void set_entry_chain(byte* entry, block_index head, block_index tail) const {
+        serialize(head, entry_payload(entry));
+        serialize(tail, entry_payload(entry) + serialized_size<block_index>());
+    }
+
+    // Number of values in the last block of an overflow chain with `count` values.
+    u64 tail_values(u64 count) const { return (count - 1) % m_overflow_capacity + 1; }
+
+    // Location of a value in the posting list of an entry.
+    struct value_position {
+        u64 index = 0;
+        block_index block; // Invalid if the value is stored inline.
+    };
+
+    // Searches the posting list of the entry for the given value.
+    bool find_value(const byte* entry, const byte* value, value_position& pos) const;
+
+    // Appends the value to the posting list of the entry.
+    void append_value(byte* entry, const byte* value);
+
+    // Removes the value at the given position from the posting list of the entry.
+    // The entry's count must be greater than 1.
+    void remove_value(byte* entry, const value_position& pos);
+
+    // Allocates a new, empty overflow block.
+    block_handle allocate_block(block_index prev);
+
+    void free_block(block_index index);
+
+    // Frees all overflow blocks of the entry (if any).
+    void release_entry(const byte* entry);
+
+    static bool key_less(const byte* left_key, const byte* right_key, void* user_data);
+    static void derive_key(const byte* value, byte* key, void* user_data);
+
+private:
+    anchor_handle<anchor> m_anchor;
+    raw_multi_btree_options m_options;
+    u32 m_key_size = 0;
+    u32 m_value_size = 0;
+    u32 m_max_inline_values = 0;
+    u32 m_overflow_capacity = 0;
+    raw_btree m_tree;
+};
+
+raw_multi_btree_impl::raw_multi_btree_impl(anchor_handle<anchor> anchor_,
+                                           const raw_multi_btree_options& options,
+                                           allocator& alloc_)
+    : uses_allocator(alloc_)
+    , m_anchor(std::move(anchor_))
+    , m_options(options)
+    , m_key_size(options.key_size)
+    , m_value_size(options.value_size)
+    , m_max_inline_values(compute_max_inline_values(options, alloc_.block_size()))
+    , m_overflow_capacity((alloc_.block_size() - 2 * serialized_size<block_index>())
+                          / options.value_size)
+    , m_tree(m_anchor.member<&anchor::tree>(), make_options(m_options, alloc_.block_size()),
+             alloc_) {
+    if (m_tree.leaf_node_capacity() < 4) {
+        PREQUEL_THROW(bad_argument(
+            fmt::format("Inline value count {} is too large (cannot fit 4 entries into one leaf)",
+                        m_max_inline_values)));
+    }
+    if (m_overflow_capacity <= m_max_inline_values) {
+        PREQUEL_THROW(bad_argument(
+            fmt::format("Inline value count {} is too large (must be less than the capacity of "
+                        "an overflow block, which is {})",
+                        m_max_inline_values, m_overflow_capacity)));
+    }
+}
+
+u32 raw_multi_btree_impl::compute_max_inline_values(const raw_multi_btree_options& options,
+                                                    u32 block_size) {
+    if (options.key_size == 0)
+        PREQUEL_THROW(bad_argument("Zero key size."));
+    if (options.value_size == 0)
+        PREQUEL_THROW(bad_argument("Zero value size."));
+    if (!options.key_less)
+        PREQUEL_THROW(bad_argument("No key_less function provided."));
+
+    if (options.max_inline_values != 0) {
+        if (u64(options.max_inline_values) * options.value_size > block_size) {
+            PREQUEL_THROW(bad_argument(fmt::format("Inline value count {} is too large",
+                                                   options.max_inline_values)));
+        }
+        return options.max_inline_values;
+    }
+
+    // Largest entry size so that 4 entries fit into a leaf
+    // (the capacity for 1-byte values is the usable space in a leaf).
+    const u32 entry_size = btree_impl::leaf_node::capacity(block_size, 1, false) / 4;
+    const u32 overhead = options.key_size + serialized_size<u64>();
+    if (entry_size < overhead + 2 * serialized_size<block_index>()
+        || entry_size - overhead < options.value_size) {
+        PREQUEL_THROW(bad_argument(fmt::format(
+            "Block size {} is too small (cannot fit 4 entries into one leaf)", block_size)));
+    }
+    return (entry_size - overhead) / options.value_size;
+}
+
+raw_btree_options raw_multi_btree_impl::make_options(const raw_multi_btree_options& options,
+                                                     u32 block_size) {
+    const u32 max_inline_values = compute_max_inline_values(options, block_size);
+
+    raw_btree_options tree_options;
+    tree_options.key_size = options.key_size;
+    tree_options.value_size = options.key_size + serialized_size<u64>()
+                              + std::max(max_inline_values * options.value_size,
+                                         u32(2 * serialized_size<block_index>()));
+    tree_options.derive_key = derive_key;
+    tree_options.key_less = key_less;
+    tree_options.user_data = const_cast<void*>(static_cast<const void*>(&options));
+    return tree_options;
+}
+
+bool raw_multi_btree_impl::key_less(const byte* left_key, const byte* right_key,
+                                    void* user_data) {
+    const raw_multi_btree_options* options =
+        reinterpret_cast<const raw_multi_btree_options*>(user_data);
+    return options->key_less(left_key, right_key, options->user_data);
+}
+
+void raw_multi_btree_impl::derive_key(const byte* value, byte* key, void* user_data) {
+    const raw_multi_btree_options* options =
+        reinterpret_cast<const raw_multi_btree_options*>(user_data);
+    std::memcpy(key, value, options->key_size);
+}
+
+u64 raw_multi_btree_impl::count(const byte* key) const {
+    auto cursor = m_tree.find(key);
+    return cursor ? entry_count(cursor.get()) : 0;
+}
+
+bool raw_multi_btree_impl::contains(const byte* key, const byte* value) const {
+    auto cursor = m_tree.find(key);
+    if (!cursor)
+        return false;
+
+    value_position pos;
+    return find_value(cursor.get(), value, pos);
+}
+
+void raw_multi_btree_impl::insert(const byte* key, const byte* value) {
+    if (!key)
+        PREQUEL_THROW(bad_argument("Key is null."));
+    if (!value)
+        PREQUEL_THROW(bad_argument("Value is null."));
+
+    raw_btree::cursor cursor = m_tree.find(key);
+    if (!cursor) {
+        std::vector<byte> entry(entry_size());
+        std::memcpy(entry.data(), key, m_key_size);
+        append_value(entry.data(), value);
+
+        [[maybe_unused]] bool inserted = cursor.insert(entry.data());
+        PREQUEL_ASSERT(inserted, "Key did not exist.");
+    } else {
+        std::vector<byte> entry(cursor.get(), cursor.get() + entry_size());
+        append_value(entry.data(), value);
+        cursor.set(entry.data());
+    }
+    m_anchor.set<&anchor::size>(size() + 1);
+}
+
+bool raw_multi_btree_impl::erase(const byte* key, const byte* value) {
+    raw_btree::cursor cursor = m_tree.find(key);
+    if (!cursor)
+        return false;
+
+    value_position pos;
+    if (!find_value(cursor.get(), value, pos))
+        return false;
+
+    if (entry_count(cursor.get()) == 1) {
+        cursor.erase();
+    } else {
+        std::vector<byte> entry(cursor.get(), cursor.get() + entry_size());
+        remove_value(entry.data(), pos);
+        cursor.set(entry.data());
+    }
+    m_anchor.set<&anchor::size>(size() - 1);
+    return true;
+}
+
+u64 raw_multi_btree_impl::erase_all(const byte* key) {
+    raw_btree::cursor cursor = m_tree.find(key);
+    if (!cursor)
+        return 0;
+
+    std::vector<byte> entry(cursor.get(), cursor.get() + entry_size());
+    cursor.erase();
+    release_entry(entry.data());
+
+    const u64 count = entry_count(entry.data());
+    m_anchor.set<&anchor::size>(size() - count);
+    return count;
+}
+
+void raw_multi_btree_impl::clear() {
+    if (overflow_blocks() > 0) {
+        for (auto cursor = m_tree.create_cursor(raw_btree::seek_min); cursor; cursor.move_next())
+            release_entry(cursor.get());
+    }
+    m_tree.clear();
+    m_anchor.set<&anchor::size>(0);
+}
+
+void raw_multi_btree_impl::reset() {
+    clear();
+    m_tree.reset();
+}
+
+bool raw_multi_btree_impl::find_value(const byte* entry, const byte* value,
+                                      value_position& pos) const {
+    const u64 count = entry_count(entry);
+    if (count <= m_max_inline_values) {
+        for (u64 i = 0; i < count; ++i) {
+            if (std::memcmp(inline_value(entry, i), value, m_value_size) == 0) {
+                pos.index = i;
+                pos.block = block_index();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    u64 index = 0;
+    for (block_index current = entry_head(entry); current;) {
+        block_handle block = get_engine().read(current);
+        const u64 values = std::min(count - index, u64(m_overflow_capacity));
+        for (u64 i = 0; i < values; ++i, ++index) {
+            if (std::memcmp(block.data() + block_value_offset(index), value, m_value_size) == 0) {
+                pos.index = index;
+                pos.block = current;
+                return true;
+            }
+        }
+        current = block_next(block);
+    }
+    return false;
+}
+
+void raw_multi_btree_impl::append_value(byte* entry, const byte* value) {
+    const u64 count = entry_count(entry);
+    if (count < m_max_inline_values) {
+        std::memcpy(entry_payload(entry) + count * m_value_size, value, m_value_size);
+    } else if (count == m_max_inline_values) {
+        // Move the posting list into its first overflow block.
+        block_handle block = allocate_block(block_index());
+        byte* data = block.writable_data();
+        std::memcpy(data + block_value_offset(0), entry_payload(entry), count * m_value_size);
+        std::memcpy(data + block_value_offset(count), value, m_value_size);
+
+        std::memset(entry_payload(entry), 0, entry_size() - m_key_size - serialized_size<u64>());
+        set_entry_chain(entry, block.index(), block.index());
+    } else {
+        block_index head = entry_head(entry);
+        block_handle tail = get_engine().read(entry_tail(entry));
+        if (tail_values(count) == m_overflow_capacity) {
+            block_handle block = allocate_block(tail.index());
+            tail.set<block_index>(serialized_size<block_index>(), block.index());
+            tail = std::move(block);
+        }
+        std::memcpy(tail.writable_data() + block_value_offset(count), value, m_value_size);
+        set_entry_chain(entry, head, tail.index());
+    }
+    set_entry_count(entry, count + 1);
+}
+
+void raw_multi_btree_impl::remove_value(byte* entry, const value_position& pos) {
+    const u64 count = entry_count(entry);
+    PREQUEL_ASSERT(count > 1, "The last value must be removed by erasing the entry.");
+    PREQUEL_ASSERT(pos.index < count, "Index out of bounds.");
+
+    if (count <= m_max_inline_values) {
+        byte* hole = entry_payload(entry) + pos.index * m_value_size;
+        byte* last = entry_payload(entry) + (count - 1) * m_value_size;
+        if (hole != last)
+            std::memcpy(hole, last, m_value_size);
+        std::memset(last, 0, m_value_size);
+        set_entry_count(entry, count - 1);
+        return;
+    }
+
+    // Fill the hole with the last value of the chain.
+    block_index head = entry_head(entry);
+    block_handle tail = get_engine().read(entry_tail(entry));
+    if (pos.index != count - 1) {
+        // The hole may be in the tail block, copy the value first
+        // because writable_data() can invalidate data pointers.
+        std::vector<byte> last(tail.data() + block_value_offset(count - 1),
+                               tail.data() + block_value_offset(count - 1) + m_value_size);
+        get_engine().read(pos.block).write(block_value_offset(pos.index), last.data(),
+                                           m_value_size);
+    }
+
+    if (tail_values(count) == 1) {
+        block_index prev = block_prev(tail);
+        PREQUEL_ASSERT(prev, "The tail must have a predecessor if it contains a single value.");
+
+        block_handle new_tail = get_engine().read(prev);
+        new_tail.set<block_index>(serialized_size<block_index>(), block_index());
+        free_block(tail.index());
+        tail = std::move(new_tail);
+    }
+    set_entry_chain(entry, head, tail.index());
+    set_entry_count(entry, count - 1);
+
+    if (count - 1 == m_max_inline_values) {
+        // The remaining values fit into the entry again. They are all in the first block,
+        // because the capacity of a block is greater than max_inline_values.
+        PREQUEL_ASSERT(head == tail.index(), "Chain must consist of a single block.");
+
+        std::memset(entry_payload(entry), 0, entry_size() - m_key_size - serialized_size<u64>());
+        std::memcpy(entry_payload(entry), tail.data() + block_value_offset(0),
+                    (count - 1) * m_value_size);
+        free_block(head);
+    }
+}
+
+block_handle raw_multi_btree_impl::allocate_block(block_index prev) {
+    block_index index = get_allocator().allocate(1);
+    block_handle block = get_engine().overwrite_zero(index);
+    block.set<block_index>(0, prev);
+    block.set<block_index>(serialized_size<block_index>(), block_index());
+    m_anchor.set<&anchor::overflow_blocks>(overflow_blocks() + 1);
+    return block;
+}
+
+void raw_multi_btree_impl::free_block(block_index index) {
+    get_allocator().free(index, 1);
+    m_anchor.set<&anchor::overflow_blocks>(overflow_blocks() - 1);
+}
+
+void raw_multi_btree_impl::release_entry(const byte* entry) {
+    if (entry_inline(entry))
+        return;
+
+    block_index current = entry_head(entry);
+    while (current) {
+        block_index next = block_next(get_engine().read(current));
+        free_block(current);
+        current = next;
+    }
+}
+
+void raw_multi_btree_impl::dump(std::ostream& os) const {
+    fmt::print(os,
+               "Raw multi btree:\n"
+               "  Key size: {}\n"
+               "  Value size: {}\n"
+               "  Max inline values: {}\n"
+               "  Overflow block capacity: {}\n"
+               "  Size: {}\n"
+               "  Overflow blocks: {}\n"
+               "\n",
+               key_size(), value_size(), max_inline_values(), overflow_capacity(), size(),
+               overflow_blocks());
+    m_tree.dump(os);
+}
+
+void raw_multi_btree_impl::validate() const {
+    m_tree.validate();
+
+    u64 seen_values = 0;
+    u64 seen_blocks = 0;
+    for (auto cursor = m_tree.create_cursor(raw_btree::seek_min); cursor; cursor.move_next()) {
+        const byte* entry = cursor.get();
+        const u64 count = entry_count(entry);
+        if (count == 0)
+            PREQUEL_THROW(corruption_error("Entry without values."));
+        seen_values += count;
+
+        if (entry_inline(entry))
+            continue;
+
+        const u64 expected_blocks = ceil_div(count, u64(m_overflow_capacity));
+        u64 blocks = 0;
+        block_index prev;
+        for (block_index current = entry_head(entry); current;) {
+            block_handle block = get_engine().read(current);
+            if (block_prev(block) != prev)
+                PREQUEL_THROW(corruption_error("Invalid previous pointer in overflow block."));
+            if (++blocks > expected_blocks)
+                PREQUEL_THROW(corruption_error("Overflow chain is too long."));
+
+            prev = current;
+            current = block_next(block);
+        }
+        if (blocks != expected_blocks)
+            PREQUEL_THROW(corruption_error("Overflow chain is too short."));
+        if (prev != entry_tail(entry))
+            PREQUEL_THROW(corruption_error("Last block of the chain is not the entry's tail."));
+        seen_blocks += blocks;
+    }
+
+    if (seen_values != size())
+        PREQUEL_THROW(corruption_error("Value count does not match the tree's state."));
+    if (seen_blocks != overflow_blocks())
+        PREQUEL_THROW(corruption_error("Overflow block count does not match the tree's state."));
+}
+
+} // namespace detail
+
+raw_multi_btree::raw_multi_btree(anchor_handle<anchor> _anchor,
+                                 const raw_multi_btree_options& options, allocator& alloc)
+    : m_impl(std::make_unique<detail::raw_multi_btree_impl>(std::move(_anchor), options, alloc)) {}
+
+raw_multi_btree::~raw_multi_btree() {}
+
+raw_multi_btree::raw_multi_btree(raw_multi_btree&& other) noexcept
+    : m_impl(std::move(other.m_impl)) {}
+
+raw_multi_btree& raw_multi_btree::operator=(raw_multi_btree&& other) noexcept {
+    if (this != &other) {
+        m_impl = std::move(other.m_impl);
+    }
+    return *this;
+}
+
+engine& raw_multi_btree::get_engine() const {
+    return impl().get_engine();
+}
+allocator& raw_multi_btree::get_allocator() const {
+    return impl().get_allocator();
+}
+
+u32 raw_multi_btree::key_size() const {
+    return impl().key_size();
+}
+u32 raw_multi_btree::value_size() const {
+    return impl().value_size();
+}
+u32 raw_multi_btree::max_inline_values() const {
+    return impl().max_inline_values();
+}
+u32 raw_multi_btree::overflow_block_capacity() const {
+    return impl().overflow_capacity();
+}
+bool raw_multi_btree::empty() const {
+    return impl().tree().empty();
+}
+u64 raw_multi_btree::size() const {
+    return impl().size();
+}
+u64 raw_multi_btree::keys() const {
+    return impl().tree().size();
+}
+u32 raw_multi_btree::height() const {
+    return impl().tree().height();
+}
+u64 raw_multi_btree::nodes() const {
+    return impl().tree().nodes();
+}
+u64 raw_multi_btree::overflow_blocks() const {
+    return impl().overflow_blocks();
+}
+u64 raw_multi_btree::byte_size() const {
+    return impl().byte_size();
+}
+
+raw_multi_btree::cursor raw_multi_btree::create_cursor(cursor_seek_t seek) const {
+    return cursor(&impl(), impl().tree().create_cursor(seek), seek == seek_max);
+}
+
+raw_multi_btree::cursor raw_multi_btree::find(const byte* key) const {
+    return cursor(&impl(), impl().tree().find(key));
+}
+
+raw_multi_btree::cursor raw_multi_btree::lower_bound(const byte* key) const {
+    return cursor(&impl(), impl().tree().lower_bound(key));
+}
+
+raw_multi_btree::cursor raw_multi_btree::upper_bound(const byte* key) const {
+    return cursor(&impl(), impl().tree().upper_bound(key));
+}
+
+u64 raw_multi_btree::count(const byte* key) const {
+    return impl().count(key);
+}
+
+bool raw_multi_btree::contains(const byte* key, const byte* value) const {
+    return impl().contains(key, value);
+}
+
+void raw_multi_btree::insert(const byte* key, const byte* value) {
+    impl().insert(key, value);
+}
+
+bool raw_multi_btree::erase(const byte* key, const byte* value) {
+    return impl().erase(key, value);
+}
+
+u64 raw_multi_btree::erase_all(const byte* key) {
+    return impl().erase_all(key);
+}
+
+void raw_multi_btree::clear() {
+    impl().clear();
+}
+
+void raw_multi_btree::reset() {
+    impl().reset();
+}
+
+void raw_multi_btree::dump(std::ostream& os) const {
+    impl().dump(os);
+}
+
+void raw_multi_btree::validate() const {
+    impl().validate();
+}
+
+detail::raw_multi_btree_impl& raw_multi_btree::impl() const {
+    if (!m_impl)
+        PREQUEL_THROW(bad_operation("Invalid tree instance."));
+    return *m_impl;
+}
+
+// --------------------------------
+//
+//   Cursor public interface
+//
+// --------------------------------
+
+raw_multi_btree_cursor::raw_multi_btree_cursor(detail::raw_multi_btree_impl* tree,
+                                               raw_btree::cursor inner, bool last)
+    : m_tree(tree)
+    , m_inner(std::move(inner)) {
+    seek_entry(!m_inner.at_end(), last);
+}
+
+const byte* raw_multi_btree_cursor::key() const {
+    return m_inner.get();
+}
+
+const byte* raw_multi_btree_cursor::value() const {
+    const byte* entry = m_inner.get();
+    if (tree().entry_inline(entry))
+        return tree().inline_value(entry, m_index);
+
+    PREQUEL_ASSERT(m_block, "Overflow block must be loaded.");
+    return m_block.data() + tree().block_value_offset(m_index);
+}
+
+u64 raw_multi_btree_cursor::duplicates() const {
+    return tree().entry_count(m_inner.get());
+}
+
+void raw_multi_btree_cursor::reset() {
+    m_inner.reset();
+    m_index = 0;
+    m_block = block_handle();
+}
+
+bool raw_multi_btree_cursor::move_min() {
+    return seek_entry(m_inner.move_min());
+}
+
+bool raw_multi_btree_cursor::move_max() {
+    return seek_entry(m_inner.move_max(), true);
+}
+
+bool raw_multi_btree_cursor::move_next() {
+    const byte* entry = m_inner.get();
+    if (m_index + 1 < tree().entry_count(entry)) {
+        ++m_index;
+        if (!tree().entry_inline(entry) && m_index % tree().overflow_capacity() == 0)
+            m_block = tree().get_engine().read(tree().block_next(m_block));
+        return true;
+    }
+    return seek_entry(m_inner.move_next());
+}
+
+bool raw_multi_btree_cursor::move_prev() {
+    const byte* entry = m_inner.get();
+    if (m_index > 0) {
+        if (!tree().entry_inline(entry) && m_index % tree().overflow_capacity() == 0)
+            m_block = tree().get_engine().read(tree().block_prev(m_block));
+        --m_index;
+        return true;
+    }
+    return seek_entry(m_inner.move_prev(), true);
+}
+
+bool raw_multi_btree_cursor::move_next_key() {
+    return seek_entry(m_inner.move_next());
+}
+
+bool raw_multi_btree_cursor::move_prev_key() {
+    return seek_entry(m_inner.move_prev());
+}
+
+bool raw_multi_btree_cursor::lower_bound(const byte* key) {
+    return seek_entry(m_inner.lower_bound(key));
+}
+
+bool raw_multi_btree_cursor::upper_bound(const byte* key) {
+    return seek_entry(m_inner.upper_bound(key));
+}
+
+bool raw_multi_btree_cursor::find(const byte* key) {
+    return seek_entry(m_inner.find(key));
+}
+
+bool raw_multi_btree_cursor::seek_entry(bool found, bool last) {
+    m_index = 0;
+    m_block = block_handle();
+    if (!found)
+        return false;
+
+    const byte* entry = m_inner.get();
+    if (last)
+        m_index = tree().entry_count(entry) - 1;
+    if (!tree().entry_inline(entry)) {
+        block_index block = last ? tree().entry_tail(entry) : tree().entry_head(entry);
+        m_block = tree().get_engine().read(block);
+    }
+    return true;
+}
+
+detail::raw_multi_btree_impl& raw_multi_btree_cursor::tree() const {
+    if (!m_tree)
+        PREQUEL_THROW(bad_cursor("Invalid cursor."));
+    return *m_tree;
+}
+
+} // namespace prequel
@@ -0,0 +1,834 @@
+#include <prequel/container/priority_queue.hpp>
+
+#include <prequel/exception.hpp>
+#include <prequel/formatting.hpp>
+#include <prequel/handle.hpp>
+
+#include <fmt/ostream.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace prequel {
+
+namespace detail {
+
+namespace {
+
+// Number of runs of the same level that are merged into a single run of the next level.
+static constexpr u32 merge_fanout = 8;
+
+// Runs are merged as soon as `merge_fanout` runs exist on a level, so levels
+// beyond this limit are never reached in practice.
+static constexpr u32 max_run_level = 64;
+
+/*
+ * Describes a sorted run. Stored in the run array, followed by a copy
+ * of the run's current head value (i.e. the smallest value in the run).
+ */
+struct run_header {
+    // The first block of the run that still contains values.
+    block_index head;
+
+    // Number of values in the run that have not been removed yet.
+    u64 remaining = 0;
+
+    // Index of the head value in the head block.
+    u32 offset = 0;
+
+    // Runs created from the insertion buffer have level 0, merging `merge_fanout`
+    // runs of level `l` produces a run of level `l + 1`.
+    u32 level = 0;
+
+    static constexpr auto get_binary_format() {
+        return binary_format(&run_header::head, &run_header::remaining, &run_header::offset,
+                             &run_header::level);
+    }
+};
+
+/*
+ * A block of a sorted run. Runs are linked lists of blocks.
+ * Values are appended while the run is being written and are consumed from the front
+ * (see `run_header::offset`) afterwards. The size of a block never changes once the run
+ * is complete.
+ *
+ * Layout: header | values[capacity].
+ */
+class run_block {
+private:
+    struct header {
+        // The next block of the same run, or invalid if this is the last block.
+        block_index next;
+
+        // Number of values in this block.
+        u32 size = 0;
+
+        static constexpr auto get_binary_format() {
+            return binary_format(&header::next, &header::size);
+        }
+    };
+
+public:
+    run_block() = default;
+
+    run_block(block_handle handle, u32 value_size, u32 capacity)
+        : m_handle(std::move(handle), 0)
+        , m_value_size(value_size)
+        , m_capacity(capacity) {
+        PREQUEL_ASSERT(capacity > 0, "Invalid capacity.");
+        PREQUEL_ASSERT(offset_of_value(capacity) <= m_handle.block().block_size(),
+                       "Capacity is too large.");
+    }
+
+    void init() const { m_handle.set(header()); }
+
+    block_index index() const { return m_handle.block().index(); }
+    bool valid() const { return index().valid(); }
+    explicit operator bool() const { return valid(); }
+
+    bool full() const { return get_size() == m_capacity; }
+
+    block_index get_next() const { return m_handle.get<&header::next>(); }
+    void set_next(block_index next) const { m_handle.set<&header::next>(next); }
+
+    u32 get_size() const { return m_handle.get<&header::size>(); }
+    void set_size(u32 size) const { m_handle.set<&header::size>(size); }
+
+    const byte* get(u32 index) const {
+        PREQUEL_ASSERT(index < get_size(), "Index out of bounds.");
+        return m_handle.block().data() + offset_of_value(index);
+    }
+
+    void append(const byte* value) const {
+        PREQUEL_ASSERT(!full(), "Block is full.");
+
+        const u32 size = get_size();
+        std::memmove(m_handle.block().writable_data() + offset_of_value(size), value,
+                     m_value_size);
+        set_size(size + 1);
+    }
+
+public:
+    static u32 compute_capacity(u32 block_size, u32 value_size) {
+        const u32 header_size = serialized_size<header>();
+        if (block_size <= header_size)
+            return 0;
+        return (block_size - header_size) / value_size;
+    }
+
+private:
+    u32 offset_of_value(u32 index) const {
+        return serialized_size<header>() + m_value_size * index;
+    }
+
+private:
+    handle<header> m_handle;
+    u32 m_value_size = 0;
+    u32 m_capacity = 0;
+};
+
+// Position of a merge input.
+struct run_cursor {
+    run_block block;
+    u32 offset = 0;
+    u64 remaining = 0;
+
+    const byte* value() const { return block.get(offset); }
+};
+
+} // namespace
+
+class raw_priority_queue_impl : public uses_allocator {
+public:
+    using anchor = raw_priority_queue_anchor;
+
+    static constexpr u64 npos = u64(-1);
+
+public:
+    raw_priority_queue_impl(anchor_handle<anchor> _anchor, const raw_priority_queue_options& _opts,
+                            allocator& _alloc);
+
+public:
+    u32 value_size() const { return m_options.value_size; }
+    u64 buffer_capacity() const { return m_buffer_capacity; }
+    u32 run_block_capacity() const { return m_run_block_capacity; }
+
+    u64 size() const { return m_anchor.get<&anchor::size>(); }
+    bool empty() const { return size() == 0; }
+    u64 buffer_size() const { return m_buffer.size(); }
+    u64 runs() const { return m_runs.size(); }
+    u64 run_blocks() const { return m_anchor.get<&anchor::run_blocks>(); }
+
+    u64 byte_size() const {
+        return m_buffer.byte_size() + m_runs.byte_size()
+               + run_blocks() * get_engine().block_size();
+    }
+
+    double overhead() const {
+        return empty() ? 1.0 : double(byte_size()) / double(size() * value_size());
+    }
+
+    void top(byte* value) const;
+    void push(const byte* value);
+    void pop(byte* value);
+
+    void clear();
+    void reset();
+    void dump(std::ostream& os) const;
+    void validate() const;
+
+private:
+    static const raw_priority_queue_options&
+    check_options(const raw_priority_queue_options& options);
+
+    // Finds the smallest value and copies it into `value`. Returns the index of the run that
+    // contains the value (its descriptor is copied into `entry`) or npos if the value
+    // is at the top of the insertion buffer.
+    u64 find_min(byte* value, byte* entry) const;
+
+    // Returns the index of the run with the smallest head value, or npos if there are no runs.
+    // The descriptor of that run is copied into `entry`.
+    u64 min_run(byte* entry) const;
+
+    // Heap operations on the insertion buffer.
+    void buffer_push(const byte* value);
+    void buffer_pop();
+
+    // Sorts the insertion buffer into a new run and merges runs as necessary.
+    void flush_buffer();
+
+    // Merges all runs of the given level into a single run of the next level.
+    // Returns false (and does nothing) if there are less than `merge_fanout` runs on that level.
+    bool merge_level(u32 level);
+
+    // Writes `count` values into a new run and registers it in the run array.
+    // `next_value` is invoked once for every value (in sorted order) and
+    // returns a pointer that must remain valid until the next invocation.
+    template<typename NextValue>
+    void write_run(u32 level, u64 count, NextValue&& next_value);
+
+    // Removes the head value of the run at the given index. `entry` must contain
+    // the run's descriptor.
+    void pop_run(u64 index, byte* entry);
+
+    // Moves the cursor to the next value of its run. Exhausted blocks are freed.
+    void advance(run_cursor& cursor);
+
+    run_block read_run_block(block_index index) const;
+    run_block create_run_block();
+    void free_run_block(block_index index);
+
+    // Frees all blocks of the run starting at `head`.
+    void free_run(block_index head);
+
+    u32 entry_size() const { return serialized_size<run_header>() + value_size(); }
+
+    static byte* head_value(byte* entry) { return entry + serialized_size<run_header>(); }
+    static const byte* head_value(const byte* entry) {
+        return entry + serialized_size<run_header>();
+    }
+
+    bool less(const byte* lhs, const byte* rhs) const {
+        return m_options.value_less(lhs, rhs, m_options.user_data);
+    }
+
+    void set_size(u64 size) { m_anchor.set<&anchor::size>(size); }
+    void set_run_blocks(u64 run_blocks) { m_anchor.set<&anchor::run_blocks>(run_blocks); }
+
+private:
+    anchor_handle<anchor> m_anchor;
+    raw_priority_queue_options m_options;
+    raw_array m_buffer;
+    raw_array m_runs;
+    u64 m_buffer_capacity = 0;
+    u32 m_run_block_capacity = 0;
+};
+
+raw_priority_queue_impl::raw_priority_queue_impl(anchor_handle<anchor> _anchor,
+                                                 const raw_priority_queue_options& _opts,
+                                                 allocator& _alloc)
+    : uses_allocator(_alloc)
+    , m_anchor(std::move(_anchor))
+    , m_options(check_options(_opts))
+    , m_buffer(m_anchor.member<&anchor::buffer>(), m_options.value_size, _alloc)
+    , m_runs(m_anchor.member<&anchor::runs>(), entry_size(), _alloc) {
+    m_buffer_capacity = u64(m_options.buffer_blocks) * m_buffer.block_capacity();
+    m_run_block_capacity =
+        run_block::compute_capacity(get_engine().block_size(), m_options.value_size);
+    if (m_run_block_capacity == 0) {
+        PREQUEL_THROW(bad_argument(
+            fmt::format("Block size {} is too small (cannot fit a single value into a run block)",
+                        get_engine().block_size())));
+    }
+}
+
+const raw_priority_queue_options&
+raw_priority_queue_impl::check_options(const raw_priority_queue_options& options) {
+    if (options.value_size == 0)
+        PREQUEL_THROW(bad_argument("Zero value size."));
+    if (!options.value_less)
+        PREQUEL_THROW(bad_argument("No value_less function provided."));
+    if (options.buffer_blocks == 0)
+        PREQUEL_THROW(bad_argument("The insertion buffer must span at least one block."));
+    return options;
+}
+
+void raw_priority_queue_impl::top(byte* value) const {
+    if (empty())
+        PREQUEL_THROW(bad_operation("Priority queue is empty."));
+
+    std::vector<byte> entry(entry_size());
+    find_min(value, entry.data());
+}
+
+void raw_priority_queue_impl::push(const byte* value) {
+    if (m_buffer.capacity() < m_buffer_capacity)
+        m_buffer.reserve(m_buffer_capacity);
+
+    buffer_push(value);
+    set_size(size() + 1);
+    if (m_buffer.size() >= m_buffer_capacity)
+        flush_buffer();
+}
+
+void raw_priority_queue_impl::pop(byte* value) {
+    if (empty())
+        PREQUEL_THROW(bad_operation("Priority queue is empty."));
+
+    std::vector<byte> min_value(value_size());
+    std::vector<byte> entry(entry_size());
+    const u64 run = find_min(min_value.data(), entry.data());
+    if (run == npos) {
+        buffer_pop();
+    } else {
+        pop_run(run, entry.data());
+    }
+    set_size(size() - 1);
+
+    if (value)
+        std::memcpy(value, min_value.data(), value_size());
+}
+
+void raw_priority_queue_impl::clear() {
+    std::vector<byte> entry(entry_size());
+    for (u64 i = 0, n = m_runs.size(); i < n; ++i) {
+        m_runs.get(i, entry.data());
+        free_run(deserialize<run_header>(entry.data()).head);
+    }
+    PREQUEL_ASSERT(run_blocks() == 0, "All run blocks must have been freed.");
+
+    m_runs.clear();
+    m_buffer.clear();
+    set_size(0);
+}
+
+void raw_priority_queue_impl::reset() {
+    clear();
+    m_runs.reset();
+    m_buffer.reset();
+}
+
+void raw_priority_queue_impl::dump(std::ostream& os) const {
+    fmt::print(os,
+               "Raw priority queue:\n"
+               "  Value size:         {}\n"
+               "  Block size:         {}\n"
+               "  Buffer capacity:    {}\n"
+               "  Run block capacity: {}\n"
+               "  Size:               {}\n"
+               "  Buffer size:        {}\n"
+               "  Runs:               {}\n"
+               "  Run blocks:         {}\n",
+               value_size(), get_engine().block_size(), buffer_capacity(), run_block_capacity(),
+               size(), buffer_size(), runs(), run_blocks());
+
+    std::vector<byte> entry(entry_size());
+    for (u64 i = 0, n = m_runs.size(); i < n; ++i) {
+        m_runs.get(i, entry.data());
+        const run_header header = deserialize<run_header>(entry.data());
+        fmt::print(os,
+                   "\n"
+                   "  Run {}:\n"
+                   "    Level: {}\n"
+                   "    Remaining: {}\n"
+                   "    Head: @{} (Offset {})\n"
+                   "    Head value: {}\n",
+                   i, header.level, header.remaining, header.head, header.offset,
+                   format_hex(head_value(entry.data()), value_size()));
+    }
+}
+
+void raw_priority_queue_impl::validate() const {
+#define PREQUEL_ERROR(...) PREQUEL_THROW(corruption_error(fmt::format("validate: " __VA_ARGS__)));
+
+    const u64 buffered = m_buffer.size();
+    if (buffered >= buffer_capacity())
+        PREQUEL_ERROR("Insertion buffer exceeds its capacity.");
+
+    {
+        std::vector<byte> parent(value_size());
+        std::vector<byte> child(value_size());
+        for (u64 i = 1; i < buffered; ++i) {
+            m_buffer.get((i - 1) / 2, parent.data());
+            m_buffer.get(i, child.data());
+            if (less(child.data(), parent.data()))
+                PREQUEL_ERROR("Insertion buffer violates the heap property.");
+        }
+    }
+
+    u64 seen_values = buffered;
+    u64 seen_blocks = 0;
+    std::vector<u64> runs_per_level(max_run_level, 0);
+    std::vector<byte> entry(entry_size());
+    std::vector<byte> previous(value_size());
+    for (u64 i = 0, n = m_runs.size(); i < n; ++i) {
+        m_runs.get(i, entry.data());
+        const run_header header = deserialize<run_header>(entry.data());
+        if (header.level >= max_run_level)
+            PREQUEL_ERROR("Run level is too large.");
+        if (++runs_per_level[header.level] >= merge_fanout)
+            PREQUEL_ERROR("Too many runs on level {}.", header.level);
+        if (header.remaining == 0)
+            PREQUEL_ERROR("Empty runs must be removed.");
+        if (!header.head)
+            PREQUEL_ERROR("Run without a head block.");
+
+        u64 values = 0;
+        u32 offset = header.offset;
+        block_index current = header.head;
+        while (current) {
+            run_block block = read_run_block(current);
+            const u32 block_size = block.get_size();
+            if (block_size == 0 || block_size > run_block_capacity())
+                PREQUEL_ERROR("Invalid run block size.");
+            if (offset >= block_size)
+                PREQUEL_ERROR("Invalid offset into the run block.");
+
+            for (u32 j = offset; j < block_size; ++j) {
+                const byte* value = block.get(j);
+                if (values == 0) {
+                    if (std::memcmp(value, head_value(entry.data()), value_size()) != 0)
+                        PREQUEL_ERROR("Cached head value is out of date.");
+                } else if (less(value, previous.data())) {
+                    PREQUEL_ERROR("Run is not sorted.");
+                }
+                std::memcpy(previous.data(), value, value_size());
+                ++values;
+            }
+
+            ++seen_blocks;
+            offset = 0;
+            current = block.get_next();
+        }
+
+        if (values != header.remaining)
+            PREQUEL_ERROR("Inconsistent number of values in run {}.", i);
+        seen_values += values;
+    }
+
+    if (seen_values != size())
+        PREQUEL_ERROR("Inconsistent value count.");
+    if (seen_blocks != run_blocks())
+        PREQUEL_ERROR("Inconsistent run block count.");
+
+#undef PREQUEL_ERROR
+}
+
+u64 raw_priority_queue_impl::find_min(byte* value, byte* entry) const {
+    PREQUEL_ASSERT(!empty(), "Queue must not be empty.");
+
+    const u64 run = min_run(entry);
+    if (m_buffer.empty()) {
+        PREQUEL_ASSERT(run != npos, "There must be a run if the buffer is empty.");
+        std::memcpy(value, head_value(entry), value_size());
+        return run;
+    }
+
+    m_buffer.get(0, value);
+    if (run != npos && less(head_value(entry), value)) {
+        std::memcpy(value, head_value(entry), value_size());
+        return run;
+    }
+    return npos;
+}
+
+u64 raw_priority_queue_impl::min_run(byte* entry) const {
+    const u64 count = m_runs.size();
+    if (count == 0)
+        return npos;
+
+    u64 result = 0;
+    m_runs.get(0, entry);
+
+    std::vector<byte> current(entry_size());
+    for (u64 i = 1; i < count; ++i) {
+        m_runs.get(i, current.data());
+        if (less(head_value(current.data()), head_value(entry))) {
+            std::memcpy(entry, current.data(), entry_size());
+            result = i;
+        }
+    }
+    return result;
+}
+
+void raw_priority_queue_impl::buffer_push(const byte* value) {
+    u64 index = m_buffer.size();
+    m_buffer.push_back(value);
+
+    std::vector<byte> parent(value_size());
+    bool moved = false;
+    while (index > 0) {
+        const u64 parent_index = (index - 1) / 2;
+        m_buffer.get(parent_index, parent.data());
+        if (!less(value, parent.data()))
+            break;
+
+        m_buffer.set(index, parent.data());
+        index = parent_index;
+        moved = true;
+    }
+    if (moved)
+        m_buffer.set(index, value);
+}
+
+void raw_priority_queue_impl::buffer_pop() {
+    PREQUEL_ASSERT(!m_buffer.empty(), "Buffer must not be empty.");
+
+    const u64 size = m_buffer.size() - 1;
+    if (size == 0) {
+        m_buffer.pop_back();
+        return;
+    }
+
+    // Move the last value to the root and let it sink down.
+    std::vector<byte> last(value_size());
+    std::vector<byte> child(value_size());
+    std::vector<byte> sibling(value_size());
+    m_buffer.get(size, last.data());
+    m_buffer.pop_back();
+
+    u64 index = 0;
+    while (1) {
+        u64 child_index = 2 * index + 1;
+        if (child_index >= size)
+            break;
+
+        m_buffer.get(child_index, child.data());
+        if (child_index + 1 < size) {
+            m_buffer.get(child_index + 1, sibling.data());
+            if (less(sibling.data(), child.data())) {
+                child.swap(sibling);
+                child_index += 1;
+            }
+        }
+        if (!less(child.data(), last.data()))
+            break;
+
+        m_buffer.set(index, child.data());
+        index = child_index;
+    }
+    m_buffer.set(index, last.data());
+}
+
+void raw_priority_queue_impl::flush_buffer() {
+    const u64 count = m_buffer.size();
+    PREQUEL_ASSERT(count > 0, "Buffer must not be empty.");
+
+    std::vector<byte> values(count * value_size());
+    std::vector<const byte*> sorted(count);
+    for (u64 i = 0; i < count; ++i) {
+        m_buffer.get(i, values.data() + i * value_size());
+        sorted[i] = values.data() + i * value_size();
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [&](const byte* lhs, const byte* rhs) { return less(lhs, rhs); });
+    m_buffer.clear();
+
+    u64 next = 0;
+    write_run(0, count, [&]() { return sorted[next++]; });
+
+    u32 level = 0;
+    while (merge_level(level))
+        ++level;
+}
+
+bool raw_priority_queue_impl::merge_level(u32 level) {
+    const u64 count = m_runs.size();
+    const u32 size = entry_size();
+
+    std::vector<byte> entries(count * size);
+    u64 merged = 0;
+    for (u64 i = 0; i < count; ++i) {
+        byte* entry = entries.data() + i * size;
+        m_runs.get(i, entry);
+        if (deserialize<run_header>(entry).level == level)
+            ++merged;
+    }
+    if (merged < merge_fanout)
+        return false;
+    if (level + 1 >= max_run_level)
+        PREQUEL_THROW(bad_operation("Too many run levels."));
+
+    // Keep the descriptors of all other runs and open a cursor for every merged run.
+    // The merged runs are consumed (and their blocks freed) while the new run is being written.
+    std::vector<run_cursor> cursors;
+    u64 total = 0;
+    m_runs.clear();
+    for (u64 i = 0; i < count; ++i) {
+        const byte* entry = entries.data() + i * size;
+        const run_header header = deserialize<run_header>(entry);
+        if (header.level != level) {
+            m_runs.push_back(entry);
+            continue;
+        }
+
+        run_cursor cursor;
+        cursor.block = read_run_block(header.head);
+        cursor.offset = header.offset;
+        cursor.remaining = header.remaining;
+        cursors.push_back(std::move(cursor));
+        total += header.remaining;
+    }
+
+    // Min-heap of cursor indices, ordered by their current value.
+    auto cursor_greater = [&](size_t lhs, size_t rhs) {
+        return less(cursors[rhs].value(), cursors[lhs].value());
+    };
+    std::vector<size_t> heap(cursors.size());
+    for (size_t i = 0; i < cursors.size(); ++i)
+        heap[i] = i;
+    std::make_heap(heap.begin(), heap.end(), cursor_greater);
+
+    std::vector<byte> current(value_size());
+    write_run(level + 1, total, [&]() {
+        PREQUEL_ASSERT(!heap.empty(), "Merge inputs exhausted.");
+        std::pop_heap(heap.begin(), heap.end(), cursor_greater);
+
+        const size_t index = heap.back();
+        run_cursor& cursor = cursors[index];
+        std::memcpy(current.data(), cursor.value(), value_size());
+        advance(cursor);
+        if (cursor.remaining > 0) {
+            std::push_heap(heap.begin(), heap.end(), cursor_greater);
+        } else {
+            heap.pop_back();
+        }
+        return current.data();
+    });
+    PREQUEL_ASSERT(heap.empty(), "All inputs must have been consumed.");
+    return true;
+}
+
+template<typename NextValue>
+void raw_priority_queue_impl::write_run(u32 level, u64 count, NextValue&& next_value) {
+    PREQUEL_ASSERT(count > 0, "Runs must not be empty.");
+
+    std::vector<byte> entry(entry_size());
+    block_index head;
+    run_block current;
+    for (u64 i = 0; i < count; ++i) {
+        const byte* value = next_value();
+        if (!current || current.full()) {
+            run_block block = create_run_block();
+            if (current) {
+                current.set_next(block.index());
+            } else {
+                head = block.index();
+            }
+            current = std::move(block);
+        }
+        if (i == 0)
+            std::memcpy(head_value(entry.data()), value, value_size());
+        current.append(value);
+    }
+
+    run_header header;
+    header.head = head;
+    header.remaining = count;
+    header.offset = 0;
+    header.level = level;
+    serialize(header, entry.data());
+    m_runs.push_back(entry.data());
+}
+
+void raw_priority_queue_impl::pop_run(u64 index, byte* entry) {
+    run_header header = deserialize<run_header>(entry);
+    PREQUEL_ASSERT(header.remaining > 0, "Run must not be empty.");
+
+    run_block block = read_run_block(header.head);
+    header.offset += 1;
+    header.remaining -= 1;
+    if (header.offset == block.get_size()) {
+        const block_index next = block.get_next();
+        block = run_block();
+        free_run_block(header.head);
+
+        header.head = next;
+        header.offset = 0;
+        if (header.remaining > 0)
+            block = read_run_block(next);
+    }
+
+    if (header.remaining == 0) {
+        PREQUEL_ASSERT(!header.head, "All blocks of the run must have been freed.");
+
+        // Replace the descriptor with the last one.
+        const u64 last = m_runs.size() - 1;
+        if (index != last) {
+            m_runs.get(last, entry);
+            m_runs.set(index, entry);
+        }
+        m_runs.pop_back();
+        return;
+    }
+
+    serialize(header, entry);
+    std::memcpy(head_value(entry), block.get(header.offset), value_size());
+    m_runs.set(index, entry);
+}
+
+void raw_priority_queue_impl::advance(run_cursor& cursor) {
+    PREQUEL_ASSERT(cursor.remaining > 0, "Cursor is at the end.");
+
+    cursor.offset += 1;
+    cursor.remaining -= 1;
+    if (cursor.offset == cursor.block.get_size()) {
+        const block_index index = cursor.block.index();
+        const block_index next = cursor.block.get_next();
+        cursor.block = run_block();
+        free_run_block(index);
+
+        cursor.offset = 0;
+        if (cursor.remaining > 0)
+            cursor.block = read_run_block(next);
+    }
+}
+
+run_block raw_priority_queue_impl::read_run_block(block_index index) const {
+    PREQUEL_ASSERT(index, "Invalid run block index.");
+    return run_block(get_engine().read(index), value_size(), run_block_capacity());
+}
+
+run_block raw_priority_queue_impl::create_run_block() {
+    block_index index = get_allocator().allocate(1);
+    run_block block(get_engine().overwrite_zero(index), value_size(), run_block_capacity());
+    block.init();
+    set_run_blocks(run_blocks() + 1);
+    return block;
+}
+
+void raw_priority_queue_impl::free_run_block(block_index index) {
+    get_allocator().free(index, 1);
+    set_run_blocks(run_blocks() - 1);
+}
+
+void raw_priority_queue_impl::free_run(block_index head) {
+    while (head) {
+        const block_index next = read_run_block(head).get_next();
+        free_run_block(head);
+        head = next;
+    }
+}
+
+} // namespace detail
+
+raw_priority_queue::raw_priority_queue(anchor_handle<anchor> anc,
+                                       const raw_priority_queue_options& options, allocator& alloc)
+    : m_impl(std::make_unique<detail::raw_priority_queue_impl>(std::move(anc), options, alloc)) {}
+
+raw_priority_queue::~raw_priority_queue() {}
+
+raw_priority_queue::raw_priority_queue(raw_priority_queue&& other) noexcept
+    : m_impl(std::move(other.m_impl)) {}
+
+raw_priority_queue& raw_priority_queue::operator=(raw_priority_queue&& other) noexcept {
+    if (this != &other) {
+        m_impl = std::move(other.m_impl);
+    }
+    return *this;
+}
+
+engine& raw_priority_queue::get_engine() const {
+    return impl().get_engine();
+}
+allocator& raw_priority_queue::get_allocator() const {
+    return impl().get_allocator();
+}
+
+u32 raw_priority_queue::value_size() const {
+    return impl().value_size();
+}
+u64 raw_priority_queue::buffer_capacity() const {
+    return impl().buffer_capacity();
+}
+u32 raw_priority_queue::run_block_capacity() const {
+    return impl().run_block_capacity();
+}
+u32 raw_priority_queue::merge_fanout() {
+    return detail::merge_fanout;
+}
+bool raw_priority_queue::empty() const {
+    return impl().empty();
+}
+u64 raw_priority_queue::size() const {
+    return impl().size();
+}
+u64 raw_priority_queue::buffer_size() const {
+    return impl().buffer_size();
+}
+u64 raw_priority_queue::runs() const {
+    return impl().runs();
+}
+u64 raw_priority_queue::run_blocks() const {
+    return impl().run_blocks();
+}
+u64 raw_priority_queue::byte_size() const {
+    return impl().byte_size();
+}
+double raw_priority_queue::overhead() const {
+    return impl().overhead();
+}
+
+void raw_priority_queue::top(byte* value) const {
+    if (!value)
+        PREQUEL_THROW(bad_argument("Value is null."));
+    impl().top(value);
+}
+
+void raw_priority_queue::push(const byte* value) {
+    if (!value)
+        PREQUEL_THROW(bad_argument("Value is null."));
+    impl().push(value);
+}
+
+void raw_priority_queue::pop() {
+    impl().pop(nullptr);
+}
+
+void raw_priority_queue::pop(byte* value) {
+    if (!value)
+        PREQUEL_THROW(bad_argument("Value is null."));
+    impl().pop(value);
+}
+
+void raw_priority_queue::reset() {
+    impl().reset();
+}
+void raw_priority_queue::clear() {
+    impl().clear();
+}
+
+void raw_priority_queue::dump(std::ostream& os) const {
+    impl().dump(os);
+}
+void raw_priority_queue::validate() const {
+    impl().validate();
+}
+
+detail::raw_priority_queue_impl& raw_priority_queue::impl() const {
+    PREQUEL_ASSERT(m_impl, "Invalid priority queue instance.");
+    return *m_impl;
+}
+
+} // namespace prequel
@@ -0,0 +1,501 @@
+#include <prequel/container/var_btree.hpp>
+
+#include <prequel/address.hpp>
+#include <prequel/deferred.hpp>
+#include <prequel/exception.hpp>
+#include <prequel/formatting.hpp>
+#include <prequel/math.hpp>
+
+#include "btree/leaf_node.hpp"
+
+#include <fmt/ostream.h>
+
+namespace prequel {
+
+namespace detail {
+
+/*
+ * Every value in the tree is an entry with the following layout:
+ * - Key (key_size bytes)
+ * - Size of the user value (u32)
+ * - Payload (max(max_inline_size, sizeof(block_index)) bytes).
+ *
+ * If the user value fits into max_inline_size bytes, it is stored in the payload directly.
+ * Otherwise, the value is stored in ceil(size / block_size) contiguous overflow blocks
+ * and the payload contains the index of the first block.
+ */
+class raw_var_btree_impl : public uses_allocator {
+public:
+    using anchor = raw_var_btree_anchor;
+
+    raw_var_btree_impl(anchor_handle<anchor> anchor_, const raw_var_btree_options& options,
+                       allocator& alloc_);
+
+    raw_var_btree_impl(const raw_var_btree_impl&) = delete;
+    raw_var_btree_impl& operator=(const raw_var_btree_impl&) = delete;
+
+    raw_btree& tree() { return m_tree; }
+    const raw_btree& tree() const { return m_tree; }
+
+    u32 key_size() const { return m_key_size; }
+    u32 max_inline_size() const { return m_max_inline_size; }
+    u32 entry_size() const { return m_tree.value_size(); }
+
+    u64 overflow_blocks() const { return m_anchor.get<&anchor::overflow_blocks>(); }
+    u64 value_bytes() const { return m_anchor.get<&anchor::value_bytes>(); }
+
+    u64 byte_size() const {
+        return m_tree.byte_size() + overflow_blocks() * get_engine().block_size();
+    }
+
+    raw_var_btree::insert_result insert(const byte* key, const byte* value, u32 value_size,
+                                        bool overwrite);
+
+    // Replaces the value of the entry at the cursor's position.
+    void set_value(raw_btree::cursor& cursor, const byte* value, u32 value_size);
+
+    // Erases the entry at the cursor's position (including its out-of-line storage).
+    void erase(raw_btree::cursor& cursor);
+
+    void clear();
+    void reset();
+
+    void dump(std::ostream& os) const;
+    void validate() const;
+
+public:
+    // Entry accessors.
+    u32 entry_value_size(const byte* entry) const {
+        return deserialize<u32>(entry + m_key_size);
+    }
+
+    bool entry_inline(const byte* entry) const {
+        return entry_value_size(entry) <= m_max_inline_size;
+    }
+
+    block_index entry_overflow(const byte* entry) const {
+        PREQUEL_ASSERT(!entry_inline(entry), "Value is stored inline.");
+        return deserialize<block_index>(entry_payload(entry));
+    }
+
+    void read_value(const byte* entry, byte* buffer) const;
+
+private:
+    static raw_btree_options make_options(const raw_var_btree_options& options, u32 block_size);
+
+    static u32 compute_max_inline_size(const raw_var_btree_options& options, u32 block_size);
+
+    const byte* entry_payload(const byte* entry) const {
+        return entry + m_key_size + serialized_size<u32>();
+    }
+
+    byte* entry_payload(byte* entry) const { return entry + m_key_size + serialized_size<u32>(); }
+
+    // Number of overflow blocks for a value of the given size.
+    u64 overflow_blocks_for(u32 value_size) const {
+        return ceil_div(u64(value_size), u64(get_engine().block_size()));
+    }
+
+    // Builds the entry for the given (key, value) pair in `entry`.
+    // Allocates overflow blocks if the value does not fit into the entry.
+    void make_entry(const byte* key, const byte* value, u32 value_size, byte* entry);
+
+    // Frees the overflow blocks of this entry (if any).
+    void release_entry(const byte* entry);
+
+    void write_blocks(block_index first, const byte* value, u32 value_size);
+
+    static bool key_less(const byte* left_key, const byte* right_key, void* user_data);
+    static void derive_key(const byte* value, byte* key, void* user_data);
+
+private:
+    anchor_handle<anchor> m_anchor;
+    raw_var_btree_options m_options;
+    u32 m_key_size = 0;
+    u32 m_max_inline_size = 0;
+    raw_btree m_tree;
+};
+
+raw_var_btree_impl::raw_var_btree_impl(anchor_handle<anchor> anchor_,
+                                       const raw_var_btree_options& options, allocator& alloc_)
+    : uses_allocator(alloc_)
+    , m_anchor(std::move(anchor_))
+    , m_options(options)
+    , m_key_size(options.key_size)
+    , m_max_inline_size(compute_max_inline_size(options, alloc_.block_size()))
+    , m_tree(m_anchor.member<&anchor::tree>(), make_options(m_options, alloc_.block_size()),
+             alloc_) {
+    if (m_tree.leaf_node_capacity() < 4) {
+        PREQUEL_THROW(bad_argument(
+            fmt::format("Inline size {} is too large (cannot fit 4 entries into one leaf)",
+                        m_max_inline_size)));
+    }
+}
+
+u32 raw_var_btree_impl::compute_max_inline_size(const raw_var_btree_options& options,
+                                                u32 block_size) {
+    if (options.key_size == 0)
+        PREQUEL_THROW(bad_argument("Zero key size."));
+    if (!options.key_less)
+        PREQUEL_THROW(bad_argument("No key_less function provided."));
+
+    if (options.max_inline_size != 0)
+        return options.max_inline_size;
+
+    // Largest entry size so that 4 entries fit into a leaf
+    // (the capacity for 1-byte values is the usable space in a leaf).
+    const u32 entry_size = btree_impl::leaf_node::capacity(block_size, 1, false) / 4;
+    const u32 overhead = options.key_size + serialized_size<u32>();
+    if (entry_size < overhead + serialized_size<block_index>()) {
+        PREQUEL_THROW(bad_argument(fmt::format(
+            "Block size {} is too small (cannot fit 4 entries into one leaf)", block_size)));
+    }
+    return entry_size - overhead;
+}
+
+raw_btree_options raw_var_btree_impl::make_options(const raw_var_btree_options& options,
+                                                   u32 block_size) {
+    const u32 max_inline_size = compute_max_inline_size(options, block_size);
+
+    raw_btree_options tree_options;
+    tree_options.key_size = options.key_size;
+    tree_options.value_size = options.key_size + serialized_size<u32>()
+                              + std::max(max_inline_size, u32(serialized_size<block_index>()));
+    tree_options.derive_key = derive_key;
+    tree_options.key_less = key_less;
+    tree_options.user_data = const_cast<void*>(static_cast<const void*>(&options));
+    return tree_options;
+}
+
+bool raw_var_btree_impl::key_less(const byte* left_key, const byte* right_key, void* user_data) {
+    const raw_var_btree_options* options =
+        reinterpret_cast<const raw_var_btree_options*>(user_data);
+    return options->key_less(left_key, right_key, options->user_data);
+}
+
+void raw_var_btree_impl::derive_key(const byte* value, byte* key, void* user_data) {
+    const raw_var_btree_options* options =
+        reinterpret_cast<const raw_var_btree_options*>(user_data);
+    std::memcpy(key, value, options->key_size);
+}
+
+raw_var_btree::insert_result raw_var_btree_impl::insert(const byte* key, const byte* value,
+                                                        u32 value_size, bool overwrite) {
+    if (!key)
+        PREQUEL_THROW(bad_argument("Key is null."));
+    if (!value && value_size > 0)
+        PREQUEL_THROW(bad_argument("Value is null."));
+
+    raw_btree::cursor cursor = m_tree.find(key);
+    if (cursor) {
+        if (overwrite)
+            set_value(cursor, value, value_size);
+        return raw_var_btree::insert_result(raw_var_btree::cursor(this, std::move(cursor)), false);
+    }
+
+    std::vector<byte> entry(entry_size());
+    make_entry(key, value, value_size, entry.data());
+    deferred guard = [&] { release_entry(entry.data()); };
+
+    [[maybe_unused]] bool inserted = cursor.insert(entry.data());
+    PREQUEL_ASSERT(inserted, "Key did not exist.");
+    guard.disable();
+
+    return raw_var_btree::insert_result(raw_var_btree::cursor(this, std::move(cursor)), true);
+}
+
+void raw_var_btree_impl::set_value(raw_btree::cursor& cursor, const byte* value, u32 value_size) {
+    if (!value && value_size > 0)
+        PREQUEL_THROW(bad_argument("Value is null."));
+
+    const byte* old_entry = cursor.get();
+    const u32 old_size = entry_value_size(old_entry);
+
+    // Overwrite the existing overflow blocks if the new value needs the same amount of storage.
+    if (!entry_inline(old_entry) && value_size > m_max_inline_size
+        && overflow_blocks_for(old_size) == overflow_blocks_for(value_size)) {
+        write_blocks(entry_overflow(old_entry), value, value_size);
+
+        std::vector<byte> entry(old_entry, old_entry + entry_size());
+        serialize(value_size, entry.data() + m_key_size);
+        cursor.set(entry.data());
+        m_anchor.set<&anchor::value_bytes>(value_bytes() - old_size + value_size);
+        return;
+    }
+
+    std::vector<byte> old(old_entry, old_entry + entry_size());
+    std::vector<byte> entry(entry_size());
+    make_entry(old.data(), value, value_size, entry.data());
+    deferred guard = [&] { release_entry(entry.data()); };
+    cursor.set(entry.data());
+    guard.disable();
+
+    release_entry(old.data());
+}
+
+void raw_var_btree_impl::erase(raw_btree::cursor& cursor) {
+    std::vector<byte> entry(cursor.get(), cursor.get() + entry_size());
+    cursor.erase();
+    release_entry(entry.data());
+}
+
+void raw_var_btree_impl::clear() {
+    if (overflow_blocks() > 0) {
+        for (auto cursor = m_tree.create_cursor(raw_btree::seek_min); cursor; cursor.move_next())
+            release_entry(cursor.get());
+    }
+    m_tree.clear();
+    m_anchor.set<&anchor::value_bytes>(0);
+}
+
+void raw_var_btree_impl::reset() {
+    clear();
+    m_tree.reset();
+}
+
+void raw_var_btree_impl::read_value(const byte* entry, byte* buffer) const {
+    const u32 size = entry_value_size(entry);
+    if (size <= m_max_inline_size) {
+        std::memcpy(buffer, entry_payload(entry), size);
+    } else {
+        read(get_engine(), get_engine().to_address(entry_overflow(entry)), buffer, size);
+    }
+}
+
+void raw_var_btree_impl::make_entry(const byte* key, const byte* value, u32 value_size,
+                                    byte* entry) {
+    std::memset(entry, 0, entry_size());
+    std::memcpy(entry, key, m_key_size);
+    serialize(value_size, entry + m_key_size);
+
+    if (value_size <= m_max_inline_size) {
+        std::memcpy(entry_payload(entry), value, value_size);
+    } else {
+        const u64 blocks = overflow_blocks_for(value_size);
+        const block_index first = get_allocator().allocate(blocks);
+        deferred guard = [&] { get_allocator().free(first, blocks); };
+        write_blocks(first, value, value_size);
+        guard.disable();
+
+        serialize(first, entry_payload(entry));
+        m_anchor.set<&anchor::overflow_blocks>(overflow_blocks() + blocks);
+    }
+    m_anchor.set<&anchor::value_bytes>(value_bytes() + value_size);
+}
+
+void raw_var_btree_impl::release_entry(const byte* entry) {
+    const u32 value_size = entry_value_size(entry);
+    if (value_size > m_max_inline_size) {
+        const u64 blocks = overflow_blocks_for(value_size);
+        get_allocator().free(entry_overflow(entry), blocks);
+        m_anchor.set<&anchor::overflow_blocks>(overflow_blocks() - blocks);
+    }
+    m_anchor.set<&anchor::value_bytes>(value_bytes() - value_size);
+}
+
+void raw_var_btree_impl::write_blocks(block_index first, const byte* value, u32 value_size) {
+    // Full blocks are overwritten without reading them first, the last block is zero-padded.
+    const u32 block_size = get_engine().block_size();
+    for (block_index index = first; value_size > 0; index += 1) {
+        const u32 n = std::min(value_size, block_size);
+        if (n == block_size) {
+            get_engine().overwrite(index, value, n);
+        } else {
+            auto block = get_engine().overwrite_zero(index);
+            std::memcpy(block.writable_data(), value, n);
+        }
+        value += n;
+        value_size -= n;
+    }
+}
+
+void raw_var_btree_impl::dump(std::ostream& os) const {
+    fmt::print(os,
+               "Raw var btree:\n"
+               "  Key size: {}\n"
+               "  Max inline size: {}\n"
+               "  Overflow blocks: {}\n"
+               "  Value bytes: {}\n"
+               "\n",
+               key_size(), max_inline_size(), overflow_blocks(), value_bytes());
+    m_tree.dump(os);
+}
+
+void raw_var_btree_impl::validate() const {
+    m_tree.validate();
+
+    u64 seen_blocks = 0;
+    u64 seen_bytes = 0;
+    for (auto cursor = m_tree.create_cursor(raw_btree::seek_min); cursor; cursor.move_next()) {
+        const byte* entry = cursor.get();
+        const u32 size = entry_value_size(entry);
+        if (size > m_max_inline_size) {
+            if (!entry_overflow(entry))
+                PREQUEL_THROW(corruption_error("Out-of-line value without overflow blocks."));
+            seen_blocks += overflow_blocks_for(size);
+        }
+        seen_bytes += size;
+    }
+
+    if (seen_blocks != overflow_blocks())
+        PREQUEL_THROW(corruption_error("Overflow block count does not match the tree's state."));
+    if (seen_bytes != value_bytes())
+        PREQUEL_THROW(corruption_error("Value byte count does not match the tree's state."));
+}
+
+} // namespace detail
+
+raw_var_btree::raw_var_btree(anchor_handle<anchor> _anchor, const raw_var_btree_options& options,
+                             allocator& alloc)
+    : m_impl(std::make_unique<detail::raw_var_btree_impl>(std::move(_anchor), options, alloc)) {}
+
+raw_var_btree::~raw_var_btree() {}
+
+raw_var_btree::raw_var_btree(raw_var_btree&& other) noexcept
+    : m_impl(std::move(other.m_impl)) {}
+
+raw_var_btree& raw_var_btree::operator=(raw_var_btree&& other) noexcept {
+    if (this != &other) {
+        m_impl = std::move(other.m_impl);
+    }
+    return *this;
+}
+
+engine& raw_var_btree::get_engine() const {
+    return impl().get_engine();
+}
+allocator& raw_var_btree::get_allocator() const {
+    return impl().get_allocator();
+}
+
+u32 raw_var_btree::key_size() const {
+    return impl().key_size();
+}
+u32 raw_var_btree::max_inline_size() const {
+    return impl().max_inline_size();
+}
+u32 raw_var_btree::leaf_node_capacity() const {
+    return impl().tree().leaf_node_capacity();
+}
+bool raw_var_btree::empty() const {
+    return impl().tree().empty();
+}
+u64 raw_var_btree::size() const {
+    return impl().tree().size();
+}
+u32 raw_var_btree::height() const {
+    return impl().tree().height();
+}
+u64 raw_var_btree::nodes() const {
+    return impl().tree().nodes();
+}
+u64 raw_var_btree::overflow_blocks() const {
+    return impl().overflow_blocks();
+}
+u64 raw_var_btree::value_bytes() const {
+    return impl().value_bytes();
+}
+u64 raw_var_btree::byte_size() const {
+    return impl().byte_size();
+}
+
+raw_var_btree::cursor raw_var_btree::create_cursor(cursor_seek_t seek) const {
+    return cursor(&impl(), impl().tree().create_cursor(seek));
+}
+
+raw_var_btree::cursor raw_var_btree::find(const byte* key) const {
+    return cursor(&impl(), impl().tree().find(key));
+}
+
+raw_var_btree::cursor raw_var_btree::lower_bound(const byte* key) const {
+    return cursor(&impl(), impl().tree().lower_bound(key));
+}
+
+raw_var_btree::cursor raw_var_btree::upper_bound(const byte* key) const {
+    return cursor(&impl(), impl().tree().upper_bound(key));
+}
+
+raw_var_btree::insert_result
+raw_var_btree::insert(const byte* key, const byte* value, u32 value_size) {
+    return impl().insert(key, value, value_size, false);
+}
+
+raw_var_btree::insert_result
+raw_var_btree::insert_or_update(const byte* key, const byte* value, u32 value_size) {
+    return impl().insert(key, value, value_size, true);
+}
+
+bool raw_var_btree::erase(const byte* key) {
+    auto c = impl().tree().find(key);
+    if (!c)
+        return false;
+    impl().erase(c);
+    return true;
+}
+
+void raw_var_btree::clear() {
+    impl().clear();
+}
+
+void raw_var_btree::reset() {
+    impl().reset();
+}
+
+void raw_var_btree::dump(std::ostream& os) const {
+    impl().dump(os);
+}
+
+void raw_var_btree::validate() const {
+    impl().validate();
+}
+
+detail::raw_var_btree_impl& raw_var_btree::impl() const {
+    if (!m_impl)
+        PREQUEL_THROW(bad_operation("Invalid tree instance."));
+    return *m_impl;
+}
+
+// --------------------------------
+//
+//   Cursor public interface
+//
+// --------------------------------
+
+const byte* raw_var_btree_cursor::key() const {
+    return m_inner.get();
+}
+
+u32 raw_var_btree_cursor::value_size() const {
+    return tree().entry_value_size(m_inner.get());
+}
+
+bool raw_var_btree_cursor::value_inline() const {
+    return tree().entry_inline(m_inner.get());
+}
+
+void raw_var_btree_cursor::read_value(byte* buffer) const {
+    tree().read_value(m_inner.get(), buffer);
+}
+
+std::vector<byte> raw_var_btree_cursor::value() const {
+    const byte* entry = m_inner.get();
+    std::vector<byte> result(tree().entry_value_size(entry));
+    tree().read_value(entry, result.data());
+    return result;
+}
+
+void raw_var_btree_cursor::set_value(const byte* value, u32 value_size) {
+    tree().set_value(m_inner, value, value_size);
+}
+
+void raw_var_btree_cursor::erase() {
+    tree().erase(m_inner);
+}
+
+detail::raw_var_btree_impl& raw_var_btree_cursor::tree() const {
+    if (!m_tree)
+        PREQUEL_THROW(bad_cursor("Invalid cursor."));
+    return *m_tree;
+}
+
+} // namespace prequel
@@ -182,6 +182,16 @@ block_handle engine::overwrite(block_index index, const byte* data, size_t size)
     return internal_populate_handle(index, initialize_data_t{data, size});
 }
 
+void engine::prefetch(block_index index) {
+    if (!index.valid() || handle_manager().find(index))
+        return;
+    do_prefetch(index);
+}
+
+void engine::do_prefetch(block_index index) {
+    unused(index);
+}
+
 template<typename Initializer>
 block_handle engine::internal_populate_handle(block_index index, Initializer&& init) {
     static constexpr bool overwrite =
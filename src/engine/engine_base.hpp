@@ -27,6 +27,10 @@ public:
     inline virtual void dirty(u64 index, block* blk);
     inline virtual void flush(u64 index, block* blk);
 
+    /// Starts loading the block in the background (if supported), unless
+    /// it is already in memory.
+    inline void prefetch(u64 index);
+
     /// Writes all dirty blocks back to disk.
     /// Throws if an I/O error occurs.
     inline virtual void flush();
@@ -39,6 +43,9 @@ protected:
     virtual void do_read(u64 index, byte* buffer) = 0;
     virtual void do_write(u64 index, const byte* buffer) = 0;
 
+    // Hint that the block will be read soon. Does nothing by default.
+    virtual void do_prefetch(u64 index) { unused(index); }
+
 protected:
     /// Throws away all dirty blocks.
     /// Requires that none of those blocks are pinned.
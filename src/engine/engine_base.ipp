@@ -103,6 +103,12 @@ void engine_base::flush(u64 index, block* blk) {
     }
 }
 
+void engine_base::prefetch(u64 index) {
+    if (m_blocks.find(index))
+        return;
+    do_prefetch(index);
+}
+
 void engine_base::flush() {
     for (auto i = m_dirty.begin(), e = m_dirty.end(); i != e;) {
         // Compute successor iterator here, flush_block will remove
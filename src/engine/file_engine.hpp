@@ -21,6 +21,7 @@ public:
 protected:
     inline void do_read(u64 index, byte* buffer) override;
     inline void do_write(u64 index, const byte* buffer) override;
+    inline void do_prefetch(u64 index) override;
 
 private:
     /// Underlying I/O-object.
@@ -37,6 +37,10 @@ void file_engine::do_write(u64 index, const byte* buffer) {
     m_file->write(index << m_block_size_log, buffer, m_block_size);
 }
 
+void file_engine::do_prefetch(u64 index) {
+    m_file->prefetch(index << m_block_size_log, m_block_size);
+}
+
 } // namespace prequel::detail::engine_impl
 
 #endif // PREQUEL_ENGINE_FILE_ENGINE_IPP
@@ -55,6 +55,10 @@ void file_engine::do_flush(block_index index, uintptr_t cookie) {
     impl().flush(index.value(), reinterpret_cast<detail::engine_impl::block*>(cookie));
 }
 
+void file_engine::do_prefetch(block_index index) {
+    impl().prefetch(index.value());
+}
+
 detail::engine_impl::file_engine& file_engine::impl() const {
     PREQUEL_ASSERT(m_impl, "Invalid engine instance.");
     return *m_impl;
@@ -14,4 +14,58 @@ u64 fnv_1a(const byte* data, size_t length) noexcept {
     return hash;
 }
 
+// Reads n (<= 8) bytes as a big endian integer.
+static u64 read_word(const byte* data, size_t n) noexcept {
+    u64 word = 0;
+    for (size_t i = 0; i < n; ++i)
+        word = (word << 8) | data[i];
+    return word;
+}
+
+static u64 read_word(const byte* data) noexcept {
+    return deserialize<u64>(data);
+}
+
+/*
+ * Inputs of up to 8 bytes are read as a single word.
+ * Inputs of up to 16 bytes are read as two (possibly overlapping) words.
+ * Larger inputs are consumed in blocks of 32 and 16 bytes, the final two words
+ * are the last 16 bytes of the input (which may overlap with the last block).
+ */
+u64 fast_hash(const byte* data, size_t length, u64 seed) noexcept {
+    seed = detail::fast_hash_seed(seed);
+
+    u64 a = 0, b = 0;
+    if (length <= 8) {
+        a = read_word(data, length);
+    } else if (length <= 16) {
+        a = read_word(data);
+        b = read_word(data + length - 8);
+    } else {
+        // Two independent lanes for blocks of 32 bytes.
+        const byte* p = data;
+        size_t remaining = length;
+        if (remaining > 32) {
+            u64 seed2 = seed;
+            for (; remaining > 32; remaining -= 32, p += 32) {
+                seed = detail::fast_hash_mix(read_word(p) ^ detail::fast_hash_p1,
+                                             read_word(p + 8) ^ seed);
+                seed2 = detail::fast_hash_mix(read_word(p + 16) ^ detail::fast_hash_p2,
+                                              read_word(p + 24) ^ seed2);
+            }
+            seed ^= seed2;
+        }
+
+        // Up to 32 bytes remain: one more block if necessary,
+        // the rest is covered by the last 16 bytes.
+        if (remaining > 16) {
+            seed = detail::fast_hash_mix(read_word(p) ^ detail::fast_hash_p1,
+                                         read_word(p + 8) ^ seed);
+        }
+        a = read_word(data + length - 16);
+        b = read_word(data + length - 8);
+    }
+    return detail::fast_hash_finish(a, b, seed, length);
+}
+
 } // namespace prequel
@@ -11,6 +11,10 @@ namespace prequel {
 
 file::~file() {}
 
+void file::prefetch(u64 offset, u64 count) {
+    unused(offset, count);
+}
+
 vfs::~vfs() {}
 
 void* vfs::memory_map(file& f, u64 offset, u64 length) {
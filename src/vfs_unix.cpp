@@ -43,6 +43,8 @@ public:
 
     void sync() override;
 
+    void prefetch(u64 offset, u64 count) override;
+
     void close() override;
 
 private:
@@ -197,6 +199,17 @@ void unix_file::sync() {
     }
 }
 
+void unix_file::prefetch(u64 offset, u64 count) {
+    check_open();
+#ifdef POSIX_FADV_WILLNEED
+    // This is only a hint, errors are ignored on purpose.
+    ::posix_fadvise(m_fd, static_cast<off_t>(offset), static_cast<off_t>(count),
+                    POSIX_FADV_WILLNEED);
+#else
+    unused(offset, count);
+#endif
+}
+
 void unix_file::close() {
     if (m_fd != -1) {
         int fd = std::exchange(m_fd, -1);
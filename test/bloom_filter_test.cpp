@@ -0,0 +1,78 @@
+#include <catch.hpp>
+
+#include <prequel/container/bloom_filter.hpp>
+#include <prequel/container/node_allocator.hpp>
+#include <prequel/exception.hpp>
+#include <prequel/hash.hpp>
+
+#include "./test_file.hpp"
+
+using namespace prequel;
+
+TEST_CASE("bloom filter", "[bloom-filter]") {
+    test_file file(256);
+
+    node_allocator::anchor alloc_anchor;
+    node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    bloom_filter::anchor filter_anchor;
+    bloom_filter filter(make_anchor_handle(filter_anchor), alloc);
+    REQUIRE(!filter.initialized());
+    REQUIRE(filter.byte_size() == 0);
+    REQUIRE(filter.may_contain(1));
+    REQUIRE_THROWS_AS(filter.insert(1), bad_operation);
+    REQUIRE_THROWS_AS(filter.reset(100, 0), bad_argument);
+    filter.validate();
+
+    const u64 count = 20000;
+    const u64 lookups = 100000;
+
+    // 2048 bits per block: the filter needs a directory with two levels.
+    filter.reset(count, 10);
+    filter.validate();
+    REQUIRE(filter.initialized());
+    REQUIRE(filter.capacity() == count);
+    REQUIRE(filter.hashes() == 7);
+    REQUIRE(filter.blocks() == (count * 10 + 2047) / 2048);
+    REQUIRE(filter.byte_size() > filter.blocks() * 256);
+
+    for (u64 i = 0; i < count; ++i)
+        filter.insert(fnv_1a(i));
+    REQUIRE(filter.size() == count);
+
+    for (u64 i = 0; i < count; ++i)
+        REQUIRE(filter.may_contain(fnv_1a(i)));
+
+    u64 false_positives = 0;
+    for (u64 i = count; i < count + lookups; ++i)
+        false_positives += filter.may_contain(fnv_1a(i));
+    REQUIRE(false_positives < lookups / 50);
+
+    // Overfilling the filter increases the false positive rate, but everything is still found.
+    for (u64 i = count; i < 2 * count; ++i)
+        filter.insert(fnv_1a(i));
+    for (u64 i = 0; i < 2 * count; ++i)
+        REQUIRE(filter.may_contain(fnv_1a(i)));
+
+    filter.clear();
+    filter.validate();
+    REQUIRE(filter.size() == 0);
+    false_positives = 0;
+    for (u64 i = 0; i < 2 * count; ++i)
+        false_positives += filter.may_contain(fnv_1a(i));
+    REQUIRE(false_positives == 0);
+
+    // A small filter consists of a single block.
+    filter.reset(10, 8);
+    filter.validate();
+    REQUIRE(filter.blocks() == 1);
+    REQUIRE(filter.byte_size() == 256);
+    filter.insert(fnv_1a(u64(5)));
+    REQUIRE(filter.may_contain(fnv_1a(u64(5))));
+
+    filter.reset();
+    filter.validate();
+    REQUIRE(!filter.initialized());
+    REQUIRE(filter.byte_size() == 0);
+    REQUIRE(alloc.data_used() == 0);
+}
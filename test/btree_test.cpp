@@ -1,13 +1,20 @@
 #include <catch.hpp>
 
 #include <prequel/container/btree.hpp>
+#include <prequel/container/default_allocator.hpp>
 #include <prequel/container/node_allocator.hpp>
+#include <prequel/exception.hpp>
 #include <prequel/formatting.hpp>
 
 #include "./test_file.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
 #include <iostream>
+#include <limits>
 #include <random>
+#include <set>
 #include <unordered_set>
 #include <vector>
 
@@ -101,7 +108,7 @@ void check_tree_equals_container_reverse(const btree<T, DeriveKey, KeyLess>& tre
 }
 
 template<typename Value, typename KeyDerive = indexed_by_identity, typename TestFunction>
-void simple_tree_test(TestFunction&& test) {
+void simple_tree_test(const raw_btree_options& settings, TestFunction&& test) {
     using tree_type = btree<Value, KeyDerive>;
 
     u32 block_sizes[] = {128, 512, 4096};
@@ -114,11 +121,18 @@ void simple_tree_test(TestFunction&& test) {
         node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
 
         typename tree_type::anchor tree_anchor;
-        tree_type tree(make_anchor_handle(tree_anchor), alloc);
+        typename tree_type::filter_anchor filter_anchor;
+        tree_type tree(make_anchor_handle(tree_anchor), make_anchor_handle(filter_anchor), alloc,
+                       settings);
         test(tree, block_size);
     }
 }
 
+template<typename Value, typename KeyDerive = indexed_by_identity, typename TestFunction>
+void simple_tree_test(TestFunction&& test) {
+    simple_tree_test<Value, KeyDerive>(raw_btree_options(), std::forward<TestFunction>(test));
+}
+
 template<typename T = i32>
 static std::vector<T> generate_numbers(size_t count, i32 seed) {
     std::mt19937_64 rng(seed);
@@ -197,6 +211,10 @@ TEST_CASE("raw btree", "[btree]") {
             REQUIRE(!c1.upper_bound(key.data()));
             REQUIRE(c1.at_end());
 
+            REQUIRE(tree.erase_range(key.data(), key.data()) == 0);
+            REQUIRE_THROWS_AS(tree.erase_range(nullptr, key.data()), bad_argument);
+            REQUIRE_THROWS_AS(tree.erase_range(key.data(), nullptr), bad_argument);
+
             tree.validate();
         }
 
@@ -755,3 +773,1389 @@ TEST_CASE("btree bulk loading", "[btree][bulk-loading]") {
         }
     });
 }
+
+TEST_CASE("btree with linked leaves", "[btree]") {
+    raw_btree_options settings;
+    settings.linked_leaves = true;
+
+    simple_tree_test<i32>(settings, [](auto&& tree, u32 block_size) {
+        const i32 max = 20000;
+
+        SECTION("insert, iterate and erase/" + std::to_string(block_size)) {
+            std::vector<i32> numbers;
+            for (i32 i = 1; i <= max; ++i)
+                numbers.push_back(i);
+
+            std::vector<i32> shuffled = numbers;
+            std::mt19937_64 rng(42);
+            std::shuffle(shuffled.begin(), shuffled.end(), rng);
+            for (i32 n : shuffled)
+                tree.insert(n);
+
+            tree.validate();
+            check_tree_equals_container(tree, numbers);
+            check_tree_equals_container_reverse(tree, numbers);
+
+            // Erase every odd number during a forward scan. The cursor moves through the
+            // leaf links and must still be able to erase values after crossing parent nodes.
+            {
+                auto cursor = tree.create_cursor(tree.seek_min);
+                while (cursor) {
+                    if (cursor.get() % 2 != 0) {
+                        cursor.erase();
+                        REQUIRE(cursor.erased());
+                    }
+                    cursor.move_next();
+                }
+            }
+            tree.validate();
+
+            numbers.erase(std::remove_if(numbers.begin(), numbers.end(),
+                                         [](i32 n) { return n % 2 != 0; }),
+                          numbers.end());
+            check_tree_equals_container(tree, numbers);
+            check_tree_equals_container_reverse(tree, numbers);
+
+            // Erase the rest backwards.
+            {
+                auto cursor = tree.create_cursor(tree.seek_max);
+                while (cursor) {
+                    cursor.erase();
+                    cursor.move_prev();
+                }
+            }
+            tree.validate();
+            REQUIRE(tree.empty());
+            REQUIRE(tree.nodes() == 0);
+        }
+
+        SECTION("cursors remain stable/" + std::to_string(block_size)) {
+            for (i32 i = 1; i <= max; ++i)
+                tree.insert(i * 2);
+
+            // Move a cursor across many leaves so that its parents are no longer tracked,
+            // then modify the tree around it.
+            auto cursor = tree.create_cursor(tree.seek_min);
+            for (i32 i = 0; i < max / 2; ++i)
+                cursor.move_next();
+            const i32 value = cursor.get();
+
+            for (i32 i = 1; i <= max; ++i) {
+                tree.insert(i * 2 + 1);
+                if (i % 3 == 0 && i * 2 != value)
+                    tree.find(i * 2).erase();
+            }
+            tree.validate();
+            REQUIRE(cursor.get() == value);
+
+            cursor.erase();
+            REQUIRE(cursor.erased());
+            REQUIRE(!tree.find(value));
+            cursor.move_next();
+            REQUIRE(cursor);
+            REQUIRE(cursor.get() == value + 1);
+            tree.validate();
+        }
+
+        SECTION("bulk loading/" + std::to_string(block_size)) {
+            std::vector<i32> numbers;
+            auto loader = tree.bulk_load();
+            for (i32 i = 0; i < max; ++i) {
+                loader.insert(i);
+                numbers.push_back(i);
+            }
+            loader.finish();
+
+            tree.validate();
+            check_tree_equals_container(tree, numbers);
+            check_tree_equals_container_reverse(tree, numbers);
+        }
+    });
+}
+
+namespace {
+
+// Composite key that is ordered like its serialized representation.
+struct pair_value {
+    u64 major = 0;
+    u64 minor = 0;
+
+    pair_value() = default;
+    pair_value(u64 major_, u64 minor_)
+        : major(major_)
+        , minor(minor_) {}
+
+    static constexpr auto get_binary_format() {
+        return binary_format(&pair_value::major, &pair_value::minor);
+    }
+
+    bool operator<(const pair_value& other) const {
+        return major < other.major || (major == other.major && minor < other.minor);
+    }
+
+    bool operator==(const pair_value& other) const {
+        return major == other.major && minor == other.minor;
+    }
+
+    bool operator!=(const pair_value& other) const { return !(*this == other); }
+
+    friend std::ostream& operator<<(std::ostream& os, const pair_value& v) {
+        return os << "(" << v.major << ", " << v.minor << ")";
+    }
+};
+
+} // namespace
+
+TEST_CASE("btree with prefix compression", "[btree]") {
+    raw_btree_options settings;
+    settings.prefix_compression = true;
+
+    simple_tree_test<pair_value>(settings, [](auto&& tree, u32 block_size) {
+        const u64 max = 20000;
+
+        SECTION("insert and erase/" + std::to_string(block_size)) {
+            std::vector<pair_value> values;
+            for (u64 i = 0; i < max; ++i)
+                values.emplace_back(i / 100, i * 7919);
+
+            std::vector<pair_value> shuffled = values;
+            std::mt19937_64 rng(7);
+            std::shuffle(shuffled.begin(), shuffled.end(), rng);
+            for (const auto& v : shuffled)
+                REQUIRE(tree.insert(v).inserted);
+
+            tree.validate();
+            check_tree_equals_container(tree, values);
+            for (const auto& v : shuffled) {
+                auto cursor = tree.find(v);
+                REQUIRE(cursor);
+                REQUIRE(cursor.get() == v);
+            }
+
+            // Erase most values in random order, the tree shrinks and nodes get merged.
+            std::shuffle(shuffled.begin(), shuffled.end(), rng);
+            shuffled.resize(shuffled.size() - 100);
+            for (const auto& v : shuffled) {
+                auto cursor = tree.find(v);
+                REQUIRE(cursor);
+                cursor.erase();
+            }
+            tree.validate();
+
+            std::sort(shuffled.begin(), shuffled.end());
+            values.erase(std::remove_if(values.begin(), values.end(),
+                                        [&](const pair_value& v) {
+                                            return std::binary_search(shuffled.begin(),
+                                                                      shuffled.end(), v);
+                                        }),
+                         values.end());
+            check_tree_equals_container(tree, values);
+        }
+
+        SECTION("bulk loading/" + std::to_string(block_size)) {
+            std::vector<pair_value> values;
+            auto loader = tree.bulk_load();
+            for (u64 i = 0; i < max; ++i) {
+                values.emplace_back(i / 1000, i);
+                loader.insert(values.back());
+            }
+            loader.finish();
+            tree.validate();
+            check_tree_equals_container(tree, values);
+
+            // Insert in between and behind the loaded values.
+            for (u64 i = 0; i < max; ++i) {
+                pair_value v((i * 13) % (max / 500), max + i);
+                REQUIRE(tree.insert(v).inserted);
+                values.push_back(v);
+            }
+            tree.validate();
+            std::sort(values.begin(), values.end());
+            check_tree_equals_container(tree, values);
+        }
+    });
+}
+
+TEST_CASE("btree prefix compression increases fanout", "[btree]") {
+    auto internal_nodes = [](bool prefix_compression) {
+        test_file file(512);
+
+        node_allocator::anchor alloc_anchor;
+        node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+        raw_btree_options settings;
+        settings.prefix_compression = prefix_compression;
+
+        btree<pair_value>::anchor tree_anchor;
+        btree<pair_value> tree(make_anchor_handle(tree_anchor), alloc, settings);
+
+        auto loader = tree.bulk_load();
+        for (u64 i = 0; i < 100000; ++i)
+            loader.insert(pair_value(i / 10000, i));
+        loader.finish();
+        tree.validate();
+        return tree.internal_nodes();
+    };
+
+    const u64 plain = internal_nodes(false);
+    const u64 compressed = internal_nodes(true);
+    CAPTURE(plain);
+    CAPTURE(compressed);
+    REQUIRE(compressed < plain);
+}
+
+TEST_CASE("btree with leaf prefix compression", "[btree]") {
+    raw_btree_options settings;
+    settings.leaf_prefix_compression = true;
+
+    simple_tree_test<raw_value, derive_key>(settings, [](auto&& tree, u32 block_size) {
+        const u32 max = 20000;
+
+        SECTION("insert and erase/" + std::to_string(block_size)) {
+            std::vector<raw_value> values;
+            for (u32 i = 0; i < max; ++i)
+                values.emplace_back(i * 3, i);
+
+            std::vector<raw_value> shuffled = values;
+            std::mt19937_64 rng(11);
+            std::shuffle(shuffled.begin(), shuffled.end(), rng);
+            for (const auto& v : shuffled)
+                REQUIRE(tree.insert(v).inserted);
+
+            tree.validate();
+            check_tree_equals_container(tree, values);
+            for (const auto& v : shuffled) {
+                auto cursor = tree.find(v.key);
+                REQUIRE(cursor);
+                REQUIRE(cursor.get() == v);
+                REQUIRE(!tree.find(v.key + 1));
+            }
+
+            // Values can be replaced in place.
+            for (auto& v : values) {
+                v.count += 1;
+                tree.find(v.key).set(v);
+            }
+            check_tree_equals_container(tree, values);
+
+            // Erase most values in random order, the tree shrinks and leaves get merged.
+            std::shuffle(shuffled.begin(), shuffled.end(), rng);
+            shuffled.resize(shuffled.size() - 100);
+            for (const auto& v : shuffled) {
+                auto cursor = tree.find(v.key);
+                REQUIRE(cursor);
+                cursor.erase();
+            }
+            tree.validate();
+
+            std::unordered_set<u32> erased;
+            for (const auto& v : shuffled)
+                erased.insert(v.key);
+            values.erase(std::remove_if(values.begin(), values.end(),
+                                        [&](const raw_value& v) { return erased.count(v.key); }),
+                         values.end());
+            check_tree_equals_container(tree, values);
+        }
+
+        SECTION("erase from both ends/" + std::to_string(block_size)) {
+            std::deque<raw_value> values;
+            for (u32 i = 0; i < max; ++i)
+                values.emplace_back(i, i);
+
+            std::vector<raw_value> shuffled(values.begin(), values.end());
+            std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64(13));
+            for (const auto& v : shuffled)
+                tree.insert(v);
+
+            // The leftmost and rightmost leaves grow towards the smallest and largest keys,
+            // their neighbors might have to give up a part of their prefix.
+            while (values.size() > 100) {
+                tree.find(values.front().key).erase();
+                values.pop_front();
+                tree.find(values.back().key).erase();
+                values.pop_back();
+            }
+            tree.validate();
+            check_tree_equals_container(tree, values);
+        }
+
+        SECTION("bulk loading/" + std::to_string(block_size)) {
+            std::vector<raw_value> values;
+            auto loader = tree.bulk_load();
+            for (u32 i = 0; i < max; ++i) {
+                values.emplace_back(i * 2, i);
+                loader.insert(values.back());
+            }
+            REQUIRE_THROWS_AS(loader.insert(raw_value(0, 0)), bad_argument);
+            loader.finish();
+            tree.validate();
+            check_tree_equals_container(tree, values);
+
+            // Insert in between and behind the loaded values.
+            for (u32 i = 0; i < max; ++i) {
+                raw_value v(i * 2 + 1, i);
+                REQUIRE(tree.insert(v).inserted);
+                values.push_back(v);
+            }
+            tree.validate();
+            std::sort(values.begin(), values.end(),
+                      [](const raw_value& a, const raw_value& b) { return a.key < b.key; });
+            check_tree_equals_container(tree, values);
+        }
+    });
+}
+
+TEST_CASE("btree leaf prefix compression requires values that start with their key", "[btree]") {
+    struct derive_count {
+        u32 operator()(const raw_value& v) const { return v.count; }
+    };
+
+    raw_btree_options settings;
+    settings.leaf_prefix_compression = true;
+
+    simple_tree_test<raw_value, derive_count>(settings, [](auto&& tree, u32) {
+        REQUIRE_THROWS_AS(tree.insert(raw_value(1, 2)), bad_argument);
+        REQUIRE(tree.empty());
+    });
+}
+
+TEST_CASE("btree leaf prefix compression reduces the number of leaves", "[btree]") {
+    auto leaf_nodes = [](bool leaf_prefix_compression) {
+        test_file file(512);
+
+        node_allocator::anchor alloc_anchor;
+        node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+        raw_btree_options settings;
+        settings.leaf_prefix_compression = leaf_prefix_compression;
+
+        btree<pair_value>::anchor tree_anchor;
+        btree<pair_value> tree(make_anchor_handle(tree_anchor), alloc, settings);
+
+        auto loader = tree.bulk_load();
+        for (u64 i = 0; i < 100000; ++i)
+            loader.insert(pair_value(i / 10000, i));
+        loader.finish();
+        tree.validate();
+        return tree.leaf_nodes();
+    };
+
+    const u64 plain = leaf_nodes(false);
+    const u64 compressed = leaf_nodes(true);
+    CAPTURE(plain);
+    CAPTURE(compressed);
+    REQUIRE(compressed < plain);
+}
+
+TEST_CASE("btree with subtree sizes", "[btree]") {
+    raw_btree_options settings;
+    settings.counted = true;
+
+    simple_tree_test<i32>(settings, [](auto&& tree, u32 block_size) {
+        REQUIRE(tree.counted());
+
+        const i32 max = 5000;
+
+        auto check_ranks = [&](const std::vector<i32>& sorted) {
+            tree.validate();
+            REQUIRE(tree.size() == sorted.size());
+            for (u64 i = 0; i < sorted.size(); ++i) {
+                auto cursor = tree.select(i);
+                REQUIRE(cursor);
+                REQUIRE(cursor.get() == sorted[i]);
+                REQUIRE(tree.rank(sorted[i]) == i);
+            }
+            REQUIRE(!tree.select(sorted.size()));
+        };
+
+        SECTION("insert, erase and rank/" + std::to_string(block_size)) {
+            std::vector<i32> numbers;
+            for (i32 i = 0; i < max; ++i)
+                numbers.push_back(i * 2);
+
+            std::mt19937_64 rng(block_size);
+            std::shuffle(numbers.begin(), numbers.end(), rng);
+            for (i32 n : numbers)
+                tree.insert(n);
+
+            std::sort(numbers.begin(), numbers.end());
+            check_ranks(numbers);
+
+            // Keys that are not in the tree.
+            REQUIRE(tree.rank(-1) == 0);
+            REQUIRE(tree.rank(1) == 1);
+            REQUIRE(tree.rank(max * 2) == u64(max));
+            REQUIRE(tree.count(-100, max * 2) == u64(max));
+            REQUIRE(tree.count(10, 20) == 5);
+            REQUIRE(tree.count(11, 21) == 5);
+            REQUIRE(tree.count(20, 10) == 0);
+            REQUIRE(tree.count(20, 20) == 0);
+
+            // Erase a random half of the values.
+            std::shuffle(numbers.begin(), numbers.end(), rng);
+            for (size_t i = 0; i < size_t(max / 2); ++i)
+                tree.find(numbers[i]).erase();
+            numbers.erase(numbers.begin(), numbers.begin() + max / 2);
+
+            std::sort(numbers.begin(), numbers.end());
+            check_ranks(numbers);
+
+            for (i32 n : numbers)
+                tree.find(n).erase();
+            tree.validate();
+            REQUIRE(tree.empty());
+            REQUIRE(tree.rank(0) == 0);
+            REQUIRE(!tree.select(0));
+        }
+
+        SECTION("bulk loading/" + std::to_string(block_size)) {
+            std::vector<i32> numbers;
+            auto loader = tree.bulk_load();
+            for (i32 i = 0; i < max; ++i) {
+                loader.insert(i);
+                numbers.push_back(i);
+            }
+            loader.finish();
+            check_ranks(numbers);
+
+            // Sizes stay correct for modifications after loading.
+            for (i32 i = 0; i < max; i += 3)
+                tree.find(i).erase();
+            for (i32 i = max; i < max + 100; ++i)
+                REQUIRE(tree.insert(i).inserted);
+
+            numbers.erase(std::remove_if(numbers.begin(), numbers.end(),
+                                         [](i32 n) { return n % 3 == 0; }),
+                          numbers.end());
+            for (i32 i = max; i < max + 100; ++i)
+                numbers.push_back(i);
+            check_ranks(numbers);
+        }
+    });
+}
+
+TEST_CASE("btree range count without subtree sizes", "[btree]") {
+    simple_tree_test<i32>([](auto&& tree, u32 block_size) {
+        (void) block_size;
+        REQUIRE(!tree.counted());
+
+        for (i32 i = 0; i < 1000; ++i)
+            tree.insert(i * 2);
+
+        REQUIRE(tree.count(-100, 5000) == 1000);
+        REQUIRE(tree.count(10, 20) == 5);
+        REQUIRE(tree.count(11, 21) == 5);
+        REQUIRE(tree.count(20, 10) == 0);
+        REQUIRE_THROWS_AS(tree.rank(0), bad_operation);
+        REQUIRE_THROWS_AS(tree.select(0), bad_operation);
+    });
+}
+
+namespace {
+
+std::vector<raw_btree_options> loader_test_settings() {
+    std::vector<raw_btree_options> result(6);
+    result[1].linked_leaves = true;
+    result[2].counted = true;
+    result[3].prefix_compression = true;
+    result[4].filter_bits_per_key = 10;
+    result[5].leaf_prefix_compression = true;
+    return result;
+}
+
+} // namespace
+
+TEST_CASE("btree with key filter", "[btree]") {
+    raw_btree_options settings;
+    settings.filter_bits_per_key = 10;
+
+    simple_tree_test<i32>(settings, [](auto&& tree, u32 block_size) {
+        REQUIRE(tree.filtered());
+
+        const i32 max = 10000;
+        SECTION("lookups/" + std::to_string(block_size)) {
+            for (i32 i = 0; i < max; ++i)
+                tree.insert(i * 3);
+            tree.validate();
+            REQUIRE(tree.byte_size() > tree.nodes() * block_size);
+
+            for (i32 i = 0; i < max * 3; ++i) {
+                auto cursor = tree.find(i);
+                if (i % 3 == 0) {
+                    REQUIRE(cursor);
+                    REQUIRE(cursor.get() == i);
+                } else {
+                    REQUIRE(!cursor);
+                }
+            }
+
+            // Erased keys remain in the filter, but they are not found.
+            for (i32 i = 0; i < max; i += 2)
+                tree.find(i * 3).erase();
+            tree.validate();
+            for (i32 i = 0; i < max; ++i)
+                REQUIRE(bool(tree.find(i * 3)) == (i % 2 == 1));
+
+            tree.clear();
+            tree.validate();
+            REQUIRE(tree.byte_size() == 0);
+            REQUIRE(!tree.find(3));
+
+            tree.insert(3);
+            tree.validate();
+            REQUIRE(tree.find(3));
+        }
+
+        SECTION("bulk loading/" + std::to_string(block_size)) {
+            auto loader = tree.bulk_load();
+            for (i32 i = 0; i < max; ++i)
+                loader.insert(i * 2);
+            loader.finish();
+            tree.validate();
+
+            for (i32 i = 0; i < max * 2; ++i)
+                REQUIRE(bool(tree.find(i)) == (i % 2 == 0));
+        }
+    });
+}
+
+TEST_CASE("btree key filter uses the key order's equality", "[btree]") {
+    raw_btree_options settings;
+    settings.filter_bits_per_key = 10;
+
+    simple_tree_test<double>(settings, [](auto&& tree, u32) {
+        // 0.0 and -0.0 are equal keys with different serialized representations.
+        tree.insert(0.0);
+        tree.insert(1.5);
+        REQUIRE(tree.find(-0.0));
+        REQUIRE(tree.find(0.0));
+        REQUIRE(!tree.find(-1.5));
+
+        REQUIRE(!tree.insert(-0.0).inserted);
+        REQUIRE(tree.size() == 2);
+        tree.validate();
+    });
+}
+
+TEST_CASE("btree key filter with a custom key order", "[btree]") {
+    // Orders keys by their absolute value, i.e. 3 and -3 are equal.
+    struct abs_less {
+        bool operator()(i32 a, i32 b) const { return std::abs(a) < std::abs(b); }
+    };
+    using tree_t = btree<i32, indexed_by_identity, abs_less>;
+
+    test_file file(512);
+    node_allocator::anchor alloc_anchor;
+    node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    raw_btree_options settings;
+    settings.filter_bits_per_key = 10;
+
+    tree_t::anchor tree_anchor;
+    tree_t::filter_anchor filter_anchor;
+    REQUIRE_THROWS_AS(
+        tree_t(make_anchor_handle(tree_anchor), make_anchor_handle(filter_anchor), alloc, settings),
+        bad_argument);
+
+    settings.key_hash = [](const byte* key, void*) {
+        return fnv_1a(std::abs(deserialize<i32>(key)));
+    };
+    tree_t tree(make_anchor_handle(tree_anchor), make_anchor_handle(filter_anchor), alloc,
+                settings);
+    REQUIRE(tree.filtered());
+    for (i32 i = 0; i < 1000; ++i)
+        tree.insert(i);
+    tree.validate();
+
+    for (i32 i = 0; i < 1000; ++i)
+        REQUIRE(tree.find(-i));
+    REQUIRE(!tree.find(-1000));
+}
+
+TEST_CASE("btree key filter can be changed for existing trees", "[btree]") {
+    test_file file(512);
+
+    node_allocator::anchor alloc_anchor;
+    node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    // The filter lives in its own anchor, the layout of the tree's anchor is unchanged.
+    REQUIRE(serialized_size<btree<i32>::anchor>() == 48);
+
+    raw_btree_options settings;
+    btree<i32>::anchor tree_anchor;
+    btree<i32>::filter_anchor filter_anchor;
+    {
+        btree<i32> tree(make_anchor_handle(tree_anchor), alloc, settings);
+        REQUIRE(!tree.filtered());
+        for (i32 i = 0; i < 1000; ++i)
+            tree.insert(i * 2);
+    }
+
+    settings.filter_bits_per_key = 12;
+    REQUIRE_THROWS_AS(btree<i32>(make_anchor_handle(tree_anchor), alloc, settings), bad_argument);
+    {
+        btree<i32> tree(make_anchor_handle(tree_anchor), make_anchor_handle(filter_anchor), alloc,
+                        settings);
+        REQUIRE(tree.filtered());
+        REQUIRE(tree.byte_size() > tree.nodes() * 512);
+        tree.validate();
+        REQUIRE(tree.find(998));
+        REQUIRE(!tree.find(999));
+    }
+
+    settings.filter_bits_per_key = 0;
+    {
+        btree<i32> tree(make_anchor_handle(tree_anchor), make_anchor_handle(filter_anchor), alloc,
+                        settings);
+        REQUIRE(!tree.filtered());
+        REQUIRE(tree.byte_size() == tree.nodes() * 512);
+        tree.validate();
+        REQUIRE(tree.find(998));
+    }
+}
+
+TEST_CASE("btree append loading", "[btree][bulk-loading]") {
+    for (const auto& settings : loader_test_settings()) {
+        simple_tree_test<i32>(settings, [](auto&& tree, u32 block_size) {
+            // Existing trees of different heights.
+            for (i32 existing : {1, 10, 1000, 20000}) {
+                SECTION("append/" + std::to_string(existing) + "/" + std::to_string(block_size)) {
+                    std::vector<i32> numbers;
+                    for (i32 i = 0; i < existing; ++i) {
+                        tree.insert(i * 2);
+                        numbers.push_back(i * 2);
+                    }
+
+                    auto first = tree.create_cursor(tree.seek_min);
+                    auto last = tree.create_cursor(tree.seek_max);
+
+                    auto loader = tree.bulk_append();
+                    REQUIRE_THROWS_AS(loader.insert(existing * 2 - 2), bad_argument);
+                    for (i32 i = existing * 2; i < existing * 4; ++i) {
+                        loader.insert(i);
+                        numbers.push_back(i);
+                    }
+                    loader.finish();
+
+                    tree.validate();
+                    check_tree_equals_container(tree, numbers);
+                    check_tree_equals_container_reverse(tree, numbers);
+                    REQUIRE(first.get() == 0);
+                    REQUIRE(last.get() == existing * 2 - 2);
+                    if (tree.counted())
+                        REQUIRE(tree.rank(existing * 2) == u64(existing));
+
+                    // The tree remains fully functional.
+                    last.move_next();
+                    REQUIRE(last.get() == existing * 2);
+                    last.erase();
+                    first.erase();
+                    for (i32 i = 0; i < existing; ++i)
+                        tree.insert(i * 2 + 1);
+                    tree.validate();
+                    REQUIRE(tree.size() == numbers.size() - 2 + size_t(existing));
+                }
+            }
+
+            SECTION("discard/" + std::to_string(block_size)) {
+                std::vector<i32> numbers;
+                for (i32 i = 0; i < 5000; ++i) {
+                    tree.insert(i);
+                    numbers.push_back(i);
+                }
+                const u64 nodes = tree.nodes();
+
+                auto loader = tree.bulk_append();
+                for (i32 i = 5000; i < 20000; ++i)
+                    loader.insert(i);
+                loader.discard();
+
+                tree.validate();
+                REQUIRE(tree.nodes() == nodes);
+                check_tree_equals_container(tree, numbers);
+            }
+
+            SECTION("empty tree/" + std::to_string(block_size)) {
+                std::vector<i32> numbers;
+                auto loader = tree.bulk_append();
+                for (i32 i = 0; i < 1000; ++i) {
+                    loader.insert(i);
+                    numbers.push_back(i);
+                }
+                loader.finish();
+
+                tree.validate();
+                check_tree_equals_container(tree, numbers);
+            }
+        });
+    }
+}
+
+TEST_CASE("btree sorted batch insertion", "[btree]") {
+    for (const auto& settings : loader_test_settings()) {
+        simple_tree_test<i32>(settings, [](auto&& tree, u32 block_size) {
+            SECTION("merge/" + std::to_string(block_size)) {
+                std::set<i32> numbers;
+                for (i32 i = 0; i < 3000; ++i) {
+                    tree.insert(i * 3);
+                    numbers.insert(i * 3);
+                }
+
+                auto cursor = tree.find(4500);
+                REQUIRE(cursor);
+
+                // Overlaps with the existing values and extends beyond the maximum.
+                // Contains duplicates and keys that already exist.
+                std::vector<i32> batch;
+                for (i32 i = -1000; i < 12000; ++i) {
+                    if (i % 3 != 1)
+                        batch.push_back(i);
+                    if (i % 7 == 0)
+                        batch.push_back(i);
+                }
+
+                u64 expected = 0;
+                for (i32 i : batch)
+                    expected += numbers.insert(i).second;
+
+                REQUIRE(tree.insert_sorted_batch(batch.begin(), batch.end()) == expected);
+                tree.validate();
+                check_tree_equals_container(tree, numbers);
+                REQUIRE(cursor.get() == 4500);
+                if (tree.counted())
+                    REQUIRE(tree.rank(4500) == u64(std::distance(numbers.begin(),
+                                                                 numbers.find(4500))));
+
+                REQUIRE(tree.insert_sorted_batch(batch.begin(), batch.end()) == 0);
+            }
+
+            SECTION("unsorted input/" + std::to_string(block_size)) {
+                std::vector<i32> batch{1, 2, 3, 2};
+                REQUIRE_THROWS_AS(tree.insert_sorted_batch(batch.begin(), batch.end()),
+                                  bad_argument);
+                tree.validate();
+                REQUIRE(tree.size() == 3);
+
+                // The input is converted in chunks, unsorted chunk boundaries are detected as well.
+                batch.clear();
+                for (i32 i = 0; i < 1024; ++i)
+                    batch.push_back(10000 + i);
+                for (i32 i = 0; i < 10; ++i)
+                    batch.push_back(100 + i);
+                REQUIRE_THROWS_AS(tree.insert_sorted_batch(batch.begin(), batch.end()),
+                                  bad_argument);
+                tree.validate();
+                REQUIRE(tree.size() == 3 + 1024);
+            }
+        });
+    }
+}
+
+TEST_CASE("btree batched lookup", "[btree]") {
+    for (const auto& settings : loader_test_settings()) {
+        simple_tree_test<i32>(settings, [](auto&& tree, u32 block_size) {
+            std::vector<i32> keys;
+            REQUIRE(tree.find_many(keys.begin(), keys.end()).empty());
+
+            for (i32 i = -10; i < 30000; ++i)
+                keys.push_back(i);
+            std::mt19937_64 rng(block_size);
+            std::shuffle(keys.begin(), keys.end(), rng);
+            keys.push_back(keys[0]);
+
+            for (u32 size : {0u, 1u, 100u, 10000u}) {
+                SECTION("lookup/" + std::to_string(size) + "/" + std::to_string(block_size)) {
+                    for (u32 i = 0; i < size; ++i)
+                        tree.insert(i32(i * 2));
+
+                    auto result = tree.find_many(keys.begin(), keys.end());
+                    REQUIRE(result.size() == keys.size());
+                    for (size_t i = 0; i < keys.size(); ++i) {
+                        const i32 key = keys[i];
+                        if (key >= 0 && key < i32(size * 2) && key % 2 == 0) {
+                            REQUIRE(result[i]);
+                            REQUIRE(*result[i] == key);
+                        } else {
+                            REQUIRE(!result[i]);
+                        }
+                    }
+                }
+            }
+        });
+    }
+}
+
+TEST_CASE("btree range erase", "[btree]") {
+    for (const auto& settings : loader_test_settings()) {
+        simple_tree_test<i32>(settings, [](auto&& tree, u32 block_size) {
+            std::set<i32> numbers;
+            for (i32 i = 0; i < 20000; ++i) {
+                tree.insert(i * 2);
+                numbers.insert(i * 2);
+            }
+
+            auto erase_range = [&](i32 lower, i32 upper) {
+                const u64 expected = tree.count(lower, upper);
+                REQUIRE(tree.erase_range(lower, upper) == expected);
+                if (lower < upper)
+                    numbers.erase(numbers.lower_bound(lower), numbers.lower_bound(upper));
+                tree.validate();
+                REQUIRE(tree.count(lower, upper) == 0);
+            };
+
+            SECTION("ranges/" + std::to_string(block_size)) {
+                auto inside = tree.find(10000);
+                auto before = tree.find(9998);
+                auto after = tree.find(30000);
+
+                // Whole leaves in the middle of the range are freed.
+                const u64 nodes = tree.nodes();
+                erase_range(9999, 30000);
+                REQUIRE(tree.nodes() < nodes);
+                check_tree_equals_container(tree, numbers);
+                REQUIRE(inside.erased());
+                REQUIRE(before.get() == 9998);
+                REQUIRE(after.get() == 30000);
+
+                // Small ranges, empty ranges and the ends of the tree.
+                erase_range(501, 507);
+                erase_range(40000, 50000);
+                erase_range(800, 800);
+                erase_range(900, 700);
+                erase_range(-100, 300);
+                erase_range(39000, 40000);
+                check_tree_equals_container(tree, numbers);
+                check_tree_equals_container_reverse(tree, numbers);
+
+                // The tree remains fully functional.
+                for (i32 i = 10000; i < 20000; ++i) {
+                    tree.insert(i * 2 + 1);
+                    numbers.insert(i * 2 + 1);
+                }
+                tree.validate();
+                check_tree_equals_container(tree, numbers);
+            }
+
+            SECTION("many ranges/" + std::to_string(block_size)) {
+                for (i32 i = 0; i < 40000; i += 1000)
+                    erase_range(i + 13, i + 13 + (i / 1000) * 20);
+                check_tree_equals_container(tree, numbers);
+            }
+
+            SECTION("random ranges/" + std::to_string(block_size)) {
+                // Cursors on erased values point to the first value after the range.
+                struct tracked_cursor {
+                    decltype(tree.create_cursor()) cursor;
+                    i32 value = 0;
+                    bool erased = false;
+                };
+                std::vector<tracked_cursor> cursors;
+                for (i32 i = 0; i < 40000; i += 98)
+                    cursors.push_back({tree.find(i), i, false});
+
+                std::mt19937_64 rng(5);
+                for (u32 i = 0; i < 20; ++i) {
+                    const i32 lower = static_cast<i32>(rng() % 40000);
+                    const i32 upper = lower + static_cast<i32>(rng() % 8000);
+                    erase_range(lower, upper);
+
+                    for (auto& t : cursors) {
+                        if (t.erased || t.value < lower || t.value >= upper)
+                            continue;
+
+                        t.erased = true;
+                        REQUIRE(t.cursor.erased());
+                        auto next = t.cursor;
+                        next.move_next();
+                        auto pos = numbers.lower_bound(upper);
+                        if (pos == numbers.end()) {
+                            REQUIRE(next.at_end());
+                        } else {
+                            REQUIRE(next.get() == *pos);
+                        }
+                    }
+                }
+                for (auto& t : cursors) {
+                    REQUIRE(t.cursor.erased() == t.erased);
+                    if (!t.erased)
+                        REQUIRE(t.cursor.get() == t.value);
+                }
+                check_tree_equals_container(tree, numbers);
+                check_tree_equals_container_reverse(tree, numbers);
+            }
+
+            SECTION("everything/" + std::to_string(block_size)) {
+                erase_range(std::numeric_limits<i32>::min(), std::numeric_limits<i32>::max());
+                REQUIRE(tree.empty());
+                REQUIRE(tree.nodes() == 0);
+            }
+        });
+    }
+}
+
+TEST_CASE("btree compaction", "[btree]") {
+    for (const auto& settings : loader_test_settings()) {
+        test_file file(512);
+
+        default_allocator::anchor alloc_anchor;
+        default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+        btree<i32>::anchor tree_anchor;
+        btree<i32>::filter_anchor filter_anchor;
+        btree<i32> tree(make_anchor_handle(tree_anchor), make_anchor_handle(filter_anchor), alloc,
+                        settings);
+        REQUIRE(tree.compact(10));
+
+        // Number of leaves that do not directly follow their predecessor (in key order) on disk.
+        auto gaps = [&] {
+            u64 result = 0;
+            block_index last;
+            tree.visit([&](const auto& node) {
+                if (node.is_leaf()) {
+                    if (last && node.address() != last + 1)
+                        ++result;
+                    last = node.address();
+                }
+                return true;
+            });
+            return result;
+        };
+
+        std::vector<i32> numbers = generate_numbers(20000, 1);
+        std::set<i32> expected;
+        for (i32 n : numbers) {
+            tree.insert(n);
+            expected.insert(n);
+        }
+        for (size_t i = 0; i < numbers.size(); i += 3) {
+            tree.find(numbers[i]).erase();
+            expected.erase(numbers[i]);
+        }
+        tree.validate();
+
+        const u64 leaves = tree.leaf_nodes();
+        const u64 initial_gaps = gaps();
+        auto cursor = tree.find(numbers[1]);
+        REQUIRE(cursor);
+
+        // The tree remains usable between calls.
+        u64 calls = 1;
+        for (; !tree.compact(64); ++calls) {
+            tree.validate();
+            tree.insert(numbers[calls * 3]);
+            expected.insert(numbers[calls * 3]);
+        }
+        tree.validate();
+        check_tree_equals_container(tree, expected);
+        REQUIRE(cursor.get() == numbers[1]);
+
+        CAPTURE(initial_gaps);
+        CAPTURE(gaps());
+        CAPTURE(calls);
+        REQUIRE(tree.leaf_nodes() < leaves);
+        REQUIRE(gaps() < initial_gaps / 10);
+
+        // A compact tree remains unchanged.
+        const u64 final_gaps = gaps();
+        REQUIRE(tree.compact(tree.leaf_nodes()));
+        tree.validate();
+        REQUIRE(gaps() <= final_gaps);
+
+        // The compaction extent is limited by the number of leaves, not by the budget.
+        for (size_t i = 0; i < numbers.size(); i += 3)
+            tree.insert(numbers[i]);
+        const u64 file_size = file.get_engine().size();
+        const u64 leaf_nodes = tree.leaf_nodes();
+        REQUIRE(tree.compact(1000000));
+        tree.validate();
+        CAPTURE(file_size);
+        CAPTURE(leaf_nodes);
+        REQUIRE(file.get_engine().size() <= file_size + 2 * leaf_nodes);
+    }
+}
+
+TEST_CASE("btree compaction with leaf prefix compression", "[btree]") {
+    test_file file(128);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    raw_btree_options settings;
+    settings.leaf_prefix_compression = true;
+
+    btree<raw_value, derive_key>::anchor tree_anchor;
+    btree<raw_value, derive_key> tree(make_anchor_handle(tree_anchor), alloc, settings);
+
+    std::vector<raw_value> values;
+    for (u32 i = 0; i < 20000; ++i)
+        values.emplace_back(i * 3, i);
+
+    std::vector<raw_value> shuffled = values;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64(17));
+    for (const auto& v : shuffled)
+        tree.insert(v);
+
+    // Sparse leaves are merged with their right neighbors. The key ranges (and
+    // therefore the prefixes) of the full leaves that follow must not change.
+    std::vector<raw_value> remaining;
+    for (u32 i = 0; i < values.size(); ++i) {
+        if ((i / 40) % 4 == 0 || ((i / 40) % 4 == 1 && i % 7 == 0)) {
+            remaining.push_back(values[i]);
+        } else {
+            tree.find(values[i].key).erase();
+        }
+    }
+    tree.validate();
+
+    while (!tree.compact(8))
+        tree.validate();
+    tree.validate();
+    check_tree_equals_container(tree, remaining);
+}
+
+TEST_CASE("btree lazy cursors survive compaction", "[btree]") {
+    test_file file(512);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    btree<i32>::anchor tree_anchor;
+    btree<i32> tree(make_anchor_handle(tree_anchor), alloc);
+
+    std::vector<i32> numbers = generate_numbers(20000, 7);
+    std::set<i32> expected;
+    for (i32 n : numbers) {
+        tree.insert(n);
+        expected.insert(n);
+    }
+    for (size_t i = 0; i < numbers.size(); i += 2) {
+        tree.find(numbers[i]).erase();
+        expected.erase(numbers[i]);
+    }
+
+    // Step through the tree while leaves are merged and moved around the cursor.
+    auto cursor = tree.create_lazy_cursor(tree.seek_min);
+    auto pos = expected.begin();
+    while (!tree.compact(4)) {
+        REQUIRE(pos != expected.end());
+        REQUIRE(cursor.get() == *pos);
+        cursor.move_next();
+        ++pos;
+    }
+    tree.validate();
+
+    for (; pos != expected.end(); ++pos, cursor.move_next())
+        REQUIRE(cursor.get() == *pos);
+    REQUIRE(cursor.at_end());
+}
+
+TEST_CASE("btree bulk load fill factor", "[btree][bulk-loading]") {
+    for (auto settings : loader_test_settings()) {
+        settings.bulk_load_fill_factor = 0.7;
+
+        simple_tree_test<i32>(settings, [&](auto&& tree, u32 block_size) {
+            std::vector<i32> numbers;
+            auto loader = tree.bulk_load();
+            for (i32 i = 0; i < 20000; ++i) {
+                loader.insert(i * 2);
+                numbers.push_back(i * 2);
+            }
+            loader.finish();
+            tree.validate();
+            check_tree_equals_container(tree, numbers);
+
+            CAPTURE(block_size);
+            CAPTURE(tree.fill_factor());
+            if (!settings.leaf_prefix_compression) // Compressed leaves exceed the capacity.
+                REQUIRE((tree.fill_factor() > 0.6 && tree.fill_factor() < 0.8));
+
+            // Values can be inserted into the loaded leaves without splitting them.
+            const u64 leaves = tree.leaf_nodes();
+            for (i32 i = 0; i < 20000; i += 50)
+                tree.insert(i * 2 + 1);
+            tree.validate();
+            REQUIRE(tree.leaf_nodes() == leaves);
+        });
+    }
+
+    raw_btree_options settings;
+    settings.bulk_load_fill_factor = 0;
+    REQUIRE_THROWS_AS(simple_tree_test<i32>(settings, [](auto&&, u32) {}), bad_argument);
+    settings.bulk_load_fill_factor = 1.5;
+    REQUIRE_THROWS_AS(simple_tree_test<i32>(settings, [](auto&&, u32) {}), bad_argument);
+}
+
+TEST_CASE("btree adaptive splits", "[btree]") {
+    // Every tenant inserts ascending timestamps, i.e. in the middle of the tree.
+    auto fill_factor = [](bool adaptive_splits) {
+        test_file file(512);
+
+        node_allocator::anchor alloc_anchor;
+        node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+        raw_btree_options settings;
+        settings.min_leaf_fill_factor = 0.1;
+        settings.adaptive_splits = adaptive_splits;
+
+        btree<i32>::anchor tree_anchor;
+        btree<i32> tree(make_anchor_handle(tree_anchor), alloc, settings);
+        for (i32 time = 0; time < 5000; ++time) {
+            for (i32 tenant = 0; tenant < 16; ++tenant)
+                tree.insert(tenant * 100000 + time);
+        }
+        tree.validate();
+        REQUIRE(tree.size() == 16 * 5000);
+        return tree.fill_factor();
+    };
+
+    const double plain = fill_factor(false);
+    const double adaptive = fill_factor(true);
+    CAPTURE(plain);
+    CAPTURE(adaptive);
+    REQUIRE(plain < 0.7);
+    REQUIRE(adaptive > 0.85);
+}
+
+TEST_CASE("btree with a low minimum leaf fill factor", "[btree]") {
+    raw_btree_options settings;
+    settings.min_leaf_fill_factor = 0.2;
+    settings.adaptive_splits = true;
+
+    simple_tree_test<i32>(settings, [](auto&& tree, u32 block_size) {
+        std::vector<i32> numbers = generate_numbers(20000, i32(block_size));
+        std::set<i32> expected;
+        for (i32 n : numbers) {
+            tree.insert(n);
+            expected.insert(n);
+        }
+        tree.validate();
+
+        // Leaves are only merged when they become almost empty.
+        const u64 leaves = tree.leaf_nodes();
+        for (size_t i = 0; i < numbers.size(); i += 2) {
+            tree.find(numbers[i]).erase();
+            expected.erase(numbers[i]);
+        }
+        tree.validate();
+        check_tree_equals_container(tree, expected);
+        REQUIRE(tree.leaf_nodes() > leaves * 3 / 4);
+
+        for (size_t i = 1; i < numbers.size(); i += 2) {
+            tree.find(numbers[i]).erase();
+            expected.erase(numbers[i]);
+            if (i % 1000 == 1)
+                tree.validate();
+        }
+        tree.validate();
+        REQUIRE(tree.empty());
+    });
+
+    settings.min_leaf_fill_factor = 0.6;
+    REQUIRE_THROWS_AS(simple_tree_test<i32>(settings, [](auto&&, u32) {}), bad_argument);
+}
+
+TEST_CASE("btree parallel bulk loading", "[btree][bulk-loading]") {
+    for (const auto& settings : loader_test_settings()) {
+        simple_tree_test<i32>(settings, [](auto&& tree, u32 block_size) {
+            for (u32 threads : {1u, 4u}) {
+                SECTION("load/" + std::to_string(threads) + "/" + std::to_string(block_size)) {
+                    std::vector<i32> numbers;
+                    for (i32 i = 0; i < 100000; ++i)
+                        numbers.push_back(i);
+
+                    // Mix with sequential inserts so that the parallel part
+                    // starts within a partially filled leaf.
+                    auto loader = tree.bulk_load();
+                    loader.insert(numbers.begin(), numbers.begin() + 7);
+                    loader.insert_parallel(numbers.begin() + 7, numbers.begin() + 60000, threads);
+                    loader.insert(numbers.begin() + 60000, numbers.begin() + 60003);
+                    loader.insert_parallel(numbers.begin() + 60003, numbers.end(), threads);
+                    loader.finish();
+
+                    tree.validate();
+                    check_tree_equals_container(tree, numbers);
+                    check_tree_equals_container_reverse(tree, numbers);
+                }
+            }
+
+            SECTION("append/" + std::to_string(block_size)) {
+                std::vector<i32> numbers;
+                for (i32 i = 0; i < 1000; ++i) {
+                    tree.insert(i);
+                    numbers.push_back(i);
+                }
+                for (i32 i = 1000; i < 50000; ++i)
+                    numbers.push_back(i);
+
+                auto loader = tree.bulk_append();
+                loader.insert_parallel(numbers.begin() + 1000, numbers.end(), 3);
+                loader.finish();
+
+                tree.validate();
+                check_tree_equals_container(tree, numbers);
+            }
+
+            SECTION("discard/" + std::to_string(block_size)) {
+                std::vector<i32> numbers;
+                for (i32 i = 0; i < 50000; ++i)
+                    numbers.push_back(i);
+
+                auto loader = tree.bulk_load();
+                loader.insert_parallel(numbers.begin(), numbers.end(), 4);
+                loader.discard();
+                REQUIRE(tree.nodes() == 0);
+            }
+        });
+    }
+}
+
+TEST_CASE("btree lazy cursors", "[btree]") {
+    simple_tree_test<i32>([](auto&& tree, u32 block_size) {
+        const i32 max = 2000;
+        for (i32 i = 0; i < max; ++i)
+            tree.insert(i * 4);
+
+        SECTION("reposition after modifications/" + std::to_string(block_size)) {
+            auto cursor = tree.create_lazy_cursor();
+            REQUIRE(cursor.lazy());
+            REQUIRE(cursor.lower_bound(1001));
+            REQUIRE(cursor.get() == 1004);
+
+            auto copy = cursor;
+            REQUIRE(copy.lazy());
+
+            // Splits and merges all around the cursor's value.
+            for (i32 i = 0; i < max; ++i)
+                tree.insert(i * 4 + 1);
+            for (i32 i = 0; i < max; i += 2)
+                tree.find(i * 4 + 1).erase();
+            tree.validate();
+            REQUIRE(cursor.get() == 1004);
+            REQUIRE(copy == cursor);
+
+            // The value is erased by someone else.
+            tree.find(1004).erase();
+            REQUIRE(cursor.erased());
+            REQUIRE(!cursor.at_end());
+            REQUIRE_THROWS_AS(cursor.get(), bad_cursor);
+            cursor.move_next();
+            REQUIRE(cursor.get() == 1005);
+
+            copy.move_prev();
+            REQUIRE(copy.get() == 1000);
+
+            // Erase through the lazy cursor itself.
+            cursor.erase();
+            REQUIRE(cursor.erased());
+            tree.insert(1006);
+            cursor.move_next();
+            REQUIRE(cursor.get() == 1006);
+            tree.validate();
+        }
+
+        SECTION("modifications next to the cursor/" + std::to_string(block_size)) {
+            // Small modifications usually leave the cursor's leaf intact; the cursor
+            // only has to find its new index within that leaf.
+            auto cursor = tree.create_lazy_cursor();
+            REQUIRE(cursor.find(4000));
+
+            tree.insert(3999);
+            REQUIRE(cursor.get() == 4000);
+            tree.find(3996).erase();
+            tree.find(3999).erase();
+            REQUIRE(cursor.get() == 4000);
+            cursor.move_prev();
+            REQUIRE(cursor.get() == 3992);
+
+            tree.find(3992).erase();
+            REQUIRE(cursor.erased());
+            tree.insert(3993);
+            cursor.move_next();
+            REQUIRE(cursor.get() == 3993);
+
+            // The successor of an erased value in the last position of its leaf.
+            cursor.move_max();
+            REQUIRE(cursor.get() == (max - 1) * 4);
+            tree.find((max - 1) * 4).erase();
+            REQUIRE(cursor.erased());
+            cursor.move_next();
+            REQUIRE(cursor.at_end());
+            tree.validate();
+        }
+
+        SECTION("iterate while modifying/" + std::to_string(block_size)) {
+            // Double every value during a forward scan.
+            std::vector<i32> expected;
+            auto cursor = tree.create_lazy_cursor(tree.seek_min);
+            for (; cursor; cursor.move_next()) {
+                const i32 value = cursor.get();
+                if (value % 8 == 0) {
+                    tree.insert(value + 1);
+                    expected.push_back(value);
+                    expected.push_back(value + 1);
+                } else if (value % 4 == 0) {
+                    cursor.erase();
+                }
+            }
+            tree.validate();
+            check_tree_equals_container(tree, expected);
+
+            // Erase everything, the cursor ends up at the end.
+            cursor.move_min();
+            tree.clear();
+            REQUIRE(cursor.erased());
+            cursor.move_next();
+            REQUIRE(cursor.at_end());
+        }
+    });
+}
+
+TEST_CASE("btree lazy cursors survive splits of failed insertions", "[btree]") {
+    simple_tree_test<i32>([](auto&& tree, u32 block_size) {
+        CAPTURE(block_size);
+
+        std::vector<i32> numbers = generate_numbers(20000, 3);
+        std::set<i32> expected;
+        auto cursor = tree.create_lazy_cursor();
+        for (size_t i = 0; i < numbers.size(); ++i) {
+            tree.insert(numbers[i]);
+            expected.insert(numbers[i]);
+            if (i % 7 != 0)
+                continue;
+
+            // Inserting an existing key splits full internal nodes on the way down,
+            // even though no value is inserted.
+            const i32 key = numbers[i / 2];
+            REQUIRE(cursor.find(key));
+            REQUIRE(!tree.insert(numbers[i / 3]).inserted);
+            REQUIRE(!tree.insert_or_update(numbers[i / 4]).inserted);
+
+            cursor.move_next();
+            auto next = expected.upper_bound(key);
+            if (next == expected.end()) {
+                REQUIRE(cursor.at_end());
+            } else {
+                REQUIRE(cursor.get() == *next);
+            }
+        }
+        tree.validate();
+    });
+}
+
+TEST_CASE("btree lazy cursors are invalidated with their tree", "[btree]") {
+    test_file file(512);
+
+    node_allocator::anchor alloc_anchor;
+    node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    btree<i32>::anchor tree_anchor;
+    btree<i32>::cursor cursor;
+    {
+        btree<i32> tree(make_anchor_handle(tree_anchor), alloc);
+        tree.insert(1);
+        cursor = tree.create_lazy_cursor(btree<i32>::seek_min);
+        REQUIRE(cursor.get() == 1);
+    }
+    REQUIRE_THROWS_AS(cursor.get(), bad_cursor);
+    REQUIRE_THROWS_AS(cursor.move_next(), bad_cursor);
+}
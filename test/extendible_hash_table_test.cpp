@@ -0,0 +1,132 @@
+#include <catch.hpp>
+
+#include <prequel/container/default_allocator.hpp>
+#include <prequel/container/extendible_hash_table.hpp>
+#include <prequel/exception.hpp>
+#include <prequel/hash.hpp>
+
+#include <set>
+
+#include "./test_file.hpp"
+
+using namespace prequel;
+
+namespace {
+
+struct entry {
+    u64 id = 0;
+    u64 value = 0;
+
+    static constexpr auto get_binary_format() {
+        return binary_format(&entry::id, &entry::value);
+    }
+};
+
+} // namespace
+
+TEST_CASE("extendible hash table", "[extendible-hash-table]") {
+    test_file file(256);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    using table_t = extendible_hash_table<entry, indexed_by_member<&entry::id>>;
+
+    table_t::anchor table_anchor;
+    table_t table(make_anchor_handle(table_anchor), alloc);
+    table.validate();
+    REQUIRE(table.empty());
+    REQUIRE(table.byte_size() == 0);
+    REQUIRE(table.bucket_capacity() == (256 - 8) / (16 + 8));
+    REQUIRE(!table.contains(1));
+
+    const u64 count = 20000;
+    for (u64 i = 0; i < count; ++i) {
+        REQUIRE(table.insert(entry{i, i * 2}));
+        if (i % 1000 == 0)
+            table.validate();
+    }
+    table.validate();
+    REQUIRE(table.size() == count);
+    REQUIRE(table.directory_size() == u64(1) << table.global_depth());
+    REQUIRE(table.buckets() >= count / table.bucket_capacity());
+    REQUIRE(table.buckets() <= table.directory_size());
+    REQUIRE(table.fill_factor() > 0.5);
+
+    for (u64 i = 0; i < count; ++i) {
+        entry e;
+        REQUIRE(table.find(i, e));
+        REQUIRE(e.id == i);
+        REQUIRE(e.value == i * 2);
+    }
+    REQUIRE(!table.contains(count));
+    REQUIRE(!table.insert(entry{5, 0}));
+    REQUIRE(!table.insert_or_update(entry{5, 123}));
+
+    entry e;
+    REQUIRE(table.find(5, e));
+    REQUIRE(e.value == 123);
+
+    std::set<u64> seen;
+    table.iterate([&](const entry& v) {
+        REQUIRE(seen.insert(v.id).second);
+        return iteration_control::next;
+    });
+    REQUIRE(seen.size() == count);
+
+    // Sparse buckets are merged with their siblings, the directory remains.
+    const u64 buckets = table.buckets();
+    const u32 depth = table.global_depth();
+    for (u64 i = 0; i < count; ++i) {
+        if (i % 10 != 0)
+            REQUIRE(table.erase(i));
+        if (i % 1000 == 0)
+            table.validate();
+    }
+    table.validate();
+    REQUIRE(table.size() == count / 10);
+    REQUIRE(table.buckets() < buckets / 2);
+    REQUIRE(table.global_depth() == depth);
+    REQUIRE(!table.erase(1));
+
+    for (u64 i = 0; i < count; ++i)
+        REQUIRE(table.contains(i) == (i % 10 == 0));
+
+    table.clear();
+    table.validate();
+    REQUIRE(table.empty());
+    REQUIRE(table.byte_size() == 0);
+    REQUIRE(alloc.stats().data_used == 0);
+
+    REQUIRE(table.insert(entry{1, 1}));
+    REQUIRE(table.buckets() == 1);
+    REQUIRE(table.global_depth() == 0);
+    table.validate();
+}
+
+TEST_CASE("extendible hash table rejects unsplittable buckets", "[extendible-hash-table]") {
+    test_file file(256);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    struct constant_hash {
+        u64 operator()(u64) const { return 42; }
+    };
+
+    using table_t = extendible_hash_table<u64, indexed_by_identity, constant_hash>;
+
+    table_t::anchor table_anchor;
+    table_t table(make_anchor_handle(table_anchor), alloc);
+
+    const u32 capacity = table.bucket_capacity();
+    for (u64 i = 0; i < capacity; ++i)
+        REQUIRE(table.insert(i));
+    REQUIRE_THROWS_AS(table.insert(capacity), bad_operation);
+    table.validate();
+    REQUIRE(table.size() == capacity);
+    REQUIRE(table.buckets() == 1);
+
+    for (u64 i = 0; i < capacity; ++i)
+        REQUIRE(table.contains(i));
+}
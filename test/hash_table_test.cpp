@@ -2,10 +2,13 @@
 
 #include <prequel/container/default_allocator.hpp>
 #include <prequel/container/hash_table.hpp>
+#include <prequel/exception.hpp>
 #include <prequel/formatting.hpp>
 #include <prequel/hash.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <random>
 
 #include "./test_file.hpp"
 
@@ -264,3 +267,521 @@ TEST_CASE("duplicated insertions fail", "[hash-table]") {
 }
 
 // TODO Test node visitation.
+
+TEST_CASE("hash table with key filter", "[hash-table]") {
+    test_file file(512);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    raw_hash_table_options settings;
+    settings.filter_bits_per_key = 10;
+
+    hash_table<u64>::anchor anchor;
+    hash_table<u64>::filter_anchor filter_anchor;
+    REQUIRE_THROWS_AS(hash_table<u64>(make_anchor_handle(anchor), alloc, settings), bad_argument);
+    {
+        hash_table<u64> table(make_anchor_handle(anchor), make_anchor_handle(filter_anchor), alloc,
+                              settings);
+        REQUIRE(table.filtered());
+        REQUIRE(table.byte_size() == 0);
+
+        for (u64 i = 0; i < 10000; ++i)
+            REQUIRE(table.insert(i * 3));
+        table.validate();
+
+        for (u64 i = 0; i < 30000; ++i) {
+            CAPTURE(i);
+            REQUIRE(table.contains(i) == (i % 3 == 0));
+        }
+
+        // Erased keys remain in the filter, but they are not found.
+        for (u64 i = 0; i < 10000; i += 2)
+            REQUIRE(table.erase(i * 3));
+        REQUIRE(!table.erase(1));
+        table.validate();
+        for (u64 i = 0; i < 10000; ++i)
+            REQUIRE(table.contains(i * 3) == (i % 2 == 1));
+    }
+
+    // The filter is freed when the table is opened without it.
+    u64 unfiltered_size = 0;
+    {
+        hash_table<u64> table(make_anchor_handle(anchor), make_anchor_handle(filter_anchor), alloc,
+                              raw_hash_table_options());
+        REQUIRE(!table.filtered());
+        table.validate();
+        REQUIRE(table.contains(3));
+        unfiltered_size = table.byte_size();
+    }
+
+    // And rebuilt when it is enabled again.
+    {
+        hash_table<u64> table(make_anchor_handle(anchor), make_anchor_handle(filter_anchor), alloc,
+                              settings);
+        REQUIRE(table.byte_size() > unfiltered_size);
+        table.validate();
+        REQUIRE(table.contains(3));
+        REQUIRE(!table.contains(6));
+
+        table.clear();
+        table.validate();
+        REQUIRE(table.byte_size() == 0);
+    }
+}
+
+TEST_CASE("hash table with stored hashes", "[hash-table]") {
+    test_file file(512);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    struct counting_hasher {
+        u64* calls;
+        u64 modulus;
+
+        u64 operator()(u64 key) const {
+            ++*calls;
+            return fnv_1a(key % modulus);
+        }
+    };
+
+    raw_hash_table_options settings;
+    settings.store_hashes = true;
+
+    SECTION("lookups do not rehash stored values") {
+        u64 calls = 0;
+        using table_t = hash_table<u64, indexed_by_identity, counting_hasher>;
+
+        table_t::anchor plain_anchor;
+        table_t plain(make_anchor_handle(plain_anchor), alloc, indexed_by_identity(),
+                      counting_hasher{&calls, u64(-1)});
+        REQUIRE(!plain.stores_hashes());
+
+        table_t::anchor anchor;
+        table_t table(make_anchor_handle(anchor), alloc, settings, indexed_by_identity(),
+                      counting_hasher{&calls, u64(-1)});
+        REQUIRE(table.stores_hashes());
+        REQUIRE(table.bucket_capacity() < plain.bucket_capacity());
+
+        for (u64 i = 0; i < 20000; ++i) {
+            REQUIRE(plain.insert(i * 5));
+            REQUIRE(table.insert(i * 5));
+        }
+        table.validate();
+
+        calls = 0;
+        for (u64 i = 0; i < 100000; ++i)
+            REQUIRE(plain.contains(i) == (i % 5 == 0));
+        REQUIRE(calls > 2 * 100000);
+
+        calls = 0;
+        for (u64 i = 0; i < 100000; ++i)
+            REQUIRE(table.contains(i) == (i % 5 == 0));
+        REQUIRE(calls == 100000);
+
+        for (u64 i = 0; i < 20000; i += 2)
+            REQUIRE(table.erase(i * 5));
+        REQUIRE(!table.erase(1));
+        table.validate();
+        for (u64 i = 0; i < 20000; ++i)
+            REQUIRE(table.contains(i * 5) == (i % 2 == 1));
+
+        const u64 size = table.size();
+        REQUIRE(!table.insert(5));
+        table.insert_or_update(5);
+        REQUIRE(table.size() == size);
+        table.validate();
+    }
+
+    SECTION("hash collisions") {
+        // Every hash is shared by 50 keys.
+        u64 calls = 0;
+        using table_t = hash_table<u64, indexed_by_identity, counting_hasher>;
+        table_t::anchor anchor;
+        table_t table(make_anchor_handle(anchor), alloc, settings, indexed_by_identity(),
+                      counting_hasher{&calls, 40});
+
+        for (u64 i = 0; i < 2000; ++i)
+            REQUIRE(table.insert(i));
+        REQUIRE(!table.insert(1234));
+        table.validate();
+
+        for (u64 i = 0; i < 4000; ++i)
+            REQUIRE(table.contains(i) == (i < 2000));
+
+        for (u64 i = 0; i < 2000; i += 3)
+            REQUIRE(table.erase(i));
+        table.validate();
+        for (u64 i = 0; i < 2000; ++i)
+            REQUIRE(table.contains(i) == (i % 3 != 0));
+
+        table.clear();
+        REQUIRE(table.byte_size() == 0);
+    }
+}
+
+TEST_CASE("hash table splits long overflow chains", "[hash-table]") {
+    test_file file(256);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    // The lowest bits of all hashes are zero, so the first splits move no values at all
+    // and the chains of the lower buckets become very long. Later splits move
+    // (nearly) entire chains.
+    struct skewed_hasher {
+        u64 operator()(u64 key) const { return (key % 61) << 5; }
+    };
+
+    raw_hash_table_options settings;
+    for (bool store_hashes : {false, true}) {
+        CAPTURE(store_hashes);
+        settings.store_hashes = store_hashes;
+
+        hash_table<u64, indexed_by_identity, skewed_hasher>::anchor anchor;
+        hash_table<u64, indexed_by_identity, skewed_hasher> table(make_anchor_handle(anchor),
+                                                                  alloc, settings);
+
+        for (u64 i = 0; i < 3000; ++i) {
+            REQUIRE(table.insert(i));
+            if (i % 500 == 0)
+                table.validate();
+        }
+        table.validate();
+        REQUIRE(table.overflow_buckets() > table.primary_buckets() / 2);
+
+        for (u64 i = 0; i < 6000; ++i)
+            REQUIRE(table.contains(i) == (i < 3000));
+
+        // Every overflow bucket is in use.
+        u64 used_overflow = 0;
+        table.visit([&](const auto& node) {
+            if (node.is_overflow()) {
+                REQUIRE(node.size() > 0);
+                ++used_overflow;
+            }
+            return iteration_control::next;
+        });
+        REQUIRE(used_overflow == table.overflow_buckets());
+
+        table.clear();
+        REQUIRE(table.byte_size() == 0);
+    }
+}
+
+TEST_CASE("hash table bulk loading", "[hash-table]") {
+    test_file file(512);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    raw_hash_table_options settings;
+    settings.filter_bits_per_key = 10;
+
+    hash_table<u64>::anchor anchor;
+    hash_table<u64>::filter_anchor filter_anchor;
+    hash_table<u64> table(make_anchor_handle(anchor), make_anchor_handle(filter_anchor), alloc,
+                          settings);
+
+    const u64 count = 50000;
+
+    // Pseudo random order, every value is inserted twice.
+    std::vector<u64> values;
+    for (u64 i = 0; i < 2 * count; ++i)
+        values.push_back((i % count) * 7919 % count);
+
+    {
+        auto loader = table.bulk_load(count);
+        const u64 buckets = table.primary_buckets();
+        REQUIRE(buckets >= count / (table.bucket_capacity() * 0.8));
+
+        loader.insert(values.begin(), values.end());
+        loader.finish();
+        REQUIRE_THROWS_AS(loader.insert(1), bad_operation);
+
+        // No splits were necessary.
+        REQUIRE(table.primary_buckets() == buckets);
+        REQUIRE(table.size() == count);
+        REQUIRE(table.fill_factor() <= 0.8);
+        table.validate();
+    }
+
+    for (u64 i = 0; i < 2 * count; ++i)
+        REQUIRE(table.contains(i) == (i < count));
+
+    REQUIRE_THROWS_AS(table.bulk_load(10), bad_operation);
+
+    // The table behaves normally after loading.
+    for (u64 i = count; i < 2 * count; ++i)
+        REQUIRE(table.insert(i));
+    for (u64 i = 0; i < 2 * count; i += 2)
+        REQUIRE(table.erase(i));
+    table.validate();
+    REQUIRE(table.size() == count);
+
+    table.clear();
+
+    // Inserting more values than expected grows the table.
+    {
+        auto loader = table.bulk_load(100);
+        loader.insert(values.begin(), values.end());
+        loader.finish();
+        table.validate();
+        REQUIRE(table.size() == count);
+        REQUIRE(table.fill_factor() <= 0.8);
+    }
+
+    table.clear();
+
+    // Loading no values at all leaves an empty table.
+    {
+        auto loader = table.bulk_load(100);
+        loader.finish();
+        REQUIRE(table.empty());
+        table.validate();
+    }
+
+    table.clear();
+
+    // Discarding a loader frees all storage.
+    {
+        auto loader = table.bulk_load(count);
+        loader.insert(values.begin(), values.end());
+        loader.discard();
+        REQUIRE(table.empty());
+        REQUIRE(table.byte_size() == 0);
+        table.validate();
+    }
+}
+
+TEST_CASE("hash table batched lookup", "[hash-table]") {
+    test_file file(512);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    std::vector<i64> keys;
+    for (i64 i = -10; i < 30000; ++i)
+        keys.push_back(i);
+    std::mt19937_64 rng(12345);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    keys.push_back(keys[0]);
+
+    for (u32 filter_bits : {0u, 10u}) {
+        raw_hash_table_options settings;
+        settings.filter_bits_per_key = filter_bits;
+
+        for (u32 size : {0u, 1u, 100u, 10000u}) {
+            CAPTURE(filter_bits);
+            CAPTURE(size);
+
+            hash_table<i64>::anchor anchor;
+            hash_table<i64>::filter_anchor filter_anchor;
+            hash_table<i64> table(make_anchor_handle(anchor), make_anchor_handle(filter_anchor),
+                                  alloc, settings);
+            REQUIRE(table.find_many(keys.end(), keys.end()).empty());
+
+            for (u32 i = 0; i < size; ++i)
+                table.insert(i * 2);
+
+            auto result = table.find_many(keys.begin(), keys.end());
+            REQUIRE(result.size() == keys.size());
+            for (size_t i = 0; i < keys.size(); ++i) {
+                const i64 key = keys[i];
+                if (key >= 0 && key < i64(size * 2) && key % 2 == 0) {
+                    REQUIRE(result[i]);
+                    REQUIRE(*result[i] == key);
+                } else {
+                    REQUIRE(!result[i]);
+                }
+            }
+
+            table.reset();
+        }
+    }
+
+    hash_table<i64>::anchor anchor;
+    hash_table<i64> table(make_anchor_handle(anchor), alloc);
+    REQUIRE_THROWS_AS(table.raw().find_many(nullptr, 1, nullptr, nullptr), bad_argument);
+}
+
+TEST_CASE("hash table resumable scan", "[hash-table]") {
+    test_file file(256);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    hash_table<u64>::anchor anchor;
+    hash_table<u64> table(make_anchor_handle(anchor), alloc);
+
+    // Scanning an empty table completes immediately.
+    REQUIRE(table.scan(0, 100, [&](u64) { return iteration_control::next; }) == 0);
+
+    for (u64 i = 0; i < 5000; ++i)
+        table.insert(i);
+
+    SECTION("without modifications, every value is visited exactly once") {
+        std::vector<u32> seen(5000);
+        u64 cursor = 0;
+        u64 steps = 0;
+        do {
+            cursor = table.scan(cursor, 50, [&](u64 v) {
+                seen.at(v) += 1;
+                return iteration_control::next;
+            });
+            ++steps;
+        } while (cursor != 0);
+
+        REQUIRE(steps > 50);
+        REQUIRE(std::all_of(seen.begin(), seen.end(), [](u32 n) { return n == 1; }));
+    }
+
+    SECTION("stopping revisits the current bucket") {
+        std::vector<u32> seen(5000);
+        u64 visited = 0;
+        u64 cursor = 0;
+        do {
+            cursor = table.scan(cursor, 1000, [&](u64 v) {
+                seen.at(v) += 1;
+                return ++visited % 100 == 0 ? iteration_control::stop : iteration_control::next;
+            });
+        } while (cursor != 0);
+
+        REQUIRE(std::all_of(seen.begin(), seen.end(), [](u32 n) { return n >= 1; }));
+    }
+
+    for (bool grow : {true, false}) {
+        SECTION(grow ? "the table grows while scanning" : "the table shrinks while scanning") {
+            // Values [0, 2500) are never modified, the others are erased and reinserted.
+            std::vector<u32> seen(20000);
+            u64 cursor = 0;
+            u64 next_value = 5000;
+            u64 next_erase = 2500;
+            do {
+                cursor = table.scan(cursor, 20, [&](u64 v) {
+                    seen.at(v) += 1;
+                    return iteration_control::next;
+                });
+
+                if (grow) {
+                    for (int i = 0; i < 50 && next_value < 20000; ++i)
+                        REQUIRE(table.insert(next_value++));
+                } else {
+                    for (int i = 0; i < 50 && next_erase < 5000; ++i)
+                        REQUIRE(table.erase(next_erase++));
+                }
+            } while (cursor != 0);
+
+            table.validate();
+            auto seen_once = [](u32 n) { return n == 1; };
+            REQUIRE(std::all_of(seen.begin(), seen.begin() + 2500, [](u32 n) { return n >= 1; }));
+            if (grow) {
+                REQUIRE(table.size() == 20000);
+                REQUIRE(std::all_of(seen.begin(), seen.begin() + 5000, seen_once));
+            }
+        }
+    }
+}
+
+TEST_CASE("hash table fill factor bounds", "[hash-table]") {
+    test_file file(512);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    {
+        raw_hash_table_options settings;
+        settings.max_fill_factor = 0;
+        hash_table<u64>::anchor anchor;
+        REQUIRE_THROWS_AS(hash_table<u64>(make_anchor_handle(anchor), alloc, settings),
+                          bad_argument);
+
+        settings.max_fill_factor = 0.5;
+        settings.min_fill_factor = 0.5;
+        REQUIRE_THROWS_AS(hash_table<u64>(make_anchor_handle(anchor), alloc, settings),
+                          bad_argument);
+    }
+
+    const u64 count = 20000;
+
+    SECTION("custom bounds") {
+        raw_hash_table_options settings;
+        settings.max_fill_factor = 2.0;
+        settings.min_fill_factor = 0.25;
+
+        hash_table<u64>::anchor anchor;
+        hash_table<u64> table(make_anchor_handle(anchor), alloc, settings);
+
+        for (u64 i = 0; i < count; ++i)
+            REQUIRE(table.insert(i));
+        table.validate();
+        REQUIRE(table.fill_factor() > 1.0);
+        REQUIRE(table.fill_factor() <= 2.0);
+
+        // Erasing half of the values does not shrink the table.
+        const u64 buckets = table.primary_buckets();
+        for (u64 i = 0; i < count; i += 2)
+            REQUIRE(table.erase(i));
+        REQUIRE(table.primary_buckets() == buckets);
+
+        for (u64 i = 1; i < count; i += 2)
+            REQUIRE(table.erase(i));
+        table.validate();
+        REQUIRE(table.empty());
+        REQUIRE(table.byte_size() == 0);
+    }
+
+    SECTION("shrinking disabled") {
+        raw_hash_table_options settings;
+        settings.min_fill_factor = 0;
+
+        hash_table<u64>::anchor anchor;
+        hash_table<u64> table(make_anchor_handle(anchor), alloc, settings);
+
+        for (u64 i = 0; i < count; ++i)
+            REQUIRE(table.insert(i));
+        const u64 buckets = table.primary_buckets();
+
+        for (u64 i = 0; i < count; ++i)
+            REQUIRE(table.erase(i));
+        table.validate();
+        REQUIRE(table.empty());
+        REQUIRE(table.primary_buckets() == buckets);
+
+        // Refilling the table does not split any buckets.
+        for (u64 i = 0; i < count; ++i)
+            REQUIRE(table.insert(i));
+        table.validate();
+        REQUIRE(table.primary_buckets() == buckets);
+
+        table.clear();
+        REQUIRE(table.byte_size() == 0);
+    }
+
+    SECTION("reserve") {
+        hash_table<u64>::anchor anchor;
+        hash_table<u64> table(make_anchor_handle(anchor), alloc);
+
+        table.reserve(0);
+        REQUIRE(table.primary_buckets() == 0);
+
+        for (u64 i = 0; i < 100; ++i)
+            REQUIRE(table.insert(i));
+
+        table.reserve(count);
+        table.validate();
+        const u64 buckets = table.primary_buckets();
+        REQUIRE(buckets >= count / (table.bucket_capacity() * 0.8));
+
+        for (u64 i = 100; i < count; ++i)
+            REQUIRE(table.insert(i));
+        table.validate();
+        REQUIRE(table.primary_buckets() == buckets);
+
+        // Reserving less than the current size has no effect.
+        table.reserve(10);
+        REQUIRE(table.primary_buckets() == buckets);
+        REQUIRE(table.size() == count);
+    }
+}
@@ -0,0 +1,79 @@
+#include <catch.hpp>
+
+#include <prequel/hash.hpp>
+
+#include <array>
+#include <set>
+#include <vector>
+
+using namespace prequel;
+
+TEST_CASE("fast hash", "[hash]") {
+    // The definition is fixed, hashes must not change between versions or platforms.
+    const char* text = "The quick brown fox jumps over the lazy dog";
+    const byte* text_data = reinterpret_cast<const byte*>(text);
+    const u64 empty = fast_hash(nullptr, 0);
+    REQUIRE(empty == UINT64_C(0x0409638ee2bde459));
+    REQUIRE(fast_hash(text_data, 3) == UINT64_C(0x0314c66b6405b584));
+    REQUIRE(fast_hash(text_data, 12) == UINT64_C(0xcce111a4a7e62077));
+    REQUIRE(fast_hash(text_data, 43) == UINT64_C(0x339abbc8a1a96017));
+    REQUIRE(fast_hash(u64(42)) == UINT64_C(0x36e9287628a2b95c));
+
+    std::vector<byte> data(200);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<byte>(i * 31 + 7);
+
+    // Every length and every byte influences the hash.
+    std::set<u64> hashes{empty};
+    for (size_t length = 1; length <= data.size(); ++length) {
+        CAPTURE(length);
+        REQUIRE(hashes.insert(fast_hash(data.data(), length)).second);
+
+        for (size_t i = 0; i < length; ++i) {
+            CAPTURE(i);
+            data[i] ^= 1;
+            REQUIRE(hashes.insert(fast_hash(data.data(), length)).second);
+            data[i] ^= 1;
+        }
+    }
+
+    // The seed changes the result.
+    for (size_t length : std::array<size_t, 8>{0, 5, 8, 16, 20, 32, 33, 100}) {
+        CAPTURE(length);
+        REQUIRE(fast_hash(data.data(), length, 1) != fast_hash(data.data(), length, 2));
+        REQUIRE(fast_hash(data.data(), length, 0) == fast_hash(data.data(), length));
+    }
+}
+
+TEST_CASE("fast hash of integers", "[hash]") {
+    // Integers are not serialized but must hash like their serialized representation.
+    auto check = [](auto value) {
+        auto buffer = serialize_to_buffer(value);
+        REQUIRE(fast_hash(value) == fast_hash(buffer.data(), buffer.size()));
+    };
+    for (i64 i = -1000; i < 1000; ++i) {
+        check(u8(i));
+        check(i8(i));
+        check(u16(i * 77));
+        check(i16(i * 77));
+        check(u32(i * 77777));
+        check(i32(i * 77777));
+        check(u64(i) * u64(7777777777777));
+        check(i64(i) * i64(7777777777777));
+    }
+    check(true);
+    check(1.5);
+
+    // Same value, different sizes.
+    REQUIRE(fast_hash(u32(5)) != fast_hash(u64(5)));
+
+    // The lowest bits are well distributed, even for sequential keys.
+    static constexpr u64 buckets = 64;
+    std::vector<u64> counts(buckets);
+    for (u64 i = 0; i < buckets * 1000; ++i)
+        counts[fast_hasher()(i) % buckets] += 1;
+    for (u64 count : counts) {
+        REQUIRE(count > 850);
+        REQUIRE(count < 1150);
+    }
+}
@@ -0,0 +1,196 @@
+#include <catch.hpp>
+
+#include <prequel/container/multi_btree.hpp>
+#include <prequel/container/node_allocator.hpp>
+#include <prequel/exception.hpp>
+
+#include "./test_file.hpp"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace prequel;
+
+TEST_CASE("multi btree", "[multi-btree]") {
+    using tree_t = multi_btree<u32, u64>;
+
+    test_file file(512);
+
+    node_allocator::anchor alloc_anchor;
+    node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    tree_t::anchor tree_anchor;
+    tree_t tree(make_anchor_handle(tree_anchor), alloc, 4);
+    REQUIRE(tree.max_inline_values() == 4);
+    REQUIRE(tree.overflow_block_capacity() == (512 - 16) / 8);
+    REQUIRE(tree.empty());
+
+    // Expected contents, values of every key in sorted order.
+    std::map<u32, std::vector<u64>> expected;
+
+    auto check_contents = [&]() {
+        tree.validate();
+
+        u64 size = 0;
+        for (const auto& pair : expected)
+            size += pair.second.size();
+        REQUIRE(tree.size() == size);
+        REQUIRE(tree.keys() == expected.size());
+
+        auto cursor = tree.create_cursor(tree_t::seek_min);
+        for (const auto& [key, values] : expected) {
+            REQUIRE(cursor);
+            REQUIRE(cursor.key() == key);
+            REQUIRE(cursor.duplicates() == values.size());
+            REQUIRE(tree.count(key) == values.size());
+
+            std::vector<u64> seen;
+            for (u64 i = 0; i < values.size(); ++i) {
+                REQUIRE(cursor);
+                REQUIRE(cursor.key() == key);
+                REQUIRE(cursor.duplicate_index() == i);
+                seen.push_back(cursor.value());
+                cursor.move_next();
+            }
+            std::sort(seen.begin(), seen.end());
+            REQUIRE(seen == values);
+        }
+        REQUIRE(!cursor);
+    };
+
+    auto insert = [&](u32 key, u64 value) {
+        tree.insert(key, value);
+        auto& values = expected[key];
+        values.insert(std::upper_bound(values.begin(), values.end(), value), value);
+    };
+
+    auto erase = [&](u32 key, u64 value) {
+        REQUIRE(tree.erase(key, value));
+        auto& values = expected[key];
+        values.erase(std::lower_bound(values.begin(), values.end(), value));
+        if (values.empty())
+            expected.erase(key);
+    };
+
+    SECTION("posting lists grow and shrink") {
+        // Key i gets i * 10 values, so some lists are inline and some need several blocks.
+        for (u32 key = 0; key < 30; ++key) {
+            for (u64 i = 0; i < key * 10; ++i)
+                insert(key, u64(key) * 1000 + i);
+        }
+        insert(99, 1);
+        check_contents();
+        REQUIRE(tree.overflow_blocks() > 0);
+
+        REQUIRE(tree.contains(29, 29000));
+        REQUIRE(tree.contains(29, 29289));
+        REQUIRE(!tree.contains(29, 29290));
+        REQUIRE(!tree.contains(100, 1));
+        REQUIRE(!tree.erase(29, 29290));
+        REQUIRE(!tree.erase(100, 1));
+
+        // Duplicate pairs are permitted.
+        insert(99, 1);
+        insert(99, 1);
+        REQUIRE(tree.count(99) == 3);
+        check_contents();
+
+        // Erase values in random order until all lists are (almost) empty again.
+        std::mt19937_64 rng(12345);
+        for (u32 key = 1; key < 30; ++key) {
+            std::vector<u64> values = expected[key];
+            std::shuffle(values.begin(), values.end(), rng);
+            for (size_t i = 0; i < values.size() - 1; ++i)
+                erase(key, values[i]);
+        }
+        erase(99, 1);
+        check_contents();
+        REQUIRE(tree.overflow_blocks() == 0);
+
+        REQUIRE(tree.erase_all(99) == 2);
+        REQUIRE(tree.erase_all(99) == 0);
+        expected.erase(99);
+        check_contents();
+
+        tree.clear();
+        expected.clear();
+        check_contents();
+        REQUIRE(tree.empty());
+    }
+
+    SECTION("cursor movement") {
+        for (u64 i = 0; i < 500; ++i)
+            insert(1, i);
+        for (u64 i = 0; i < 3; ++i)
+            insert(2, i);
+        for (u64 i = 0; i < 200; ++i)
+            insert(3, i);
+        check_contents();
+
+        // Backwards iteration visits every pair.
+        std::map<u32, std::vector<u64>> seen;
+        auto cursor = tree.create_cursor(tree_t::seek_max);
+        REQUIRE(cursor.key() == 3);
+        REQUIRE(cursor.duplicate_index() == 199);
+        for (; cursor; cursor.move_prev())
+            seen[cursor.key()].push_back(cursor.value());
+        for (auto& pair : seen)
+            std::sort(pair.second.begin(), pair.second.end());
+        REQUIRE(seen == expected);
+
+        cursor = tree.find(2);
+        REQUIRE(cursor.key() == 2);
+        REQUIRE(cursor.duplicates() == 3);
+        cursor.move_prev_key();
+        REQUIRE(cursor.key() == 1);
+        REQUIRE(cursor.duplicate_index() == 0);
+        cursor.move_next_key();
+        cursor.move_next_key();
+        REQUIRE(cursor.key() == 3);
+        cursor.move_next_key();
+        REQUIRE(!cursor);
+
+        REQUIRE(tree.lower_bound(0).key() == 1);
+        REQUIRE(tree.upper_bound(2).key() == 3);
+        REQUIRE(!tree.upper_bound(3));
+        REQUIRE(!tree.find(4));
+
+        REQUIRE(tree.erase_all(1) == 500);
+        expected.erase(1);
+        check_contents();
+
+        tree.reset();
+        REQUIRE(tree.byte_size() == 0);
+    }
+}
+
+TEST_CASE("multi btree reopen", "[multi-btree]") {
+    using tree_t = multi_btree<u64, u32>;
+
+    test_file file(4096);
+
+    node_allocator::anchor alloc_anchor;
+    node_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    tree_t::anchor tree_anchor;
+    {
+        tree_t tree(make_anchor_handle(tree_anchor), alloc);
+        REQUIRE(tree.max_inline_values() > 4);
+        for (u64 key = 0; key < 1000; ++key) {
+            for (u32 i = 0; i <= key % 100; ++i)
+                tree.insert(key, i);
+        }
+        tree.validate();
+    }
+
+    tree_t tree(make_anchor_handle(tree_anchor), alloc);
+    tree.validate();
+    REQUIRE(tree.keys() == 1000);
+    for (u64 key = 0; key < 1000; ++key)
+        REQUIRE(tree.count(key) == key % 100 + 1);
+
+    tree_t::anchor other_anchor;
+    REQUIRE_THROWS_AS(tree_t(make_anchor_handle(other_anchor), alloc, 1000), bad_argument);
+}
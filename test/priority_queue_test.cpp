@@ -0,0 +1,130 @@
+#include <catch.hpp>
+
+#include <prequel/container/default_allocator.hpp>
+#include <prequel/container/priority_queue.hpp>
+#include <prequel/exception.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "./test_file.hpp"
+
+using namespace prequel;
+
+TEST_CASE("priority queue", "[priority-queue]") {
+    test_file file(256);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    using queue_t = priority_queue<u64>;
+
+    queue_t::anchor queue_anchor;
+    queue_t queue(make_anchor_handle(queue_anchor), alloc, {}, 2);
+    queue.validate();
+    REQUIRE(queue.empty());
+    REQUIRE(queue.byte_size() == 0);
+    REQUIRE(queue.buffer_capacity() == 2 * (256 / 8));
+    REQUIRE(queue.run_block_capacity() == (256 - 12) / 8);
+    REQUIRE_THROWS_AS(queue.top(), bad_operation);
+    REQUIRE_THROWS_AS(queue.pop(), bad_operation);
+
+    std::mt19937_64 rng(12345);
+    std::vector<u64> values;
+    const u64 count = 20000;
+    for (u64 i = 0; i < count; ++i) {
+        values.push_back(rng() % 5000);
+        queue.push(values.back());
+        if (i % 1000 == 0)
+            queue.validate();
+    }
+    queue.validate();
+    REQUIRE(queue.size() == count);
+    REQUIRE(queue.runs() > 0);
+    REQUIRE(queue.runs() < count / queue.buffer_capacity());
+    REQUIRE(queue.buffer_size() < queue.buffer_capacity());
+
+    SECTION("values are removed in sorted order") {
+        std::sort(values.begin(), values.end());
+        for (u64 i = 0; i < count; ++i) {
+            REQUIRE(queue.top() == values[i]);
+            REQUIRE(queue.pop_min() == values[i]);
+            if (i % 1000 == 0)
+                queue.validate();
+        }
+        queue.validate();
+        REQUIRE(queue.empty());
+        REQUIRE(queue.runs() == 0);
+        REQUIRE(queue.run_blocks() == 0);
+    }
+
+    SECTION("interleaved push and pop") {
+        std::priority_queue<u64, std::vector<u64>, std::greater<>> expected(values.begin(),
+                                                                            values.end());
+        for (u64 i = 0; i < 50000; ++i) {
+            if (rng() % 3 == 0 || expected.empty()) {
+                const u64 v = rng() % 10000;
+                expected.push(v);
+                queue.push(v);
+            } else {
+                REQUIRE(queue.pop_min() == expected.top());
+                expected.pop();
+            }
+            if (i % 5000 == 0)
+                queue.validate();
+        }
+        queue.validate();
+        REQUIRE(queue.size() == expected.size());
+
+        while (!expected.empty()) {
+            REQUIRE(queue.pop_min() == expected.top());
+            expected.pop();
+        }
+        REQUIRE(queue.empty());
+    }
+
+    SECTION("clear and reset") {
+        queue.clear();
+        queue.validate();
+        REQUIRE(queue.empty());
+        REQUIRE(queue.run_blocks() == 0);
+        REQUIRE(queue.byte_size() > 0);
+
+        queue.push(1);
+        REQUIRE(queue.top() == 1);
+
+        queue.reset();
+        queue.validate();
+        REQUIRE(queue.empty());
+        REQUIRE(queue.byte_size() == 0);
+        REQUIRE(alloc.stats().data_used == 0);
+    }
+}
+
+TEST_CASE("priority queue with custom order", "[priority-queue]") {
+    test_file file(256);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    using queue_t = priority_queue<i32, std::greater<>>;
+
+    queue_t::anchor queue_anchor;
+    {
+        queue_t queue(make_anchor_handle(queue_anchor), alloc, {}, 1);
+        for (i32 i = 0; i < 1000; ++i)
+            queue.push(i);
+        queue.validate();
+    }
+
+    // The state is persistent.
+    queue_t queue(make_anchor_handle(queue_anchor), alloc, {}, 1);
+    REQUIRE(queue.size() == 1000);
+    for (i32 i = 999; i >= 0; --i)
+        REQUIRE(queue.pop_min() == i);
+    REQUIRE(queue.empty());
+    REQUIRE(queue.run_blocks() == 0);
+}
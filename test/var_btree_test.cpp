@@ -0,0 +1,148 @@
+#include <catch.hpp>
+
+#include <prequel/container/default_allocator.hpp>
+#include <prequel/container/var_btree.hpp>
+
+#include "./test_file.hpp"
+
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace prequel;
+
+namespace {
+
+std::vector<byte> make_value(u32 size, u32 seed) {
+    std::vector<byte> value(size);
+    for (u32 i = 0; i < size; ++i)
+        value[i] = byte((seed * 31 + i * 7) & 0xff);
+    return value;
+}
+
+} // namespace
+
+TEST_CASE("var btree", "[var-btree]") {
+    using tree_t = var_btree<u32>;
+
+    test_file file(512);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    tree_t::anchor tree_anchor;
+    tree_t tree(make_anchor_handle(tree_anchor), alloc, 32);
+    REQUIRE(tree.max_inline_size() == 32);
+    REQUIRE(tree.empty());
+
+    std::map<u32, std::vector<byte>> expected;
+    auto check_contents = [&]() {
+        tree.validate();
+        REQUIRE(tree.size() == expected.size());
+
+        auto cursor = tree.create_cursor(tree_t::seek_min);
+        for (const auto& [key, value] : expected) {
+            REQUIRE(cursor);
+            REQUIRE(cursor.key() == key);
+            REQUIRE(cursor.value_size() == value.size());
+            REQUIRE(cursor.value_inline() == (value.size() <= tree.max_inline_size()));
+            REQUIRE(cursor.value() == value);
+            cursor.move_next();
+        }
+        REQUIRE(!cursor);
+    };
+
+    SECTION("insert, update and erase") {
+        std::mt19937 rng(123);
+        std::uniform_int_distribution<u32> sizes(0, 2000);
+        for (u32 i = 0; i < 1000; ++i) {
+            u32 key = (i * 7919) % 1000;
+            auto value = make_value(i % 3 == 0 ? sizes(rng) : i % 33, i);
+            auto result = tree.insert(key, value.data(), value.size());
+            REQUIRE(result.inserted);
+            REQUIRE(result.position.value() == value);
+            expected[key] = value;
+        }
+        check_contents();
+        REQUIRE(tree.overflow_blocks() > 0);
+
+        // Existing keys are not overwritten by insert().
+        {
+            auto value = make_value(10, 0);
+            auto result = tree.insert(5, value.data(), value.size());
+            REQUIRE(!result.inserted);
+            REQUIRE(result.position.value() == expected[5]);
+        }
+
+        // Move values between inline and out-of-line storage.
+        for (u32 key = 0; key < 1000; key += 3) {
+            auto value = make_value(expected[key].size() <= 32 ? 700 : 8, key);
+            auto result = tree.insert_or_update(key, value.data(), value.size());
+            REQUIRE(!result.inserted);
+            expected[key] = value;
+        }
+        check_contents();
+
+        // Overwrite out-of-line values in place (same number of blocks).
+        for (u32 key = 0; key < 1000; key += 3) {
+            if (expected[key].size() != 700)
+                continue;
+
+            auto value = make_value(701, key + 1);
+            auto cursor = tree.find(key);
+            REQUIRE(cursor);
+            cursor.set_value(value.data(), value.size());
+            expected[key] = value;
+        }
+        check_contents();
+
+        for (u32 key = 0; key < 1000; key += 2) {
+            REQUIRE(tree.erase(key));
+            expected.erase(key);
+        }
+        REQUIRE(!tree.erase(0));
+        check_contents();
+
+        tree.clear();
+        expected.clear();
+        check_contents();
+        REQUIRE(tree.overflow_blocks() == 0);
+        REQUIRE(tree.value_bytes() == 0);
+    }
+
+    SECTION("erase through cursors") {
+        for (u32 key = 0; key < 200; ++key) {
+            auto value = make_value(key * 5, key);
+            tree.insert(key, value.data(), value.size());
+            expected[key] = value;
+        }
+
+        for (auto cursor = tree.create_cursor(tree_t::seek_min); cursor; cursor.move_next()) {
+            if (cursor.key() % 3 != 0) {
+                expected.erase(cursor.key());
+                cursor.erase();
+            }
+        }
+        check_contents();
+
+        tree.reset();
+        REQUIRE(tree.byte_size() == 0);
+    }
+}
+
+TEST_CASE("var btree default inline size", "[var-btree]") {
+    test_file file(4096);
+
+    default_allocator::anchor alloc_anchor;
+    default_allocator alloc(make_anchor_handle(alloc_anchor), file.get_engine());
+
+    var_btree<u64>::anchor tree_anchor;
+    var_btree<u64> tree(make_anchor_handle(tree_anchor), alloc);
+    REQUIRE(tree.leaf_node_capacity() >= 4);
+    REQUIRE(tree.max_inline_size() > 4096 / 8);
+
+    // Values that are too large for a leaf must be rejected when the tree is opened.
+    var_btree<u64>::anchor other_anchor;
+    REQUIRE_THROWS_AS(var_btree<u64>(make_anchor_handle(other_anchor), alloc, 2048),
+                      bad_argument);
+}